@@ -0,0 +1,208 @@
+/*
+ * Arduino.h
+ *
+ * The part of the Teensy 3 core the box sketches use, for building them on
+ * a Linux host, see hub_sim.h: pins, time, the serial ports, and the chip
+ * registers mot_sense_hub_3 goes to directly, the GPIO ports, the PIT
+ * timers, the DMA mux and the cycle counter.
+ *
+ * The port registers sit in memory laid out as on the chip, 0x40 a port,
+ * so taking their address and stepping between ports works; reads of PDIR
+ * bring it up to date from the simulated lines first, and the set, clear
+ * and direction registers are written through hub_sim_reg so the lines
+ * follow at once.
+ */
+
+#ifndef __HUB_SIM_ARDUINO_H__
+#define __HUB_SIM_ARDUINO_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define HIGH                     1
+#define LOW                      0
+#define INPUT                    0
+#define OUTPUT                   1
+#define INPUT_PULLUP             2
+#define INPUT_PULLDOWN           3
+#define LED_BUILTIN              13
+#define DEC                      10
+#define HEX                      16
+
+#define F_CPU                    96000000
+#define F_BUS                    48000000
+
+#define DMAMEM
+#define FASTRUN
+#define PROGMEM
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+uint8_t digitalRead(uint8_t pin);
+uint32_t micros(void);
+uint32_t millis(void);
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void cli(void);
+void sei(void);
+void yield(void);
+
+
+// USB serial and the UARTs, each a pty on the host unless hub_sim -P
+class hub_sim_serial
+{
+public:
+  hub_sim_serial(const char *name);
+  void begin(uint32_t baud);
+  void end(void);
+  int available(void);
+  int read(void);
+  int peek(void);
+  void flush(void) {}
+  size_t write(uint8_t c);
+  size_t write(const uint8_t *buf, size_t n);
+  size_t transmit(const uint8_t *buf, size_t n);    // write() without the poll, for the DMA
+  size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+  size_t print(const char *s) { return write(s); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(long n, int base = DEC);
+  size_t println(void) { return write((const uint8_t *)"\r\n", 2); }
+  size_t println(const char *s) { return print(s) + println(); }
+  size_t println(long n, int base = DEC) { return print(n, base) + println(); }
+  int printf(const char *format, ...);
+  operator bool() { return true; }
+
+  const char *name;
+  int fd;                        // pty master, -1 when counting only
+  int peeked;
+  uint32_t baud;
+  char path[64];                 // pty for the other end
+  unsigned long bytes_out;
+  unsigned long dropped;         // pty full
+  unsigned long bytes_in;
+  uint8_t log[256];              // bytes written since hub_sim last looked
+  int log_length;
+};
+
+extern hub_sim_serial Serial, Serial1, Serial2, Serial3;
+
+
+// GPIO ports A to E, registers as words 0x40 apart
+#define HUB_SIM_PORTS            5
+#define HUB_SIM_PDOR             0
+#define HUB_SIM_PSOR             1
+#define HUB_SIM_PCOR             2
+#define HUB_SIM_PTOR             3
+#define HUB_SIM_PDIR             4
+#define HUB_SIM_PDDR             5
+
+extern volatile uint32_t hub_sim_gpio[HUB_SIM_PORTS][16];
+volatile uint32_t *hub_sim_pdir(int port);
+void hub_sim_gpio_write(int port, int reg, uint32_t value);
+
+// a writable port register
+class hub_sim_reg
+{
+public:
+  hub_sim_reg(int port, int reg) : port(port), reg(reg) {}
+  operator uint32_t() const { return hub_sim_gpio[port][reg]; }
+  hub_sim_reg &operator=(uint32_t v) { hub_sim_gpio_write(port, reg, v); return *this; }
+  hub_sim_reg &operator|=(uint32_t v) { hub_sim_gpio_write(port, reg, hub_sim_gpio[port][reg] | v); return *this; }
+  hub_sim_reg &operator&=(uint32_t v) { hub_sim_gpio_write(port, reg, hub_sim_gpio[port][reg] & v); return *this; }
+  hub_sim_reg &operator^=(uint32_t v) { hub_sim_gpio_write(port, reg, hub_sim_gpio[port][reg] ^ v); return *this; }
+
+  int port;
+  int reg;
+};
+
+#define GPIO_REG(p, r)           (hub_sim_reg((p), HUB_SIM_##r))
+#define GPIOA_PDOR               GPIO_REG(0, PDOR)
+#define GPIOA_PSOR               GPIO_REG(0, PSOR)
+#define GPIOA_PCOR               GPIO_REG(0, PCOR)
+#define GPIOA_PTOR               GPIO_REG(0, PTOR)
+#define GPIOA_PDIR               (*hub_sim_pdir(0))
+#define GPIOA_PDDR               GPIO_REG(0, PDDR)
+#define GPIOB_PDOR               GPIO_REG(1, PDOR)
+#define GPIOB_PSOR               GPIO_REG(1, PSOR)
+#define GPIOB_PCOR               GPIO_REG(1, PCOR)
+#define GPIOB_PTOR               GPIO_REG(1, PTOR)
+#define GPIOB_PDIR               (*hub_sim_pdir(1))
+#define GPIOB_PDDR               GPIO_REG(1, PDDR)
+#define GPIOC_PDOR               GPIO_REG(2, PDOR)
+#define GPIOC_PSOR               GPIO_REG(2, PSOR)
+#define GPIOC_PCOR               GPIO_REG(2, PCOR)
+#define GPIOC_PTOR               GPIO_REG(2, PTOR)
+#define GPIOC_PDIR               (*hub_sim_pdir(2))
+#define GPIOC_PDDR               GPIO_REG(2, PDDR)
+#define GPIOD_PDOR               GPIO_REG(3, PDOR)
+#define GPIOD_PSOR               GPIO_REG(3, PSOR)
+#define GPIOD_PCOR               GPIO_REG(3, PCOR)
+#define GPIOD_PTOR               GPIO_REG(3, PTOR)
+#define GPIOD_PDIR               (*hub_sim_pdir(3))
+#define GPIOD_PDDR               GPIO_REG(3, PDDR)
+#define GPIOE_PDOR               GPIO_REG(4, PDOR)
+#define GPIOE_PSOR               GPIO_REG(4, PSOR)
+#define GPIOE_PCOR               GPIO_REG(4, PCOR)
+#define GPIOE_PTOR               GPIO_REG(4, PTOR)
+#define GPIOE_PDIR               (*hub_sim_pdir(4))
+#define GPIOE_PDDR               GPIO_REG(4, PDDR)
+
+
+// the DWT cycle counter, counting at F_CPU off the host clock once enabled
+extern volatile uint32_t hub_sim_demcr, hub_sim_dwt_ctrl;
+uint32_t hub_sim_cyccnt(void);
+
+#define ARM_DEMCR                hub_sim_demcr
+#define ARM_DEMCR_TRCENA         (1 << 24)
+#define ARM_DWT_CTRL             hub_sim_dwt_ctrl
+#define ARM_DWT_CTRL_CYCCNTENA   (1 << 0)
+#define ARM_DWT_CYCCNT           (hub_sim_cyccnt())
+
+
+// PIT channels 0-3: LDVAL, CVAL, TCTRL, TFLG each, read when hub_sim polls
+#define HUB_SIM_PIT_CHANNELS     4
+
+extern volatile uint32_t hub_sim_pit[HUB_SIM_PIT_CHANNELS][4];
+extern volatile uint32_t hub_sim_pit_mcr, hub_sim_scgc6;
+
+#define PIT_MCR                  hub_sim_pit_mcr
+#define PIT_LDVAL0               (hub_sim_pit[0][0])
+#define PIT_TCTRL0               (hub_sim_pit[0][2])
+#define PIT_TFLG0                (hub_sim_pit[0][3])
+#define PIT_TCTRL_TEN            (1 << 0)
+#define PIT_TCTRL_TIE            (1 << 1)
+#define SIM_SCGC6                hub_sim_scgc6
+#define SIM_SCGC6_PIT            (1 << 23)
+
+// DMA mux, one byte a channel
+#define HUB_SIM_DMA_CHANNELS     16
+
+extern volatile uint8_t hub_sim_dmamux[HUB_SIM_DMA_CHANNELS];
+
+#define DMAMUX0_CHCFG0           (hub_sim_dmamux[0])
+#define DMAMUX_SOURCE_UART0_TX   3
+#define DMAMUX_SOURCE_ALWAYS0    54
+#define DMAMUX_TRIG              0x40
+#define DMAMUX_ENABLE            0x80
+
+// UART0, Serial1's, as far as a DMA transmit needs: with TDMAS and TIE set
+// it asks for a byte whenever it can take one, at the baud Serial1 began at
+extern volatile uint8_t hub_sim_uart0_d, hub_sim_uart0_c2, hub_sim_uart0_c5;
+
+#define UART0_D                  hub_sim_uart0_d
+#define UART0_C2                 hub_sim_uart0_c2
+#define UART0_C5                 hub_sim_uart0_c5
+#define UART_C2_TIE              0x80
+#define UART_C2_RIE              0x20
+#define UART_C5_TDMAS            0x80
+
+
+#endif /* __HUB_SIM_ARDUINO_H__ */
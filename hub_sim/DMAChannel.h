@@ -0,0 +1,73 @@
+/*
+ * DMAChannel.h
+ *
+ * The Teensy DMAChannel for hub_sim: a channel's TCD is plain memory the
+ * sketch programs as on the chip, and the transfers it asks for are done
+ * when the sketch next looks, at the times the hardware would have done
+ * them.  Only what a PIT triggered capture and a UART transmit use is
+ * there: 8, 16 and 32 bit transfers, minor loop offsets, the major loop end
+ * and DREQ.
+ */
+
+#ifndef __HUB_SIM_DMACHANNEL_H__
+#define __HUB_SIM_DMACHANNEL_H__
+
+#include "Arduino.h"
+
+int64_t hub_sim_poll(void);
+
+#define DMA_TCD_ATTR_SSIZE(n)                  (((n) & 0x7) << 8)
+#define DMA_TCD_ATTR_DSIZE(n)                  ((n) & 0x7)
+#define DMA_TCD_NBYTES_SMLOE                   ((uint32_t)1 << 31)
+#define DMA_TCD_NBYTES_DMLOE                   ((uint32_t)1 << 30)
+#define DMA_TCD_NBYTES_MLOFFYES_MLOFF(n)       (((uint32_t)(n) & 0xfffff) << 10)
+#define DMA_TCD_NBYTES_MLOFFYES_NBYTES(n)      ((n) & 0x3ff)
+#define DMA_TCD_CSR_INTMAJOR                   0x02
+#define DMA_TCD_CSR_DREQ                       0x08
+#define DMA_TCD_CSR_DONE                       0x80
+
+// the current major loop count, brought up to date when read
+class hub_sim_citer
+{
+public:
+  operator uint16_t() const { hub_sim_poll(); return value; }
+  hub_sim_citer &operator=(uint16_t v) { value = v; return *this; }
+
+  uint16_t value;
+};
+
+typedef struct
+{
+  volatile const void *SADDR;
+  int16_t SOFF;
+  uint16_t ATTR;
+  union {
+    uint32_t NBYTES_MLNO;
+    uint32_t NBYTES_MLOFFYES;
+  };
+  int32_t SLAST;
+  volatile void *DADDR;
+  int16_t DOFF;
+  hub_sim_citer CITER_ELINKNO;
+  int32_t DLASTSGA;
+  uint16_t CSR;
+  uint16_t BITER_ELINKNO;
+} hub_sim_tcd_t;
+
+class DMAChannel
+{
+public:
+  DMAChannel() : TCD(NULL), channel(HUB_SIM_DMA_CHANNELS) {}
+  void begin(bool force_initialization = false);
+  void release(void);
+  void enable(void);
+  void disable(void);
+  bool complete(void);
+  void clearComplete(void);
+
+  hub_sim_tcd_t *TCD;
+  uint8_t channel;
+};
+
+
+#endif /* __HUB_SIM_DMACHANNEL_H__ */
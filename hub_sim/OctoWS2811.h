@@ -0,0 +1,44 @@
+/*
+ * OctoWS2811.h
+ *
+ * The OctoWS2811 LED driver for hub_sim: pixels are set in the drawing
+ * buffer and show() copies them to the display buffer as the DMA would,
+ * counting frames.
+ */
+
+#ifndef __HUB_SIM_OCTOWS2811_H__
+#define __HUB_SIM_OCTOWS2811_H__
+
+#include "Arduino.h"
+
+#define WS2811_RGB               0
+#define WS2811_RBG               1
+#define WS2811_GRB               2
+#define WS2811_GBR               3
+#define WS2811_800kHz            0x00
+#define WS2811_400kHz            0x10
+#define WS2813_800kHz            0x20
+
+class OctoWS2811
+{
+public:
+  OctoWS2811(uint32_t numPerStrip, void *frameBuf, void *drawBuf, uint8_t config = WS2811_GRB);
+  void begin(void) {}
+  void setPixel(uint32_t num, int color);
+  void setPixel(uint32_t num, uint8_t red, uint8_t green, uint8_t blue)
+  {
+    setPixel(num, (red << 16) | (green << 8) | blue);
+  }
+  int getPixel(uint32_t num);
+  void show(void);
+  int busy(void) { return 0; }
+  int numPixels(void) { return stripLen * 8; }
+
+private:
+  uint32_t stripLen;
+  uint32_t *frameBuffer;
+  uint32_t *drawBuffer;
+};
+
+
+#endif /* __HUB_SIM_OCTOWS2811_H__ */
@@ -0,0 +1,199 @@
+/*
+ * dma.cpp
+ *
+ * DMA channels and the PIT timers that trigger them, see DMAChannel.h.  A
+ * PIT channel is seen to start and stop on the first core call after its
+ * TEN bit changes; from then it ticks every LDVAL + 1 bus clocks, and each
+ * tick lets a channel with DMAMUX_TRIG through for one minor loop.  Minor
+ * loops run on the next core call after their tick, reading the ports as
+ * they were at the tick.
+ *
+ * A channel muxed to DMAMUX_SOURCE_UART0_TX moves a byte into UART0_D for
+ * every 10 bits of Serial1's baud while the UART asks, and the byte goes
+ * out on Serial1; with -f the UART takes them as fast as they come.
+ */
+
+#include "Arduino.h"
+#include "DMAChannel.h"
+#include "hub_sim.h"
+
+volatile uint32_t hub_sim_pit[HUB_SIM_PIT_CHANNELS][4];
+volatile uint32_t hub_sim_pit_mcr, hub_sim_scgc6;
+volatile uint8_t hub_sim_dmamux[HUB_SIM_DMA_CHANNELS];
+volatile uint8_t hub_sim_uart0_d, hub_sim_uart0_c2, hub_sim_uart0_c5;
+
+static hub_sim_tcd_t tcds[HUB_SIM_DMA_CHANNELS];
+
+static struct
+{
+  int allocated;
+  int request;                   // ERQ
+  int done;
+} channels[HUB_SIM_DMA_CHANNELS];
+
+static struct
+{
+  int running;
+  int64_t start;
+  int64_t clocks;                // bus clocks a tick
+  int64_t ticks;                 // handed to the DMA so far
+} pits[HUB_SIM_PIT_CHANNELS];
+
+static int64_t uart0_next;      // when it can take the next byte
+
+
+// a source word, the ports as they were at t
+static uint32_t dma_read(const volatile uint8_t *src, int size, int64_t t)
+{
+  const volatile uint8_t *gpio = (const volatile uint8_t *)hub_sim_gpio;
+  uint32_t v = 0;
+  ptrdiff_t offset = src - gpio;
+
+  if (offset >= 0 && offset < (ptrdiff_t)sizeof(hub_sim_gpio) && offset % 64 / 4 == HUB_SIM_PDIR) {
+    v = hub_sim_port_at(offset / 64, t) >> (offset % 4 * 8);
+  } else {
+    memcpy(&v, (const void *)src, size);
+  }
+  return size == 4 ? v : v & ((1UL << (size * 8)) - 1);
+}
+
+static void minor_loop(int ch, int64_t t)
+{
+  hub_sim_tcd_t *tcd = &tcds[ch];
+  const volatile uint8_t *src = (const volatile uint8_t *)tcd->SADDR;
+  volatile uint8_t *dst = (volatile uint8_t *)tcd->DADDR;
+  uint32_t nbytes = tcd->NBYTES_MLOFFYES, v;
+  int32_t mloff = 0;
+  int size = 1 << ((tcd->ATTR >> 8) & 0x7), i;
+
+  if (nbytes & (DMA_TCD_NBYTES_SMLOE | DMA_TCD_NBYTES_DMLOE)) {
+    mloff = (int32_t)(nbytes << 2) >> 12;    // 20 bits, signed
+    nbytes &= 0x3ff;
+  }
+  for (i = 0; i < (int)nbytes; i += size) {
+    v = dma_read(src, size, t);
+    memcpy((void *)dst, &v, size);
+    src += tcd->SOFF;
+    dst += tcd->DOFF;
+  }
+  if (tcd->NBYTES_MLOFFYES & DMA_TCD_NBYTES_SMLOE) {
+    src += mloff;
+  }
+  if (tcd->NBYTES_MLOFFYES & DMA_TCD_NBYTES_DMLOE) {
+    dst += mloff;
+  }
+  if (--tcd->CITER_ELINKNO.value == 0) {
+    src += tcd->SLAST;
+    dst += tcd->DLASTSGA;
+    tcd->CITER_ELINKNO.value = tcd->BITER_ELINKNO;
+    tcd->CSR |= DMA_TCD_CSR_DONE;
+    channels[ch].done = 1;
+    if (tcd->CSR & DMA_TCD_CSR_DREQ) {
+      channels[ch].request = 0;
+    }
+  }
+  tcd->SADDR = src;
+  tcd->DADDR = dst;
+}
+
+static void uart0_run(int64_t now)
+{
+  int64_t byte_ns = Serial1.baud > 0 && !hub_sim_config.fast_delay ? 10000000000LL / Serial1.baud : 0;
+  int c;
+
+  for (c = 0; c < HUB_SIM_DMA_CHANNELS; c++) {
+    if (channels[c].request && hub_sim_dmamux[c] == (DMAMUX_ENABLE | DMAMUX_SOURCE_UART0_TX) &&
+        (hub_sim_uart0_c5 & UART_C5_TDMAS) && (hub_sim_uart0_c2 & UART_C2_TIE)) {
+      break;
+    }
+  }
+  if (c == HUB_SIM_DMA_CHANNELS) {
+    uart0_next = uart0_next > now ? uart0_next : now;
+    return;
+  }
+  while (channels[c].request && uart0_next <= now) {
+    minor_loop(c, now);
+    Serial1.transmit((const uint8_t *)&hub_sim_uart0_d, 1);
+    uart0_next += byte_ns;
+  }
+}
+
+void hub_sim_dma_run(int64_t now)
+{
+  int64_t tick;
+  int c, triggered;
+
+  for (c = 0; c < HUB_SIM_PIT_CHANNELS; c++) {
+    if (!pits[c].running && (hub_sim_pit[c][2] & PIT_TCTRL_TEN)) {
+      pits[c].running = 1;
+      pits[c].start = now;
+      pits[c].clocks = (int64_t)hub_sim_pit[c][0] + 1;
+      pits[c].ticks = 0;
+    } else if (pits[c].running && !(hub_sim_pit[c][2] & PIT_TCTRL_TEN)) {
+      pits[c].running = 0;
+    }
+    if (!pits[c].running) {
+      continue;
+    }
+    // the DMA channel of the same number, when its mux lets the PIT through
+    triggered = (hub_sim_dmamux[c] & (DMAMUX_ENABLE | DMAMUX_TRIG)) == (DMAMUX_ENABLE | DMAMUX_TRIG);
+    while ((tick = pits[c].start + (pits[c].ticks + 1) * pits[c].clocks * 1000000000 / F_BUS) <= now) {
+      pits[c].ticks++;
+      hub_sim_pit[c][3] = 1;
+      if (triggered && channels[c].request) {
+        minor_loop(c, tick);
+      }
+    }
+  }
+  uart0_run(now);
+}
+
+void DMAChannel::begin(bool force_initialization)
+{
+  int c;
+
+  if (TCD != NULL && !force_initialization) {
+    return;
+  }
+  for (c = 0; c < HUB_SIM_DMA_CHANNELS && channels[c].allocated; c++);
+  if (c == HUB_SIM_DMA_CHANNELS) {
+    return;
+  }
+  channels[c].allocated = 1;
+  memset(&tcds[c], 0, sizeof(tcds[c]));
+  TCD = &tcds[c];
+  channel = c;
+}
+
+void DMAChannel::release(void)
+{
+  if (TCD != NULL) {
+    channels[channel] = {0, 0, 0};
+    TCD = NULL;
+    channel = HUB_SIM_DMA_CHANNELS;
+  }
+}
+
+void DMAChannel::enable(void)
+{
+  hub_sim_poll();
+  channels[channel].request = 1;
+}
+
+void DMAChannel::disable(void)
+{
+  hub_sim_poll();
+  channels[channel].request = 0;
+}
+
+bool DMAChannel::complete(void)
+{
+  hub_sim_poll();
+  return channels[channel].done;
+}
+
+void DMAChannel::clearComplete(void)
+{
+  channels[channel].done = 0;
+  TCD->CSR &= ~DMA_TCD_CSR_DONE;
+}
@@ -0,0 +1,276 @@
+/*
+ * gpio.cpp
+ *
+ * Pins, ports and the motion nodes on them, see hub_sim.h.  A line reads
+ * high from its pull-up unless the hub drives it, it is held low from
+ * outside, or its node is sending a 0.  Each port's input is kept with the
+ * time of the next edge any of its nodes could make, so reading it in a
+ * busy loop does not work the nodes out again every time.
+ */
+
+#include "Arduino.h"
+#include "hub_sim.h"
+
+volatile uint32_t hub_sim_gpio[HUB_SIM_PORTS][16];
+volatile uint32_t hub_sim_demcr, hub_sim_dwt_ctrl;
+
+// Teensy 3.1/3.2 pins 0-33 to their port bits, as in hub_scan.h
+const hub_sim_pin_t hub_sim_teensy3_pins[34] = {
+  {1, 16}, {1, 17}, {3, 0}, {0, 12}, {0, 13}, {3, 7}, {3, 4}, {3, 2}, {3, 3}, {2, 3},
+  {2, 4}, {2, 6}, {2, 7}, {2, 5}, {3, 1}, {2, 0}, {1, 0}, {1, 1}, {1, 3}, {1, 2},
+  {3, 5}, {3, 6}, {2, 1}, {2, 2}, {0, 5}, {1, 19}, {4, 1}, {2, 9}, {2, 8}, {2, 10},
+  {2, 11}, {4, 0}, {1, 18}, {0, 4},
+};
+
+typedef struct
+{
+  hub_sim_pin_t pin;
+  int present;
+  int period;                    // ns, this node's clock
+  int64_t reply_at;              // start edge of the last reply
+  uint8_t byte;
+  int answered;
+  int64_t last_trigger;
+  int64_t tap_at;
+  int tap_peak;
+} node_t;
+
+static node_t nodes[HUB_SIM_MAX_NODES];
+static int port_nodes[HUB_SIM_PORTS][HUB_SIM_MAX_NODES];
+static int n_port_nodes[HUB_SIM_PORTS];
+static uint32_t low_mask[HUB_SIM_PORTS];
+static uint32_t driven_low[HUB_SIM_PORTS];     // by the hub
+static int64_t valid_until[HUB_SIM_PORTS];     // of PDIR as it is
+static unsigned long replies, ignored;
+
+
+void hub_sim_gpio_init(void)
+{
+  const hub_sim_config_t *config = &hub_sim_config;
+  node_t *node;
+  int i, p;
+
+  memset((void *)hub_sim_gpio, 0, sizeof(hub_sim_gpio));
+  for (i = 0; i < 34; i++) {
+    if (config->low_pins & (1UL << i)) {
+      low_mask[hub_sim_teensy3_pins[i].port] |= 1UL << hub_sim_teensy3_pins[i].bit;
+    }
+  }
+  for (i = 0; i < config->n_nodes; i++) {
+    node = &nodes[i];
+    node->pin = hub_sim_teensy3_pins[config->node_pin[i]];
+    node->present = config->present[i];
+    node->period = config->bit_ns * (1000 + rand() % (2 * HUB_SIM_PERIOD_ERROR + 1) - HUB_SIM_PERIOD_ERROR) / 1000;
+    node->reply_at = HUB_SIM_NEVER;
+    node->tap_at = -HUB_SIM_TAP_DECAY_NS;
+    p = node->pin.port;
+    port_nodes[p][n_port_nodes[p]++] = i;
+  }
+}
+
+// the node's line at t, and when it could change next
+static int node_line(const node_t *node, int64_t t, int64_t *next)
+{
+  int64_t d = t - node->reply_at;
+  int start = hub_sim_config.start_ns, bit;
+
+  if (d < 0) {
+    *next = node->reply_at;
+    return 1;
+  }
+  if (d < start) {
+    *next = node->reply_at + start;
+    return 0;
+  }
+  bit = (d - start) / node->period;
+  if (bit >= 8) {
+    *next = HUB_SIM_NEVER;
+    return 1;
+  }
+  *next = node->reply_at + start + (int64_t)(bit + 1) * node->period;
+  return (node->byte >> bit) & 1;
+}
+
+static uint32_t port_lines(int port, int64_t t, int64_t *next)
+{
+  uint32_t pdor = hub_sim_gpio[port][HUB_SIM_PDOR], pddr = hub_sim_gpio[port][HUB_SIM_PDDR];
+  uint32_t v = (~pddr | pdor) & ~low_mask[port];
+  int64_t edge;
+  node_t *node;
+  int i;
+
+  *next = HUB_SIM_NEVER;
+  for (i = 0; i < n_port_nodes[port]; i++) {
+    node = &nodes[port_nodes[port][i]];
+    if (!node_line(node, t, &edge)) {
+      v &= ~(1UL << node->pin.bit);
+    }
+    *next = edge < *next ? edge : *next;
+  }
+  return v;
+}
+
+uint32_t hub_sim_port_at(int port, int64_t t)
+{
+  int64_t next;
+
+  return port_lines(port, t, &next);
+}
+
+static void refresh(int port, int64_t now)
+{
+  if (now >= valid_until[port]) {
+    hub_sim_gpio[port][HUB_SIM_PDIR] = port_lines(port, now, &valid_until[port]);
+  }
+}
+
+volatile uint32_t *hub_sim_pdir(int port)
+{
+  refresh(port, hub_sim_poll());
+  return &hub_sim_gpio[port][HUB_SIM_PDIR];
+}
+
+// 0 mostly, a small value now and then, and a tap that dies away
+static uint8_t motion_byte(node_t *node, int64_t now)
+{
+  double dt = (now - node->last_trigger) * 1e-9;
+  int64_t since;
+  int level = 0;
+
+  node->last_trigger = now;
+  if (rand() < RAND_MAX * hub_sim_config.taps_per_s * dt) {
+    node->tap_at = now;
+    node->tap_peak = 49 + rand() % 79;
+  }
+  since = now - node->tap_at;
+  if (since < HUB_SIM_TAP_DECAY_NS) {
+    level = node->tap_peak * (HUB_SIM_TAP_DECAY_NS - since) / HUB_SIM_TAP_DECAY_NS;
+  }
+  if (rand() % HUB_SIM_JITTER_SHARE == 0) {
+    level += 1 + rand() % 7;
+  }
+  return level < 127 ? level : 127;
+}
+
+static void trigger(node_t *node, int64_t now)
+{
+  if (!node->present) {
+    return;
+  }
+  if (node->reply_at != HUB_SIM_NEVER && now < node->reply_at + hub_sim_config.start_ns + 9 * node->period) {
+    ignored++;
+    return;
+  }
+  node->reply_at = now + node->period * HUB_SIM_MIN_DELAY_BITS +
+                   rand() % ((HUB_SIM_MAX_DELAY_BITS - HUB_SIM_MIN_DELAY_BITS) * node->period);
+  node->byte = motion_byte(node, now);
+  node->answered = 1;
+  replies++;
+}
+
+void hub_sim_gpio_write(int port, int reg, uint32_t value)
+{
+  volatile uint32_t *r = hub_sim_gpio[port];
+  uint32_t released;
+  int64_t now;
+  int i;
+
+  now = hub_sim_poll();    // the DMA caught up before the lines change
+  switch (reg) {
+  case HUB_SIM_PDOR:
+    r[HUB_SIM_PDOR] = value;
+    break;
+  case HUB_SIM_PSOR:
+    r[HUB_SIM_PDOR] |= value;
+    break;
+  case HUB_SIM_PCOR:
+    r[HUB_SIM_PDOR] &= ~value;
+    break;
+  case HUB_SIM_PTOR:
+    r[HUB_SIM_PDOR] ^= value;
+    break;
+  case HUB_SIM_PDDR:
+    r[HUB_SIM_PDDR] = value;
+    break;
+  default:
+    return;
+  }
+  released = driven_low[port] & ~(r[HUB_SIM_PDDR] & ~r[HUB_SIM_PDOR]);
+  driven_low[port] = r[HUB_SIM_PDDR] & ~r[HUB_SIM_PDOR];
+  if (released) {
+    for (i = 0; i < n_port_nodes[port]; i++) {
+      if (released & (1UL << nodes[port_nodes[port][i]].pin.bit)) {
+        trigger(&nodes[port_nodes[port][i]], now);
+      }
+    }
+  }
+  valid_until[port] = 0;
+}
+
+int hub_sim_node_byte(int node, uint8_t *byte)
+{
+  *byte = nodes[node].byte;
+  return nodes[node].answered;
+}
+
+unsigned long hub_sim_node_replies(void)
+{
+  return replies;
+}
+
+unsigned long hub_sim_node_ignored(void)
+{
+  return ignored;
+}
+
+uint32_t hub_sim_cyccnt(void)
+{
+  int64_t now = hub_sim_poll();
+  int p;
+
+  if (!(hub_sim_demcr & ARM_DEMCR_TRCENA) || !(hub_sim_dwt_ctrl & ARM_DWT_CTRL_CYCCNTENA)) {
+    return 0;
+  }
+  // sketches poll PDIR through pointers between reading this
+  for (p = 0; p < HUB_SIM_PORTS; p++) {
+    refresh(p, now);
+  }
+  return (uint32_t)(now * (F_CPU / 1000000) / 1000);
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  hub_sim_pin_t p;
+
+  if (pin >= 34) {
+    return;
+  }
+  p = hub_sim_teensy3_pins[pin];
+  if (mode == OUTPUT) {
+    hub_sim_gpio_write(p.port, HUB_SIM_PDDR, hub_sim_gpio[p.port][HUB_SIM_PDDR] | 1UL << p.bit);
+  } else {
+    hub_sim_gpio_write(p.port, HUB_SIM_PDDR, hub_sim_gpio[p.port][HUB_SIM_PDDR] & ~(1UL << p.bit));
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  hub_sim_pin_t p;
+
+  if (pin >= 34) {
+    return;
+  }
+  p = hub_sim_teensy3_pins[pin];
+  hub_sim_gpio_write(p.port, value ? HUB_SIM_PSOR : HUB_SIM_PCOR, 1UL << p.bit);
+}
+
+uint8_t digitalRead(uint8_t pin)
+{
+  hub_sim_pin_t p;
+
+  if (pin >= 34) {
+    return LOW;
+  }
+  p = hub_sim_teensy3_pins[pin];
+  return (*hub_sim_pdir(p.port) >> p.bit) & 1;
+}
@@ -0,0 +1,394 @@
+/*
+ * hub_sim.cpp
+ *
+ * Runs a sketch's setup() and then its loop() against the simulated
+ * hardware, see hub_sim.h, and prints how fast the loop went and what went
+ * over the serial ports.  Stops after -n loops or -t seconds, else on
+ * Ctrl-C; a sketch stuck in a loop is stopped on its next core call.
+ */
+
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "box_hub_frame.h"
+#include "hub_sim.h"
+
+#define SIM_NODE_PINS_DEFAULT    "4-12,14-33"    // mot_sense_hub_3's sensors
+#define SIM_LOW_PINS_DEFAULT     ""
+#define SIM_TAPS_DEFAULT         0.5
+#define SIM_I2C_ADDRESS_DEFAULT  0x44
+#define SIM_SCANS_KEPT           4096            // loops a late packet can still be checked against
+
+void setup(void);
+void loop(void);
+
+hub_sim_config_t hub_sim_config;
+
+static int64_t sim_now;
+static struct timespec host_start;
+static int64_t deadline = HUB_SIM_NEVER;
+static volatile sig_atomic_t stop_requested;
+static const char *name;
+static int check_packets;
+static unsigned long loops, packets, checked, wrong, too_late;
+static box_hub_reader_t packet_reader;
+static box_hub_motion_t packet_motion;
+static box_hub_status_t packet_status;
+static unsigned long statuses;
+static int64_t loop_ns, loop_longest, run_start;
+
+// what the nodes sent in each loop, by when it began
+static struct
+{
+  uint32_t start_us;
+  uint8_t byte[HUB_SIM_MAX_NODES];
+  uint8_t known[HUB_SIM_MAX_NODES];
+} scans[SIM_SCANS_KEPT];
+
+
+int64_t hub_sim_ns(void)
+{
+  return sim_now;
+}
+
+static double host_seconds(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec - host_start.tv_sec) + (ts.tv_nsec - host_start.tv_nsec) * 1e-9;
+}
+
+static void stop_handler(int sig)
+{
+  (void)sig;
+  stop_requested = 1;
+}
+
+static void report_serial(const hub_sim_serial *s)
+{
+  if (s->bytes_out > 0 || s->dropped > 0 || s->bytes_in > 0) {
+    printf("%-8s %lu bytes out, %lu dropped, %lu in%s%s\n", s->name, s->bytes_out, s->dropped, s->bytes_in,
+           s->path[0] ? " on " : "", s->path);
+  }
+}
+
+static void finish(void)
+{
+  double seconds = (hub_sim_ns() - run_start) * 1e-9;
+
+  printf("%s: %lu loops in %.2f s, %.1f us a loop, longest %.1f us, simulated at %i ns an access; "
+         "%.2f s on the host\n", name, loops, seconds, loops > 0 ? loop_ns * 1e-3 / loops : 0.0, loop_longest * 1e-3,
+         hub_sim_config.access_ns, host_seconds());
+  printf("nodes    %lu replies, %lu triggers mid reply\n", hub_sim_node_replies(), hub_sim_node_ignored());
+  report_serial(&Serial);
+  report_serial(&Serial1);
+  report_serial(&Serial2);
+  report_serial(&Serial3);
+  if (hub_sim_wire_transfers() > 0) {
+    printf("Wire     %lu transfers\n", hub_sim_wire_transfers());
+  }
+  if (hub_sim_led_frames() > 0) {
+    printf("LEDs     %lu frames\n", hub_sim_led_frames());
+  }
+  if (check_packets) {
+    printf("packets  %lu of %lu loops checked, %lu of %lu sensor bytes wrong, %lu too late to check\n", packets,
+           loops, wrong, checked, too_late);
+    printf("frames   %lu, %lu lost, %lu crc errors, %lu bad, %lu keyframes, %lu deltas, %lu deltas skipped\n",
+           packet_reader.frames, packet_reader.lost, packet_reader.crc_errors, packet_reader.bad,
+           packet_motion.keyframes, packet_motion.deltas, packet_motion.skipped);
+    if (statuses > 0) {
+      printf("status   %lu, the last %u scans, %u frames, %u scans unsent, backlog max %u bytes\n", statuses,
+             packet_status.scans, packet_status.frames, packet_status.unsent, packet_status.backlog_max);
+    }
+  }
+  fflush(stdout);
+  exit(check_packets && (packets == 0 || wrong > 0 || packet_reader.lost > 0 || packet_reader.crc_errors > 0 ||
+                         packet_reader.bad > 0) ? 1 : 0);
+}
+
+int64_t hub_sim_poll(void)
+{
+  int64_t now = sim_now += hub_sim_config.access_ns;
+
+  if (stop_requested || now >= deadline) {
+    finish();
+  }
+  hub_sim_dma_run(now);
+  return now;
+}
+
+// loop number loops - 1
+static void keep_scan(int64_t start)
+{
+  int k = (loops - 1) % SIM_SCANS_KEPT, i;
+
+  scans[k].start_us = start / 1000;
+  for (i = 0; i < hub_sim_config.n_nodes; i++) {
+    scans[k].known[i] = hub_sim_node_byte(i, &scans[k].byte[i]);
+  }
+}
+
+// mot_sense_hub_3's motion frames, see box_hub_frame.h, brought up to the
+// whole packet if a delta: the scene, then the sensors in node order as
+// they were read, 255 for no reply.  A frame may go out loops after its
+// scan, which the time in it finds: the last loop to begin before it.
+static void check_packets_sent(const hub_sim_serial *s)
+{
+  box_hub_frame_t frame;
+  uint8_t expect;
+  unsigned long j;
+  int b, i, k;
+
+  for (b = 0; b < s->log_length; b++) {
+    if (!box_hub_reader_push(&packet_reader, s->log[b], &frame)) {
+      continue;
+    }
+    if (frame.type == BOX_HUB_FRAME_STATUS && box_hub_status_read(&frame, &packet_status) == 0) {
+      statuses++;
+    }
+    if (!box_hub_motion_apply(&packet_motion, &frame) ||
+        packet_motion.length < 1 + hub_sim_config.n_nodes) {
+      continue;
+    }
+    for (j = 0; j < SIM_SCANS_KEPT && j < loops; j++) {
+      if ((int32_t)(frame.time_us - scans[(loops - 1 - j) % SIM_SCANS_KEPT].start_us) >= 0) {
+        break;
+      }
+    }
+    if (j == SIM_SCANS_KEPT || j == loops) {
+      too_late++;
+      continue;
+    }
+    k = (loops - 1 - j) % SIM_SCANS_KEPT;
+    packets++;
+    for (i = 0; i < hub_sim_config.n_nodes; i++) {
+      if (!hub_sim_config.present[i]) {
+        expect = BOX_HUB_NO_REPLY;
+      } else if (scans[k].known[i]) {
+        expect = scans[k].byte[i];
+      } else {
+        continue;
+      }
+      checked++;
+      wrong += packet_motion.data[1 + i] != expect;
+    }
+  }
+}
+
+// "4-12,14-33" to pins in order, -1 on a bad list
+static int parse_pins(const char *list, int *pins, int max)
+{
+  char *end;
+  long from, to;
+  int n = 0;
+
+  while (*list != '\0') {
+    from = to = strtol(list, &end, 10);
+    if (end == list) {
+      return -1;
+    }
+    if (*end == '-') {
+      list = end + 1;
+      to = strtol(list, &end, 10);
+      if (end == list) {
+        return -1;
+      }
+    }
+    for (; from <= to; from++) {
+      if (from < 0 || from >= 34 || n == max) {
+        return -1;
+      }
+      pins[n++] = from;
+    }
+    list = *end == ',' ? end + 1 : end;
+    if (*end != ',' && *end != '\0') {
+      return -1;
+    }
+  }
+  return n;
+}
+
+void cli(void)
+{
+  hub_sim_poll();
+}
+
+void sei(void)
+{
+  hub_sim_poll();
+}
+
+void yield(void)
+{
+  hub_sim_poll();
+}
+
+uint32_t micros(void)
+{
+  return hub_sim_poll() / 1000;
+}
+
+uint32_t millis(void)
+{
+  return hub_sim_poll() / 1000000;
+}
+
+// the clock moved on to until, the DMA caught up to it on the way
+static void wait_until(int64_t until)
+{
+  if (until > sim_now + hub_sim_config.access_ns) {
+    sim_now = until - hub_sim_config.access_ns;
+  }
+  hub_sim_poll();
+}
+
+void delayMicroseconds(uint32_t us)
+{
+  int64_t until = hub_sim_poll() + (int64_t)us * 1000;
+
+  if (!hub_sim_config.fast_delay) {
+    wait_until(until);
+  }
+}
+
+void delay(uint32_t ms)
+{
+  int64_t ns = (int64_t)ms * 1000000;
+  struct timespec ts = {(time_t)(ns / 1000000000), (long)(ns % 1000000000)};
+  int64_t until = hub_sim_poll() + ns;
+
+  if (!hub_sim_config.fast_delay) {
+    if (hub_sim_config.use_pty) {
+      nanosleep(&ts, NULL);
+    }
+    wait_until(until);
+  }
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: %s [-n loops] [-t seconds] [-f] [-x access ns] [-P] [-c] [-S seed]\n"
+          "       [-N node pins] [-L low pins] [-a absent] [-b bit ns] [-s start ns] [-r taps per second]\n"
+          "       [-w i2c address]\n", name);
+  exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+  hub_sim_config_t *config = &hub_sim_config;
+  const char *node_pins = SIM_NODE_PINS_DEFAULT, *low_pins = SIM_LOW_PINS_DEFAULT;
+  unsigned long max_loops = 0;
+  int low[34], n_low, absent = 0, i, j, opt;
+  unsigned seed = 1;
+  int64_t start, elapsed;
+
+  name = strrchr(argv[0], '/') != NULL ? strrchr(argv[0], '/') + 1 : argv[0];
+  config->bit_ns = HUB_SIM_BIT_NS;
+  config->start_ns = HUB_SIM_START_NS;
+  config->taps_per_s = SIM_TAPS_DEFAULT;
+  config->access_ns = HUB_SIM_ACCESS_NS;
+  config->use_pty = 1;
+  config->i2c_address = SIM_I2C_ADDRESS_DEFAULT;
+  clock_gettime(CLOCK_MONOTONIC, &host_start);
+
+  while ((opt = getopt(argc, argv, "n:t:fx:PcS:N:L:a:b:s:r:w:")) != -1) {
+    switch (opt) {
+    case 'n':
+      max_loops = strtoul(optarg, NULL, 0);
+      break;
+    case 't':
+      deadline = (int64_t)(atof(optarg) * 1e9);
+      break;
+    case 'f':
+      config->fast_delay = 1;
+      break;
+    case 'x':
+      config->access_ns = atoi(optarg);
+      break;
+    case 'P':
+      config->use_pty = 0;
+      break;
+    case 'c':
+      check_packets = 1;
+      break;
+    case 'S':
+      seed = strtoul(optarg, NULL, 0);
+      break;
+    case 'N':
+      node_pins = optarg;
+      break;
+    case 'L':
+      low_pins = optarg;
+      break;
+    case 'a':
+      absent = atoi(optarg);
+      break;
+    case 'b':
+      config->bit_ns = atoi(optarg);
+      break;
+    case 's':
+      config->start_ns = atoi(optarg);
+      break;
+    case 'r':
+      config->taps_per_s = atof(optarg);
+      break;
+    case 'w':
+      config->i2c_address = strtol(optarg, NULL, 0);
+      break;
+    default:
+      usage();
+    }
+  }
+  config->n_nodes = parse_pins(node_pins, config->node_pin, HUB_SIM_MAX_NODES);
+  n_low = parse_pins(low_pins, low, 34);
+  if (optind < argc || config->n_nodes < 0 || n_low < 0 || config->bit_ns <= 0 || config->start_ns < 0 ||
+      config->access_ns < 1) {
+    usage();
+  }
+  for (i = 0; i < n_low; i++) {
+    config->low_pins |= 1UL << low[i];
+  }
+
+  srand(seed);
+  for (i = 0; i < config->n_nodes; i++) {
+    config->present[i] = 1;
+  }
+  for (i = 0; i < absent && i < config->n_nodes; ) {
+    j = rand() % config->n_nodes;
+    if (config->present[j]) {
+      config->present[j] = 0;
+      i++;
+    }
+  }
+  hub_sim_gpio_init();
+  box_hub_reader_init(&packet_reader);
+  signal(SIGINT, stop_handler);
+  signal(SIGTERM, stop_handler);
+
+  setup();
+  Serial.log_length = Serial1.log_length = Serial2.log_length = Serial3.log_length = 0;
+
+  run_start = hub_sim_ns();
+  while (max_loops == 0 || loops < max_loops) {
+    start = hub_sim_ns();
+    loop();
+    elapsed = hub_sim_ns() - start;
+    loop_ns += elapsed;
+    loop_longest = elapsed > loop_longest ? elapsed : loop_longest;
+    loops++;
+
+    if (check_packets) {
+      keep_scan(start);
+      hub_sim_poll();    // the DMA caught up on what the loop queued
+      check_packets_sent(&Serial1);
+    }
+    Serial.log_length = Serial1.log_length = Serial2.log_length = Serial3.log_length = 0;
+    hub_sim_wire_run(hub_sim_ns());
+    hub_sim_poll();
+  }
+  finish();
+  return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * hub_sim.h
+ *
+ * The Teensy sketches built unmodified for a Linux host and run against
+ * simulated hardware, to run and time them without boards:
+ *
+ *   Arduino.h, DMAChannel.h, i2c_t3.h, OctoWS2811.h
+ *     the core and library calls the sketches make, declared as the Teensy
+ *     ones are
+ *   gpio.cpp      pins and ports, the motion nodes on them, the cycle counter
+ *   dma.cpp       DMA channels triggered by the PIT timers or UART0 transmit
+ *   serial.cpp    Serial and Serial1-3 as ptys
+ *   wire.cpp      Wire, with a simulated device or master at the other end
+ *   octows2811.cpp
+ *   hub_sim.cpp   setup() then loop() until done, and the numbers
+ *
+ * Time is simulated: the clock starts at 0 and only the simulation moves
+ * it, by -x ns for every core call and register access the sketch makes and
+ * by however long delay() and delayMicroseconds() ask for.  micros(), the
+ * cycle counter, the PIT ticks and the nodes' lines all run off it, so a
+ * run is the same every time whatever else the host is doing, and busy
+ * waits and polling loops see replies as they come in sketch time.  Code
+ * between accesses takes no time.  A node answers the hub letting go of its line after holding it low, as
+ * mot_sense_hub_3 triggers them, with a start pulse and 8 bits LSB first;
+ * what it sends is made up, mostly 0 with taps now and then.
+ *
+ * The Makefile builds one binary a sketch, the .ino compiled as C++ with
+ * the prototypes the Arduino IDE would have added:
+ *
+ *   mot_sense_hub_3 [-n loops] [-t seconds] [-f] [-x access ns] [-P] [-c] [-S seed]
+ *                   [-N node pins] [-L low pins] [-a absent] [-b bit ns]
+ *                   [-s start ns] [-r taps per second] [-w i2c address]
+ *
+ * The serial ports print the pty to open at the other end, where Pd or the
+ * renderer can read them; -P drops the bytes instead.  -f makes delay()
+ * return at once, to time the code rather than the waits, and UART0 take
+ * DMA bytes as fast as they come rather than at the baud; -c checks each
+ * packet on Serial1 against what the nodes sent in the loop its time is
+ * from, and fails the run on a single wrong sensor byte or lost frame.
+ * With the ptys in use delay() also sleeps on the host, so whatever is at
+ * the other end sees the sketch's pace.
+ */
+
+#ifndef __HUB_SIM_H__
+#define __HUB_SIM_H__
+
+#include <stdint.h>
+
+#define HUB_SIM_MAX_NODES        34      // one per Teensy pin 0-33
+#define HUB_SIM_BIT_NS           1000
+#define HUB_SIM_START_NS         340
+#define HUB_SIM_MIN_DELAY_BITS   1       // a node answers this late at the soonest
+#define HUB_SIM_MAX_DELAY_BITS   6       // and up to this late
+#define HUB_SIM_PERIOD_ERROR     20      // per mille, each node's clock
+#define HUB_SIM_TAP_DECAY_NS     150000000LL
+#define HUB_SIM_JITTER_SHARE     16      // replies at rest that are not 0, one in
+#define HUB_SIM_ACCESS_NS        20      // 2 cycles at 96 MHz
+#define HUB_SIM_NEVER            INT64_MAX
+
+
+typedef struct
+{
+  uint8_t port;                  // 0 = A
+  uint8_t bit;
+} hub_sim_pin_t;
+
+// what the simulation runs with, from the command line
+typedef struct
+{
+  int n_nodes;
+  int node_pin[HUB_SIM_MAX_NODES];     // in the order the packet has them
+  int present[HUB_SIM_MAX_NODES];
+  uint32_t low_pins;                   // held low from outside, pin bits
+  int bit_ns;
+  int start_ns;
+  double taps_per_s;                   // each node
+  int fast_delay;
+  int access_ns;                       // simulated time a core call or register access takes
+  int use_pty;
+  int i2c_address;
+} hub_sim_config_t;
+
+extern hub_sim_config_t hub_sim_config;
+extern const hub_sim_pin_t hub_sim_teensy3_pins[34];
+
+int64_t hub_sim_ns(void);            // simulated, since the start
+int64_t hub_sim_poll(void);          // on every core call: moves the clock on, catches up the DMA; the time
+
+// gpio.cpp
+void hub_sim_gpio_init(void);
+uint32_t hub_sim_port_at(int port, int64_t t);
+int hub_sim_node_byte(int node, uint8_t *byte);      // 0 if it never answered
+unsigned long hub_sim_node_replies(void);
+unsigned long hub_sim_node_ignored(void);            // triggered mid reply
+
+// dma.cpp
+void hub_sim_dma_run(int64_t now);
+
+// wire.cpp
+void hub_sim_wire_run(int64_t now);
+unsigned long hub_sim_wire_transfers(void);
+
+// octows2811.cpp
+unsigned long hub_sim_led_frames(void);
+
+
+#endif /* __HUB_SIM_H__ */
@@ -0,0 +1,83 @@
+/*
+ * i2c_t3.h
+ *
+ * Wire for hub_sim, the part of the i2c_t3 library box_led_hub and
+ * i2c_master use.  There is one bus and one sketch on it: a master's
+ * transfers go to a simulated device, 256 bytes of memory with the WRITE,
+ * READ and SETRATE commands of box_led_hub; a slave is written motion
+ * events by a simulated master, as the box's hub would send them.
+ * Transfers are whole at once, so the non-blocking calls are done as soon
+ * as they return.
+ */
+
+#ifndef __HUB_SIM_I2C_T3_H__
+#define __HUB_SIM_I2C_T3_H__
+
+#include "Arduino.h"
+#include "DMAChannel.h"
+
+#define I2C_TX_BUFFER_LENGTH     259
+#define I2C_RX_BUFFER_LENGTH     259
+
+enum i2c_mode { I2C_MASTER, I2C_SLAVE };
+enum i2c_pins { I2C_PINS_18_19, I2C_PINS_16_17, I2C_PINS_22_23, I2C_PINS_29_30, I2C_PINS_26_31 };
+enum i2c_pullup { I2C_PULLUP_EXT, I2C_PULLUP_INT };
+enum i2c_rate { I2C_RATE_100, I2C_RATE_200, I2C_RATE_300, I2C_RATE_400, I2C_RATE_600, I2C_RATE_800,
+                I2C_RATE_1000, I2C_RATE_1200, I2C_RATE_1500, I2C_RATE_1800, I2C_RATE_2000, I2C_RATE_2400,
+                I2C_RATE_2800, I2C_RATE_3000 };
+enum i2c_op_mode { I2C_OP_MODE_IMM, I2C_OP_MODE_ISR, I2C_OP_MODE_DMA };
+enum i2c_stop { I2C_NOSTOP, I2C_STOP };
+enum i2c_status { I2C_WAITING, I2C_SENDING, I2C_SEND_ADDR, I2C_RECEIVING, I2C_TIMEOUT, I2C_ADDR_NAK,
+                  I2C_DATA_NAK, I2C_ARB_LOST, I2C_BUF_OVF, I2C_SLAVE_TX, I2C_SLAVE_RX };
+
+struct i2cStruct
+{
+  i2c_mode currentMode;
+  i2c_pins currentPins;
+  i2c_rate currentRate;
+  i2c_op_mode opMode;
+  i2c_status currentStatus;
+  DMAChannel *DMA;
+  uint8_t txBuffer[I2C_TX_BUFFER_LENGTH];
+  size_t txBufferLength;
+  uint8_t rxBuffer[I2C_RX_BUFFER_LENGTH];
+  size_t rxBufferIndex;
+  size_t rxBufferLength;
+  uint8_t txAddr;
+  uint8_t slaveAddr;
+  void (*user_onReceive)(size_t len);
+  void (*user_onRequest)(void);
+};
+
+class i2c_t3
+{
+public:
+  i2c_t3();
+  void begin(i2c_mode mode = I2C_MASTER, uint8_t address = 0, i2c_pins pins = I2C_PINS_18_19,
+             i2c_pullup pullup = I2C_PULLUP_EXT, i2c_rate rate = I2C_RATE_100, i2c_op_mode opMode = I2C_OP_MODE_ISR);
+  uint8_t setOpMode(i2c_op_mode opMode);
+  void setRate(i2c_rate rate) { i2c->currentRate = rate; }
+  void beginTransmission(uint8_t address);
+  uint8_t endTransmission(i2c_stop stop = I2C_STOP);
+  void sendTransmission(i2c_stop stop = I2C_STOP);
+  size_t requestFrom(uint8_t address, size_t length, i2c_stop stop = I2C_STOP);
+  void sendRequest(uint8_t address, size_t length, i2c_stop stop = I2C_STOP);
+  uint8_t done(void) { return 1; }
+  uint8_t finish(uint32_t timeout = 0) { (void)timeout; return i2c->currentStatus == I2C_WAITING; }
+  i2c_status status(void) { return i2c->currentStatus; }
+  size_t write(uint8_t data);
+  size_t write(const uint8_t *data, size_t quantity);
+  int available(void) { return i2c->rxBufferLength - i2c->rxBufferIndex; }
+  int read(void) { return available() ? i2c->rxBuffer[i2c->rxBufferIndex++] : -1; }
+  uint8_t readByte(void) { return available() ? i2c->rxBuffer[i2c->rxBufferIndex++] : 0; }
+  int peek(void) { return available() ? i2c->rxBuffer[i2c->rxBufferIndex] : -1; }
+  void onReceive(void (*function)(size_t len)) { i2c->user_onReceive = function; }
+  void onRequest(void (*function)(void)) { i2c->user_onRequest = function; }
+
+  i2cStruct *i2c;
+};
+
+extern i2c_t3 Wire;
+
+
+#endif /* __HUB_SIM_I2C_T3_H__ */
@@ -0,0 +1,43 @@
+/*
+ * octows2811.cpp
+ *
+ * The LED driver for hub_sim, see OctoWS2811.h.  The buffers are the
+ * sketch's, 6 words for each LED of a strip as OctoWS2811 asks; here a
+ * pixel takes one word, so six of the eight strips fit.
+ */
+
+#include "OctoWS2811.h"
+#include "hub_sim.h"
+
+static unsigned long frames;
+
+
+OctoWS2811::OctoWS2811(uint32_t numPerStrip, void *frameBuf, void *drawBuf, uint8_t config)
+  : stripLen(numPerStrip), frameBuffer((uint32_t *)frameBuf), drawBuffer((uint32_t *)drawBuf)
+{
+  (void)config;
+}
+
+void OctoWS2811::setPixel(uint32_t num, int color)
+{
+  if (num < stripLen * 6) {
+    drawBuffer[num] = color;
+  }
+}
+
+int OctoWS2811::getPixel(uint32_t num)
+{
+  return num < stripLen * 6 ? (int)drawBuffer[num] : 0;
+}
+
+void OctoWS2811::show(void)
+{
+  hub_sim_poll();
+  memcpy(frameBuffer, drawBuffer, stripLen * 6 * sizeof(uint32_t));
+  frames++;
+}
+
+unsigned long hub_sim_led_frames(void)
+{
+  return frames;
+}
@@ -0,0 +1,147 @@
+/*
+ * serial.cpp
+ *
+ * Serial and Serial1-3 for hub_sim.  begin() opens a pty and prints the
+ * name of its other end, which is put in raw mode and kept open so bytes
+ * nobody reads yet wait in the pty rather than hang it up; once it is full
+ * they are dropped and counted, as a UART would lose them.  With -P the
+ * bytes are only counted.  No baud rate is kept to by write(); a DMA
+ * transmit on UART0 keeps to Serial1's, see dma.cpp.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+
+#include "Arduino.h"
+#include "hub_sim.h"
+
+hub_sim_serial Serial("Serial"), Serial1("Serial1"), Serial2("Serial2"), Serial3("Serial3");
+
+
+hub_sim_serial::hub_sim_serial(const char *name) : name(name), fd(-1), peeked(-1), baud(0), bytes_out(0),
+  dropped(0), bytes_in(0), log_length(0)
+{
+  path[0] = '\0';
+}
+
+void hub_sim_serial::begin(uint32_t baud)
+{
+  struct termios tio;
+  int other;
+
+  this->baud = baud;
+  if (fd >= 0 || !hub_sim_config.use_pty) {
+    return;
+  }
+  fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0 || ptsname_r(fd, path, sizeof(path)) != 0) {
+    perror("pty");
+    end();
+    return;
+  }
+  other = open(path, O_RDWR | O_NOCTTY);    // left open, see above
+  if (other < 0 || tcgetattr(other, &tio) < 0) {
+    perror(path);
+    end();
+    return;
+  }
+  cfmakeraw(&tio);
+  tcsetattr(other, TCSANOW, &tio);
+  fprintf(stderr, "%s on %s\n", name, path);
+}
+
+void hub_sim_serial::end(void)
+{
+  if (fd >= 0) {
+    close(fd);
+  }
+  fd = -1;
+}
+
+int hub_sim_serial::peek(void)
+{
+  uint8_t c;
+
+  hub_sim_poll();
+  if (peeked < 0 && fd >= 0 && ::read(fd, &c, 1) == 1) {
+    peeked = c;
+    bytes_in++;
+  }
+  return peeked;
+}
+
+int hub_sim_serial::available(void)
+{
+  return peek() >= 0;
+}
+
+int hub_sim_serial::read(void)
+{
+  int c = peek();
+
+  peeked = -1;
+  return c;
+}
+
+size_t hub_sim_serial::write(const uint8_t *buf, size_t n)
+{
+  hub_sim_poll();
+  return transmit(buf, n);
+}
+
+size_t hub_sim_serial::transmit(const uint8_t *buf, size_t n)
+{
+  ssize_t written = 0;
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    if (log_length < (int)sizeof(log)) {
+      log[log_length++] = buf[i];
+    }
+  }
+  if (fd >= 0) {
+    written = ::write(fd, buf, n);
+    written = written > 0 ? written : 0;
+  } else if (!hub_sim_config.use_pty) {
+    written = n;
+  }
+  bytes_out += written;
+  dropped += n - written;
+  return n;
+}
+
+size_t hub_sim_serial::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t hub_sim_serial::print(long n, int base)
+{
+  char text[72];
+
+  snprintf(text, sizeof(text), base == HEX ? "%lx" : "%li", n);
+  return write(text);
+}
+
+int hub_sim_serial::printf(const char *format, ...)
+{
+  char text[512];
+  va_list ap;
+  int n;
+
+  va_start(ap, format);
+  n = vsnprintf(text, sizeof(text), format, ap);
+  va_end(ap);
+  if (n < 0) {
+    return n;
+  }
+  n = n < (int)sizeof(text) ? n : (int)sizeof(text) - 1;
+  write((const uint8_t *)text, n);
+  return n;
+}
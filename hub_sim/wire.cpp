@@ -0,0 +1,166 @@
+/*
+ * wire.cpp
+ *
+ * Wire and what is at the other end of it, see i2c_t3.h.
+ */
+
+#include "Arduino.h"
+#include "i2c_t3.h"
+#include "hub_sim.h"
+
+#define WIRE_WRITE               0x10    // box_led_hub's commands
+#define WIRE_READ                0x20
+#define WIRE_SETRATE             0x30
+#define WIRE_MEM_LEN             256
+#define WIRE_EVENTS              13      // motion events a write from the master
+#define WIRE_PERIOD_NS           20000000
+
+i2c_t3 Wire;
+
+static i2cStruct bus;
+static DMAChannel wire_dma;
+
+// the simulated device
+static uint8_t mem[WIRE_MEM_LEN];
+static size_t mem_addr;
+
+static int64_t next_write;
+static unsigned long transfers;
+
+
+i2c_t3::i2c_t3() : i2c(&bus)
+{
+}
+
+void i2c_t3::begin(i2c_mode mode, uint8_t address, i2c_pins pins, i2c_pullup pullup, i2c_rate rate,
+                   i2c_op_mode opMode)
+{
+  (void)pullup;
+  i2c->currentMode = mode;
+  i2c->slaveAddr = address;
+  i2c->currentPins = pins;
+  i2c->currentRate = rate;
+  i2c->currentStatus = I2C_WAITING;
+  setOpMode(opMode);
+}
+
+uint8_t i2c_t3::setOpMode(i2c_op_mode opMode)
+{
+  if (opMode == I2C_OP_MODE_DMA) {
+    wire_dma.begin();
+    if (wire_dma.TCD == NULL) {
+      i2c->opMode = I2C_OP_MODE_ISR;
+      return 0;
+    }
+    i2c->DMA = &wire_dma;
+  }
+  i2c->opMode = opMode;
+  return 1;
+}
+
+void i2c_t3::beginTransmission(uint8_t address)
+{
+  i2c->txAddr = address;
+  i2c->txBufferLength = 0;
+  i2c->currentStatus = I2C_WAITING;
+}
+
+size_t i2c_t3::write(uint8_t data)
+{
+  if (i2c->txBufferLength == I2C_TX_BUFFER_LENGTH) {
+    i2c->currentStatus = I2C_BUF_OVF;
+    return 0;
+  }
+  i2c->txBuffer[i2c->txBufferLength++] = data;
+  return 1;
+}
+
+size_t i2c_t3::write(const uint8_t *data, size_t quantity)
+{
+  size_t i;
+
+  for (i = 0; i < quantity && write(data[i]); i++);
+  return i;
+}
+
+// the simulated device takes a master's write
+uint8_t i2c_t3::endTransmission(i2c_stop stop)
+{
+  const uint8_t *b = i2c->txBuffer;
+  size_t n = i2c->txBufferLength, i;
+
+  (void)stop;
+  hub_sim_poll();
+  if (i2c->txAddr != hub_sim_config.i2c_address) {
+    i2c->currentStatus = I2C_ADDR_NAK;
+    return 2;
+  }
+  transfers++;
+  if (n >= 2 && b[0] == WIRE_WRITE) {
+    for (i = 2, mem_addr = b[1]; i < n && mem_addr < WIRE_MEM_LEN; i++) {
+      mem[mem_addr++] = b[i];
+    }
+  } else if (n >= 2 && b[0] == WIRE_READ) {
+    mem_addr = b[1];
+  }
+  i2c->currentStatus = I2C_WAITING;
+  return 0;
+}
+
+void i2c_t3::sendTransmission(i2c_stop stop)
+{
+  endTransmission(stop);
+}
+
+// and a read
+size_t i2c_t3::requestFrom(uint8_t address, size_t length, i2c_stop stop)
+{
+  (void)stop;
+  hub_sim_poll();
+  i2c->rxBufferIndex = 0;
+  i2c->rxBufferLength = 0;
+  if (address != hub_sim_config.i2c_address) {
+    i2c->currentStatus = I2C_ADDR_NAK;
+    return 0;
+  }
+  transfers++;
+  while (i2c->rxBufferLength < length && i2c->rxBufferLength < I2C_RX_BUFFER_LENGTH) {
+    i2c->rxBuffer[i2c->rxBufferLength++] = mem_addr < WIRE_MEM_LEN ? mem[mem_addr++] : 0xff;
+  }
+  i2c->currentStatus = I2C_WAITING;
+  return i2c->rxBufferLength;
+}
+
+void i2c_t3::sendRequest(uint8_t address, size_t length, i2c_stop stop)
+{
+  requestFrom(address, length, stop);
+}
+
+// a slave sketch is written the motion events every WIRE_PERIOD_NS
+void hub_sim_wire_run(int64_t now)
+{
+  double p = hub_sim_config.taps_per_s * WIRE_PERIOD_NS * 1e-9;
+  int i;
+
+  if (bus.currentMode != I2C_SLAVE || bus.slaveAddr != hub_sim_config.i2c_address || bus.user_onReceive == NULL ||
+      now < next_write) {
+    return;
+  }
+  next_write = now + WIRE_PERIOD_NS;
+  bus.rxBuffer[0] = WIRE_WRITE;
+  bus.rxBuffer[1] = 0;
+  for (i = 0; i < WIRE_EVENTS; i++) {
+    bus.rxBuffer[2 + i] = rand() < RAND_MAX * p;
+  }
+  bus.rxBufferIndex = 0;
+  bus.rxBufferLength = 2 + WIRE_EVENTS;
+  bus.currentStatus = I2C_SLAVE_RX;
+  bus.user_onReceive(bus.rxBufferLength);
+  bus.currentStatus = I2C_WAITING;
+  transfers++;
+}
+
+unsigned long hub_sim_wire_transfers(void)
+{
+  return transfers;
+}
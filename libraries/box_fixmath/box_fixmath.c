@@ -0,0 +1,97 @@
+// Box Fixed Point Math
+// lookup tables, generated at compile time
+//
+// Every entry below is an arithmetic constant expression, so the compiler
+// folds it to a number and the tables land in flash (Teensy) or .rodata (Pi)
+// exactly as the old pasted literals did.  The FX_REP_* macros expand a
+// generator once per entry with a hex literal index, the generators use a
+// short Taylor series for sine on a quarter wave.
+
+#include "box_fixmath.h"
+
+#define FX_PI                   3.14159265358979323846
+
+// sin(x) for |x| <= pi/2, error < 1e-7
+#define FX_SIN_POLY(x)          ((x) * (1.0 + (x) * (x) * (-1.0 / 6 + (x) * (x) * (1.0 / 120 + (x) * (x) * \
+                                (-1.0 / 5040 + (x) * (x) * (1.0 / 362880 + (x) * (x) * (-1.0 / 39916800)))))))
+
+// index repetition, M(i) for i = 0 .. n-1 as hex literals
+#define FX_REP_16(M, p)         M(p##0), M(p##1), M(p##2), M(p##3), M(p##4), M(p##5), M(p##6), M(p##7), \
+                                M(p##8), M(p##9), M(p##a), M(p##b), M(p##c), M(p##d), M(p##e), M(p##f)
+#define FX_REP_256(M, p)        FX_REP_16(M, p##0), FX_REP_16(M, p##1), FX_REP_16(M, p##2), FX_REP_16(M, p##3), \
+                                FX_REP_16(M, p##4), FX_REP_16(M, p##5), FX_REP_16(M, p##6), FX_REP_16(M, p##7), \
+                                FX_REP_16(M, p##8), FX_REP_16(M, p##9), FX_REP_16(M, p##a), FX_REP_16(M, p##b), \
+                                FX_REP_16(M, p##c), FX_REP_16(M, p##d), FX_REP_16(M, p##e), FX_REP_16(M, p##f)
+#define FX_REP_64(M)            FX_REP_16(M, 0x0), FX_REP_16(M, 0x1), FX_REP_16(M, 0x2), FX_REP_16(M, 0x3)
+#define FX_REP_128(M)           FX_REP_64(M), FX_REP_16(M, 0x4), FX_REP_16(M, 0x5), FX_REP_16(M, 0x6), FX_REP_16(M, 0x7)
+#define FX_REP_512(M)           FX_REP_256(M, 0x0), FX_REP_256(M, 0x1)
+
+// one quarter of the cosine table per repetition, so the generator only ever
+// sees a sine of a small positive index
+#define FX_COS_QUARTER          (FX_COS_SIZE / 4)
+#define FX_COS_AMP              ((1 << FIXMATH_COS_AMP_BITS) - 1)
+#define FX_QSIN(j)              FX_SIN_POLY((j) * (FX_PI / 2 / FX_COS_QUARTER))
+#define FX_COS_ENTRY(s)         ((fx_cos_entry_t)(FX_COS_AMP / 2.0 * (1.0 + (s)) + 0.5))
+#define FX_COS_Q0(i)            FX_COS_ENTRY(FX_QSIN(FX_COS_QUARTER - (i)))
+#define FX_COS_Q1(i)            FX_COS_ENTRY(-FX_QSIN(i))
+#define FX_COS_Q2(i)            FX_COS_ENTRY(-FX_QSIN(FX_COS_QUARTER - (i)))
+#define FX_COS_Q3(i)            FX_COS_ENTRY(FX_QSIN(i))
+
+#if FIXMATH_COS_BITS == 11
+#define FX_REP_QUARTER(M)       FX_REP_512(M)
+#elif FIXMATH_COS_BITS == 10
+#define FX_REP_QUARTER(M)       FX_REP_256(M, 0x)
+#elif FIXMATH_COS_BITS == 9
+#define FX_REP_QUARTER(M)       FX_REP_128(M)
+#elif FIXMATH_COS_BITS == 8
+#define FX_REP_QUARTER(M)       FX_REP_64(M)
+#else
+#error "FIXMATH_COS_BITS must be 8..11"
+#endif
+
+const fx_cos_entry_t fx_cos_table[FX_COS_SIZE] =
+{
+    FX_REP_QUARTER(FX_COS_Q0),
+    FX_REP_QUARTER(FX_COS_Q1),
+    FX_REP_QUARTER(FX_COS_Q2),
+    FX_REP_QUARTER(FX_COS_Q3),
+};
+
+// Gamma Correction Curve
+// x^gamma approximated by blending x^2 and x^3, within 3 of pow() for gamma 2..3
+// and within 4 of the hand tuned table it replaces at the default 2.5
+#define FX_GAMMA_X(i)           ((i) / 255.0)
+#define FX_GAMMA_ENTRY(i)       ((uint8_t)(255 * FX_GAMMA_X(i) * FX_GAMMA_X(i) * \
+                                ((3.0 - FIXMATH_GAMMA) + (FIXMATH_GAMMA - 2.0) * FX_GAMMA_X(i)) + 0.5))
+
+const uint8_t fx_gamma_table[256] =
+{
+    FX_REP_256(FX_GAMMA_ENTRY, 0x),
+};
+
+// Palettes, 256 entries of 0x00RRGGBB
+#define FX_CHANNEL(v)           ((uint32_t)(255 * (v) + 0.5))
+#define FX_RGB(r, g, b)         ((FX_CHANNEL(r) << 16) | (FX_CHANNEL(g) << 8) | FX_CHANNEL(b))
+
+// rainbow: a smooth bump per channel, a third of a turn apart.  Hue runs in
+// 768 steps per turn so the channel offsets stay integers, each channel is
+// (1 - t^2)^2 of its distance t (in half turns) from the channel's centre
+#define FX_HUE_DIST(i, c)       ((((i) * 3 - (c) + 768 + 384) % 768) - 384)
+#define FX_HUE_T(i, c)          ((FX_HUE_DIST(i, c) < 0 ? -FX_HUE_DIST(i, c) : FX_HUE_DIST(i, c)) / 384.0)
+#define FX_HUE_BUMP(t)          ((1.0 - (t) * (t)) * (1.0 - (t) * (t)))
+#define FX_RAINBOW_CH(i, c)     FX_HUE_BUMP(FX_HUE_T(i, c))
+#define FX_RAINBOW_ENTRY(i)     FX_RGB(FX_RAINBOW_CH(i, 0), FX_RAINBOW_CH(i, 256), FX_RAINBOW_CH(i, 512))
+
+const uint32_t fx_palette_rainbow[FX_PALETTE_SIZE] =
+{
+    FX_REP_256(FX_RAINBOW_ENTRY, 0x),
+};
+
+// fire: black -> red -> yellow -> white
+#define FX_RAMP(i, lo)          ((i) < (lo) ? 0.0 : (i) >= (lo) + 85 ? 1.0 : ((i) - (lo)) / 85.0)
+#define FX_FIRE_ENTRY(i)        FX_RGB(FX_RAMP(i, 0), FX_RAMP(i, 85), FX_RAMP(i, 170))
+
+const uint32_t fx_palette_fire[FX_PALETTE_SIZE] =
+{
+    FX_REP_256(FX_FIRE_ENTRY, 0x),
+};
@@ -0,0 +1,112 @@
+// Box Fixed Point Math
+// shared by the LED hub sketches and the light pi renderer
+//
+// Cosine, gamma and palette lookup tables are generated by the compiler from
+// constant expressions (see box_fixmath.c), so there are no pasted literals
+// to keep in sync and the size/precision can be chosen per build:
+//
+//   FIXMATH_COS_BITS      index bits stored in the cosine table, 8..11 (default 11 = 2048 entries)
+//   FIXMATH_COS_AMP_BITS  amplitude bits stored per entry, 8 or 11 (default 11 = uint16_t)
+//   FIXMATH_COS_LERP      1 = interpolate between entries of a reduced table (default 0)
+//   FIXMATH_GAMMA         display gamma, 2.0..3.0 (default 2.5)
+//
+// Whatever the table size, fastCosineCalc() keeps the original contract: an
+// 11 bit phase (2048 per turn, wrapped) in, an 11 bit wave (0..2047, 2047 at
+// phase 0) out.  A 512 entry uint8_t table is 512 bytes instead of 4 KB.
+
+#ifndef __BOX_FIXMATH_H__
+#define __BOX_FIXMATH_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef FIXMATH_COS_BITS
+#define FIXMATH_COS_BITS        11
+#endif
+#ifndef FIXMATH_COS_AMP_BITS
+#define FIXMATH_COS_AMP_BITS    11
+#endif
+#ifndef FIXMATH_COS_LERP
+#define FIXMATH_COS_LERP        0
+#endif
+#ifndef FIXMATH_GAMMA
+#define FIXMATH_GAMMA           2.5
+#endif
+
+#define FX_PHASE_BITS           11                          // phase and wave resolution of the API
+#define FX_PHASE_MASK           ((1 << FX_PHASE_BITS) - 1)
+#define FX_COS_SIZE             (1 << FIXMATH_COS_BITS)
+#define FX_COS_INDEX_SHIFT      (FX_PHASE_BITS - FIXMATH_COS_BITS)
+#define FX_COS_AMP_SHIFT        (FX_PHASE_BITS - FIXMATH_COS_AMP_BITS)
+#define FX_PALETTE_SIZE         256
+
+#if FIXMATH_COS_AMP_BITS > 8
+typedef uint16_t fx_cos_entry_t;
+#else
+typedef uint8_t fx_cos_entry_t;
+#endif
+
+// unsigned 11 bit wave, 0..2047, as returned by fastCosineCalc()
+typedef uint16_t fx_wave_t;
+// unsigned Q10 level, 1024 = 1.0, e.g. strip_red_levels
+typedef uint16_t fx_level_t;
+
+extern const fx_cos_entry_t fx_cos_table[FX_COS_SIZE];
+extern const uint8_t fx_gamma_table[256];
+extern const uint32_t fx_palette_rainbow[FX_PALETTE_SIZE];
+extern const uint32_t fx_palette_fire[FX_PALETTE_SIZE];
+
+
+// Byte val 2PI Cosine Wave, offset by 1 PI
+// supports fast trig calcs and smooth LED fading/pulsing
+static inline fx_wave_t fastCosineCalc(uint16_t preWrapVal)
+{
+    uint16_t phase = preWrapVal & FX_PHASE_MASK;
+#if FIXMATH_COS_LERP && FX_COS_INDEX_SHIFT > 0
+    uint16_t index = phase >> FX_COS_INDEX_SHIFT;
+    uint16_t frac = phase & ((1 << FX_COS_INDEX_SHIFT) - 1);
+    int32_t a = fx_cos_table[index];
+    int32_t b = fx_cos_table[(index + 1) & (FX_COS_SIZE - 1)];
+    return (fx_wave_t)((a + (((b - a) * frac) >> FX_COS_INDEX_SHIFT)) << FX_COS_AMP_SHIFT);
+#else
+    return (fx_wave_t)fx_cos_table[phase >> FX_COS_INDEX_SHIFT] << FX_COS_AMP_SHIFT;
+#endif
+}
+
+// fixed point multiply, (a * b) >> shift with a 32 bit intermediate
+static inline int32_t fx_mul(int32_t a, int32_t b, int shift)
+{
+    return (a * b) >> shift;
+}
+
+// wave down to an 8 bit channel, was `c >> 3`
+static inline uint8_t fx_wave_to_u8(fx_wave_t c)
+{
+    return c >> (FX_PHASE_BITS - 8);
+}
+
+// wave scaled by a Q10 level down to an 8 bit channel, was `(c * level) >> 13`
+static inline uint8_t fx_wave_level_u8(fx_wave_t c, fx_level_t level)
+{
+    return (uint8_t)(((uint32_t)c * level) >> (FX_PHASE_BITS - 8 + 10));
+}
+
+// squared wave down to an 8 bit channel, was `(c * c) >> 14`
+static inline uint8_t fx_wave_sq_u8(fx_wave_t c)
+{
+    return (uint8_t)(((uint32_t)c * c) >> (2 * FX_PHASE_BITS - 8));
+}
+
+static inline uint8_t fx_gamma(uint8_t value)
+{
+    return fx_gamma_table[value];
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BOX_FIXMATH_H__ */
@@ -0,0 +1,307 @@
+// Box Hub Frames
+// encoder, decoder and the byte at a time reader, see box_hub_frame.h
+//
+// Small enough for the Teensy: no tables, and nothing bigger than one frame
+// on the stack.
+
+#include <string.h>
+
+#include "box_hub_frame.h"
+
+// CRC-16/CCITT-FALSE, polynomial 0x1021 from 0xffff, a byte at a time
+// without a table; "123456789" gives 0x29b1
+uint16_t box_hub_crc16(const uint8_t *data, size_t n)
+{
+    uint16_t crc = 0xffff;
+    uint8_t x;
+
+    while (n-- > 0) {
+        x = (crc >> 8) ^ *data++;
+        x ^= x >> 4;
+        crc = (crc << 8) ^ ((uint16_t)x << 12) ^ ((uint16_t)x << 5) ^ x;
+    }
+    return crc;
+}
+
+// Each run of up to 254 non-zero bytes goes out behind a code byte of its
+// length plus one, the 0 that ended it left out; out needs n + n / 254 + 1
+size_t box_hub_cobs_encode(const uint8_t *in, size_t n, uint8_t *out)
+{
+    size_t code_at = 0, o = 1, i;
+    uint8_t code = 1;
+
+    for (i = 0; i < n; i++) {
+        if (in[i] != 0) {
+            out[o++] = in[i];
+            code++;
+        }
+        if (in[i] == 0 || code == 0xff) {
+            out[code_at] = code;
+            code = 1;
+            code_at = o++;
+        }
+    }
+    out[code_at] = code;
+    return o;
+}
+
+// out needs n bytes
+size_t box_hub_cobs_decode(const uint8_t *in, size_t n, uint8_t *out)
+{
+    size_t i = 0, o = 0;
+    uint8_t code, j;
+
+    while (i < n) {
+        code = in[i++];
+        if (code == 0 || (size_t)(code - 1) > n - i) {
+            return 0;
+        }
+        for (j = 1; j < code; j++) {
+            if (in[i] == 0) {
+                return 0;
+            }
+            out[o++] = in[i++];
+        }
+        // a full run was not ended by a 0, nor is the last
+        if (code != 0xff && i < n) {
+            out[o++] = 0;
+        }
+    }
+    return o;
+}
+
+size_t box_hub_frame_encode(const box_hub_frame_t *frame, uint8_t *out)
+{
+    uint8_t raw[BOX_HUB_FRAME_MAX_RAW];
+    size_t length = frame->length < BOX_HUB_FRAME_MAX_DATA ? frame->length : BOX_HUB_FRAME_MAX_DATA;
+    size_t n;
+    uint16_t crc;
+
+    raw[0] = BOX_HUB_FRAME_VERSION;
+    raw[1] = frame->type;
+    raw[2] = frame->sequence & 0xff;
+    raw[3] = frame->sequence >> 8;
+    raw[4] = frame->time_us & 0xff;
+    raw[5] = (frame->time_us >> 8) & 0xff;
+    raw[6] = (frame->time_us >> 16) & 0xff;
+    raw[7] = frame->time_us >> 24;
+    memcpy(raw + BOX_HUB_FRAME_HEADER_SIZE, frame->data, length);
+    n = BOX_HUB_FRAME_HEADER_SIZE + length;
+    crc = box_hub_crc16(raw, n);
+    raw[n++] = crc & 0xff;
+    raw[n++] = crc >> 8;
+
+    n = box_hub_cobs_encode(raw, n, out);
+    out[n++] = 0;
+    return n;
+}
+
+// one frame without its 0; 0, or BOX_HUB_FRAME_BAD or _CRC_ERROR
+int box_hub_frame_decode(const uint8_t *encoded, size_t n, box_hub_frame_t *frame)
+{
+    uint8_t raw[BOX_HUB_FRAME_MAX_ENCODED];
+    size_t m;
+
+    if (n > sizeof(raw)) {
+        return BOX_HUB_FRAME_BAD;
+    }
+    m = box_hub_cobs_decode(encoded, n, raw);
+    if (m < BOX_HUB_FRAME_HEADER_SIZE + BOX_HUB_FRAME_CRC_SIZE ||
+        m > BOX_HUB_FRAME_MAX_RAW) {
+        return BOX_HUB_FRAME_BAD;
+    }
+    m -= BOX_HUB_FRAME_CRC_SIZE;
+    if (box_hub_crc16(raw, m) != (raw[m] | raw[m + 1] << 8)) {
+        return BOX_HUB_FRAME_CRC_ERROR;
+    }
+    if (raw[0] != BOX_HUB_FRAME_VERSION) {
+        return BOX_HUB_FRAME_BAD;
+    }
+
+    frame->type = raw[1];
+    frame->sequence = raw[2] | raw[3] << 8;
+    frame->time_us = raw[4] | raw[5] << 8 | (uint32_t)raw[6] << 16 | (uint32_t)raw[7] << 24;
+    frame->length = m - BOX_HUB_FRAME_HEADER_SIZE;
+    memcpy(frame->data, raw + BOX_HUB_FRAME_HEADER_SIZE, frame->length);
+    return 0;
+}
+
+// whatever came before the first 0 may be the end of a frame, so skipped
+void box_hub_reader_init(box_hub_reader_t *reader)
+{
+    memset(reader, 0, sizeof(*reader));
+    reader->length = -1;
+}
+
+// 1 when byte ended a good frame, now in frame
+int box_hub_reader_push(box_hub_reader_t *reader, uint8_t byte, box_hub_frame_t *frame)
+{
+    int n = reader->length, result;
+    uint16_t gap;
+
+    if (byte != 0) {
+        if (n >= 0 && n < (int)sizeof(reader->encoded)) {
+            reader->encoded[reader->length++] = byte;
+        } else if (n >= 0) {
+            reader->bad++;
+            reader->length = -1;
+        }
+        return 0;
+    }
+
+    reader->length = 0;
+    if (n <= 0) {
+        return 0;
+    }
+    result = box_hub_frame_decode(reader->encoded, n, frame);
+    if (result == BOX_HUB_FRAME_CRC_ERROR) {
+        reader->crc_errors++;
+        return 0;
+    }
+    if (result < 0) {
+        reader->bad++;
+        return 0;
+    }
+
+    // a sequence going back is the hub starting over, not frames lost
+    gap = frame->sequence - reader->next_sequence;
+    if (reader->synced && gap < 0x8000) {
+        reader->lost += gap;
+    }
+    reader->synced = 1;
+    reader->next_sequence = frame->sequence + 1;
+    reader->frames++;
+    return 1;
+}
+
+// The hub's end: data as a keyframe or as the delta from what motion
+// holds, whichever keyframe asks and is smaller, into frame, which keeps
+// its sequence and time; motion then holds data.
+void box_hub_motion_frame(box_hub_motion_t *motion, const uint8_t *data, int length, int keyframe,
+                          box_hub_frame_t *frame)
+{
+    int n, map, o, i;
+
+    length = length < BOX_HUB_FRAME_MAX_DATA ? length : BOX_HUB_FRAME_MAX_DATA;
+    n = length - 1;
+    map = (n + 7) / 8;
+    o = 1 + map;
+    if (!keyframe && motion->length == length && length > 0) {
+        frame->data[0] = data[0];
+        memset(frame->data + 1, 0, map);
+        for (i = 0; i < n && o < length; i++) {
+            if (data[1 + i] != motion->data[1 + i]) {
+                frame->data[1 + i / 8] |= 1 << (i % 8);
+                frame->data[o++] = data[1 + i];
+            }
+        }
+        keyframe = i < n;    // the delta grew as big as the data
+    }
+
+    if (keyframe || motion->length != length || length == 0) {
+        frame->type = BOX_HUB_FRAME_MOTION;
+        frame->length = length;
+        memcpy(frame->data, data, length);
+        motion->keyframes++;
+    } else {
+        frame->type = BOX_HUB_FRAME_MOTION_DELTA;
+        frame->length = o;
+        motion->deltas++;
+    }
+    memcpy(motion->data, data, length);
+    motion->length = length;
+    motion->sequence = frame->sequence;
+    motion->time_us = frame->time_us;
+}
+
+// The Pi's end: 1 when frame brought motion up to date, 0 for frames of
+// other types and deltas it cannot take, after which it waits for a keyframe
+int box_hub_motion_apply(box_hub_motion_t *motion, const box_hub_frame_t *frame)
+{
+    int n, map, o, i, changed = 0;
+
+    switch (frame->type) {
+    case BOX_HUB_FRAME_MOTION:
+        memcpy(motion->data, frame->data, frame->length);
+        motion->length = frame->length;
+        motion->keyframes++;
+        break;
+
+    case BOX_HUB_FRAME_MOTION_DELTA:
+        n = motion->length - 1;
+        map = (n + 7) / 8;
+        if (motion->length == 0 || frame->sequence != (uint16_t)(motion->sequence + 1) || frame->length < 1 + map) {
+            changed = -1;
+        }
+        for (i = 0; i < n && changed >= 0; i++) {
+            changed += (frame->data[1 + i / 8] >> (i % 8)) & 1;
+        }
+        if (changed < 0 || changed != frame->length - 1 - map) {
+            motion->length = 0;
+            motion->skipped++;
+            return 0;
+        }
+        motion->data[0] = frame->data[0];
+        for (i = 0, o = 1 + map; i < n; i++) {
+            if ((frame->data[1 + i / 8] >> (i % 8)) & 1) {
+                motion->data[1 + i] = frame->data[o++];
+            }
+        }
+        motion->deltas++;
+        break;
+
+    default:
+        return 0;
+    }
+    motion->sequence = frame->sequence;
+    motion->time_us = frame->time_us;
+    return 1;
+}
+
+void box_hub_offsets_frame(const uint16_t *offset_us, int n, box_hub_frame_t *frame)
+{
+    int i;
+
+    n = n < BOX_HUB_FRAME_MAX_DATA / 2 ? n : BOX_HUB_FRAME_MAX_DATA / 2;
+    frame->type = BOX_HUB_FRAME_OFFSETS;
+    frame->length = 2 * n;
+    for (i = 0; i < n; i++) {
+        frame->data[2 * i] = offset_us[i] & 0xff;
+        frame->data[2 * i + 1] = offset_us[i] >> 8;
+    }
+}
+
+// the number of sensors read, at most max
+int box_hub_offsets_read(const box_hub_frame_t *frame, uint16_t *offset_us, int max)
+{
+    int n = frame->length / 2, i;
+
+    n = n < max ? n : max;
+    for (i = 0; i < n; i++) {
+        offset_us[i] = frame->data[2 * i] | frame->data[2 * i + 1] << 8;
+    }
+    return n;
+}
+
+// the fields in order, packed as the offsets are
+void box_hub_status_frame(const box_hub_status_t *status, box_hub_frame_t *frame)
+{
+    uint16_t field[4] = {status->scans, status->frames, status->unsent, status->backlog_max};
+
+    box_hub_offsets_frame(field, 4, frame);
+    frame->type = BOX_HUB_FRAME_STATUS;
+}
+
+int box_hub_status_read(const box_hub_frame_t *frame, box_hub_status_t *status)
+{
+    uint16_t field[4];
+
+    if (frame->length < BOX_HUB_STATUS_SIZE || box_hub_offsets_read(frame, field, 4) < 4) {
+        return BOX_HUB_FRAME_BAD;
+    }
+    status->scans = field[0];
+    status->frames = field[1];
+    status->unsent = field[2];
+    status->backlog_max = field[3];
+    return 0;
+}
@@ -0,0 +1,146 @@
+// Box Hub Frames
+// the hub to Pi serial format, shared by mot_sense_hub_3 and the light pi
+// renderer
+//
+// A frame is a header, the data and a CRC, COBS stuffed so that no byte of
+// it is 0, and ended by a 0:
+//
+//   version  1 byte, BOX_HUB_FRAME_VERSION
+//   type     1 byte, BOX_HUB_FRAME_*
+//   sequence 2 bytes, one more every frame the hub sends, wrapping
+//   time     4 bytes, the hub's micros() when the scan began
+//   data     0 .. BOX_HUB_FRAME_MAX_DATA bytes
+//   crc      2 bytes, CRC-16/CCITT-FALSE of everything before it
+//
+// little endian.  Any byte value can be sent, so sensor bytes go as read:
+// 255 for a node that did not answer, the top bit for a tilt.  A reader
+// that starts or loses bytes mid frame picks up again at the next 0, and
+// a gap in the sequence tells it how many frames went missing.
+//
+//   BOX_HUB_FRAME_MOTION        the scene, then one byte per sensor: a keyframe
+//   BOX_HUB_FRAME_MOTION_DELTA  the scene, a bitmap of the sensors that changed
+//                               since the frame before, sensor 0 in bit 0 of
+//                               the first byte, then their bytes in order
+//   BOX_HUB_FRAME_OFFSETS       per sensor 2 bytes, the us from a scan's time to
+//                               when the hub triggered that sensor, for the
+//                               motion frames after it; before each periodic
+//                               keyframe
+//   BOX_HUB_FRAME_STATUS        box_hub_status_t, 2 bytes a field, once a
+//                               second before a periodic keyframe
+//
+// A delta only means something on top of the frame just before it, so once
+// one is missing the receiving end waits for the next keyframe; the hub
+// sends one every so often, and whenever a delta would be no smaller.
+
+#ifndef __BOX_HUB_FRAME_H__
+#define __BOX_HUB_FRAME_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BOX_HUB_FRAME_VERSION       1
+#define BOX_HUB_FRAME_MOTION        1
+#define BOX_HUB_FRAME_MOTION_DELTA  2
+#define BOX_HUB_FRAME_OFFSETS       3
+#define BOX_HUB_FRAME_STATUS        4
+
+#define BOX_HUB_FRAME_HEADER_SIZE   8
+#define BOX_HUB_FRAME_CRC_SIZE      2
+#define BOX_HUB_FRAME_MAX_DATA      128
+#define BOX_HUB_FRAME_MAX_RAW       (BOX_HUB_FRAME_HEADER_SIZE + BOX_HUB_FRAME_MAX_DATA + BOX_HUB_FRAME_CRC_SIZE)
+// one COBS code byte per 254, and the 0 at the end
+#define BOX_HUB_FRAME_MAX_ENCODED   (BOX_HUB_FRAME_MAX_RAW + BOX_HUB_FRAME_MAX_RAW / 254 + 2)
+
+#define BOX_HUB_STATUS_SIZE         8
+
+#define BOX_HUB_FRAME_BAD           -1      // from box_hub_frame_decode()
+#define BOX_HUB_FRAME_CRC_ERROR     -2
+
+#define BOX_HUB_NO_REPLY            255     // a sensor byte from a node that did not answer
+#define BOX_HUB_TILT                0x80
+
+
+typedef struct
+{
+    uint8_t type;
+    uint16_t sequence;
+    uint32_t time_us;
+    uint8_t length;                         // of data
+    uint8_t data[BOX_HUB_FRAME_MAX_DATA];
+} box_hub_frame_t;
+
+// the receiving end, fed a byte at a time
+typedef struct
+{
+    uint8_t encoded[BOX_HUB_FRAME_MAX_ENCODED];
+    int length;                             // -1 while skipping to the next 0
+    int synced;                             // a frame came in, the sequence counts
+    uint16_t next_sequence;
+    unsigned long frames;
+    unsigned long crc_errors;
+    unsigned long bad;                      // too long, badly stuffed, too short or another version
+    unsigned long lost;                     // frames missing from the sequence
+} box_hub_reader_t;
+
+// the motion data as the frames so far have it, at either end
+typedef struct
+{
+    uint8_t data[BOX_HUB_FRAME_MAX_DATA];
+    int length;                             // 0 until a keyframe
+    uint16_t sequence;                      // of the last frame applied
+    uint32_t time_us;
+    unsigned long keyframes;
+    unsigned long deltas;
+    unsigned long skipped;                  // deltas without the frame before, or inconsistent
+} box_hub_motion_t;
+
+// how the hub's sending went over the last second
+typedef struct
+{
+    uint16_t scans;
+    uint16_t frames;                        // motion frames sent
+    uint16_t unsent;                        // scans not sent, the link still busy
+    uint16_t backlog_max;                   // the most bytes waiting to go out
+} box_hub_status_t;
+
+
+uint16_t box_hub_crc16(const uint8_t *data, size_t n);
+size_t box_hub_cobs_encode(const uint8_t *in, size_t n, uint8_t *out);
+size_t box_hub_cobs_decode(const uint8_t *in, size_t n, uint8_t *out);    // 0 if badly stuffed
+
+size_t box_hub_frame_encode(const box_hub_frame_t *frame, uint8_t *out);  // with the 0, at most MAX_ENCODED
+int box_hub_frame_decode(const uint8_t *encoded, size_t n, box_hub_frame_t *frame);    // 0 if good
+
+void box_hub_reader_init(box_hub_reader_t *reader);
+int box_hub_reader_push(box_hub_reader_t *reader, uint8_t byte, box_hub_frame_t *frame);
+
+void box_hub_motion_frame(box_hub_motion_t *motion, const uint8_t *data, int length, int keyframe,
+                          box_hub_frame_t *frame);
+int box_hub_motion_apply(box_hub_motion_t *motion, const box_hub_frame_t *frame);
+
+void box_hub_offsets_frame(const uint16_t *offset_us, int n, box_hub_frame_t *frame);
+int box_hub_offsets_read(const box_hub_frame_t *frame, uint16_t *offset_us, int max);
+
+void box_hub_status_frame(const box_hub_status_t *status, box_hub_frame_t *frame);
+int box_hub_status_read(const box_hub_frame_t *frame, box_hub_status_t *status);    // 0 if good
+
+// a sensor byte as the level the renderer draws, 0..127
+static inline uint8_t box_hub_level(uint8_t value)
+{
+    return value == BOX_HUB_NO_REPLY ? 0 : value & ~BOX_HUB_TILT;
+}
+
+static inline int box_hub_tilted(uint8_t value)
+{
+    return value != BOX_HUB_NO_REPLY && (value & BOX_HUB_TILT) != 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BOX_HUB_FRAME_H__ */
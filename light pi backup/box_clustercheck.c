@@ -0,0 +1,303 @@
+/*
+ * box_clustercheck.c
+ *
+ * Loopback check for cluster rendering, see cluster.h.  Starts one leader
+ * and n followers of the renderer on this machine, all headless, with the
+ * followers splitting the strips between them, and sends the leader scene
+ * changes and taps over UDP so every scene gets drawn.  The leader checks
+ * each follower's slice against the same strips of its own frame; this adds
+ * up the leader's cluster lines and fails unless slices were compared and
+ * none differed, or a node exits early.
+ *
+ *   box_clustercheck [-n followers] [-t seconds] [-m group:port] [-u udp_port]
+ *                    [-S scenes] [-s strips] renderer [renderer options]
+ *
+ * The renderer options go to every node, e.g. -l box.layout.  With a
+ * layout the followers' slices end on universe boundaries, as a node
+ * refuses a slice that splits a universe.  The followers' output is
+ * dropped, the leader's cluster lines are printed.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "input.h"
+#include "udp_input.h"
+#include "cluster.h"
+#include "layout.h"
+
+#define CHECK_FOLLOWERS_DEFAULT  3
+#define CHECK_SECONDS_DEFAULT    24
+#define CHECK_SCENES_DEFAULT     12      // the renderer's N_SCENES
+#define CHECK_STRIPS_DEFAULT     23      // and N_STRIPS
+#define CHECK_UDP_PORT_DEFAULT   7779    // not the renderer's default, to keep clear of a live one
+#define CHECK_EVENT_MS           200     // between scene and tap datagrams
+#define CHECK_MAX_FOLLOWERS      16
+#define CHECK_MAX_ARGS           64
+
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static pid_t start_node(char *const *argv, int out_fd)
+{
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        dup2(out_fd, STDOUT_FILENO);
+        execvp(argv[0], argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+    return pid;
+}
+
+// the scene, and a tap on a strip so the tap driven scenes have something
+static void send_events(int fd, const struct sockaddr_in *to, int scene, int n_strips)
+{
+    uint8_t datagram[UDP_INPUT_HEADER_SIZE + 2 * UDP_INPUT_RECORD_SIZE] = {
+        UDP_INPUT_MAGIC_0, UDP_INPUT_MAGIC_1, UDP_INPUT_VERSION, 2,
+        INPUT_EVENT_SCENE, 0, scene, 0,
+        INPUT_EVENT_TAP, rand() % n_strips, 40 + rand() % 88, 0,
+    };
+
+    sendto(fd, datagram, sizeof(datagram), 0, (const struct sockaddr *)to, sizeof(*to));
+}
+
+// 1 if some universe has strips on both sides of the cut before strip cut
+static int cuts_universe(const layout_t *layout, int cut)
+{
+    const layout_universe_t *universe;
+    int i, j, before;
+
+    for (i = 0; i < layout->n_universes; i++) {
+        universe = &layout->universe[i];
+        before = 0;
+        for (j = 0; j < universe->n_strips; j++) {
+            before += universe->strip[j] < cut;
+        }
+        if (before > 0 && before < universe->n_strips) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// moves an even split of the strips to the nearest cuts that keep every
+// universe on one follower; -1 if there are not enough such cuts
+static int split_strips(const layout_t *layout, int n_strips, int n_followers, int *cuts)
+{
+    int i, d;
+
+    cuts[0] = 0;
+    cuts[n_followers] = n_strips;
+    for (i = 1; i < n_followers; i++) {
+        cuts[i] = n_strips * i / n_followers;
+        for (d = 0; d < n_strips; d++) {
+            if (cuts[i] - d > cuts[i - 1] && !cuts_universe(layout, cuts[i] - d)) {
+                cuts[i] -= d;
+                break;
+            }
+            if (cuts[i] + d < n_strips && !cuts_universe(layout, cuts[i] + d)) {
+                cuts[i] += d;
+                break;
+            }
+        }
+        if (d == n_strips || cuts[i] <= cuts[i - 1]) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-n followers] [-t seconds] [-m group:port] [-u udp_port] [-S scenes] [-s strips]\n"
+            "       renderer [renderer options]\n", name);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    int n_followers = CHECK_FOLLOWERS_DEFAULT, seconds = CHECK_SECONDS_DEFAULT, n_scenes = CHECK_SCENES_DEFAULT;
+    int n_strips = CHECK_STRIPS_DEFAULT, udp_port = CHECK_UDP_PORT_DEFAULT;
+    char group[64], slice[CHECK_MAX_FOLLOWERS][24], port[16], line[512];
+    char *node_argv[CHECK_MAX_ARGS];
+    int cuts[CHECK_MAX_FOLLOWERS + 1];
+    layout_t layout;
+    pid_t pids[CHECK_MAX_FOLLOWERS + 1];
+    struct sockaddr_in to;
+    struct pollfd pfd;
+    unsigned long frames, reports, compared, mismatches;
+    unsigned long total_frames = 0, total_reports = 0, total_compared = 0, total_mismatches = 0;
+    long long skew_max, total_skew_max = 0;
+    int64_t start, next_event;
+    int fds[2], null_fd, udp_fd, opt, n_args, n_pids = 0, used = 0, len, died = 0, status, i;
+    pid_t pid;
+    char *nl;
+
+    snprintf(group, sizeof(group), "%s:%i@127.0.0.1", CLUSTER_GROUP_DEFAULT, CLUSTER_PORT_DEFAULT + 10);
+    while ((opt = getopt(argc, argv, "+n:t:m:u:S:s:")) != -1) {
+        switch (opt) {
+        case 'n':
+            n_followers = atoi(optarg);
+            break;
+        case 't':
+            seconds = atoi(optarg);
+            break;
+        case 'm':
+            snprintf(group, sizeof(group), "%s@127.0.0.1", optarg);
+            break;
+        case 'u':
+            udp_port = atoi(optarg);
+            break;
+        case 'S':
+            n_scenes = atoi(optarg);
+            break;
+        case 's':
+            n_strips = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind >= argc || n_followers < 1 || n_followers > CHECK_MAX_FOLLOWERS || n_followers > n_strips ||
+        seconds < 1 || n_scenes < 1 || argc - optind + 8 >= CHECK_MAX_ARGS) {
+        usage(argv[0]);
+    }
+
+    // the layout the nodes will load, if any, for where the slices may end
+    layout_init(&layout);
+    for (i = optind + 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "-l") == 0 && layout_load(&layout, argv[i + 1]) < 0) {
+            return 1;
+        }
+    }
+    if (split_strips(&layout, n_strips, n_followers, cuts) < 0) {
+        fprintf(stderr, "%i strips do not split between %i followers on universe boundaries\n", n_strips, n_followers);
+        return 1;
+    }
+
+    null_fd = open("/dev/null", O_WRONLY);
+    udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (null_fd < 0 || udp_fd < 0 || pipe(fds) < 0) {
+        perror("setup");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    // followers first, so they are listening for the leader's first clock;
+    // node_argv is renderer -x -c role -m group, -s or -u, then the options
+    node_argv[0] = argv[optind];
+    node_argv[1] = "-x";
+    node_argv[2] = "-c";
+    node_argv[4] = "-m";
+    node_argv[5] = group;
+    for (i = optind + 1; i < argc; i++) {
+        node_argv[8 + i - optind - 1] = argv[i];
+    }
+    n_args = 8 + argc - optind - 1;
+    node_argv[n_args] = NULL;
+
+    node_argv[3] = "follower";
+    node_argv[6] = "-s";
+    for (i = 0; i < n_followers; i++) {
+        snprintf(slice[i], sizeof(slice[i]), "%i-%i", cuts[i], cuts[i + 1] - 1);
+        node_argv[7] = slice[i];
+        pids[n_pids++] = start_node(node_argv, null_fd);
+    }
+    usleep(500000);
+
+    snprintf(port, sizeof(port), "%i", udp_port);
+    node_argv[3] = "leader";
+    node_argv[6] = "-u";
+    node_argv[7] = port;
+    pids[n_pids++] = start_node(node_argv, fds[1]);
+    close(fds[1]);
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+    printf("leader and %i followers of %s on %s, %i scenes over %i s\n", n_followers, argv[optind], group, n_scenes,
+           seconds);
+    memset(&to, 0, sizeof(to));
+    to.sin_family = AF_INET;
+    to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    to.sin_port = htons(udp_port);
+
+    srand(1);
+    start = next_event = now_ms();
+    pfd.fd = fds[0];
+    pfd.events = POLLIN;
+    while (now_ms() - start < seconds * 1000LL && !died) {
+        if (now_ms() >= next_event) {
+            send_events(udp_fd, &to, (now_ms() - start) * n_scenes / (seconds * 1000LL), n_strips);
+            next_event += CHECK_EVENT_MS;
+        }
+        poll(&pfd, 1, CHECK_EVENT_MS / 4);
+
+        len = read(fds[0], line + used, sizeof(line) - 1 - used);
+        if (len > 0) {
+            used += len;
+        } else if (len == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            died = 1;    // the leader closed its output
+        }
+        line[used] = 0;
+        while ((nl = strchr(line, '\n')) != NULL) {
+            *nl = 0;
+            if (sscanf(line, "cluster: %lu frames, %lu reports, skew avg %*d us max %lld us, %lu slices compared, "
+                       "%lu mismatches", &frames, &reports, &skew_max, &compared, &mismatches) == 5) {
+                printf("%s\n", line);
+                total_frames += frames;
+                total_reports += reports;
+                total_compared += compared;
+                total_mismatches += mismatches;
+                total_skew_max = skew_max > total_skew_max ? skew_max : total_skew_max;
+            }
+            used -= nl + 1 - line;
+            memmove(line, nl + 1, used + 1);
+        }
+        if (used == sizeof(line) - 1) {
+            used = 0;    // no line that long is ours
+        }
+
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            fprintf(stderr, "node %i exited early, status %i\n", (int)pid, status);
+            for (i = 0; i < n_pids; i++) {
+                pids[i] = pids[i] == pid ? 0 : pids[i];
+            }
+            died = 1;
+        }
+    }
+
+    for (i = 0; i < n_pids; i++) {
+        if (pids[i] > 0) {
+            kill(pids[i], SIGTERM);
+            waitpid(pids[i], NULL, 0);
+        }
+    }
+
+    printf("cluster: %lu frames, %lu reports, skew max %lli us, %lu slices compared, %lu mismatches%s\n",
+           total_frames, total_reports, total_skew_max, total_compared, total_mismatches,
+           died ? ", a node exited early" : "");
+    close(udp_fd);
+    close(null_fd);
+    close(fds[0]);
+
+    return died || total_compared == 0 || total_mismatches > 0 ? 1 : 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * box_exprbench.c
+ *
+ * Benchmarks a pattern expression against the hand written C it replaces.
+ * Renders BLUE_PLASMA both ways over the installation's strips with moving
+ * time and random tap levels, checks the frames are identical and reports
+ * the time per frame of each.
+ *
+ *   box_exprbench [-n frames] [-e expression file] <layout file>
+ *
+ * The expression defaults to scenes/plasma.expr.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "box_fixmath.h"
+#include "layout.h"
+#include "expr.h"
+
+#define BENCH_FRAMES_DEFAULT   2000
+#define BENCH_SPACE_SCALE      50
+
+
+static const char *const uniform_names[] = {"t", "t1", "t2", "t3", "scale"};
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// BluePlasmaField() and RedLevelOverlay() from the renderer at full quality
+static void plasma_c(const layout_t *layout, uint16_t tpos1, uint16_t tpos2, uint16_t tpos3, int space_scale,
+                     const int *red_levels, uint32_t *matrix)
+{
+    const layout_strip_t *strip;
+    uint16_t z, r, g, b, pos1, pos2, pos3;
+    int s, led, x = 0;
+
+    for (s = 0; s < layout->n_strips; s++) {
+        strip = &layout->strip[s];
+        for (led = 0; led < strip->length; led++, x++) {
+            z = strip->length - led;
+            pos1 = ((-strip->x + strip->y + z) * 10 * space_scale) >> 6;
+            pos2 = ((strip->x - strip->y + z) * 6 * space_scale) >> 6;
+            pos3 = ((strip->x + strip->y - z) * 8 * space_scale) >> 6;
+            r = fastCosineCalc((pos1 + (tpos3 >> 1) + fastCosineCalc(tpos2 + pos2)));
+            g = fastCosineCalc((tpos1 + pos2 + fastCosineCalc((-(tpos3 >> 2) + pos3))));
+            b = fastCosineCalc((tpos2 + pos3 + fastCosineCalc((tpos1 + pos1))));
+            r = fx_mul(fx_wave_to_u8(r), red_levels[s], 10);
+            g = fx_wave_to_u8(g);
+            b = fx_wave_to_u8(b);
+            matrix[x] = (r << 16) + (g << 8) + b;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const char *expr_file = "scenes/plasma.expr";
+    int lengths[LAYOUT_MAX_STRIPS], xs[LAYOUT_MAX_STRIPS], ys[LAYOUT_MAX_STRIPS];
+    int red_levels[LAYOUT_MAX_STRIPS];
+    int32_t t[3] = {0, 0, 0}, uniforms[5];
+    uint32_t *reference, *compiled;
+    int64_t c_ns = 0, expr_ns = 0, start;
+    expr_prog_t prog;
+    expr_leds_t leds;
+    layout_t layout;
+    int frames = BENCH_FRAMES_DEFAULT;
+    int opt, frame, i, bad = 0;
+
+    while ((opt = getopt(argc, argv, "e:n:")) != -1) {
+        switch (opt) {
+        case 'e':
+            expr_file = optarg;
+            break;
+        case 'n':
+            frames = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n frames] [-e expression file] <layout file>\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "usage: %s [-n frames] [-e expression file] <layout file>\n", argv[0]);
+        return 1;
+    }
+
+    if (layout_load(&layout, argv[optind]) < 0 || layout_check(&layout) < 0 || layout.n_strips == 0) {
+        fprintf(stderr, "%s: no strips\n", argv[optind]);
+        return 1;
+    }
+    if (expr_load(&prog, expr_file, uniform_names, 5) < 0) {
+        fprintf(stderr, "%s: %s\n", expr_file, prog.error);
+        return 1;
+    }
+    for (i = 0; i < layout.n_strips; i++) {
+        lengths[i] = layout.strip[i].length;
+        xs[i] = layout.strip[i].x;
+        ys[i] = layout.strip[i].y;
+    }
+    if (expr_leds_init(&leds, layout.n_strips, lengths, xs, ys) < 0) {
+        return 1;
+    }
+    if (expr_prepare(&prog, &leds) < 0) {
+        return 1;
+    }
+    reference = calloc(layout.n_leds, sizeof(*reference));
+    compiled = calloc(layout.n_leds, sizeof(*compiled));
+
+    srand(1);
+    for (frame = 0; frame < frames; frame++) {
+        // plasma's default speeds and time scale
+        t[0] += 57 * 50;
+        t[1] += -91 * 50;
+        t[2] += 61 * 50;
+        uniforms[0] = frame;
+        uniforms[1] = fastCosineCalc(t[0] >> 10);
+        uniforms[2] = fastCosineCalc(t[1] >> 10);
+        uniforms[3] = fastCosineCalc(t[2] >> 10);
+        uniforms[4] = BENCH_SPACE_SCALE;
+        for (i = 0; i < layout.n_strips; i++) {
+            red_levels[i] = rand() % 1025;
+        }
+
+        start = now_ns();
+        plasma_c(&layout, uniforms[1], uniforms[2], uniforms[3], BENCH_SPACE_SCALE, red_levels, reference);
+        c_ns += now_ns() - start;
+
+        start = now_ns();
+        expr_leds_set_strip(&leds, EXPR_IN_TAP, red_levels);
+        expr_run(&prog, &leds, uniforms, 0, layout.n_leds, compiled);
+        expr_ns += now_ns() - start;
+
+        for (i = 0; i < layout.n_leds; i++) {
+            if (reference[i] != compiled[i]) {
+                if (bad == 0) {
+                    printf("frame %i led %i: C %06x, expression %06x\n", frame, i, reference[i], compiled[i]);
+                }
+                bad++;
+            }
+        }
+    }
+
+    printf("%s: %i instructions, %i static, %i registers, %i frames of %i LEDs, %i mismatches\n",
+           expr_file, prog.n_code, prog.n_static_code, prog.n_regs, frames, layout.n_leds, bad);
+    printf("C:          %.2f us per frame\n", c_ns / 1000.0 / frames);
+    printf("expression: %.2f us per frame (%.2fx)\n", expr_ns / 1000.0 / frames, (double)expr_ns / c_ns);
+
+    expr_free(&prog);
+    expr_leds_free(&leds);
+    free(reference);
+    free(compiled);
+
+    return bad ? 1 : 0;
+}
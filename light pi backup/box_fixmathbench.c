@@ -0,0 +1,124 @@
+/*
+ * box_fixmathbench.c
+ *
+ * Times fastCosineCalc() and measures its error against cos() for the
+ * table box_fixmath.c was built with, and checks the generated gamma table
+ * against pow().  The table shape is chosen at compile time, so each build
+ * measures one; -h prints the column names.  Every shape, from the
+ * renderer's directory:
+ *
+ *   ./box_fixmathbench -h
+ *   for bits in 8 9 10 11; do for lerp in 0 1; do for amp in 8 11; do
+ *     cc -O2 -DFIXMATH_COS_BITS=$bits -DFIXMATH_COS_LERP=$lerp -DFIXMATH_COS_AMP_BITS=$amp \
+ *        -I../libraries/box_fixmath -o box_fixmathbench box_fixmathbench.c \
+ *        ../libraries/box_fixmath/box_fixmath.c -lm && ./box_fixmathbench
+ *   done; done; done
+ *
+ *   box_fixmathbench [-h] [-n calls]
+ *
+ * Exits 1 if a gamma entry is more than BENCH_GAMMA_TOLERANCE from pow().
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+#include "box_fixmath.h"
+
+#define BENCH_CALLS_DEFAULT    (1 << 26)
+#define BENCH_GAMMA_TOLERANCE  3       // box_fixmath.c's claim for gamma 2..3
+
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// phases stepped by an odd amount, as the scenes' time and space terms do,
+// so every entry and both ends of each lerp are visited
+static double cosine_ns(long calls, uint32_t *sum)
+{
+    uint16_t phase = 0;
+    int64_t start;
+    long i;
+
+    *sum = 0;
+    start = now_ns();
+    for (i = 0; i < calls; i++) {
+        *sum += fastCosineCalc(phase);
+        phase += 377;
+    }
+    return (double)(now_ns() - start) / calls;
+}
+
+// against the wave the API promises, 2047 at phase 0, over every phase
+static double cosine_max_error(double *mean)
+{
+    double want, error, worst = 0.0, total = 0.0;
+    int phase;
+
+    for (phase = 0; phase <= FX_PHASE_MASK; phase++) {
+        want = FX_PHASE_MASK / 2.0 * (1.0 + cos(2.0 * M_PI * phase / (FX_PHASE_MASK + 1)));
+        error = fabs(fastCosineCalc(phase) - want);
+        worst = error > worst ? error : worst;
+        total += error;
+    }
+    *mean = total / (FX_PHASE_MASK + 1);
+    return worst;
+}
+
+static int gamma_max_error(void)
+{
+    int i, want, error, worst = 0;
+
+    for (i = 0; i < 256; i++) {
+        want = (int)(255.0 * pow(i / 255.0, FIXMATH_GAMMA) + 0.5);
+        error = abs(fx_gamma(i) - want);
+        worst = error > worst ? error : worst;
+    }
+    return worst;
+}
+
+int main(int argc, char *argv[])
+{
+    long calls = BENCH_CALLS_DEFAULT;
+    double ns, worst, mean;
+    uint32_t sum;
+    int opt, gamma_error;
+
+    while ((opt = getopt(argc, argv, "hn:")) != -1) {
+        switch (opt) {
+        case 'h':
+            printf("%4s %4s %4s %6s %8s %10s %10s %6s %6s\n", "bits", "amp", "lerp", "bytes", "ns/call", "max error",
+                   "mean error", "gamma", "error");
+            return 0;
+        case 'n':
+            calls = atol(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-h] [-n calls]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (calls <= 0) {
+        fprintf(stderr, "usage: %s [-h] [-n calls]\n", argv[0]);
+        return 1;
+    }
+
+    cosine_ns(calls / 16, &sum);    // warm up
+    ns = cosine_ns(calls, &sum);
+    worst = cosine_max_error(&mean);
+    gamma_error = gamma_max_error();
+
+    // sum printed so the calls aren't optimised away
+    printf("%4i %4i %4i %6zu %8.3f %10.2f %10.2f %6.2f %6i%s  (%u)\n", FIXMATH_COS_BITS, FIXMATH_COS_AMP_BITS,
+           FIXMATH_COS_LERP, sizeof(fx_cos_table), ns, worst, mean, FIXMATH_GAMMA, gamma_error,
+           gamma_error > BENCH_GAMMA_TOLERANCE ? " OVER" : "", sum);
+    return gamma_error > BENCH_GAMMA_TOLERANCE;
+}
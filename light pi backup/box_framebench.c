@@ -0,0 +1,394 @@
+/*
+ * box_framebench.c
+ *
+ * Checks and times the hub frames, see box_hub_frame.h.  A status frame
+ * has to read back as it was made, and COBS and whole frames of random
+ * data, heavy in 0s and 255s, go through and come back the same; then a stream of frames is damaged at random, a bit flipped, a
+ * byte dropped or added, a 0 put in or the 0 between two frames lost, and
+ * the reader has to take every frame that was left alone and next to none
+ * that was not; then random bytes, from which nothing should come.  Motion
+ * packets that change a few sensors at a time go as keyframes and deltas
+ * with frames lost on the way, and every packet the Pi's end makes of them
+ * has to be the one the hub had.  The hub's clock, drifting and wrapping,
+ * is mapped onto ours from frames that come in late by anything up to
+ * 20 ms, and has to land within CLOCK_ERROR_US of when each frame left;
+ * then the hub starts over.  Last the reader is timed on a stream of
+ * motion frames as the hub sends them.
+ *
+ *   box_framebench [-n frames] [-S seed]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "box_hub_frame.h"
+#include "hubclock.h"
+
+#define BENCH_FRAMES_DEFAULT   50000
+#define BENCH_MOTION_SIZE      31      // the scene and 30 sensors, as mot_sense_hub_3 sends
+#define BENCH_DAMAGE_SHARE     4       // one frame in, of the fuzzed stream
+#define BENCH_GARBAGE_BYTES    (16 << 20)
+#define BENCH_TIMED_PASSES     20
+#define BENCH_KEYFRAME_FRAMES  32      // as mot_sense_hub_3
+#define BENCH_LOSS_SHARE       50      // frames lost, one in
+
+#define CLOCK_SECONDS          300
+#define CLOCK_SETTLE_SECONDS   20      // before the mapping is checked
+#define CLOCK_FRAME_US         2500
+#define CLOCK_DRIFT            -80e-6  // the hub's crystal against ours
+#define CLOCK_WIRE_US          1800    // the least a frame takes
+#define CLOCK_LATE_SHARE       10      // frames held up by up to 20 ms, one in
+#define CLOCK_ERROR_US         100
+
+#define DAMAGE_FLIP            0
+#define DAMAGE_DROP            1
+#define DAMAGE_ADD             2
+#define DAMAGE_ZERO            3
+#define DAMAGE_DELIMITER       4
+#define DAMAGE_KINDS           5
+
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// mostly anything, with runs of 0 and of 255 now and then
+static uint8_t random_byte(void)
+{
+    switch (rand() % 8) {
+    case 0:
+        return 0;
+    case 1:
+        return 255;
+    default:
+        return rand();
+    }
+}
+
+static void random_frame(box_hub_frame_t *frame, uint16_t sequence, int length)
+{
+    int i;
+
+    frame->type = BOX_HUB_FRAME_MOTION;
+    frame->sequence = sequence;
+    frame->time_us = (uint32_t)rand() << 16 ^ rand();
+    frame->length = length;
+    for (i = 0; i < length; i++) {
+        frame->data[i] = random_byte();
+    }
+}
+
+static int same_frame(const box_hub_frame_t *a, const box_hub_frame_t *b)
+{
+    return a->type == b->type && a->sequence == b->sequence && a->time_us == b->time_us &&
+           a->length == b->length && memcmp(a->data, b->data, a->length) == 0;
+}
+
+// COBS of every length up to a few runs of 254, of 0s, of non-0s and mixed
+static int check_status(void)
+{
+    box_hub_status_t status = {400, 362, 38, 0xab01}, back;
+    box_hub_frame_t frame;
+
+    box_hub_status_frame(&status, &frame);
+    if (box_hub_status_read(&frame, &back) != 0) {
+        return 1;
+    }
+    return memcmp(&status, &back, sizeof(status)) != 0;
+}
+
+static int check_cobs(void)
+{
+    uint8_t in[1024], encoded[1024 + 8], out[1024 + 8];
+    size_t n, e, d;
+    int kind, bad = 0;
+
+    for (n = 1; n < 800; n++) {
+        for (kind = 0; kind < 3; kind++) {
+            memset(in, 0, n);
+            for (e = 0; e < n; e++) {
+                in[e] = kind == 0 ? 0 : kind == 1 ? 1 + rand() % 255 : random_byte();
+            }
+            e = box_hub_cobs_encode(in, n, encoded);
+            d = box_hub_cobs_decode(encoded, e, out);
+            bad += e > n + n / 254 + 1 || memchr(encoded, 0, e) != NULL || d != n || memcmp(in, out, n) != 0;
+        }
+    }
+    return bad;
+}
+
+static int check_round_trip(int frames)
+{
+    uint8_t encoded[BOX_HUB_FRAME_MAX_ENCODED];
+    box_hub_frame_t frame, back;
+    box_hub_reader_t reader;
+    size_t n, i;
+    int f, got, bad = 0;
+
+    box_hub_reader_init(&reader);
+    box_hub_reader_push(&reader, 0, &back);
+    for (f = 0; f < frames; f++) {
+        random_frame(&frame, f, rand() % (BOX_HUB_FRAME_MAX_DATA + 1));
+        n = box_hub_frame_encode(&frame, encoded);
+        got = 0;
+        for (i = 0; i < n; i++) {
+            got += box_hub_reader_push(&reader, encoded[i], &back);
+        }
+        bad += n > BOX_HUB_FRAME_MAX_ENCODED || got != 1 || !same_frame(&frame, &back);
+    }
+    bad += reader.frames != (unsigned long)frames || reader.lost != 0 || reader.crc_errors != 0 || reader.bad != 0;
+    return bad;
+}
+
+// the stream with one frame in BENCH_DAMAGE_SHARE damaged; frames are kept
+// by sequence to know what came back
+static int check_damaged(int frames, unsigned long *false_accepts)
+{
+    uint8_t encoded[BOX_HUB_FRAME_MAX_ENCODED + 1];
+    box_hub_frame_t *sent = malloc(frames * sizeof(*sent)), back;
+    uint8_t *damaged = calloc(frames + 1, 1), *received = calloc(frames, 1);
+    unsigned long kinds[DAMAGE_KINDS] = {0};
+    box_hub_reader_t reader;
+    int f, i, n, at, kind, missed = 0, expected = 0;
+
+    box_hub_reader_init(&reader);
+    box_hub_reader_push(&reader, 0, &back);
+    *false_accepts = 0;
+    for (f = 0; f < frames; f++) {
+        random_frame(&sent[f], f, BENCH_MOTION_SIZE + rand() % 8);
+        n = box_hub_frame_encode(&sent[f], encoded);
+        if (rand() % BENCH_DAMAGE_SHARE == 0) {
+            kind = rand() % DAMAGE_KINDS;
+            at = rand() % (n - 1);    // not the 0 at the end, but for DAMAGE_DELIMITER
+            switch (kind) {
+            case DAMAGE_FLIP:
+                encoded[at] ^= 1 << rand() % 8;
+                break;
+            case DAMAGE_DROP:
+                memmove(encoded + at, encoded + at + 1, n - at - 1);
+                n--;
+                break;
+            case DAMAGE_ADD:
+                memmove(encoded + at + 1, encoded + at, n - at);
+                encoded[at] = 1 + rand() % 255;
+                n++;
+                break;
+            case DAMAGE_ZERO:
+                encoded[at] = 0;
+                break;
+            case DAMAGE_DELIMITER:
+                n--;
+                damaged[f + 1] = 1;    // goes down with this one
+                break;
+            }
+            damaged[f] = 1;
+            kinds[kind]++;
+        }
+        for (i = 0; i < n; i++) {
+            if (!box_hub_reader_push(&reader, encoded[i], &back)) {
+                continue;
+            }
+            if (back.sequence < frames && back.sequence <= f && same_frame(&back, &sent[back.sequence]) &&
+                !damaged[back.sequence]) {
+                received[back.sequence] = 1;
+            } else {
+                (*false_accepts)++;
+            }
+        }
+    }
+    for (f = 0; f < frames; f++) {
+        expected += !damaged[f];
+        missed += !damaged[f] && !received[f];
+    }
+    printf("damaged stream   %i frames, %lu flipped, %lu dropped, %lu added, %lu zeroed, %lu merged\n", frames,
+           kinds[DAMAGE_FLIP], kinds[DAMAGE_DROP], kinds[DAMAGE_ADD], kinds[DAMAGE_ZERO], kinds[DAMAGE_DELIMITER]);
+    printf("                 %lu read, %i of %i whole ones missed, %lu damaged ones taken, "
+           "%lu lost by sequence, %lu crc errors, %lu bad\n", reader.frames, missed, expected, *false_accepts,
+           reader.lost, reader.crc_errors, reader.bad);
+    free(sent);
+    free(damaged);
+    free(received);
+    return missed;
+}
+
+static void check_garbage(size_t n)
+{
+    box_hub_reader_t reader;
+    box_hub_frame_t back;
+    unsigned long taken = 0;
+    size_t i;
+
+    box_hub_reader_init(&reader);
+    for (i = 0; i < n; i++) {
+        taken += box_hub_reader_push(&reader, rand(), &back);
+    }
+    printf("random bytes     %zu MB, %lu frames taken, %lu crc errors, %lu bad\n", n >> 20, taken,
+           reader.crc_errors, reader.bad);
+}
+
+// a hub where a sensor changes one frame in 16 and is 0 most of the time
+static int check_motion(int frames)
+{
+    uint8_t packet[BENCH_MOTION_SIZE], encoded[BOX_HUB_FRAME_MAX_ENCODED];
+    box_hub_motion_t sent, got;
+    box_hub_reader_t reader;
+    box_hub_frame_t frame, back;
+    unsigned long bytes[2] = {0, 0};
+    int f, i, n, applied = 0, wrong = 0, lost = 0;
+
+    memset(&sent, 0, sizeof(sent));
+    memset(&got, 0, sizeof(got));
+    memset(packet, 0, sizeof(packet));
+    box_hub_reader_init(&reader);
+    box_hub_reader_push(&reader, 0, &back);
+    for (f = 0; f < frames; f++) {
+        packet[0] = f / 1000 % 10;
+        for (i = 1; i < BENCH_MOTION_SIZE; i++) {
+            if (rand() % 16 == 0) {
+                packet[i] = rand() % 4 != 0 ? 0 : rand() % 2 ? rand() % 8 : rand();
+            }
+        }
+        frame.sequence = f;
+        frame.time_us = f * 1000;
+        box_hub_motion_frame(&sent, packet, BENCH_MOTION_SIZE, f % BENCH_KEYFRAME_FRAMES == 0, &frame);
+        n = box_hub_frame_encode(&frame, encoded);
+        bytes[frame.type == BOX_HUB_FRAME_MOTION_DELTA] += n;
+        if (rand() % BENCH_LOSS_SHARE == 0) {
+            lost++;
+            continue;
+        }
+        for (i = 0; i < n; i++) {
+            if (box_hub_reader_push(&reader, encoded[i], &back) && box_hub_motion_apply(&got, &back)) {
+                applied++;
+                wrong += got.length != BENCH_MOTION_SIZE || memcmp(got.data, packet, BENCH_MOTION_SIZE) != 0;
+            }
+        }
+    }
+    printf("motion           %i frames, %lu keyframes of %.1f bytes, %lu deltas of %.1f, %i lost\n", frames,
+           sent.keyframes, sent.keyframes ? (double)bytes[0] / sent.keyframes : 0.0, sent.deltas,
+           sent.deltas ? (double)bytes[1] / sent.deltas : 0.0, lost);
+    printf("                 %i applied, %lu deltas skipped, %i wrong\n", applied, got.skipped, wrong);
+    return wrong;
+}
+
+static int check_clock(void)
+{
+    hubclock_t clock;
+    uint32_t hub = 0xffffffffu - 60000000u;    // wraps a minute in
+    int64_t sent, error, worst = 0;
+    uint64_t pi;
+    double drift;
+    int f, frames = CLOCK_SECONDS * 1000000 / CLOCK_FRAME_US, wrong;
+
+    hubclock_init(&clock);
+    for (f = 0; f < frames; f++, hub += CLOCK_FRAME_US) {
+        sent = 1000000000 + (int64_t)((double)f * CLOCK_FRAME_US * (1 + CLOCK_DRIFT));
+        pi = sent + CLOCK_WIRE_US + (rand() % CLOCK_LATE_SHARE ? rand() % 500 : rand() % 20000);
+        hubclock_add(&clock, hub, pi);
+        if (f * (int64_t)CLOCK_FRAME_US >= CLOCK_SETTLE_SECONDS * 1000000LL) {
+            error = (int64_t)hubclock_to_pi(&clock, hub) - (sent + CLOCK_WIRE_US);
+            error = error < 0 ? -error : error;
+            worst = error > worst ? error : worst;
+        }
+    }
+    drift = clock.drift;
+    hubclock_add(&clock, 1000, pi + CLOCK_FRAME_US);
+    wrong = worst > CLOCK_ERROR_US || drift < CLOCK_DRIFT - 2e-6 || drift > CLOCK_DRIFT + 2e-6 ||
+            clock.restarts != 1;
+
+    printf("hub clock        %i s at %.0f ppm, drift %.1f ppm, mapped within %lli us, %lu restarts\n",
+           CLOCK_SECONDS, CLOCK_DRIFT * 1e6, drift * 1e6, (long long)worst, clock.restarts);
+    return wrong;
+}
+
+static void time_reader(int frames)
+{
+    size_t size = (size_t)frames * BOX_HUB_FRAME_MAX_ENCODED, n = 0, i;
+    uint8_t *stream = malloc(size);
+    box_hub_reader_t reader;
+    box_hub_frame_t frame;
+    int64_t start, encode_ns, decode_ns = 0;
+    unsigned long read = 0;
+    int f, pass;
+
+    random_frame(&frame, 0, BENCH_MOTION_SIZE);
+    start = now_ns();
+    for (f = 0; f < frames; f++) {
+        frame.sequence = f;
+        frame.time_us += 1000;
+        n += box_hub_frame_encode(&frame, stream + n);
+    }
+    encode_ns = now_ns() - start;
+
+    for (pass = 0; pass < BENCH_TIMED_PASSES; pass++) {
+        box_hub_reader_init(&reader);
+        start = now_ns();
+        for (i = 0; i < n; i++) {
+            read += box_hub_reader_push(&reader, stream[i], &frame);
+        }
+        decode_ns += now_ns() - start;
+    }
+    printf("motion frames    %zu bytes each, %.1f ns to encode, %.1f ns to read, %.1f MB/s, %lu read\n",
+           n / frames, (double)encode_ns / frames, (double)decode_ns / BENCH_TIMED_PASSES / frames,
+           (double)n * BENCH_TIMED_PASSES * 1e3 / decode_ns, read);
+    free(stream);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long false_accepts;
+    unsigned seed = 1;
+    int frames = BENCH_FRAMES_DEFAULT;
+    int opt, bad = 0, n;
+
+    while ((opt = getopt(argc, argv, "n:S:")) != -1) {
+        switch (opt) {
+        case 'n':
+            frames = atoi(optarg);
+            break;
+        case 'S':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n frames] [-S seed]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (frames <= 0 || frames > 0x10000) {
+        fprintf(stderr, "%s: 1 to 65536 frames, so the sequence does not wrap\n", argv[0]);
+        return 1;
+    }
+    srand(seed);
+
+    if (box_hub_crc16((const uint8_t *)"123456789", 9) != 0x29b1) {
+        printf("crc of \"123456789\" is %04x, not 29b1\n", box_hub_crc16((const uint8_t *)"123456789", 9));
+        bad++;
+    }
+    if (check_status() != 0) {
+        printf("status frame does not read back\n");
+        bad++;
+    }
+    n = check_cobs();
+    printf("cobs             %i of 2397 wrong\n", n);
+    bad += n;
+    n = check_round_trip(frames);
+    printf("round trip       %i frames, %i wrong\n", frames, n);
+    bad += n;
+    bad += check_damaged(frames, &false_accepts);
+    check_garbage(BENCH_GARBAGE_BYTES);
+    bad += check_motion(frames);
+    bad += check_clock();
+    time_reader(frames);
+
+    // one in 65536 damaged frames gets past the CRC, so a few are expected
+    // from a long run; whole frames missed or wrong are not
+    return bad > 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * box_netcheck.c
+ *
+ * Loopback check for the network output.  Sends frames of a known pattern
+ * through netout to 127.0.0.1, receives them on the protocol's port and
+ * checks every header field and pixel, then reports the per-frame packet
+ * building cost.
+ *
+ *   box_netcheck [-a] [-n frames] <layout file>
+ *
+ * -a checks Art-Net instead of the layout's own protocol.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+
+#include "layout.h"
+#include "netout.h"
+
+#define CHECK_FRAMES_DEFAULT   1000
+
+
+static uint32_t pattern(int frame, int led)
+{
+    uint32_t x = frame * 2654435761u ^ led * 40503u;
+
+    x ^= x >> 13;
+    x *= 0x5bd1e995;
+    return (x ^ (x >> 15)) & 0xffffff;
+}
+
+static int get16(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static const layout_universe_t *find_universe(const layout_t *layout, int number)
+{
+    int i;
+
+    for (i = 0; i < layout->n_universes; i++) {
+        if (layout->universe[i].number == number) {
+            return &layout->universe[i];
+        }
+    }
+    return NULL;
+}
+
+static int check_pixels(const layout_t *layout, const layout_universe_t *universe, const uint8_t *data, int frame)
+{
+    const layout_strip_t *strip;
+    uint32_t expect;
+    int s, i;
+
+    for (s = 0; s < universe->n_strips; s++) {
+        strip = &layout->strip[universe->strip[s]];
+        for (i = 0; i < strip->length; i++) {
+            expect = pattern(frame, strip->offset + i);
+            if (data[0] != (uint8_t)(expect >> 16) || data[1] != (uint8_t)(expect >> 8) || data[2] != (uint8_t)expect) {
+                return -1;
+            }
+            data += 3;
+        }
+    }
+    return 0;
+}
+
+// returns 1 for a good data packet, 2 for a good sync packet, -1 otherwise
+static int check_packet(const layout_t *layout, const uint8_t *p, int len, uint8_t sequence, int frame)
+{
+    const layout_universe_t *universe;
+    int slots;
+
+    if (layout->output == LAYOUT_OUTPUT_E131) {
+        if (len < 22 || get16(p) != 0x0010 || memcmp(p + 4, "ASC-E1.17\0\0\0", 12) != 0 || (get16(p + 16) & 0xfff) != len - 16) {
+            return -1;
+        }
+        if (len == NETOUT_E131_SYNC_SIZE && p[21] == 0x08) {
+            return p[44] == sequence && get16(p + 45) == layout->sync_universe ? 2 : -1;
+        }
+        if (len < NETOUT_E131_HEADER_SIZE || p[21] != 0x04 || p[43] != 0x02 || p[111] != sequence || p[117] != 0x02 || p[125] != 0) {
+            return -1;
+        }
+        if (get16(p + 109) != layout->sync_universe || (get16(p + 115) & 0xfff) != len - 115) {
+            return -1;
+        }
+        universe = find_universe(layout, get16(p + 113));
+        slots = get16(p + 123) - 1;
+        if (universe == NULL || slots != universe->pixels * 3 || len != NETOUT_E131_HEADER_SIZE + slots) {
+            return -1;
+        }
+        return check_pixels(layout, universe, p + NETOUT_E131_HEADER_SIZE, frame) == 0 ? 1 : -1;
+    }
+
+    if (len < NETOUT_ARTNET_SYNC_SIZE || memcmp(p, "Art-Net\0", 8) != 0 || get16(p + 10) != 14) {
+        return -1;
+    }
+    if (p[8] == 0x00 && p[9] == 0x52) {
+        return len == NETOUT_ARTNET_SYNC_SIZE ? 2 : -1;
+    }
+    if (p[8] != 0x00 || p[9] != 0x50 || p[12] != sequence || len < NETOUT_ARTNET_HEADER_SIZE) {
+        return -1;
+    }
+    universe = find_universe(layout, p[14] | (p[15] << 8));
+    slots = get16(p + 16);
+    if (universe == NULL || slots != ((universe->pixels * 3 + 1) & ~1) || len != NETOUT_ARTNET_HEADER_SIZE + slots) {
+        return -1;
+    }
+    return check_pixels(layout, universe, p + NETOUT_ARTNET_HEADER_SIZE, frame) == 0 ? 1 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    struct sockaddr_in addr;
+    struct timeval timeout = { 1, 0 };
+    static uint8_t packet[2048];
+    uint32_t *frame_pixels;
+    layout_t layout;
+    netout_t net;
+    int frames = CHECK_FRAMES_DEFAULT;
+    int artnet = 0;
+    int fd, opt, frame, i, n, len, got, bad = 0, lost = 0, syncs = 0;
+
+    while ((opt = getopt(argc, argv, "an:")) != -1) {
+        switch (opt) {
+        case 'a':
+            artnet = 1;
+            break;
+        case 'n':
+            frames = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-a] [-n frames] <layout file>\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "usage: %s [-a] [-n frames] <layout file>\n", argv[0]);
+        return 1;
+    }
+
+    if (layout_load(&layout, argv[optind]) < 0) {
+        return 1;
+    }
+    layout.output = artnet ? LAYOUT_OUTPUT_ARTNET : LAYOUT_OUTPUT_E131;
+    strcpy(layout.target, "127.0.0.1");
+    if (layout_check(&layout) < 0 || layout.n_universes == 0) {
+        fprintf(stderr, "%s: nothing to send\n", argv[optind]);
+        return 1;
+    }
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(artnet ? NETOUT_ARTNET_PORT : NETOUT_E131_PORT);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        return 1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    if (netout_open(&net, &layout) < 0) {
+        fprintf(stderr, "netout_open failed\n");
+        return 1;
+    }
+
+    frame_pixels = calloc(layout.n_leds, sizeof(*frame_pixels));
+    for (frame = 0; frame < frames; frame++) {
+        for (i = 0; i < layout.n_leds; i++) {
+            frame_pixels[i] = pattern(frame, i);
+        }
+        if (netout_send(&net, &layout, frame_pixels) < 0) {
+            perror("sendmmsg");
+            return 1;
+        }
+        for (n = 0; n < net.n_packets; n++) {
+            len = recv(fd, packet, sizeof(packet), 0);
+            if (len < 0) {
+                lost += net.n_packets - n;
+                break;
+            }
+            got = check_packet(&layout, packet, len, net.sequence, frame);
+            if (got < 0) {
+                bad++;
+            } else if (got == 2) {
+                syncs++;
+            }
+        }
+    }
+
+    printf("%s: %i frames, %i packets per frame, %i bad, %i lost, %i syncs\n",
+           artnet ? "Art-Net" : "E1.31", frames, net.n_packets, bad, lost, syncs);
+    printf("build: %.2f us per frame for %i pixels\n", net.build_ns / 1000.0 / frames, layout.n_leds);
+
+    netout_close(&net);
+    free(frame_pixels);
+    close(fd);
+
+    return bad || lost ? 1 : 0;
+}
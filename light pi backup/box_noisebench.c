@@ -0,0 +1,176 @@
+/*
+ * box_noisebench.c
+ *
+ * Per LED cost of the noise fields against the cosine fire field they can
+ * replace.  Renders FireField() as FireStep() does, at full quality and
+ * without the nested term, then the noise field at each octave count, for
+ * one channel (smoke) and three (fire), over the installation's strips
+ * with moving time.  The vector field is checked against noise_at().
+ *
+ *   box_noisebench [-n frames] <layout file>
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "box_fixmath.h"
+#include "layout.h"
+#include "noise.h"
+
+#define BENCH_FRAMES_DEFAULT   2000
+#define BENCH_SPACE_SCALE      300
+#define BENCH_T_STEP           6840    // fire defaults, t1 speed 57 * t scale 120
+
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// FireField() from the renderer
+static void fire_c(const layout_t *layout, uint16_t tpos1, uint16_t tpos2, uint16_t tpos3, int space_scale,
+                   int nest, uint32_t *matrix)
+{
+    const layout_strip_t *strip;
+    uint16_t z, pos1, pos2, pos3;
+    long r, g, b;
+    int s, led, x = 0;
+
+    for (s = 0; s < layout->n_strips; s++) {
+        strip = &layout->strip[s];
+        for (led = 0; led < strip->length; led++, x++) {
+            z = strip->length - led;
+            pos1 = ((-strip->x + strip->y + z) * 10 * space_scale) >> 6;
+            pos2 = ((strip->x - strip->y + z) * 6 * space_scale) >> 6;
+            pos3 = ((-strip->x - strip->y + z) * 8 * space_scale) >> 6;
+            if (nest) {
+                r = fastCosineCalc((pos1 + (tpos3 >> 1) + fastCosineCalc(tpos2 + pos2)));
+                g = fastCosineCalc((tpos1 + pos2 + fastCosineCalc(((tpos3 >> 2) + pos3))));
+                b = fastCosineCalc((tpos2 + pos3 + fastCosineCalc((tpos1 + pos1))));
+            } else {
+                r = fastCosineCalc(pos1 + (tpos3 >> 1));
+                g = fastCosineCalc(tpos1 + pos2);
+                b = fastCosineCalc(tpos2 + pos3);
+            }
+            matrix[x] = (fx_wave_to_u8(r) << 16) + (fx_wave_to_u8(g) << 8) + fx_wave_to_u8(b);
+        }
+    }
+}
+
+// FireNoiseField() from the renderer, channels channels
+static void fire_noise(const int32_t *const xyz[3], int n_leds, const int32_t *t, int space_scale, int octaves,
+                       int channels, uint8_t *out[3], uint32_t *matrix)
+{
+    int32_t drift[3];
+    int c, k, x;
+
+    for (c = 0; c < channels; c++) {
+        for (k = 0; k < 3; k++) {
+            drift[k] = (t[(c + k) % 3] >> 11) & 0xffffff;
+        }
+        noise_field(xyz[0], xyz[1], xyz[2], 0, n_leds, space_scale / 10, drift, octaves, 1 + c * 0x9e3779b9, out[c]);
+    }
+    for (x = 0; x < n_leds; x++) {
+        matrix[x] = (out[0][x] << 16) + (out[channels > 1][x] << 8) + out[channels > 2 ? 2 : 0][x];
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int32_t *xyz[3], t[3] = {0, 0, 0}, drift[3];
+    uint8_t *out[3];
+    uint32_t *matrix;
+    int64_t start, elapsed;
+    layout_t layout;
+    int frames = BENCH_FRAMES_DEFAULT;
+    int opt, frame, s, led, x, k, octaves, channels, padded, mismatches = 0;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+        case 'n':
+            frames = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n frames] <layout file>\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc || frames <= 0) {
+        fprintf(stderr, "usage: %s [-n frames] <layout file>\n", argv[0]);
+        return 1;
+    }
+    if (layout_load(&layout, argv[optind]) < 0 || layout_check(&layout) < 0 || layout.n_strips == 0) {
+        fprintf(stderr, "%s: no strips\n", argv[optind]);
+        return 1;
+    }
+
+    padded = (layout.n_leds + 3) & ~3;
+    for (k = 0; k < 3; k++) {
+        xyz[k] = calloc(padded, sizeof(int32_t));
+        out[k] = calloc(padded, 1);
+    }
+    matrix = calloc(layout.n_leds, sizeof(*matrix));
+    x = 0;
+    for (s = 0; s < layout.n_strips; s++) {
+        for (led = 0; led < layout.strip[s].length; led++, x++) {
+            xyz[0][x] = layout.strip[s].x;
+            xyz[1][x] = layout.strip[s].y;
+            xyz[2][x] = layout.strip[s].length - led;
+        }
+    }
+
+    printf("%i frames, %i LEDs\n", frames, layout.n_leds);
+
+    for (k = 1; k >= 0; k--) {
+        start = now_ns();
+        for (frame = 0; frame < frames; frame++) {
+            t[0] += BENCH_T_STEP;
+            t[1] += BENCH_T_STEP * 2;
+            t[2] += BENCH_T_STEP;
+            fire_c(&layout, t[0] >> 10, t[1] >> 10, t[2] >> 10, BENCH_SPACE_SCALE, k, matrix);
+        }
+        elapsed = now_ns() - start;
+        printf("fire cosine field%-10s %6.1f ns per LED\n", k ? "" : ", no nest", (double)elapsed / frames / layout.n_leds);
+    }
+
+    for (channels = 1; channels <= 3; channels += 2) {
+        for (octaves = 1; octaves <= NOISE_MAX_OCTAVES; octaves++) {
+            start = now_ns();
+            for (frame = 0; frame < frames; frame++) {
+                t[0] += BENCH_T_STEP;
+                t[1] += BENCH_T_STEP * 2;
+                t[2] += BENCH_T_STEP;
+                fire_noise((const int32_t *const *)xyz, layout.n_leds, t, BENCH_SPACE_SCALE, octaves, channels, out,
+                           matrix);
+            }
+            elapsed = now_ns() - start;
+            printf("noise, %i channels, %i octaves  %6.1f ns per LED\n", channels, octaves,
+                   (double)elapsed / frames / layout.n_leds);
+
+            for (k = 0; k < 3; k++) {
+                drift[k] = (t[k] >> 11) & 0xffffff;
+            }
+            for (x = 0; x < layout.n_leds; x++) {
+                mismatches += out[0][x] != noise_at(xyz[0][x], xyz[1][x], xyz[2][x], BENCH_SPACE_SCALE / 10, drift,
+                                                    octaves, 1);
+            }
+        }
+    }
+    if (mismatches > 0) {
+        printf("%i LEDs differ from noise_at()\n", mismatches);
+    }
+
+    for (k = 0; k < 3; k++) {
+        free(xyz[k]);
+        free(out[k]);
+    }
+    free(matrix);
+
+    return mismatches > 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * box_param.c
+ *
+ * Command line access to the renderer's live parameters, see params.h.
+ *
+ *   box_param list
+ *   box_param get <name>
+ *   box_param set <name> <value>
+ *   box_param reset <name>
+ *   box_param save <file>
+ *   box_param load <file>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "params.h"
+
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s list | get <name> | set <name> <value> | reset <name> | save <file> | load <file>\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    param_table_t *table;
+    uint32_t count, i;
+    int slot, ret = 0;
+
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    table = params_open(0);
+    if (table == NULL) {
+        fprintf(stderr, "no parameters at %s, is the renderer running?\n", PARAMS_SHM_NAME);
+        return 1;
+    }
+
+    if (strcmp(argv[1], "list") == 0) {
+        count = __atomic_load_n(&table->count, __ATOMIC_ACQUIRE);
+        for (i = 0; i < count; i++) {
+            printf("%-24s %7i  [%i, %i] default %i\n", table->param[i].name, (int)params_get(table, i),
+                   (int)table->param[i].min, (int)table->param[i].max, (int)table->param[i].def);
+        }
+    } else if (strcmp(argv[1], "get") == 0 && argc == 3) {
+        slot = params_find(table, argv[2]);
+        if (slot < 0) {
+            fprintf(stderr, "unknown parameter %s\n", argv[2]);
+            ret = 1;
+        } else {
+            printf("%i\n", (int)params_get(table, slot));
+        }
+    } else if ((strcmp(argv[1], "set") == 0 && argc == 4) || (strcmp(argv[1], "reset") == 0 && argc == 3)) {
+        slot = params_find(table, argv[2]);
+        if (slot < 0) {
+            fprintf(stderr, "unknown parameter %s\n", argv[2]);
+            ret = 1;
+        } else {
+            params_set(table, slot, argc == 4 ? strtol(argv[3], NULL, 0) : table->param[slot].def);
+            printf("%s %i\n", argv[2], (int)params_get(table, slot));
+            // and the ordered partner, which may have moved with it
+            if (table->param[slot].low >= 0) {
+                printf("%s %i\n", table->param[table->param[slot].low].name, (int)params_get(table, table->param[slot].low));
+            }
+            if (table->param[slot].high >= 0) {
+                printf("%s %i\n", table->param[table->param[slot].high].name, (int)params_get(table, table->param[slot].high));
+            }
+        }
+    } else if (strcmp(argv[1], "save") == 0 && argc == 3) {
+        if (params_save(table, argv[2]) < 0) {
+            perror(argv[2]);
+            ret = 1;
+        }
+    } else if (strcmp(argv[1], "load") == 0 && argc == 3) {
+        slot = params_load(table, argv[2]);
+        if (slot < 0) {
+            perror(argv[2]);
+            ret = 1;
+        } else {
+            printf("loaded %i parameters\n", slot);
+        }
+    } else {
+        usage(argv[0]);
+        ret = 1;
+    }
+
+    params_close(table);
+
+    return ret;
+}
@@ -0,0 +1,113 @@
+/*
+ * box_particlebench.c
+ *
+ * Times the particle pool at a given live count over the installation's
+ * strips: taps on random strips keep the pool topped up, and each frame is
+ * timed for the update and for the splat into the frame.
+ *
+ *   box_particlebench [-n frames] [-p live particles] <layout file>
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "layout.h"
+#include "spatial.h"
+#include "particles.h"
+
+#define BENCH_FRAMES_DEFAULT   1000
+#define BENCH_LIVE_DEFAULT     10000
+#define BENCH_RADIUS           3
+#define BENCH_LIFE             60
+#define BENCH_BURST            500
+
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+    int lengths[LAYOUT_MAX_STRIPS], xs[LAYOUT_MAX_STRIPS], ys[LAYOUT_MAX_STRIPS];
+    int64_t update_ns = 0, render_ns = 0, start;
+    long live_sum = 0;
+    particles_t particles;
+    spatial_t index;
+    layout_t layout;
+    uint32_t *matrix;
+    int frames = BENCH_FRAMES_DEFAULT;
+    int live = BENCH_LIVE_DEFAULT;
+    int opt, frame, strip, i;
+
+    while ((opt = getopt(argc, argv, "n:p:")) != -1) {
+        switch (opt) {
+        case 'n':
+            frames = atoi(optarg);
+            break;
+        case 'p':
+            live = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n frames] [-p live particles] <layout file>\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "usage: %s [-n frames] [-p live particles] <layout file>\n", argv[0]);
+        return 1;
+    }
+
+    if (layout_load(&layout, argv[optind]) < 0 || layout_check(&layout) < 0 || layout.n_strips == 0) {
+        fprintf(stderr, "%s: no strips\n", argv[optind]);
+        return 1;
+    }
+    for (i = 0; i < layout.n_strips; i++) {
+        lengths[i] = layout.strip[i].length;
+        xs[i] = layout.strip[i].x;
+        ys[i] = layout.strip[i].y;
+    }
+    if (spatial_init(&index, layout.n_strips, lengths, xs, ys, BENCH_RADIUS) < 0 ||
+        particles_init(&particles, &index, BENCH_RADIUS) < 0) {
+        fprintf(stderr, "particles_init failed\n");
+        return 1;
+    }
+    matrix = calloc(layout.n_leds, sizeof(*matrix));
+
+    srand(1);
+    for (frame = 0; frame < frames; frame++) {
+        while (particles.count < live && particles.count < particles.limit) {
+            strip = rand() % layout.n_strips;
+            particles_spawn(&particles, BENCH_BURST, xs[strip] << PARTICLES_FIX, ys[strip] << PARTICLES_FIX,
+                            (rand() % lengths[strip] + 1) << PARTICLES_FIX, 160, BENCH_LIFE,
+                            0xff8040, rand(), frame);
+        }
+        live_sum += particles.count;
+
+        start = now_ns();
+        particles_update(&particles, 4, 5, 0);
+        update_ns += now_ns() - start;
+
+        start = now_ns();
+        particles_render(&particles, BENCH_LIFE, 0, layout.n_leds, matrix);
+        render_ns += now_ns() - start;
+    }
+
+    printf("%i frames, %li live particles on average, %i LEDs\n", frames, live_sum / frames, layout.n_leds);
+    printf("update: %.1f us per frame, %.1f ns per particle\n", update_ns / 1000.0 / frames,
+           (double)update_ns / live_sum);
+    printf("render: %.1f us per frame, %.1f ns per particle\n", render_ns / 1000.0 / frames,
+           (double)render_ns / live_sum);
+
+    particles_free(&particles);
+    spatial_free(&index);
+    free(matrix);
+
+    return 0;
+}
@@ -0,0 +1,217 @@
+/*
+ * box_replay.c
+ *
+ * Reads back a flight recorder dump, see recorder.h.  Prints a line per
+ * frame with its timings, scene and motion data, then a summary; with -p
+ * replays the frames on a truecolor terminal instead, one row per strip
+ * when given the layout, at the recorded pace scaled by -s.  Indexed frames
+ * are coloured through the palettes in the dump.
+ *
+ *   box_replay [-p] [-l layout] [-s speed] <dump file>
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "layout.h"
+#include "recorder.h"
+
+#define REPLAY_ROW_DEFAULT     64      // LEDs per row without a layout
+#define REPLAY_MOTION_SHOWN    12
+
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-p] [-l layout] [-s speed] <dump file>\n", prog);
+}
+
+// one row per strip of the slice recorded, or rows of REPLAY_ROW_DEFAULT
+static void draw(const uint8_t *rgb, int n_leds, int first_led, const layout_t *layout)
+{
+    int s, led = 0, skip = first_led, row, i;
+
+    printf("\033[H");
+    for (s = 0; led < n_leds; s++) {
+        if (layout != NULL && s < layout->n_strips) {
+            row = layout->strip[s].length;
+            if (skip >= row) {
+                skip -= row;
+                continue;
+            }
+            row -= skip;
+            skip = 0;
+        } else {
+            row = REPLAY_ROW_DEFAULT;
+        }
+        row = led + row > n_leds ? n_leds - led : row;
+        for (i = led; i < led + row; i++) {
+            printf("\033[48;2;%i;%i;%im ", rgb[i * 3], rgb[i * 3 + 1], rgb[i * 3 + 2]);
+        }
+        printf("\033[0m\033[K\n");
+        led += row;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    recorder_file_t head;
+    recorder_frame_t frame;
+    layout_t layout;
+    uint32_t (*palettes)[RECORDER_PALETTE_SIZE] = NULL;
+    uint32_t color;
+    uint8_t *bytes, *rgb, *shown, *coded;
+    size_t n_bytes, n_coded;
+    double speed = 1.0, brightness;
+    const char *layout_file = NULL;
+    uint32_t i, first_us = 0, max_compute = 0;
+    uint64_t coded_total = 0;
+    unsigned long overruns = 0, keyframes = 0, indexed = 0;
+    int play = 0, opt, k, lit, ret = 0;
+    FILE *f;
+
+    while ((opt = getopt(argc, argv, "pl:s:")) != -1) {
+        switch (opt) {
+        case 'p':
+            play = 1;
+            break;
+        case 'l':
+            layout_file = optarg;
+            break;
+        case 's':
+            speed = atof(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc || speed <= 0.0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (layout_file != NULL && (layout_load(&layout, layout_file) < 0 || layout_check(&layout) < 0)) {
+        fprintf(stderr, "%s: bad layout\n", layout_file);
+        return 1;
+    }
+
+    f = fopen(argv[optind], "rb");
+    if (f == NULL) {
+        perror(argv[optind]);
+        return 1;
+    }
+    if (fread(&head, sizeof(head), 1, f) != 1 || memcmp(head.magic, RECORDER_MAGIC, sizeof(head.magic)) != 0) {
+        fprintf(stderr, "%s: not a recorder dump\n", argv[optind]);
+        fclose(f);
+        return 1;
+    }
+    if (head.n_palettes > RECORDER_PALETTES_MAX) {
+        fprintf(stderr, "%s: %u palettes\n", argv[optind], head.n_palettes);
+        fclose(f);
+        return 1;
+    }
+    if (head.n_palettes > 0) {
+        palettes = malloc(head.n_palettes * sizeof(*palettes));
+        if (fread(palettes, sizeof(*palettes), head.n_palettes, f) != head.n_palettes) {
+            fprintf(stderr, "%s: truncated in the palettes\n", argv[optind]);
+            free(palettes);
+            fclose(f);
+            return 1;
+        }
+    }
+    n_bytes = (size_t)head.n_leds * 3;
+    bytes = calloc(n_bytes + 1, 1);    // as recorded, indices in the first n_leds
+    rgb = calloc(n_bytes + 1, 1);      // an indexed frame through its palette
+    coded = malloc(recorder_coded_max(n_bytes) + 1);
+
+    if (play) {
+        printf("\033[2J");
+    } else {
+        printf("%u frames of %u LEDs from LED %u, keyframe every %u\n", head.n_frames, head.n_leds, head.first_led,
+               head.key_interval);
+        printf("%8s %9s %8s %8s %5s %3s %6s %5s %6s  %s\n", "frame", "ms", "compute", "period", "scene", "q", "bytes",
+               "lit", "level", "motion");
+    }
+
+    for (i = 0; i < head.n_frames; i++) {
+        if (fread(&frame, sizeof(frame), 1, f) != 1 || frame.length > recorder_coded_max(n_bytes) ||
+            fread(coded, 1, frame.length, f) != frame.length) {
+            fprintf(stderr, "%s: truncated at frame %u\n", argv[optind], i);
+            ret = 1;
+            break;
+        }
+        if (frame.flags & RECORDER_KEYFRAME) {
+            memset(bytes, 0, n_bytes);
+            keyframes++;
+        }
+        n_coded = (frame.flags & RECORDER_INDEXED) ? head.n_leds : n_bytes;
+        if (recorder_decode(coded, frame.length, bytes, n_coded) < 0) {
+            fprintf(stderr, "%s: frame %u does not decode\n", argv[optind], frame.frame);
+            ret = 1;
+            break;
+        }
+        shown = bytes;
+        if (frame.flags & RECORDER_INDEXED) {
+            if (frame.palette >= head.n_palettes) {
+                fprintf(stderr, "%s: frame %u has no palette %u\n", argv[optind], frame.frame, frame.palette);
+                ret = 1;
+                break;
+            }
+            for (k = 0; k < (int)head.n_leds; k++) {
+                color = palettes[frame.palette][bytes[k]];
+                rgb[k * 3] = color >> 16;
+                rgb[k * 3 + 1] = color >> 8;
+                rgb[k * 3 + 2] = color;
+            }
+            shown = rgb;
+            indexed++;
+        }
+        if (i == 0) {
+            first_us = frame.time_us;
+        }
+        overruns += (frame.flags & RECORDER_OVERRUN) != 0;
+        max_compute = frame.compute_us > max_compute ? frame.compute_us : max_compute;
+        coded_total += frame.length;
+
+        if (play) {
+            if (i > 0) {
+                usleep(frame.period_us / speed);
+            }
+            draw(shown, head.n_leds, head.first_led, layout_file != NULL ? &layout : NULL);
+            printf("frame %u  scene %u  compute %u us%s\033[K\n", frame.frame, frame.scene, frame.compute_us,
+                   (frame.flags & RECORDER_OVERRUN) ? "  OVERRUN" : "");
+            fflush(stdout);
+            continue;
+        }
+
+        lit = 0;
+        brightness = 0.0;
+        for (k = 0; k < (int)n_bytes; k += 3) {
+            lit += (shown[k] | shown[k + 1] | shown[k + 2]) != 0;
+            brightness += shown[k] + shown[k + 1] + shown[k + 2];
+        }
+        printf("%8u %9.1f %8u %8u %5u %3u %6u %5i %6.1f %c%c%c", frame.frame, (uint32_t)(frame.time_us - first_us) / 1000.0,
+               frame.compute_us, frame.period_us, frame.scene, frame.quality, frame.length, lit,
+               head.n_leds ? brightness / n_bytes : 0.0, (frame.flags & RECORDER_KEYFRAME) ? 'K' : ' ',
+               (frame.flags & RECORDER_OVERRUN) ? '!' : ' ', (frame.flags & RECORDER_INDEXED) ? 'I' : ' ');
+        for (k = 1; k <= REPLAY_MOTION_SHOWN && k < RECORDER_MOTION_SIZE; k++) {
+            printf(" %3u", frame.motion[k]);
+        }
+        printf("\n");
+    }
+
+    if (!play && i > 0) {
+        printf("%u frames over %.1f s, %lu keyframes, %lu indexed, %lu overruns, max compute %u us, "
+               "%.0f bytes per frame (of %zu)\n", i, (uint32_t)(frame.time_us - first_us) / 1e6, keyframes, indexed,
+               overruns, max_compute, (double)coded_total / i, n_bytes);
+    }
+
+    free(palettes);
+    free(bytes);
+    free(rgb);
+    free(coded);
+    fclose(f);
+    return ret;
+}
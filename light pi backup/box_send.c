@@ -0,0 +1,184 @@
+/*
+ * box_send.c
+ *
+ * Test driver for the renderer's UDP input, see udp_input.h.
+ *
+ *   box_send [-h host] [-p port] [-o] scene <n>
+ *   box_send [-h host] [-p port] [-o] tap <strip> <strength>
+ *   box_send [-h host] [-p port] flood <taps per second> <seconds>
+ *
+ * -o sends OSC instead of the binary format.  flood sends random taps in
+ * full binary datagrams, for checking the renderer keeps up.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "input.h"
+#include "udp_input.h"
+
+#define FLOOD_RECORDS   64    // records per datagram
+#define N_TAP_STRIPS    23
+
+
+static int osc_pad_string(uint8_t *out, const char *str)
+{
+    int len = strlen(str);
+    int padded = (len + 4) & ~3;
+
+    memset(out, 0, padded);
+    memcpy(out, str, len);
+
+    return padded;
+}
+
+static int osc_put_int(uint8_t *out, int32_t value)
+{
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+
+    return 4;
+}
+
+static int build_osc(uint8_t *out, int type, int index, int value)
+{
+    int len = 0;
+
+    if (type == INPUT_EVENT_SCENE) {
+        len += osc_pad_string(out + len, "/box/scene");
+        len += osc_pad_string(out + len, ",i");
+        len += osc_put_int(out + len, value);
+    } else {
+        len += osc_pad_string(out + len, "/box/tap");
+        len += osc_pad_string(out + len, ",ii");
+        len += osc_put_int(out + len, index);
+        len += osc_put_int(out + len, value);
+    }
+
+    return len;
+}
+
+static int build_binary(uint8_t *out, int count)
+{
+    out[0] = UDP_INPUT_MAGIC_0;
+    out[1] = UDP_INPUT_MAGIC_1;
+    out[2] = UDP_INPUT_VERSION;
+    out[3] = count;
+
+    return UDP_INPUT_HEADER_SIZE + count * UDP_INPUT_RECORD_SIZE;
+}
+
+static void put_record(uint8_t *out, int n, int type, int index, int value)
+{
+    uint8_t *record = out + UDP_INPUT_HEADER_SIZE + n * UDP_INPUT_RECORD_SIZE;
+
+    record[0] = type;
+    record[1] = index;
+    record[2] = value;
+    record[3] = 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-h host] [-p port] [-o] scene <n> | tap <strip> <strength> | flood <taps per second> <seconds>\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    struct sockaddr_in addr;
+    struct timespec wait;
+    uint8_t packet[UDP_INPUT_DATAGRAM_SIZE];
+    const char *host = "127.0.0.1";
+    int port = UDP_INPUT_PORT_DEFAULT;
+    int osc = 0;
+    int fd, opt, len, i;
+    long rate, sent, total;
+
+    while ((opt = getopt(argc, argv, "h:p:o")) != -1) {
+        switch (opt) {
+        case 'h':
+            host = optarg;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'o':
+            osc = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    argc -= optind;
+    argv += optind;
+    if (argc < 2) {
+        usage(argv[-optind]);
+        return 1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        fprintf(stderr, "bad address %s\n", host);
+        return 1;
+    }
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return 1;
+    }
+
+    if (strcmp(argv[0], "scene") == 0 && argc == 2) {
+        if (osc) {
+            len = build_osc(packet, INPUT_EVENT_SCENE, 0, atoi(argv[1]));
+        } else {
+            len = build_binary(packet, 1);
+            put_record(packet, 0, INPUT_EVENT_SCENE, 0, atoi(argv[1]));
+        }
+        sendto(fd, packet, len, 0, (struct sockaddr *)&addr, sizeof(addr));
+    } else if (strcmp(argv[0], "tap") == 0 && argc == 3) {
+        if (osc) {
+            len = build_osc(packet, INPUT_EVENT_TAP, atoi(argv[1]), atoi(argv[2]));
+        } else {
+            len = build_binary(packet, 1);
+            put_record(packet, 0, INPUT_EVENT_TAP, atoi(argv[1]), atoi(argv[2]));
+        }
+        sendto(fd, packet, len, 0, (struct sockaddr *)&addr, sizeof(addr));
+    } else if (strcmp(argv[0], "flood") == 0 && argc == 3) {
+        rate = atol(argv[1]);
+        total = rate * atol(argv[2]);
+        if (rate <= 0) {
+            usage(argv[-optind]);
+            return 1;
+        }
+        wait.tv_sec = FLOOD_RECORDS / rate;
+        wait.tv_nsec = (1000000000LL * FLOOD_RECORDS / rate) % 1000000000LL;
+        for (sent = 0; sent < total; sent += FLOOD_RECORDS) {
+            len = build_binary(packet, FLOOD_RECORDS);
+            for (i = 0; i < FLOOD_RECORDS; i++) {
+                put_record(packet, i, INPUT_EVENT_TAP, rand() % N_TAP_STRIPS, rand() & 0x7f);
+            }
+            sendto(fd, packet, len, 0, (struct sockaddr *)&addr, sizeof(addr));
+            nanosleep(&wait, NULL);
+        }
+        printf("sent %li taps\n", sent);
+    } else {
+        usage(argv[-optind]);
+        return 1;
+    }
+
+    close(fd);
+
+    return 0;
+}
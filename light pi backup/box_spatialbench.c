@@ -0,0 +1,198 @@
+/*
+ * box_spatialbench.c
+ *
+ * Times spatial index queries against a scan of every LED, on synthetic
+ * installations that grow at constant density: strips `spacing` apart on a
+ * square grid, each `length` LEDs.  Every query is checked against the scan
+ * and the index time should stay flat as the installation grows.
+ *
+ *   box_spatialbench [-q queries] [-r radius] [-k nearest]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "spatial.h"
+
+#define BENCH_QUERIES_DEFAULT  10000
+#define BENCH_RADIUS_DEFAULT   3
+#define BENCH_K_DEFAULT        8
+#define BENCH_SPACING          10
+#define BENCH_LENGTH           30
+#define BENCH_K_MAX            64
+
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// LEDs within r of p by the index, and by scanning them all
+static int radius_index(const spatial_t *index, const int32_t p[3], int32_t r)
+{
+    spatial_range_t ranges[SPATIAL_MAX_RANGES];
+    int64_t r2 = (int64_t)r * r, dx, dy, dz;
+    int n_ranges, i, j, n = 0;
+
+    n_ranges = spatial_radius(index, p, r, ranges, SPATIAL_MAX_RANGES);
+    for (i = 0; i < n_ranges; i++) {
+        for (j = ranges[i].start; j < ranges[i].end; j++) {
+            dx = index->x[j] - p[0];
+            dy = index->y[j] - p[1];
+            dz = index->z[j] - p[2];
+            n += dx * dx + dy * dy + dz * dz <= r2;
+        }
+    }
+    return n;
+}
+
+static int radius_scan(const spatial_t *index, const int32_t p[3], int32_t r)
+{
+    int64_t r2 = (int64_t)r * r, dx, dy, dz;
+    int j, n = 0;
+
+    for (j = 0; j < index->n; j++) {
+        dx = index->x[j] - p[0];
+        dy = index->y[j] - p[1];
+        dz = index->z[j] - p[2];
+        n += dx * dx + dy * dy + dz * dz <= r2;
+    }
+    return n;
+}
+
+// k-th nearest squared distance, Q8, by scanning
+static int32_t nearest_scan(const spatial_t *index, const int32_t p[3], int k)
+{
+    int64_t best[BENCH_K_MAX], dx, dy, dz, d2;
+    int i, j, found = 0;
+
+    for (j = 0; j < index->n; j++) {
+        dx = index->x[j] - p[0];
+        dy = index->y[j] - p[1];
+        dz = index->z[j] - p[2];
+        d2 = dx * dx + dy * dy + dz * dz;
+        if (found == k && d2 >= best[k - 1]) {
+            continue;
+        }
+        i = found < k ? found++ : k - 1;
+        while (i > 0 && best[i - 1] > d2) {
+            best[i] = best[i - 1];
+            i--;
+        }
+        best[i] = d2;
+    }
+    return found > 0 ? (int32_t)(best[found - 1] >> SPATIAL_FIX) : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    static const int sides[] = {5, 10, 20, 40};
+    int leds[BENCH_K_MAX];
+    int32_t d2[BENCH_K_MAX];
+    int queries = BENCH_QUERIES_DEFAULT;
+    int radius = BENCH_RADIUS_DEFAULT;
+    int k = BENCH_K_DEFAULT;
+    int *lengths, *xs, *ys;
+    int64_t index_ns, scan_ns, nearest_ns, start;
+    int32_t (*points)[3];
+    spatial_t index;
+    int opt, size, side, n_strips, q, i, found, mismatches;
+    long hits, scan_hits;
+
+    while ((opt = getopt(argc, argv, "q:r:k:")) != -1) {
+        switch (opt) {
+        case 'q':
+            queries = atoi(optarg);
+            break;
+        case 'r':
+            radius = atoi(optarg);
+            break;
+        case 'k':
+            k = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-q queries] [-r radius] [-k nearest]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (queries <= 0 || radius <= 0 || k <= 0 || k > BENCH_K_MAX) {
+        fprintf(stderr, "usage: %s [-q queries] [-r radius] [-k nearest, up to %i]\n", argv[0], BENCH_K_MAX);
+        return 1;
+    }
+    points = malloc(queries * sizeof(*points));
+
+    printf("%7s %7s %10s %10s %10s %8s\n", "strips", "LEDs", "index ns", "scan ns", "nearest ns", "hits");
+    for (size = 0; size < (int)(sizeof(sides) / sizeof(sides[0])); size++) {
+        side = sides[size];
+        n_strips = side * side;
+        lengths = malloc(n_strips * sizeof(int));
+        xs = malloc(n_strips * sizeof(int));
+        ys = malloc(n_strips * sizeof(int));
+        for (i = 0; i < n_strips; i++) {
+            lengths[i] = BENCH_LENGTH;
+            xs[i] = (i % side) * BENCH_SPACING;
+            ys[i] = (i / side) * BENCH_SPACING;
+        }
+        if (spatial_init(&index, n_strips, lengths, xs, ys, radius) < 0) {
+            fprintf(stderr, "spatial_init failed\n");
+            return 1;
+        }
+
+        // around the strips, where the effects put their points
+        srand(1);
+        for (q = 0; q < queries; q++) {
+            i = rand() % n_strips;
+            points[q][0] = (xs[i] << SPATIAL_FIX) + rand() % (2 * radius << SPATIAL_FIX) - (radius << SPATIAL_FIX);
+            points[q][1] = (ys[i] << SPATIAL_FIX) + rand() % (2 * radius << SPATIAL_FIX) - (radius << SPATIAL_FIX);
+            points[q][2] = rand() % ((BENCH_LENGTH + 1) << SPATIAL_FIX);
+        }
+
+        hits = 0;
+        start = now_ns();
+        for (q = 0; q < queries; q++) {
+            hits += radius_index(&index, points[q], radius << SPATIAL_FIX);
+        }
+        index_ns = now_ns() - start;
+
+        scan_hits = 0;
+        start = now_ns();
+        for (q = 0; q < queries; q++) {
+            scan_hits += radius_scan(&index, points[q], radius << SPATIAL_FIX);
+        }
+        scan_ns = now_ns() - start;
+
+        mismatches = scan_hits != hits;
+        for (q = 0; q < queries; q++) {
+            mismatches += radius_index(&index, points[q], radius << SPATIAL_FIX) !=
+                          radius_scan(&index, points[q], radius << SPATIAL_FIX);
+        }
+
+        nearest_ns = 0;
+        for (q = 0; q < queries; q++) {
+            start = now_ns();
+            found = spatial_nearest(&index, points[q], k, leds, d2);
+            nearest_ns += now_ns() - start;
+            mismatches += found != (k < index.n ? k : index.n) || d2[found - 1] != nearest_scan(&index, points[q], k);
+        }
+
+        printf("%7i %7i %10.0f %10.0f %10.0f %8.1f\n", n_strips, index.n, (double)index_ns / queries,
+               (double)scan_ns / queries, (double)nearest_ns / queries, (double)hits / queries);
+        if (mismatches > 0) {
+            printf("  %i queries disagree with the scan\n", mismatches);
+        }
+
+        spatial_free(&index);
+        free(lengths);
+        free(xs);
+        free(ys);
+    }
+
+    free(points);
+    return 0;
+}
@@ -0,0 +1,155 @@
+/*
+ * box_spibench.c
+ *
+ * Checks and times the SPI WS2811 encoder, see spiout.h.  Random frames are
+ * encoded by the table and by a bit at a time reference, compared byte for
+ * byte and decoded back off the wire patterns; then whole frames go through
+ * spiout_send() into a file sink, file:/dev/null unless given, to time the
+ * path the renderer takes without the SPI hardware.  A spidev device works
+ * as the sink too.  Build with -pthread.
+ *
+ *   box_spibench [-n frames] [-l leds] [file:path | spidev device]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "spiout.h"
+
+#define BENCH_FRAMES_DEFAULT   2000
+#define BENCH_LEDS_DEFAULT     689
+
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// one wire bit after another, GRB, MSB first
+static void encode_reference(const uint32_t *frame, int n_leds, uint8_t *out)
+{
+    uint32_t grb;
+    int led, bit, wire, pos = 0;
+
+    memset(out, 0, (size_t)n_leds * SPIOUT_BYTES_PER_LED);
+    for (led = 0; led < n_leds; led++) {
+        grb = ((frame[led] >> 8) & 0xff) << 16 | ((frame[led] >> 16) & 0xff) << 8 | (frame[led] & 0xff);
+        for (bit = 23; bit >= 0; bit--) {
+            for (wire = 0; wire < 3; wire++, pos++) {
+                if (wire == 0 || (wire == 1 && (grb >> bit) & 1)) {
+                    out[pos / 8] |= 0x80 >> (pos % 8);
+                }
+            }
+        }
+    }
+}
+
+// the LED's view: each bit is the middle of its three, after a leading high
+static int decode(const uint8_t *bits, int n_leds, uint32_t *frame)
+{
+    uint32_t grb;
+    int led, bit, pos = 0, bad = 0;
+
+    for (led = 0; led < n_leds; led++) {
+        grb = 0;
+        for (bit = 0; bit < 24; bit++, pos += 3) {
+            bad += !((bits[pos / 8] >> (7 - pos % 8)) & 1) || ((bits[(pos + 2) / 8] >> (7 - (pos + 2) % 8)) & 1);
+            grb = (grb << 1) | ((bits[(pos + 1) / 8] >> (7 - (pos + 1) % 8)) & 1);
+        }
+        frame[led] = ((grb >> 8) & 0xff) << 16 | ((grb >> 16) & 0xff) << 8 | (grb & 0xff);
+    }
+    return bad;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *sink = SPIOUT_FILE_PREFIX "/dev/null";
+    int frames = BENCH_FRAMES_DEFAULT;
+    int n_leds = BENCH_LEDS_DEFAULT;
+    uint32_t *frame, *back;
+    uint8_t *bits, *reference;
+    int64_t start, table_ns, reference_ns;
+    size_t n_bytes;
+    spiout_t spi;
+    int opt, f, i, mismatches = 0;
+
+    while ((opt = getopt(argc, argv, "n:l:")) != -1) {
+        switch (opt) {
+        case 'n':
+            frames = atoi(optarg);
+            break;
+        case 'l':
+            n_leds = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n frames] [-l leds] [file:path | spidev device]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (frames <= 0 || n_leds <= 0) {
+        fprintf(stderr, "usage: %s [-n frames] [-l leds] [file:path | spidev device]\n", argv[0]);
+        return 1;
+    }
+    if (optind < argc) {
+        sink = argv[optind];
+    }
+
+    n_bytes = (size_t)n_leds * SPIOUT_BYTES_PER_LED;
+    frame = malloc(n_leds * sizeof(uint32_t));
+    back = malloc(n_leds * sizeof(uint32_t));
+    bits = malloc(n_bytes + 1);
+    reference = malloc(n_bytes);
+
+    srand(1);
+    table_ns = reference_ns = 0;
+    for (f = 0; f < frames; f++) {
+        for (i = 0; i < n_leds; i++) {
+            frame[i] = (uint32_t)rand() & 0xffffff;
+        }
+        start = now_ns();
+        spiout_encode(frame, n_leds, bits);
+        table_ns += now_ns() - start;
+        start = now_ns();
+        encode_reference(frame, n_leds, reference);
+        reference_ns += now_ns() - start;
+
+        mismatches += memcmp(bits, reference, n_bytes) != 0;
+        mismatches += decode(bits, n_leds, back) != 0 || memcmp(frame, back, n_leds * sizeof(uint32_t)) != 0;
+    }
+    printf("%i frames, %i LEDs, %zu bytes on the wire, %.0f us at %i Hz\n", frames, n_leds,
+           n_bytes + SPIOUT_LATCH_BYTES, (n_bytes + SPIOUT_LATCH_BYTES) * 8 * 1e6 / SPIOUT_SPEED_HZ, SPIOUT_SPEED_HZ);
+    printf("table encode     %6.2f ns per LED\n", (double)table_ns / frames / n_leds);
+    printf("reference encode %6.2f ns per LED\n", (double)reference_ns / frames / n_leds);
+
+    if (spiout_open(&spi, sink, n_leds) < 0) {
+        perror(sink);
+        return 1;
+    }
+    start = now_ns();
+    for (f = 0; f < frames; f++) {
+        frame[f % n_leds] ^= 0x010101;
+        if (spiout_send(&spi, frame) < 0) {
+            perror(sink);
+            break;
+        }
+    }
+    spiout_close(&spi);    // waits for the last frame
+    printf("send to %s (%s)  %6.2f us per frame, %.2f of it encoding, chunks of %zu\n", sink, spi.is_spi ? "spidev" : "file",
+           (double)(now_ns() - start) / frames / 1000, (double)spi.encode_ns / frames / 1000, spi.chunk);
+
+    if (mismatches > 0) {
+        printf("%i frames differ from the reference\n", mismatches);
+    }
+    free(frame);
+    free(back);
+    free(bits);
+    free(reference);
+    return mismatches > 0;
+}
@@ -0,0 +1,366 @@
+/*
+ * cluster.c
+ *
+ * Shared frame clock for multi-node rendering, see cluster.h.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "input.h"
+#include "cluster.h"
+
+
+// "group[:port][@interface]", any part may be left out
+static int parse_spec(const char *spec, struct sockaddr_in *group, struct in_addr *iface)
+{
+    char buf[64];
+    char *at, *colon;
+
+    memset(group, 0, sizeof(*group));
+    group->sin_family = AF_INET;
+    group->sin_port = htons(CLUSTER_PORT_DEFAULT);
+    inet_pton(AF_INET, CLUSTER_GROUP_DEFAULT, &group->sin_addr);
+    iface->s_addr = htonl(INADDR_ANY);
+
+    if (spec == NULL) {
+        return 0;
+    }
+    if (strlen(spec) >= sizeof(buf)) {
+        return -1;
+    }
+    strcpy(buf, spec);
+
+    at = strchr(buf, '@');
+    if (at != NULL) {
+        *at++ = 0;
+        if (inet_pton(AF_INET, at, iface) != 1) {
+            return -1;
+        }
+    }
+    colon = strchr(buf, ':');
+    if (colon != NULL) {
+        *colon++ = 0;
+        group->sin_port = htons(atoi(colon));
+    }
+    if (buf[0] != 0 && inet_pton(AF_INET, buf, &group->sin_addr) != 1) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int cluster_open(cluster_t *cluster, int role, const char *spec)
+{
+    struct sockaddr_in addr;
+    struct ip_mreq mreq;
+    struct in_addr iface;
+    unsigned char ttl = 1;
+    int one = 1;
+
+    memset(cluster, 0, sizeof(*cluster));
+    cluster->fd = -1;
+    cluster->role = role;
+    if (role == CLUSTER_NONE) {
+        return 0;
+    }
+
+    if (parse_spec(spec, &cluster->group, &iface) < 0) {
+        fprintf(stderr, "cluster: bad group %s\n", spec);
+        return -1;
+    }
+
+    cluster->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (cluster->fd < 0) {
+        return -1;
+    }
+    setsockopt(cluster->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(cluster->fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one));
+    fcntl(cluster->fd, F_SETFL, fcntl(cluster->fd, F_GETFL) | O_NONBLOCK);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if (role == CLUSTER_LEADER) {
+        // reports come back to whatever port the kernel picks
+        setsockopt(cluster->fd, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface));
+        setsockopt(cluster->fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+        setsockopt(cluster->fd, IPPROTO_IP, IP_MULTICAST_LOOP, &one, sizeof(one));
+    } else {
+        addr.sin_port = cluster->group.sin_port;
+    }
+    if (bind(cluster->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(cluster->fd);
+        cluster->fd = -1;
+        return -1;
+    }
+
+    if (role == CLUSTER_FOLLOWER) {
+        mreq.imr_multiaddr = cluster->group.sin_addr;
+        mreq.imr_interface = iface;
+        if (setsockopt(cluster->fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+            close(cluster->fd);
+            cluster->fd = -1;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void cluster_close(cluster_t *cluster)
+{
+    if (cluster->fd >= 0) {
+        close(cluster->fd);
+        cluster->fd = -1;
+    }
+}
+
+// Kernel receive time mapped onto CLOCK_MONOTONIC, so queueing between
+// arrival and the next time we look doesn't count as network delay.
+static int receive(cluster_t *cluster, void *buf, int size, struct sockaddr_in *from, uint64_t *receive_us)
+{
+    uint8_t control[CMSG_SPACE(sizeof(struct timespec))];
+    struct timespec real, *ts;
+    struct cmsghdr *cmsg;
+    struct msghdr hdr;
+    struct iovec iov;
+    uint64_t now_us;
+    int len;
+
+    iov.iov_base = buf;
+    iov.iov_len = size;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_name = from;
+    hdr.msg_namelen = sizeof(*from);
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control;
+    hdr.msg_controllen = sizeof(control);
+
+    len = recvmsg(cluster->fd, &hdr, MSG_DONTWAIT);
+    if (len < 0) {
+        return -1;
+    }
+
+    now_us = input_now_us();
+    *receive_us = now_us;
+    for (cmsg = CMSG_FIRSTHDR(&hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            ts = (struct timespec *)CMSG_DATA(cmsg);
+            clock_gettime(CLOCK_REALTIME, &real);
+            *receive_us = now_us - (((int64_t)real.tv_sec - ts->tv_sec) * 1000000 + (real.tv_nsec - ts->tv_nsec) / 1000);
+        }
+    }
+
+    return len;
+}
+
+// leader: the caller fills in frame, seed, scene, quality, phase and motion
+int cluster_publish(cluster_t *cluster, cluster_clock_t *clock)
+{
+    cluster_history_t *history;
+
+    if (cluster->fd < 0) {
+        return 0;
+    }
+
+    clock->magic = CLUSTER_MAGIC_CLOCK;
+    clock->send_us = input_now_us();
+
+    history = &cluster->history[clock->frame % CLUSTER_HISTORY];
+    history->frame = clock->frame;
+    history->send_us = clock->send_us;
+    history->present_us = 0;
+    history->n_slices = 0;
+
+    cluster->clock = *clock;
+    cluster->frames++;
+
+    if (sendto(cluster->fd, clock, sizeof(*clock), 0, (struct sockaddr *)&cluster->group, sizeof(cluster->group)) != sizeof(*clock)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Follower: waits for the next clock, oldest first if several are queued.
+// Returns the number of frames lost since the previous clock, or -1 if
+// nothing came within the timeout.
+int cluster_wait(cluster_t *cluster, cluster_clock_t *clock, int timeout_ms)
+{
+    struct pollfd pfd;
+    struct sockaddr_in from;
+    uint64_t receive_us;
+    int len, missed;
+
+    pfd.fd = cluster->fd;
+    pfd.events = POLLIN;
+
+    while (1) {
+        len = receive(cluster, clock, sizeof(*clock), &from, &receive_us);
+        if (len < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                return -1;
+            }
+            if (poll(&pfd, 1, timeout_ms) <= 0) {
+                return -1;
+            }
+            continue;
+        }
+        if (len == sizeof(*clock) && clock->magic == CLUSTER_MAGIC_CLOCK) {
+            break;
+        }
+    }
+
+    missed = 0;
+    if (cluster->have_clock && clock->frame > cluster->clock.frame) {
+        missed = clock->frame - cluster->clock.frame - 1;    // a leader restart goes backwards, just follow it
+    }
+    cluster->missed += missed;
+    cluster->frames++;
+    cluster->clock = *clock;
+    cluster->receive_us = receive_us;
+    cluster->leader = from;
+    cluster->have_clock = 1;
+
+    return missed;
+}
+
+// FNV-1a over the strips' own checksums
+uint32_t cluster_fold(const uint32_t *strip_checksums, int first_strip, int end_strip)
+{
+    uint32_t hash = 2166136261u;
+    int i;
+
+    for (i = first_strip; i < end_strip; i++) {
+        hash = (hash ^ strip_checksums[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// against the leader's own strips if the slice is inside its own, else
+// against another report of the same slice
+static void check_slice(cluster_t *cluster, cluster_history_t *history, int first_strip, int end_strip, uint32_t checksum)
+{
+    int i;
+
+    if (first_strip >= cluster->first_strip && end_strip <= cluster->end_strip && first_strip < end_strip) {
+        cluster->compared++;
+        if (cluster_fold(history->strip_checksum, first_strip, end_strip) != checksum) {
+            cluster->mismatches++;
+        }
+        return;
+    }
+    for (i = 0; i < history->n_slices; i++) {
+        if (history->slice_first[i] == first_strip && history->slice_end[i] == end_strip) {
+            cluster->compared++;
+            if (history->slice_checksum[i] != checksum) {
+                cluster->mismatches++;
+            }
+            return;
+        }
+    }
+    if (history->n_slices < CLUSTER_SLICES) {
+        history->slice_first[i] = first_strip;
+        history->slice_end[i] = end_strip;
+        history->slice_checksum[i] = checksum;
+        history->n_slices++;
+    }
+}
+
+// called by every node once its slice of a frame is out
+void cluster_presented(cluster_t *cluster, uint32_t frame, uint64_t present_us, int first_strip, int end_strip,
+                       const uint32_t *strip_checksums)
+{
+    cluster_history_t *history;
+    cluster_report_t report;
+
+    if (cluster->fd < 0) {
+        return;
+    }
+    if (end_strip > CLUSTER_MAX_STRIPS) {
+        end_strip = CLUSTER_MAX_STRIPS;
+    }
+
+    if (cluster->role == CLUSTER_LEADER) {
+        history = &cluster->history[frame % CLUSTER_HISTORY];
+        if (history->frame == frame) {
+            history->present_us = present_us;
+            memcpy(history->strip_checksum + first_strip, strip_checksums + first_strip,
+                   (end_strip - first_strip) * sizeof(uint32_t));
+            cluster->first_strip = first_strip;
+            cluster->end_strip = end_strip;
+        }
+        return;
+    }
+
+    report.magic = CLUSTER_MAGIC_REPORT;
+    report.frame = frame;
+    report.present_delay_us = present_us - cluster->receive_us;
+    report.checksum = cluster_fold(strip_checksums, first_strip, end_strip);
+    report.first_strip = first_strip;
+    report.end_strip = end_strip;
+    sendto(cluster->fd, &report, sizeof(report), 0, (struct sockaddr *)&cluster->leader, sizeof(cluster->leader));
+}
+
+// Leader: drains follower reports.  The follower reports straight after
+// presenting, so the round trip less its present delay is twice the network
+// leg, and its present time on our clock is send + leg + present delay.
+void cluster_collect(cluster_t *cluster)
+{
+    cluster_history_t *history;
+    cluster_report_t report;
+    struct sockaddr_in from;
+    uint64_t receive_us;
+    int64_t leg_us, skew_us;
+
+    if (cluster->fd < 0 || cluster->role != CLUSTER_LEADER) {
+        return;
+    }
+
+    while (receive(cluster, &report, sizeof(report), &from, &receive_us) >= 0) {
+        if (report.magic != CLUSTER_MAGIC_REPORT) {
+            continue;
+        }
+        history = &cluster->history[report.frame % CLUSTER_HISTORY];
+        if (history->frame != report.frame || history->present_us == 0) {
+            continue;    // too old, or from before we presented it ourselves
+        }
+
+        leg_us = ((int64_t)(receive_us - history->send_us) - report.present_delay_us) / 2;
+        if (leg_us < 0) {
+            leg_us = 0;
+        }
+        skew_us = (int64_t)(history->send_us + leg_us + report.present_delay_us) - (int64_t)history->present_us;
+
+        cluster->reports++;
+        cluster->skew_sum_us += skew_us;
+        if (llabs(skew_us) > cluster->skew_max_us) {
+            cluster->skew_max_us = llabs(skew_us);
+        }
+        check_slice(cluster, history, report.first_strip, report.end_strip, report.checksum);
+    }
+}
+
+void cluster_stats_reset(cluster_t *cluster)
+{
+    cluster->frames = 0;
+    cluster->missed = 0;
+    cluster->reports = 0;
+    cluster->compared = 0;
+    cluster->mismatches = 0;
+    cluster->skew_sum_us = 0;
+    cluster->skew_max_us = 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * cluster.h
+ *
+ * Several renderers sharing one installation, each drawing a slice of the
+ * strips.  The leader owns the inputs; at the start of every frame it
+ * multicasts a clock packet with the frame number, the scene and its time
+ * base, the quality level, the random seed, the live parameters and the
+ * motion data.  Followers render exactly that frame when the packet arrives,
+ * so with the counter based randoms in prng.h all nodes compute the same
+ * field and the slices line up without any pixels crossing the network.
+ *
+ * After presenting a frame each follower sends the leader a report with
+ * how long it took from receiving the clock to presenting, and a checksum of
+ * its slice.  The leader turns those into an estimate of each follower's
+ * present time on its own clock (half the round trip for the network leg)
+ * and keeps skew statistics.  A checksum is a fold of per strip checksums,
+ * so the leader can check any slice inside its own against its own frame;
+ * slices outside it are compared between the nodes drawing them.  Either
+ * catches anything non-deterministic.
+ *
+ * Packets are sent in host order, every node is a Pi.
+ */
+
+#ifndef __CLUSTER_H__
+#define __CLUSTER_H__
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+#include "input.h"
+
+#define CLUSTER_GROUP_DEFAULT    "239.255.66.1"
+#define CLUSTER_PORT_DEFAULT     7772
+#define CLUSTER_MAGIC_CLOCK      0x4b4c4358    // "XCLK"
+#define CLUSTER_MAGIC_REPORT     0x50524358    // "XRRP"
+#define CLUSTER_HISTORY          64            // frames the leader remembers for matching reports
+#define CLUSTER_SLICES           8             // distinct slices per frame checked for agreement
+#define CLUSTER_PARAMS           64            // live parameters carried in each clock
+#define CLUSTER_MAX_STRIPS       64
+
+#define CLUSTER_NONE             0
+#define CLUSTER_LEADER           1
+#define CLUSTER_FOLLOWER         2
+
+
+typedef struct __attribute__((packed))
+{
+    uint32_t magic;
+    uint32_t frame;
+    uint64_t send_us;                  // leader's CLOCK_MONOTONIC at send
+    uint32_t seed;
+    uint8_t scene;
+    uint8_t quality;
+    uint8_t keyframe_phase;
+    uint8_t n_params;
+    int32_t scene_time[3];             // active scene's time accumulators at frame start
+    int32_t param[CLUSTER_PARAMS];     // leader's live parameters, followers adopt them
+    uint8_t motion[INPUT_MOTION_SIZE];
+} cluster_clock_t;
+
+typedef struct __attribute__((packed))
+{
+    uint32_t magic;
+    uint32_t frame;
+    uint32_t present_delay_us;         // clock received -> frame presented
+    uint32_t checksum;                 // of the follower's slice, cluster_fold()
+    uint16_t first_strip;
+    uint16_t end_strip;
+} cluster_report_t;
+
+typedef struct
+{
+    uint32_t frame;
+    uint64_t send_us;
+    uint64_t present_us;
+    uint32_t strip_checksum[CLUSTER_MAX_STRIPS];    // the leader's own, over its slice
+    int n_slices;                      // and reported slices outside it
+    uint16_t slice_first[CLUSTER_SLICES];
+    uint16_t slice_end[CLUSTER_SLICES];
+    uint32_t slice_checksum[CLUSTER_SLICES];
+} cluster_history_t;
+
+typedef struct
+{
+    int fd;
+    int role;
+    struct sockaddr_in group;
+    struct sockaddr_in leader;         // follower: where clocks come from, reports go back there
+    cluster_clock_t clock;             // last sent or received
+    uint64_t receive_us;               // follower: when the last clock arrived
+    int have_clock;
+    cluster_history_t history[CLUSTER_HISTORY];
+    int first_strip;                   // leader: its own slice, set by cluster_presented()
+    int end_strip;
+    // statistics since the last cluster_stats_reset()
+    unsigned long frames;
+    unsigned long missed;              // follower: clocks lost in the network
+    unsigned long reports;
+    unsigned long compared;            // slices checked against the leader's or another node's
+    unsigned long mismatches;          // same strips, different pixels
+    int64_t skew_sum_us;
+    int64_t skew_max_us;               // largest |skew|
+} cluster_t;
+
+
+int cluster_open(cluster_t *cluster, int role, const char *spec);
+void cluster_close(cluster_t *cluster);
+
+int cluster_publish(cluster_t *cluster, cluster_clock_t *clock);
+int cluster_wait(cluster_t *cluster, cluster_clock_t *clock, int timeout_ms);
+
+// strip_checksums is indexed by strip, only first_strip..end_strip - 1 are read
+uint32_t cluster_fold(const uint32_t *strip_checksums, int first_strip, int end_strip);
+void cluster_presented(cluster_t *cluster, uint32_t frame, uint64_t present_us, int first_strip, int end_strip,
+                       const uint32_t *strip_checksums);
+void cluster_collect(cluster_t *cluster);
+void cluster_stats_reset(cluster_t *cluster);
+
+
+#endif /* __CLUSTER_H__ */
@@ -0,0 +1,119 @@
+/*
+ * envelope.c
+ *
+ * Per strip tap envelopes, see envelope.h.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "envelope.h"
+
+
+int envelopes_init(envelopes_t *env, int n_strips, int n_envelopes)
+{
+    int id;
+
+    memset(env, 0, sizeof(*env));
+    if (n_envelopes > ENVELOPE_MAX) {
+        return -1;
+    }
+    env->n = n_strips;
+    env->n_envelopes = n_envelopes;
+    env->tap = calloc(n_strips, sizeof(uint8_t));
+    env->rise = calloc(n_strips, sizeof(int32_t));
+    if (env->tap == NULL || env->rise == NULL) {
+        envelopes_free(env);
+        return -1;
+    }
+    for (id = 0; id < n_envelopes; id++) {
+        env->setpoint[id] = calloc(n_strips, sizeof(int32_t));
+        env->level[id] = calloc(n_strips, sizeof(int32_t));
+        if (env->setpoint[id] == NULL || env->level[id] == NULL) {
+            envelopes_free(env);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void envelopes_free(envelopes_t *env)
+{
+    int id;
+
+    for (id = 0; id < ENVELOPE_MAX; id++) {
+        free(env->setpoint[id]);
+        free(env->level[id]);
+    }
+    free(env->tap);
+    free(env->rise);
+    memset(env, 0, sizeof(*env));
+}
+
+// a new shape applies from the next update, the state carries on
+void envelopes_shape(envelopes_t *env, int id, const envelope_shape_t *shape)
+{
+    env->shape[id] = *shape;
+}
+
+void envelopes_reset(envelopes_t *env, int id)
+{
+    int i;
+
+    for (i = 0; i < env->n; i++) {
+        env->setpoint[id][i] = env->shape[id].rest;
+        env->level[id][i] = env->shape[id].rest;
+    }
+}
+
+// taps[i] for strips 0..n_taps - 1, the rest see no taps
+void envelopes_update(envelopes_t *env, const uint8_t *taps, int n_taps)
+{
+    const envelope_shape_t *shape;
+    int32_t *setpoint, *level, target, rest, step, limit, gain;
+    int id, i, n = env->n < n_taps ? env->n : n_taps;
+
+    for (i = 0; i < n; i++) {
+        env->rise[i] = taps[i] > env->tap[i] ? taps[i] - env->tap[i] : 0;
+        env->tap[i] = taps[i];
+    }
+    for (; i < env->n; i++) {
+        env->rise[i] = 0;
+        env->tap[i] = 0;
+    }
+
+    for (id = 0; id < env->n_envelopes; id++) {
+        shape = &env->shape[id];
+        setpoint = env->setpoint[id];
+        level = env->level[id];
+        rest = shape->rest;
+        step = shape->step;
+        limit = shape->limit;
+        gain = shape->gain;
+
+        if (gain >= 0) {
+            for (i = 0; i < env->n; i++) {
+                target = rest + env->tap[i] * gain;
+                target = target > limit ? limit : target;
+                setpoint[i] = target > setpoint[i] ? target : setpoint[i];
+                setpoint[i] = setpoint[i] > rest + step ? setpoint[i] - step : rest;
+            }
+        } else {
+            for (i = 0; i < env->n; i++) {
+                target = rest + env->tap[i] * gain;
+                target = target < limit ? limit : target;
+                setpoint[i] = target < setpoint[i] ? target : setpoint[i];
+                setpoint[i] = setpoint[i] < rest - step ? setpoint[i] + step : rest;
+            }
+        }
+
+        if (shape->follow > 0) {
+            for (i = 0; i < env->n; i++) {
+                level[i] = (setpoint[i] + level[i] * ((1 << shape->follow) - 1)) >> shape->follow;
+            }
+        } else {
+            memcpy(level, setpoint, env->n * sizeof(int32_t));
+        }
+    }
+}
@@ -0,0 +1,56 @@
+/*
+ * envelope.h
+ *
+ * Tap envelopes for every strip, updated once per frame for all scenes.
+ * Each envelope has a set point that a tap pushes away from its rest value
+ * and that then steps back towards it, and a level that follows the set
+ * point smoothly.  Scenes only read the levels.
+ *
+ * A tap t attacks to rest + t * gain, no further than limit; a negative
+ * gain attacks downwards.  The set point only moves if the attack goes
+ * further than where it already is, so held taps hold it.  Every update it
+ * then steps `step` back towards rest, and the level moves 1 / 2^follow of
+ * the way to the set point (follow 0: the level is the set point).
+ *
+ * State is kept as a structure of arrays, one array per envelope over the
+ * strips, so each update is a few flat loops.
+ */
+
+#ifndef __ENVELOPE_H__
+#define __ENVELOPE_H__
+
+#include <stdint.h>
+
+#define ENVELOPE_MAX             8
+
+
+typedef struct
+{
+    int32_t rest;
+    int32_t gain;                      // per unit of tap
+    int32_t limit;
+    int32_t step;                      // back towards rest per update
+    int follow;                        // level follows the set point by 1 / 2^follow per update
+} envelope_shape_t;
+
+typedef struct
+{
+    int n;                             // strips
+    int n_envelopes;
+    envelope_shape_t shape[ENVELOPE_MAX];
+    int32_t *setpoint[ENVELOPE_MAX];
+    int32_t *level[ENVELOPE_MAX];
+    uint8_t *tap;                      // this update's tap per strip
+    int32_t *rise;                     // tap minus the previous update's, 0 if it fell
+} envelopes_t;
+
+
+int envelopes_init(envelopes_t *env, int n_strips, int n_envelopes);
+void envelopes_free(envelopes_t *env);
+
+void envelopes_shape(envelopes_t *env, int id, const envelope_shape_t *shape);
+void envelopes_reset(envelopes_t *env, int id);
+void envelopes_update(envelopes_t *env, const uint8_t *taps, int n_taps);
+
+
+#endif /* __ENVELOPE_H__ */
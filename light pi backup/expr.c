@@ -0,0 +1,823 @@
+/*
+ * expr.c
+ *
+ * Pattern expression compiler and block interpreter, see expr.h.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "box_fixmath.h"
+#include "expr.h"
+
+#define EXPR_SOURCE_MAX          8192
+
+enum {
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD, OP_SHL, OP_SHR, OP_AND, OP_OR, OP_XOR,
+    OP_MIN, OP_MAX, OP_NEG, OP_ABS, OP_COS, OP_WAVE8, OP_SQ8, OP_SHLK, OP_SHRK,
+    OP_ADD_COS, OP_COS_WAVE8, OP_ADD_COS_WAVE8, OP_MUL_SHRK    // fused by emit(), never parsed
+};
+
+#define OP_UNARY(op)    ((op) >= OP_NEG && (op) != OP_MUL_SHRK)
+
+// 4 lanes, NEON on the Pi, SSE on a desktop; inputs need not be 16 byte aligned
+typedef int32_t expr_v4_t __attribute__((vector_size(16), aligned(4), may_alias));
+typedef uint32_t expr_u4_t __attribute__((vector_size(16)));
+
+static const char *const input_names[EXPR_N_INPUTS] = {"x", "y", "z", "strip", "led", "tap"};
+
+static const struct
+{
+    const char *name;
+    int op;
+} functions[] = {
+    {"cos", OP_COS}, {"wave8", OP_WAVE8}, {"sq8", OP_SQ8}, {"abs", OP_ABS}, {"min", OP_MIN}, {"max", OP_MAX},
+};
+
+
+static int32_t eval_scalar(int op, int32_t a, int32_t b)
+{
+    switch (op) {
+    case OP_ADD:   return (int32_t)((uint32_t)a + (uint32_t)b);
+    case OP_SUB:   return (int32_t)((uint32_t)a - (uint32_t)b);
+    case OP_MUL:   return (int32_t)((uint32_t)a * (uint32_t)b);
+    case OP_DIV:   return (b == 0 || (b == -1 && a == INT32_MIN)) ? 0 : a / b;
+    case OP_MOD:   return (b == 0 || b == -1) ? 0 : a % b;
+    case OP_SHL:   return (int32_t)((uint32_t)a << (b & 31));
+    case OP_SHR:   return a >> (b & 31);
+    case OP_ADD_COS:       return fastCosineCalc((uint16_t)((uint32_t)a + b));
+    case OP_COS_WAVE8:     return fx_wave_to_u8(fastCosineCalc((uint16_t)a));
+    case OP_ADD_COS_WAVE8: return fx_wave_to_u8(fastCosineCalc((uint16_t)((uint32_t)a + b)));
+    case OP_AND:   return a & b;
+    case OP_OR:    return a | b;
+    case OP_XOR:   return a ^ b;
+    case OP_MIN:   return a < b ? a : b;
+    case OP_MAX:   return a > b ? a : b;
+    case OP_NEG:   return (int32_t)(0u - (uint32_t)a);
+    case OP_ABS:   return a < 0 ? (int32_t)(0u - (uint32_t)a) : a;
+    case OP_COS:   return fastCosineCalc((uint16_t)a);
+    case OP_WAVE8: return fx_wave_to_u8((fx_wave_t)a);
+    case OP_SQ8:   return fx_wave_sq_u8((fx_wave_t)a);
+    }
+    return 0;
+}
+
+
+// ---- compiler ----
+
+#define TOK_END      0
+#define TOK_NUM      256
+#define TOK_NAME     257
+#define TOK_SHL      258
+#define TOK_SHR      259
+
+typedef struct
+{
+    expr_prog_t *prog;
+    const char *pos;
+    int line;
+    int tok_line;                      // where the current token is, for errors
+    int depth;                         // inside parentheses newlines don't end a statement
+    int tok;
+    int32_t value;
+    char name[EXPR_NAME_LEN];
+    int n_locals;
+    char local[EXPR_MAX_LOCALS][EXPR_NAME_LEN];
+    int local_reg[EXPR_MAX_LOCALS];
+    uint8_t pinned[EXPR_MAX_REGS];     // inputs, uniforms, constants, per frame values and locals are never reused
+    uint8_t varying[EXPR_MAX_REGS];    // differs from LED to LED and frame to frame
+    uint8_t fixed[EXPR_MAX_REGS];      // differs from LED to LED only, the static code
+    uint8_t free[EXPR_MAX_REGS];
+    int failed;
+} parser_t;
+
+static void fail(parser_t *p, const char *what, const char *name)
+{
+    if (!p->failed) {
+        snprintf(p->prog->error, sizeof(p->prog->error), "line %i: %s%s%s", p->tok_line, what,
+                 name ? " " : "", name ? name : "");
+        p->failed = 1;
+    }
+}
+
+static void next(parser_t *p)
+{
+    const char *s = p->pos;
+    int len;
+
+    for (;;) {
+        while (*s == ' ' || *s == '\t' || *s == '\r' || (*s == '\n' && p->depth > 0)) {
+            p->line += *s == '\n';
+            s++;
+        }
+        if (*s != '#') {
+            break;
+        }
+        while (*s && *s != '\n') {
+            s++;
+        }
+    }
+
+    p->tok_line = p->line;
+    if (*s == 0) {
+        p->tok = TOK_END;
+    } else if (isdigit((unsigned char)*s)) {
+        p->tok = TOK_NUM;
+        p->value = (int32_t)strtoul(s, (char **)&s, 0);
+        p->pos = s;
+        return;
+    } else if (isalpha((unsigned char)*s) || *s == '_') {
+        for (len = 0; isalnum((unsigned char)s[len]) || s[len] == '_'; len++) {
+        }
+        if (len >= EXPR_NAME_LEN) {
+            fail(p, "name too long", NULL);
+            len = EXPR_NAME_LEN - 1;
+        }
+        memcpy(p->name, s, len);
+        p->name[len] = 0;
+        while (isalnum((unsigned char)*s) || *s == '_') {
+            s++;
+        }
+        p->tok = TOK_NAME;
+        p->pos = s;
+        return;
+    } else if ((s[0] == '<' && s[1] == '<') || (s[0] == '>' && s[1] == '>')) {
+        p->tok = s[0] == '<' ? TOK_SHL : TOK_SHR;
+        s++;
+    } else {
+        p->tok = *s == ';' ? '\n' : *s;
+        p->depth += (*s == '(') - (*s == ')');
+        if (p->depth < 0) {
+            p->depth = 0;
+        }
+    }
+    if (p->tok != TOK_END) {
+        s++;
+    }
+    if (p->tok == '\n' && *(s - 1) == '\n') {
+        p->line++;
+    }
+    p->pos = s;
+}
+
+// Constants are broadcast once per run, so they never share a register
+// with a temporary that an instruction writes.
+static int alloc_reg(parser_t *p, int reuse)
+{
+    int reg;
+
+    for (reg = 0; reuse && reg < p->prog->n_regs; reg++) {
+        if (p->free[reg]) {
+            p->free[reg] = 0;
+            return reg;
+        }
+    }
+    if (p->prog->n_regs == EXPR_MAX_REGS) {
+        fail(p, "expression too complex", NULL);
+        return -1;
+    }
+    return p->prog->n_regs++;
+}
+
+static void release_reg(parser_t *p, int reg)
+{
+    if (reg >= 0 && !p->pinned[reg]) {
+        p->free[reg] = 1;
+    }
+}
+
+static int const_reg(parser_t *p, int32_t value)
+{
+    expr_prog_t *prog = p->prog;
+    int reg;
+
+    for (reg = 0; reg < prog->n_regs; reg++) {
+        if (prog->is_const[reg] && prog->const_value[reg] == value) {
+            return reg;
+        }
+    }
+    reg = alloc_reg(p, 0);
+    if (reg >= 0) {
+        prog->is_const[reg] = 1;
+        prog->const_value[reg] = value;
+        p->pinned[reg] = 1;
+    }
+    return reg;
+}
+
+#define FIXED(r)    (p->fixed[r] || prog->is_const[r])
+#define PER_LED(r)  (p->fixed[r] || p->varying[r])
+
+// One instruction, or a constant if every operand is one.  Instructions on
+// uniforms alone go to the per frame list and those on the fixed LED inputs
+// alone to the static list, into registers of their own, so the per block
+// code never overwrites them.
+static int emit(parser_t *p, int op, int a, int b)
+{
+    expr_prog_t *prog = p->prog;
+    expr_insn_t *insn;
+    int dst, varying, fixed;
+
+    if (a < 0 || (!OP_UNARY(op) && b < 0)) {
+        return -1;
+    }
+    if (prog->is_const[a] && (OP_UNARY(op) || prog->is_const[b])) {
+        return const_reg(p, eval_scalar(op, prog->const_value[a], OP_UNARY(op) ? 0 : prog->const_value[b]));
+    }
+    // fixed only on fixed inputs and constants, else per LED on any per LED
+    // operand, else per frame
+    fixed = FIXED(a) && (OP_UNARY(op) || FIXED(b));
+    varying = !fixed && (PER_LED(a) || (!OP_UNARY(op) && PER_LED(b)));
+    if (varying ? prog->n_code == EXPR_MAX_CODE :
+        fixed ? prog->n_static_code == EXPR_MAX_STATIC_CODE : prog->n_frame_code == EXPR_MAX_FRAME_CODE) {
+        fail(p, "program too long", NULL);
+        return -1;
+    }
+
+    // cos(a + b) and wave8(cos(..)) are the plasma idiom, fuse them into the
+    // instruction that computed the operand to save a pass over the block
+    if (varying && prog->n_code > 0 && !p->pinned[a]) {
+        insn = &prog->code[prog->n_code - 1];
+        if (insn->dst == a && ((op == OP_COS && insn->op == OP_ADD) ||
+                               (op == OP_WAVE8 && (insn->op == OP_COS || insn->op == OP_ADD_COS)))) {
+            insn->op = op == OP_COS ? OP_ADD_COS : insn->op == OP_COS ? OP_COS_WAVE8 : OP_ADD_COS_WAVE8;
+            return a;
+        }
+        // and (a * b) >> k, fixed point scaling
+        if (insn->dst == a && op == OP_SHR && insn->op == OP_MUL && prog->is_const[b]) {
+            insn->op = OP_MUL_SHRK;
+            insn->k = prog->const_value[b] & 31;
+            return a;
+        }
+    }
+
+    release_reg(p, a);    // ops are elementwise, the result may overwrite an operand
+    if (!OP_UNARY(op)) {
+        release_reg(p, b);
+    }
+    dst = alloc_reg(p, varying);
+    if (dst < 0) {
+        return -1;
+    }
+    if (varying) {
+        insn = &prog->code[prog->n_code++];
+        p->varying[dst] = 1;
+    } else if (fixed) {
+        insn = &prog->static_code[prog->n_static_code++];
+        p->fixed[dst] = 1;
+        p->pinned[dst] = 1;
+    } else {
+        insn = &prog->frame_code[prog->n_frame_code++];
+        p->pinned[dst] = 1;
+    }
+    insn->op = op;
+    insn->dst = dst;
+    insn->a = a;
+    insn->b = OP_UNARY(op) ? a : b;
+    insn->k = 0;
+    if ((op == OP_SHL || op == OP_SHR) && prog->is_const[b]) {
+        insn->op = op == OP_SHL ? OP_SHLK : OP_SHRK;
+        insn->k = prog->const_value[b] & 31;
+    }
+    return dst;
+}
+#undef FIXED
+#undef PER_LED
+
+static int parse_or(parser_t *p);
+
+static int expect(parser_t *p, int tok, const char *what)
+{
+    if (p->tok != tok) {
+        fail(p, "expected", what);
+        return -1;
+    }
+    next(p);
+    return 0;
+}
+
+static int lookup(parser_t *p, const char *name)
+{
+    int i;
+
+    for (i = 0; i < p->n_locals; i++) {
+        if (strcmp(p->local[i], name) == 0) {
+            return p->local_reg[i];
+        }
+    }
+    for (i = 0; i < EXPR_N_INPUTS; i++) {
+        if (strcmp(input_names[i], name) == 0) {
+            return i;
+        }
+    }
+    for (i = 0; i < p->prog->n_uniforms; i++) {
+        if (strcmp(p->prog->uniform[i], name) == 0) {
+            return EXPR_N_INPUTS + i;
+        }
+    }
+    return -1;
+}
+
+static int parse_call(parser_t *p, const char *name)
+{
+    int i, op, a, b = -1;
+
+    for (i = 0; i < (int)(sizeof(functions) / sizeof(functions[0])); i++) {
+        if (strcmp(functions[i].name, name) == 0) {
+            break;
+        }
+    }
+    if (i == (int)(sizeof(functions) / sizeof(functions[0]))) {
+        fail(p, "unknown function", name);
+        return -1;
+    }
+    op = functions[i].op;
+
+    next(p);    // (
+    a = parse_or(p);
+    if (!OP_UNARY(op)) {
+        if (expect(p, ',', "','") < 0) {
+            return -1;
+        }
+        b = parse_or(p);
+    }
+    if (expect(p, ')', "')'") < 0) {
+        return -1;
+    }
+    return emit(p, op, a, b);
+}
+
+static int parse_primary(parser_t *p)
+{
+    char name[EXPR_NAME_LEN];
+    int reg;
+
+    if (p->tok == TOK_NUM) {
+        reg = const_reg(p, p->value);
+        next(p);
+        return reg;
+    }
+    if (p->tok == TOK_NAME) {
+        strcpy(name, p->name);
+        next(p);
+        if (p->tok == '(') {
+            return parse_call(p, name);
+        }
+        reg = lookup(p, name);
+        if (reg < 0) {
+            fail(p, "unknown name", name);
+        }
+        return reg;
+    }
+    if (p->tok == '(') {
+        next(p);
+        reg = parse_or(p);
+        if (expect(p, ')', "')'") < 0) {
+            return -1;
+        }
+        return reg;
+    }
+    fail(p, "expected a value", NULL);
+    return -1;
+}
+
+static int parse_unary(parser_t *p)
+{
+    if (p->tok == '-') {
+        next(p);
+        return emit(p, OP_NEG, parse_unary(p), -1);
+    }
+    if (p->tok == '+') {
+        next(p);
+        return parse_unary(p);
+    }
+    return parse_primary(p);
+}
+
+static int parse_mul(parser_t *p)
+{
+    int reg = parse_unary(p);
+    int op;
+
+    while (p->tok == '*' || p->tok == '/' || p->tok == '%') {
+        op = p->tok == '*' ? OP_MUL : p->tok == '/' ? OP_DIV : OP_MOD;
+        next(p);
+        reg = emit(p, op, reg, parse_unary(p));
+    }
+    return reg;
+}
+
+static int parse_add(parser_t *p)
+{
+    int reg = parse_mul(p);
+    int op;
+
+    while (p->tok == '+' || p->tok == '-') {
+        op = p->tok == '+' ? OP_ADD : OP_SUB;
+        next(p);
+        reg = emit(p, op, reg, parse_mul(p));
+    }
+    return reg;
+}
+
+static int parse_shift(parser_t *p)
+{
+    int reg = parse_add(p);
+    int op;
+
+    while (p->tok == TOK_SHL || p->tok == TOK_SHR) {
+        op = p->tok == TOK_SHL ? OP_SHL : OP_SHR;
+        next(p);
+        reg = emit(p, op, reg, parse_add(p));
+    }
+    return reg;
+}
+
+static int parse_and(parser_t *p)
+{
+    int reg = parse_shift(p);
+
+    while (p->tok == '&') {
+        next(p);
+        reg = emit(p, OP_AND, reg, parse_shift(p));
+    }
+    return reg;
+}
+
+static int parse_xor(parser_t *p)
+{
+    int reg = parse_and(p);
+
+    while (p->tok == '^') {
+        next(p);
+        reg = emit(p, OP_XOR, reg, parse_and(p));
+    }
+    return reg;
+}
+
+static int parse_or(parser_t *p)
+{
+    int reg = parse_xor(p);
+
+    while (p->tok == '|') {
+        next(p);
+        reg = emit(p, OP_OR, reg, parse_xor(p));
+    }
+    return reg;
+}
+
+static void parse_assignment(parser_t *p)
+{
+    char name[EXPR_NAME_LEN];
+    int i, reg;
+
+    if (p->tok != TOK_NAME) {
+        fail(p, "expected", "name = expression");
+        return;
+    }
+    strcpy(name, p->name);
+    for (i = 0; i < p->n_locals && strcmp(p->local[i], name) != 0; i++) {
+    }
+    if (i == p->n_locals && lookup(p, name) >= 0) {
+        fail(p, "cannot assign to input", name);
+        return;
+    }
+    next(p);
+    if (expect(p, '=', "'='") < 0) {
+        return;
+    }
+    reg = parse_or(p);
+    if (reg < 0) {
+        return;
+    }
+    if (p->tok != '\n' && p->tok != TOK_END) {
+        fail(p, "expected end of line", NULL);
+        return;
+    }
+
+    if (i == p->n_locals) {
+        if (p->n_locals == EXPR_MAX_LOCALS) {
+            fail(p, "too many names", NULL);
+            return;
+        }
+        strcpy(p->local[p->n_locals++], name);
+    }
+    p->local_reg[i] = reg;
+    p->pinned[reg] = 1;
+}
+
+int expr_compile(expr_prog_t *prog, const char *source, const char *const *uniforms, int n_uniforms)
+{
+    parser_t p;
+    int i;
+
+    memset(prog, 0, sizeof(*prog));
+    memset(&p, 0, sizeof(p));
+    p.prog = prog;
+    p.pos = source;
+    p.line = 1;
+
+    if (n_uniforms > EXPR_MAX_UNIFORMS) {
+        snprintf(prog->error, sizeof(prog->error), "too many uniforms");
+        return -1;
+    }
+    prog->n_uniforms = n_uniforms;
+    for (i = 0; i < n_uniforms; i++) {
+        strncpy(prog->uniform[i], uniforms[i], EXPR_NAME_LEN - 1);
+    }
+    prog->n_regs = EXPR_N_INPUTS + n_uniforms;
+    memset(p.pinned, 1, prog->n_regs);
+    memset(p.fixed, 1, EXPR_N_INPUTS);
+    p.fixed[EXPR_IN_TAP] = 0;    // set every frame
+    p.varying[EXPR_IN_TAP] = 1;
+
+    next(&p);
+    while (p.tok != TOK_END && !p.failed) {
+        if (p.tok == '\n') {
+            next(&p);
+            continue;
+        }
+        parse_assignment(&p);
+    }
+    if (p.failed) {
+        return -1;
+    }
+
+    prog->out[EXPR_OUT_R] = lookup(&p, "r");
+    prog->out[EXPR_OUT_G] = lookup(&p, "g");
+    prog->out[EXPR_OUT_B] = lookup(&p, "b");
+    return 0;
+}
+
+int expr_load(expr_prog_t *prog, const char *path, const char *const *uniforms, int n_uniforms)
+{
+    char *source;
+    FILE *f;
+    size_t len;
+    int ret;
+
+    f = fopen(path, "r");
+    if (f == NULL) {
+        snprintf(prog->error, sizeof(prog->error), "unable to open %s", path);
+        return -1;
+    }
+    source = malloc(EXPR_SOURCE_MAX + 1);
+    if (source == NULL) {
+        fclose(f);
+        return -1;
+    }
+    len = fread(source, 1, EXPR_SOURCE_MAX, f);
+    source[len] = 0;
+    fclose(f);
+
+    ret = expr_compile(prog, source, uniforms, n_uniforms);
+    free(source);
+    return ret;
+}
+
+
+// ---- block interpreter ----
+
+static void run_insn(const expr_insn_t *insn, int32_t *const *reg)
+{
+    int32_t *d = reg[insn->dst];
+    const int32_t *a = reg[insn->a];
+    const int32_t *b = reg[insn->b];
+    expr_v4_t va, vb, mask;
+    int i, k = insn->k;
+
+    switch (insn->op) {
+#define VECTOR_OP(op, expr)                                     \
+    case op:                                                    \
+        for (i = 0; i < EXPR_BLOCK; i += 4) {                   \
+            va = *(const expr_v4_t *)(a + i);                   \
+            vb = *(const expr_v4_t *)(b + i);                   \
+            *(expr_v4_t *)(d + i) = (expr);                     \
+        }                                                       \
+        break;
+    VECTOR_OP(OP_ADD, va + vb)
+    VECTOR_OP(OP_SUB, va - vb)
+    VECTOR_OP(OP_MUL, va * vb)
+    VECTOR_OP(OP_SHL, va << (vb & 31))
+    VECTOR_OP(OP_SHR, va >> (vb & 31))
+    VECTOR_OP(OP_SHLK, va << k)
+    VECTOR_OP(OP_SHRK, va >> k)
+    VECTOR_OP(OP_MUL_SHRK, (va * vb) >> k)
+    VECTOR_OP(OP_AND, va & vb)
+    VECTOR_OP(OP_OR, va | vb)
+    VECTOR_OP(OP_XOR, va ^ vb)
+    VECTOR_OP(OP_NEG, -va)
+    VECTOR_OP(OP_MIN, (mask = va < vb, (va & mask) | (vb & ~mask)))
+    VECTOR_OP(OP_MAX, (mask = va > vb, (va & mask) | (vb & ~mask)))
+    VECTOR_OP(OP_ABS, (mask = va >> 31, (va ^ mask) - mask))
+    VECTOR_OP(OP_WAVE8, (va & 0xffff) >> (FX_PHASE_BITS - 8))
+    VECTOR_OP(OP_SQ8, (expr_v4_t)((expr_u4_t)((va & 0xffff) * (va & 0xffff)) >> (2 * FX_PHASE_BITS - 8)) & 0xff)
+#undef VECTOR_OP
+    case OP_COS:    // table lookups, one lane at a time
+        for (i = 0; i < EXPR_BLOCK; i++) {
+            d[i] = fastCosineCalc((uint16_t)a[i]);
+        }
+        break;
+    case OP_ADD_COS:
+        for (i = 0; i < EXPR_BLOCK; i++) {
+            d[i] = fastCosineCalc((uint16_t)((uint32_t)a[i] + b[i]));
+        }
+        break;
+    case OP_COS_WAVE8:
+        for (i = 0; i < EXPR_BLOCK; i++) {
+            d[i] = fx_wave_to_u8(fastCosineCalc((uint16_t)a[i]));
+        }
+        break;
+    case OP_ADD_COS_WAVE8:
+        for (i = 0; i < EXPR_BLOCK; i++) {
+            d[i] = fx_wave_to_u8(fastCosineCalc((uint16_t)((uint32_t)a[i] + b[i])));
+        }
+        break;
+    default:
+        for (i = 0; i < EXPR_BLOCK; i++) {
+            d[i] = eval_scalar(insn->op, a[i], b[i]);
+        }
+        break;
+    }
+}
+
+// registers in scratch, constants broadcast
+static void init_regs(const expr_prog_t *prog, int32_t (*scratch)[EXPR_BLOCK], int32_t **reg)
+{
+    int r, i;
+
+    for (r = 0; r < prog->n_regs; r++) {
+        reg[r] = scratch[r];
+        if (prog->is_const[r]) {
+            for (i = 0; i < EXPR_BLOCK; i++) {
+                scratch[r][i] = prog->const_value[r];
+            }
+        }
+    }
+}
+
+void expr_free(expr_prog_t *prog)
+{
+    int r;
+
+    for (r = 0; r < EXPR_MAX_REGS; r++) {
+        free(prog->static_values[r]);
+        prog->static_values[r] = NULL;
+    }
+    prog->prepared = NULL;
+}
+
+int expr_prepare(expr_prog_t *prog, const expr_leds_t *leds)
+{
+    int32_t scratch[EXPR_MAX_REGS][EXPR_BLOCK] __attribute__((aligned(16)));
+    int32_t *reg[EXPR_MAX_REGS];
+    int base, r, i;
+
+    expr_free(prog);
+    if (prog->n_static_code == 0) {
+        prog->prepared = leds;
+        return 0;
+    }
+    for (i = 0; i < prog->n_static_code; i++) {
+        r = prog->static_code[i].dst;
+        prog->static_values[r] = malloc((leds->capacity ? leds->capacity : EXPR_BLOCK) * sizeof(int32_t));
+        if (prog->static_values[r] == NULL) {
+            expr_free(prog);
+            return -1;
+        }
+    }
+
+    init_regs(prog, scratch, reg);
+    for (base = 0; base < leds->capacity; base += EXPR_BLOCK) {
+        for (r = 0; r < EXPR_N_INPUTS; r++) {
+            reg[r] = leds->in[r] + base;
+        }
+        for (i = 0; i < prog->n_static_code; i++) {
+            r = prog->static_code[i].dst;
+            reg[r] = prog->static_values[r] + base;
+            run_insn(&prog->static_code[i], reg);
+        }
+    }
+    prog->prepared = leds;
+    return 0;
+}
+
+void expr_run(const expr_prog_t *prog, const expr_leds_t *leds, const int32_t *uniforms,
+              int first_led, int end_led, uint32_t *matrix)
+{
+    static const int32_t zero[EXPR_BLOCK] __attribute__((aligned(16)));
+    int32_t scratch[EXPR_MAX_REGS][EXPR_BLOCK] __attribute__((aligned(16)));
+    uint32_t packed[EXPR_BLOCK] __attribute__((aligned(16)));
+    int32_t *reg[EXPR_MAX_REGS];
+    const int32_t *out[3];
+    expr_v4_t c[3], lo = {0, 0, 0, 0}, hi = {255, 255, 255, 255}, mask;
+    int base, from, to, r, i, k, prepared = prog->prepared == leds;
+
+    if (end_led > leds->n_leds) {
+        end_led = leds->n_leds;
+    }
+
+    init_regs(prog, scratch, reg);
+    for (r = 0; r < prog->n_uniforms; r++) {
+        for (i = 0; i < EXPR_BLOCK; i++) {
+            scratch[EXPR_N_INPUTS + r][i] = uniforms[r];
+        }
+    }
+    for (i = 0; i < prog->n_frame_code; i++) {
+        run_insn(&prog->frame_code[i], reg);
+    }
+
+    for (base = first_led - first_led % EXPR_BLOCK; base < end_led; base += EXPR_BLOCK) {
+        for (r = 0; r < EXPR_N_INPUTS; r++) {
+            reg[r] = leds->in[r] + base;    // capacity is whole blocks
+        }
+        for (i = 0; i < prog->n_static_code; i++) {
+            if (prepared) {
+                reg[prog->static_code[i].dst] = prog->static_values[prog->static_code[i].dst] + base;
+            } else {
+                run_insn(&prog->static_code[i], reg);
+            }
+        }
+        for (i = 0; i < prog->n_code; i++) {
+            run_insn(&prog->code[i], reg);
+        }
+
+        for (k = 0; k < 3; k++) {
+            out[k] = prog->out[k] >= 0 ? reg[prog->out[k]] : zero;
+        }
+        for (i = 0; i < EXPR_BLOCK; i += 4) {
+            for (k = 0; k < 3; k++) {
+                c[k] = *(const expr_v4_t *)(out[k] + i);
+                mask = c[k] < lo;
+                c[k] &= ~mask;
+                mask = c[k] > hi;
+                c[k] = (c[k] & ~mask) | (hi & mask);
+            }
+            *(expr_v4_t *)(packed + i) = (c[0] << 16) | (c[1] << 8) | c[2];
+        }
+
+        from = base < first_led ? first_led : base;
+        to = base + EXPR_BLOCK > end_led ? end_led : base + EXPR_BLOCK;
+        memcpy(matrix + from, packed + (from - base), (to - from) * sizeof(uint32_t));
+    }
+}
+
+
+// ---- LED inputs ----
+
+int expr_leds_init(expr_leds_t *leds, int n_strips, const int *lengths, const int *x, const int *y)
+{
+    int strip, led, n, k;
+
+    memset(leds, 0, sizeof(*leds));
+    for (strip = 0; strip < n_strips; strip++) {
+        leds->n_leds += lengths[strip];
+    }
+    leds->capacity = (leds->n_leds + EXPR_BLOCK - 1) / EXPR_BLOCK * EXPR_BLOCK;
+    for (k = 0; k < EXPR_N_INPUTS; k++) {
+        leds->in[k] = calloc(leds->capacity ? leds->capacity : EXPR_BLOCK, sizeof(int32_t));
+        if (leds->in[k] == NULL) {
+            expr_leds_free(leds);
+            return -1;
+        }
+    }
+
+    n = 0;
+    for (strip = 0; strip < n_strips; strip++) {
+        for (led = 0; led < lengths[strip]; led++, n++) {
+            leds->in[EXPR_IN_X][n] = x[strip];
+            leds->in[EXPR_IN_Y][n] = y[strip];
+            leds->in[EXPR_IN_Z][n] = lengths[strip] - led;
+            leds->in[EXPR_IN_STRIP][n] = strip;
+            leds->in[EXPR_IN_LED][n] = led;
+        }
+    }
+    return 0;
+}
+
+// per strip values, e.g. the tap envelope, spread over the strip's LEDs
+void expr_leds_set_strip(expr_leds_t *leds, int input, const int *per_strip)
+{
+    const int32_t *strip = leds->in[EXPR_IN_STRIP];
+    int32_t *in = leds->in[input];
+    int i;
+
+    for (i = 0; i < leds->n_leds; i++) {
+        in[i] = per_strip[strip[i]];
+    }
+}
+
+void expr_leds_free(expr_leds_t *leds)
+{
+    int k;
+
+    for (k = 0; k < EXPR_N_INPUTS; k++) {
+        free(leds->in[k]);
+        leds->in[k] = NULL;
+    }
+    leds->n_leds = 0;
+    leds->capacity = 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * expr.h
+ *
+ * Pattern expressions: per LED colour written as a few lines of integer
+ * arithmetic instead of C.  A program is a list of assignments, one per line
+ * or separated by ';', # starts a comment:
+ *
+ *   p1 = ((y - x + z) * 10 * scale) >> 6
+ *   r = wave8(cos(p1 + (t3 >> 1)))
+ *
+ * r, g and b are the output channels, clamped to 0..255 (unassigned = 0);
+ * any other name assigned is a local.  Per LED inputs are x and y (strip
+ * position), z (LEDs from the strip end, as the scenes use it), strip, led
+ * (index within the strip) and tap (the strip's tap envelope, Q10).  The
+ * caller names its own per frame uniforms, e.g. t1..t3 and scale.
+ *
+ * Operators are C's + - * / % << >> & | ^ and unary -, with C precedence,
+ * on 32 bit ints; x / 0 and x % 0 are 0.  Functions:
+ *
+ *   cos(a)       fastCosineCalc(a), 11 bit phase in, 0..2047 out
+ *   wave8(a)     fx_wave_to_u8(a)
+ *   sq8(a)       fx_wave_sq_u8(a)
+ *   abs(a), min(a, b), max(a, b)
+ *
+ * expr_compile() turns the source into flat register bytecode once, folding
+ * constants and splitting off whatever depends only on the uniforms, which
+ * runs once per frame, and whatever depends only on x, y, z, strip and led,
+ * which doesn't change from frame to frame: expr_prepare() works that out
+ * once per LED and keeps it.  expr_run() then executes the rest in blocks
+ * of EXPR_BLOCK: each instruction is one tight loop over the block, on 4
+ * lane vectors where the op has one, with the inputs read straight from the
+ * structure of arrays in expr_leds_t.  A multiply followed by a constant
+ * shift, the fixed point idiom, is one instruction.
+ *
+ * That is not hand written speed: the cos() lookups go one lane at a time
+ * as they do in C, and everything else is another pass over the block.
+ * box_exprbench puts the plasma at a little under twice its C.
+ */
+
+#ifndef __EXPR_H__
+#define __EXPR_H__
+
+#include <stdint.h>
+
+#define EXPR_BLOCK               64     // LEDs per block, multiple of 4
+#define EXPR_MAX_REGS            64
+#define EXPR_MAX_CODE            256
+#define EXPR_MAX_FRAME_CODE      64
+#define EXPR_MAX_STATIC_CODE     32
+#define EXPR_MAX_UNIFORMS        8
+#define EXPR_MAX_LOCALS          24
+#define EXPR_NAME_LEN            16
+
+// per LED inputs, registers 0..EXPR_N_INPUTS-1
+#define EXPR_IN_X                0
+#define EXPR_IN_Y                1
+#define EXPR_IN_Z                2
+#define EXPR_IN_STRIP            3
+#define EXPR_IN_LED              4
+#define EXPR_IN_TAP              5
+#define EXPR_N_INPUTS            6
+
+#define EXPR_OUT_R               0
+#define EXPR_OUT_G               1
+#define EXPR_OUT_B               2
+
+
+// per LED inputs as a structure of arrays, padded to whole blocks
+typedef struct
+{
+    int n_leds;
+    int capacity;
+    int32_t *in[EXPR_N_INPUTS];
+} expr_leds_t;
+
+typedef struct
+{
+    uint8_t op;
+    uint8_t dst;
+    uint8_t a;
+    uint8_t b;
+    uint8_t k;                         // constant shift of the *K ops
+} expr_insn_t;
+
+typedef struct
+{
+    int n_frame_code;                  // depends only on uniforms, run once per expr_run()
+    expr_insn_t frame_code[EXPR_MAX_FRAME_CODE];
+    int n_static_code;                 // depends only on the fixed LED inputs, see expr_prepare()
+    expr_insn_t static_code[EXPR_MAX_STATIC_CODE];
+    int n_code;                        // run for every block of LEDs
+    expr_insn_t code[EXPR_MAX_CODE];
+    int n_regs;
+    int n_uniforms;
+    char uniform[EXPR_MAX_UNIFORMS][EXPR_NAME_LEN];
+    uint8_t is_const[EXPR_MAX_REGS];
+    int32_t const_value[EXPR_MAX_REGS];
+    int out[3];                        // register per channel, -1 = 0
+    const expr_leds_t *prepared;       // the LEDs static_values are for, NULL none
+    int32_t *static_values[EXPR_MAX_REGS];    // per register the static code writes
+    char error[96];
+} expr_prog_t;
+
+
+int expr_compile(expr_prog_t *prog, const char *source, const char *const *uniforms, int n_uniforms);
+int expr_load(expr_prog_t *prog, const char *path, const char *const *uniforms, int n_uniforms);
+// Works out the static code for every LED of leds and keeps it for
+// expr_run() with the same leds, until their x, y, z, strip or led change;
+// without it expr_run() repeats it every block.  -1 if out of memory.
+int expr_prepare(expr_prog_t *prog, const expr_leds_t *leds);
+void expr_free(expr_prog_t *prog);    // what expr_prepare() kept
+void expr_run(const expr_prog_t *prog, const expr_leds_t *leds, const int32_t *uniforms,
+              int first_led, int end_led, uint32_t *matrix);
+
+int expr_leds_init(expr_leds_t *leds, int n_strips, const int *lengths, const int *x, const int *y);
+void expr_leds_set_strip(expr_leds_t *leds, int input, const int *per_strip);
+void expr_leds_free(expr_leds_t *leds);
+
+
+#endif /* __EXPR_H__ */
@@ -0,0 +1,102 @@
+/*
+ * hubclock.c
+ *
+ * The hub's clock mapped onto the Pi's, see hubclock.h.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "hubclock.h"
+
+
+void hubclock_init(hubclock_t *clock)
+{
+    memset(clock, 0, sizeof(*clock));
+}
+
+// least squares through the window points, relative to the newest so the
+// doubles keep their precision
+static void fit(hubclock_t *clock)
+{
+    int newest = (clock->next_point + HUBCLOCK_WINDOWS - 1) % HUBCLOCK_WINDOWS;
+    int64_t x0 = clock->point_hub_us[newest], y0 = clock->point_delay_us[newest];
+    double n = clock->n_points, sx = 0, sy = 0, sxx = 0, sxy = 0, x, y, d;
+    int i;
+
+    for (i = 0; i < clock->n_points; i++) {
+        x = clock->point_hub_us[i] - x0;
+        y = clock->point_delay_us[i] - y0;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    d = n * sxx - sx * sx;
+    clock->drift = clock->n_points >= 2 && d > 0 ? (n * sxy - sx * sy) / d : 0;
+    clock->fit_hub_us = x0;
+    clock->offset_us = y0 + (sy - clock->drift * sx) / n;
+}
+
+static int64_t unwrap(const hubclock_t *clock, uint32_t hub_us)
+{
+    return clock->hub_us + (int32_t)(hub_us - clock->hub_raw);
+}
+
+void hubclock_add(hubclock_t *clock, uint32_t hub_us, uint64_t pi_us)
+{
+    int64_t hub, delay;
+
+    if (clock->started) {
+        hub = unwrap(clock, hub_us);
+        if (hub < clock->hub_us || hub > clock->hub_us + HUBCLOCK_JUMP_US) {
+            clock->started = 0;
+            clock->restarts++;
+        }
+    }
+    if (!clock->started) {
+        clock->started = 1;
+        clock->n_points = clock->next_point = 0;
+        clock->hub_raw = hub_us;
+        clock->hub_us = hub_us;
+        clock->window_end_us = clock->hub_us + HUBCLOCK_WINDOW_US;
+        clock->window_delay_us = INT64_MAX;
+    }
+    hub = unwrap(clock, hub_us);
+    clock->hub_raw = hub_us;
+    clock->hub_us = hub;
+    clock->samples++;
+
+    delay = (int64_t)pi_us - hub;
+    if (delay < clock->window_delay_us) {
+        clock->window_delay_us = delay;
+        clock->window_hub_us = hub;
+    }
+
+    if (hub >= clock->window_end_us) {
+        clock->point_hub_us[clock->next_point] = clock->window_hub_us;
+        clock->point_delay_us[clock->next_point] = clock->window_delay_us;
+        clock->next_point = (clock->next_point + 1) % HUBCLOCK_WINDOWS;
+        if (clock->n_points < HUBCLOCK_WINDOWS) {
+            clock->n_points++;
+        }
+        fit(clock);
+        clock->window_end_us = hub + HUBCLOCK_WINDOW_US;
+        clock->window_delay_us = INT64_MAX;
+    } else if (clock->n_points == 0) {
+        clock->fit_hub_us = clock->window_hub_us;
+        clock->offset_us = clock->window_delay_us;
+        clock->drift = 0;
+    }
+}
+
+uint64_t hubclock_to_pi(const hubclock_t *clock, uint32_t hub_us)
+{
+    int64_t hub;
+
+    if (!clock->started) {
+        return 0;
+    }
+    hub = unwrap(clock, hub_us);
+    return hub + (int64_t)(clock->offset_us + clock->drift * (hub - clock->fit_hub_us));
+}
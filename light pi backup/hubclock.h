@@ -0,0 +1,53 @@
+/*
+ * hubclock.h
+ *
+ * The hub's micros() mapped onto the Pi's CLOCK_MONOTONIC.  Every frame
+ * gives a pair of the hub's time for it and the Pi's when it came in; the
+ * difference is the clock offset plus however long the bytes took, which
+ * is never less than the wire time and often more, so only the least
+ * difference over each window of HUBCLOCK_WINDOW_US counts.  A line fitted
+ * through the last HUBCLOCK_WINDOWS of those gives the offset and how fast
+ * the two crystals drift apart; before there are two, the least so far is
+ * taken with no drift.
+ *
+ * The hub's time wraps every 71 minutes, which is unwrapped; going back, or
+ * forward by more than HUBCLOCK_JUMP_US, is the hub starting over and the
+ * fit starts again.
+ */
+
+#ifndef __HUBCLOCK_H__
+#define __HUBCLOCK_H__
+
+#include <stdint.h>
+
+#define HUBCLOCK_WINDOW_US       1000000
+#define HUBCLOCK_WINDOWS         16
+#define HUBCLOCK_JUMP_US         10000000
+
+
+typedef struct
+{
+    int started;
+    uint32_t hub_raw;                  // the last hub time, as sent
+    int64_t hub_us;                    // and unwrapped
+    int64_t window_end_us;
+    int64_t window_hub_us;             // where in the window the least delay was
+    int64_t window_delay_us;
+    int64_t point_hub_us[HUBCLOCK_WINDOWS];
+    int64_t point_delay_us[HUBCLOCK_WINDOWS];
+    int n_points;
+    int next_point;
+    int64_t fit_hub_us;                // Pi time = hub + offset + drift * (hub - fit_hub)
+    double offset_us;
+    double drift;
+    unsigned long samples;
+    unsigned long restarts;
+} hubclock_t;
+
+
+void hubclock_init(hubclock_t *clock);
+void hubclock_add(hubclock_t *clock, uint32_t hub_us, uint64_t pi_us);
+uint64_t hubclock_to_pi(const hubclock_t *clock, uint32_t hub_us);    // 0 before the first sample
+
+
+#endif /* __HUBCLOCK_H__ */
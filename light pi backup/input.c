@@ -0,0 +1,64 @@
+/*
+ * input.c
+ *
+ * Timestamped input events for the renderer.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "input.h"
+
+
+uint64_t input_now_us(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// returns the slot to fill in, or NULL when the batch is full for this frame
+input_event_t *input_push(input_batch_t *batch, uint64_t time_us, int type, int source)
+{
+    input_event_t *event;
+
+    if (batch->count >= INPUT_MAX_EVENTS) {
+        batch->dropped++;
+        return NULL;
+    }
+
+    event = &batch->event[batch->count++];
+    event->time_us = time_us;
+    event->type = type;
+    event->source = source;
+    event->index = 0;
+    event->value = 0;
+
+    return event;
+}
+
+// Stable insertion sort.  Each source already delivers in order, so the
+// batch is a few interleaved runs and this stays close to linear.
+void input_sort(input_batch_t *batch)
+{
+    input_event_t tmp;
+    int i, j;
+
+    for (i = 1; i < batch->count; i++) {
+        if (batch->event[i].time_us >= batch->event[i - 1].time_us) {
+            continue;
+        }
+        tmp = batch->event[i];
+        for (j = i; j > 0 && batch->event[j - 1].time_us > tmp.time_us; j--) {
+            batch->event[j] = batch->event[j - 1];
+        }
+        batch->event[j] = tmp;
+    }
+}
+
+void input_clear(input_batch_t *batch)
+{
+    batch->count = 0;
+}
@@ -0,0 +1,50 @@
+/*
+ * input.h
+ *
+ * Timestamped input events for the renderer.  Every source (the hub's serial
+ * stream, UDP) pushes into one batch per frame, the batch is sorted by time
+ * and applied in order so scene changes from different sources resolve to
+ * whichever actually came last.
+ */
+
+#ifndef __INPUT_H__
+#define __INPUT_H__
+
+#include <stdint.h>
+
+#define INPUT_MOTION_SIZE        31    // scene byte + 30 sensor slots, as motion_data
+#define INPUT_MAX_EVENTS         512
+
+#define INPUT_EVENT_PACKET       0     // a complete motion packet from the hub
+#define INPUT_EVENT_SCENE        1     // scene change, value = scene
+#define INPUT_EVENT_TAP          2     // one sensor tap, index = sensor, value = strength
+
+#define INPUT_SOURCE_SERIAL      0
+#define INPUT_SOURCE_UDP         1
+
+
+typedef struct
+{
+    uint64_t time_us;                  // CLOCK_MONOTONIC
+    uint8_t type;
+    uint8_t source;
+    uint8_t index;
+    uint8_t value;
+    uint8_t motion[INPUT_MOTION_SIZE]; // INPUT_EVENT_PACKET only
+} input_event_t;
+
+typedef struct
+{
+    input_event_t event[INPUT_MAX_EVENTS];
+    int count;
+    unsigned long dropped;             // events lost to a full batch
+} input_batch_t;
+
+
+uint64_t input_now_us(void);
+input_event_t *input_push(input_batch_t *batch, uint64_t time_us, int type, int source);
+void input_sort(input_batch_t *batch);
+void input_clear(input_batch_t *batch);
+
+
+#endif /* __INPUT_H__ */
@@ -0,0 +1,233 @@
+/*
+ * layout.c
+ *
+ * Installation layout file, see layout.h for the format.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "layout.h"
+
+#define LAYOUT_LINE_LEN    256
+
+
+void layout_init(layout_t *layout)
+{
+    memset(layout, 0, sizeof(*layout));
+}
+
+static int parse_line(layout_t *layout, char *line, unsigned char *defined)
+{
+    layout_universe_t *universe;
+    layout_strip_t *strip;
+    char *word, *end;
+    long value;
+    int index, length, x, y;
+
+    word = strtok(line, " \t\r\n");
+    if (word == NULL || word[0] == '#') {
+        return 0;
+    }
+
+    if (strcmp(word, "strip") == 0) {
+        word = strtok(NULL, "");
+        if (word == NULL || sscanf(word, "%i %i %i %i", &index, &length, &x, &y) != 4) {
+            return -1;
+        }
+        if (index < 0 || index >= LAYOUT_MAX_STRIPS || length <= 0 || defined[index]) {
+            return -1;
+        }
+        strip = &layout->strip[index];
+        strip->length = length;
+        strip->x = x;
+        strip->y = y;
+        defined[index] = 1;
+        if (index >= layout->n_strips) {
+            layout->n_strips = index + 1;
+        }
+    } else if (strcmp(word, "universe") == 0) {
+        if (layout->n_universes >= LAYOUT_MAX_UNIVERSES) {
+            return -1;
+        }
+        universe = &layout->universe[layout->n_universes];
+        memset(universe, 0, sizeof(*universe));
+        word = strtok(NULL, " \t\r\n");
+        if (word == NULL) {
+            return -1;
+        }
+        universe->number = strtol(word, &end, 0);
+        if (*end != 0) {
+            return -1;
+        }
+        while ((word = strtok(NULL, " \t\r\n")) != NULL && word[0] != '#') {
+            value = strtol(word, &end, 0);
+            if (*end != 0 || value < 0 || value >= LAYOUT_MAX_STRIPS || universe->n_strips >= LAYOUT_MAX_UNIVERSE_STRIPS) {
+                return -1;
+            }
+            universe->strip[universe->n_strips++] = value;
+        }
+        if (universe->n_strips == 0) {
+            return -1;
+        }
+        layout->n_universes++;
+    } else if (strcmp(word, "output") == 0) {
+        word = strtok(NULL, " \t\r\n");
+        if (word == NULL) {
+            return -1;
+        }
+        if (strcmp(word, "e131") == 0) {
+            layout->output = LAYOUT_OUTPUT_E131;
+        } else if (strcmp(word, "artnet") == 0) {
+            layout->output = LAYOUT_OUTPUT_ARTNET;
+        } else {
+            return -1;
+        }
+        word = strtok(NULL, " \t\r\n");
+        if (word != NULL && word[0] != '#') {
+            if (strlen(word) >= sizeof(layout->target)) {
+                return -1;
+            }
+            strcpy(layout->target, word);
+        }
+    } else if (strcmp(word, "sync") == 0) {
+        word = strtok(NULL, " \t\r\n");
+        if (word == NULL) {
+            return -1;
+        }
+        layout->sync_universe = strtol(word, &end, 0);
+        if (*end != 0 || layout->sync_universe <= 0) {
+            return -1;
+        }
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+int layout_load(layout_t *layout, const char *path)
+{
+    unsigned char defined[LAYOUT_MAX_STRIPS];
+    char line[LAYOUT_LINE_LEN];
+    int line_number = 0;
+    int i;
+    FILE *f;
+
+    layout_init(layout);
+    memset(defined, 0, sizeof(defined));
+
+    f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line_number++;
+        if (parse_line(layout, line, defined) < 0) {
+            fprintf(stderr, "%s:%i: bad layout line\n", path, line_number);
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+
+    for (i = 0; i < layout->n_strips; i++) {
+        if (!defined[i]) {
+            fprintf(stderr, "%s: strip %i missing\n", path, i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// fills in the geometry from the renderer's own tables, for layout files
+// that only describe the network side
+void layout_set_strips(layout_t *layout, int n_strips, const int *lengths, const int *x, const int *y)
+{
+    int i;
+
+    if (n_strips > LAYOUT_MAX_STRIPS) {
+        n_strips = LAYOUT_MAX_STRIPS;
+    }
+    for (i = 0; i < n_strips; i++) {
+        layout->strip[i].length = lengths[i];
+        layout->strip[i].x = x[i];
+        layout->strip[i].y = y[i];
+    }
+    layout->n_strips = n_strips;
+}
+
+// Works out strip offsets and universe sizes once the geometry is final.
+// Returns -1 if a universe names a missing strip or overflows.
+int layout_check(layout_t *layout)
+{
+    layout_universe_t *universe;
+    int i, j, max_number;
+
+    layout->n_leds = 0;
+    for (i = 0; i < layout->n_strips; i++) {
+        layout->strip[i].offset = layout->n_leds;
+        layout->n_leds += layout->strip[i].length;
+    }
+
+    max_number = layout->output == LAYOUT_OUTPUT_ARTNET ? 0x7fff : 63999;
+    for (i = 0; i < layout->n_universes; i++) {
+        universe = &layout->universe[i];
+        universe->pixels = 0;
+        for (j = 0; j < universe->n_strips; j++) {
+            if (universe->strip[j] >= layout->n_strips) {
+                fprintf(stderr, "layout: universe %i uses missing strip %i\n", universe->number, universe->strip[j]);
+                return -1;
+            }
+            universe->pixels += layout->strip[universe->strip[j]].length;
+        }
+        if (universe->pixels > LAYOUT_UNIVERSE_PIXELS) {
+            fprintf(stderr, "layout: universe %i has %i pixels, %i fit\n", universe->number, universe->pixels, LAYOUT_UNIVERSE_PIXELS);
+            return -1;
+        }
+        if (universe->number > max_number || (layout->output == LAYOUT_OUTPUT_E131 && universe->number < 1)) {
+            fprintf(stderr, "layout: universe number %i out of range\n", universe->number);
+            return -1;
+        }
+        for (j = 0; j < i; j++) {
+            if (layout->universe[j].number == universe->number) {
+                fprintf(stderr, "layout: universe %i listed twice\n", universe->number);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Keeps the universes made up of strips in [first_strip, end_strip), for a
+// renderer that only draws part of the installation.  Returns the number of
+// universes left, or -1 if a universe has strips both inside and outside,
+// since no node would send it whole.
+int layout_select_strips(layout_t *layout, int first_strip, int end_strip)
+{
+    layout_universe_t *universe;
+    int i, j, inside, kept = 0;
+
+    for (i = 0; i < layout->n_universes; i++) {
+        universe = &layout->universe[i];
+        inside = 0;
+        for (j = 0; j < universe->n_strips; j++) {
+            inside += universe->strip[j] >= first_strip && universe->strip[j] < end_strip;
+        }
+        if (inside > 0 && inside < universe->n_strips) {
+            fprintf(stderr, "layout: universe %i has strips both inside and outside strips %i-%i\n", universe->number,
+                    first_strip, end_strip - 1);
+            return -1;
+        }
+        if (inside > 0) {
+            layout->universe[kept++] = *universe;
+        }
+    }
+    layout->n_universes = kept;
+
+    return kept;
+}
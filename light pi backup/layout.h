@@ -0,0 +1,68 @@
+/*
+ * layout.h
+ *
+ * Installation layout: strip geometry and how strips map onto network
+ * universes.  Loaded from a text file, one directive per line, # comments:
+ *
+ *   strip <index> <leds> <x> <y>            strips are stored back to back in
+ *                                           the frame in index order
+ *   universe <number> <strip> [<strip> ...] strips packed in order into one
+ *                                           universe, up to 170 RGB pixels
+ *   output <e131 | artnet> [<ipv4 address>] send universes over the network,
+ *                                           E1.31 defaults to multicast and
+ *                                           Art-Net to broadcast
+ *   sync <universe>                         send a sync packet after each frame
+ *
+ * A file without strip lines keeps the renderer's compiled-in geometry.
+ */
+
+#ifndef __LAYOUT_H__
+#define __LAYOUT_H__
+
+#define LAYOUT_MAX_STRIPS            64
+#define LAYOUT_MAX_UNIVERSES         32
+#define LAYOUT_MAX_UNIVERSE_STRIPS   16
+#define LAYOUT_UNIVERSE_PIXELS       170    // 512 DMX slots / 3
+
+#define LAYOUT_OUTPUT_NONE           0
+#define LAYOUT_OUTPUT_E131           1
+#define LAYOUT_OUTPUT_ARTNET         2
+
+
+typedef struct
+{
+    int length;
+    int x;
+    int y;
+    int offset;                        // first LED in the frame
+} layout_strip_t;
+
+typedef struct
+{
+    int number;
+    int n_strips;
+    int strip[LAYOUT_MAX_UNIVERSE_STRIPS];
+    int pixels;
+} layout_universe_t;
+
+typedef struct
+{
+    int n_strips;
+    layout_strip_t strip[LAYOUT_MAX_STRIPS];
+    int n_leds;
+    int n_universes;
+    layout_universe_t universe[LAYOUT_MAX_UNIVERSES];
+    int output;
+    char target[16];                   // dotted quad, empty for the protocol default
+    int sync_universe;                 // 0 for no sync packet
+} layout_t;
+
+
+void layout_init(layout_t *layout);
+int layout_load(layout_t *layout, const char *path);
+void layout_set_strips(layout_t *layout, int n_strips, const int *lengths, const int *x, const int *y);
+int layout_check(layout_t *layout);
+int layout_select_strips(layout_t *layout, int first_strip, int end_strip);
+
+
+#endif /* __LAYOUT_H__ */
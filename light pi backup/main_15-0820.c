@@ -51,12 +51,43 @@
 
 #include "wiringSerial.h"
 
+#include "box_fixmath.h"
+#include "box_hub_frame.h"
+
+#include "params.h"
+#include "quality.h"
+#include "upsample.h"
+#include "input.h"
+#include "hubclock.h"
+#include "udp_input.h"
+#include "layout.h"
+#include "netout.h"
+#include "prng.h"
+#include "cluster.h"
+#include "plugins.h"
+#include "expr.h"
+#include "spatial.h"
+#include "particles.h"
+#include "noise.h"
+#include "palette.h"
+#include "envelope.h"
+#include "recorder.h"
+#include "spiout.h"
+
 #define BCM2708_ST_BASE 0x20003000 /* BCM 2835 System Timer */
 
 volatile unsigned *TIMER_registers;
 
+// the system timer's 1 MHz count, or the same from the kernel when there is
+// no /dev/mem mapping (headless, see -x)
 unsigned int TIMER_GetSysTick()
 {
+    struct timespec ts;
+
+    if (TIMER_registers == NULL) {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (unsigned int)(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+    }
     return TIMER_registers[1];
 }
 
@@ -99,29 +130,6 @@ void TIMER_Init()
 //  v0.3.2
 
 
-uint16_t const cos_wave_larger[2048] ={ 2047 ,  2047 , 2047 , 2047 , 2047 , 2047 , 2047 , 2047 , 2047 , 2047 , 2047 , 2046 , 2046 , 2046 , 2046 , 2046 , 2046 , 2046 , 2045 , 2045 , 2045 , 2045 , 2045 , 2044 , 2044 , 2044 , 2044 , 2043 , 2043 , 2043 , 2043 , 2042 , 2042 , 2042 , 2041 , 2041 , 2041 , 2040 , 2040 , 2040 , 2039 , 2039 , 2039 , 2038 , 2038 , 2037 , 2037 , 2036 , 2036 , 2035 , 2035 , 2034 , 2034 , 2033 , 2033 , 2032 , 2032 , 2031 , 2031 , 2030 , 2030 , 2029 , 2029 , 2028 , 2027 , 2027 , 2026 , 2025 , 2025 , 2024 , 2023 , 2023 , 2022 , 2021 , 2021 , 2020 , 2019 , 2019 , 2018 , 2017 , 2016 , 2016 , 2015 , 2014 , 2013 , 2012 , 2012 , 2011 , 2010 , 2009 , 2008 , 2007 , 2007 , 2006 , 2005 , 2004 , 2003 , 2002 , 2001 , 2000 , 1999 , 1998 , 1997 , 1996 , 1995 , 1994 , 1993 , 1992 , 1991 , 1990 , 1989 , 1988 , 1987 , 1986 , 1985 , 1984 , 1983 , 1982 , 1981 , 1980 , 1978 , 1977 , 1976 , 1975 , 1974 , 1973 , 1971 , 1970 , 1969 , 1968 , 1967 , 1965 , 1964 , 1963 , 1962 , 1960 , 1959 , 1958 , 1957 , 1955 , 1954 , 1953 , 1951 , 1950 , 1949 , 1947 , 1946 , 1945 , 1943 , 1942 , 1941 , 1939 , 1938 , 1936 , 1935 , 1933 , 1932 , 1931 , 1929 , 1928 , 1926 , 1925 , 1923 , 1922 , 1920 , 1919 , 1917 , 1916 , 1914 , 1912 , 1911 , 1909 , 1908 , 1906 , 1905 , 1903 , 1901 , 1900 , 1898 , 1897 , 1895 , 1893 , 1892 , 1890 , 1888 , 1887 , 1885 , 1883 , 1881 , 1880 , 1878 , 1876 , 1875 , 1873 , 1871 , 1869 , 1867 , 1866 , 1864 , 1862 , 1860 , 1858 , 1857 , 1855 , 1853 , 1851 , 1849 , 1847 , 1846 , 1844 , 1842 , 1840 , 1838 , 1836 , 1834 , 1832 , 1830 , 1828 , 1826 , 1825 , 1823 , 1821 , 1819 , 1817 , 1815 , 1813 , 1811 , 1809 , 1807 , 1805 , 1803 , 1801 , 1799 , 1796 , 1794 , 1792 , 1790 , 1788 , 1786 , 1784 , 1782 , 1780 , 1778 , 1776 , 1773 , 1771 , 1769 , 1767 , 1765 , 1763 , 1760 , 1758 , 1756 , 1754 , 1752 , 1749 , 1747 , 1745 , 1743 , 1741 , 1738 , 1736 , 1734 , 1732 , 1729 , 1727 , 1725 , 1722 , 1720 , 1718 , 1715 , 1713 , 1711 , 1709 , 1706 , 1704 , 1701 , 1699 , 1697 , 1694 , 1692 , 1690 , 1687 , 1685 , 1682 , 1680 , 1678 , 1675 , 1673 , 1670 , 1668 , 1665 , 1663 , 1661 , 1658 , 1656 , 1653 , 1651 , 1648 , 1646 , 1643 , 1641 , 1638 , 1636 , 1633 , 1631 , 1628 , 1626 , 1623 , 1621 , 1618 , 1615 , 1613 , 1610 , 1608 , 1605 , 1603 , 1600 , 1597 , 1595 , 1592 , 1590 , 1587 , 1584 , 1582 , 1579 , 1576 , 1574 , 1571 , 1568 , 1566 , 1563 , 1560 , 1558 , 1555 , 1552 , 1550 , 1547 , 1544 , 1542 , 1539 , 1536 , 1533 , 1531 , 1528 , 1525 , 1523 , 1520 , 1517 , 1514 , 1512 , 1509 , 1506 , 1503 , 1500 , 1498 , 1495 , 1492 , 1489 , 1486 , 1484 , 1481 , 1478 , 1475 , 1472 , 1470 , 1467 , 1464 , 1461 , 1458 , 1455 , 1453 , 1450 , 1447 , 1444 , 1441 , 1438 , 1435 , 1433 , 1430 , 1427 , 1424 , 1421 , 1418 , 1415 , 1412 , 1409 , 1406 , 1404 , 1401 , 1398 , 1395 , 1392 , 1389 , 1386 , 1383 , 1380 , 1377 , 1374 , 1371 , 1368 , 1365 , 1362 , 1359 , 1356 , 1353 , 1351 , 1348 , 1345 , 1342 , 1339 , 1336 , 1333 , 1330 , 1327 , 1324 , 1321 , 1318 , 1315 , 1312 , 1309 , 1306 , 1303 , 1300 , 1296 , 1293 , 1290 , 1287 , 1284 , 1281 , 1278 , 1275 , 1272 , 1269 , 1266 , 1263 , 1260 , 1257 , 1254 , 1251 , 1248 , 1245 , 1242 , 1239 , 1235 , 1232 , 1229 , 1226 , 1223 , 1220 , 1217 , 1214 , 1211 , 1208 , 1205 , 1202 , 1198 , 1195 , 1192 , 1189 , 1186 , 1183 , 1180 , 1177 , 1174 , 1171 , 1167 , 1164 , 1161 , 1158 , 1155 , 1152 , 1149 , 1146 , 1143 , 1139 , 1136 , 1133 , 1130 , 1127 , 1124 , 1121 , 1118 , 1114 , 1111 , 1108 , 1105 , 1102 , 1099 , 1096 , 1093 , 1089 , 1086 , 1083 , 1080 , 1077 , 1074 , 1071 , 1067 , 1064 , 1061 , 1058 , 1055 , 1052 , 1049 , 1045 , 1042 , 1039 , 1036 , 1033 , 1030 , 1027 , 1024 , 1020 , 1017 , 1014 , 1011 , 1008 , 1005 , 1002 , 998 , 995 , 992 , 989 , 986 , 983 , 980 , 976 , 973 , 970 , 967 , 964 , 961 , 958 , 954 , 951 , 948 , 945 , 942 , 939 , 936 , 933 , 929 , 926 , 923 , 920 , 917 , 914 , 911 , 908 , 904 , 901 , 898 , 895 , 892 , 889 , 886 , 883 , 880 , 876 , 873 , 870 , 867 , 864 , 861 , 858 , 855 , 852 , 849 , 845 , 842 , 839 , 836 , 833 , 830 , 827 , 824 , 821 , 818 , 815 , 812 , 808 , 805 , 802 , 799 , 796 , 793 , 790 , 787 , 784 , 781 , 778 , 775 , 772 , 769 , 766 , 763 , 760 , 757 , 754 , 751 , 747 , 744 , 741 , 738 , 735 , 732 , 729 , 726 , 723 , 720 , 717 , 714 , 711 , 708 , 705 , 702 , 699 , 696 , 694 , 691 , 688 , 685 , 682 , 679 , 676 , 673 , 670 , 667 , 664 , 661 , 658 , 655 , 652 , 649 , 646 , 643 , 641 , 638 , 635 , 632 , 629 , 626 , 623 , 620 , 617 , 614 , 612 , 609 , 606 , 603 , 600 , 597 , 594 , 592 , 589 , 586 , 583 , 580 , 577 , 575 , 572 , 569 , 566 , 563 , 561 , 558 , 555 , 552 , 549 , 547 , 544 , 541 , 538 , 535 , 533 , 530 , 527 , 524 , 522 , 519 , 516 , 514 , 511 , 508 , 505 , 503 , 500 , 497 , 495 , 492 , 489 , 487 , 484 , 481 , 479 , 476 , 473 , 471 , 468 , 465 , 463 , 460 , 457 , 455 , 452 , 450 , 447 , 444 , 442 , 439 , 437 , 434 , 432 , 429 , 426 , 424 , 421 , 419 , 416 , 414 , 411 , 409 , 406 , 404 , 401 , 399 , 396 , 394 , 391 , 389 , 386 , 384 , 382 , 379 , 377 , 374 , 372 , 369 , 367 , 365 , 362 , 360 , 357 , 355 , 353 , 350 , 348 , 346 , 343 , 341 , 338 , 336 , 334 , 332 , 329 , 327 , 325 , 322 , 320 , 318 , 315 , 313 , 311 , 309 , 306 , 304 , 302 , 300 , 298 , 295 , 293 , 291 , 289 , 287 , 284 , 282 , 280 , 278 , 276 , 274 , 271 , 269 , 267 , 265 , 263 , 261 , 259 , 257 , 255 , 253 , 251 , 248 , 246 , 244 , 242 , 240 , 238 , 236 , 234 , 232 , 230 , 228 , 226 , 224 , 222 , 221 , 219 , 217 , 215 , 213 , 211 , 209 , 207 , 205 , 203 , 201 , 200 , 198 , 196 , 194 , 192 , 190 , 189 , 187 , 185 , 183 , 181 , 180 , 178 , 176 , 174 , 172 , 171 , 169 , 167 , 166 , 164 , 162 , 160 , 159 , 157 , 155 , 154 , 152 , 150 , 149 , 147 , 146 , 144 , 142 , 141 , 139 , 138 , 136 , 135 , 133 , 131 , 130 , 128 , 127 , 125 , 124 , 122 , 121 , 119 , 118 , 116 , 115 , 114 , 112 , 111 , 109 , 108 , 106 , 105 , 104 , 102 , 101 , 100 , 98 , 97 , 96 , 94 , 93 , 92 , 90 , 89 , 88 , 87 , 85 , 84 , 83 , 82 , 80 , 79 , 78 , 77 , 76 , 74 , 73 , 72 , 71 , 70 , 69 , 67 , 66 , 65 , 64 , 63 , 62 , 61 , 60 , 59 , 58 , 57 , 56 , 55 , 54 , 53 , 52 , 51 , 50 , 49 , 48 , 47 , 46 , 45 , 44 , 43 , 42 , 41 , 40 , 40 , 39 , 38 , 37 , 36 , 35 , 35 , 34 , 33 , 32 , 31 , 31 , 30 , 29 , 28 , 28 , 27 , 26 , 26 , 25 , 24 , 24 , 23 , 22 , 22 , 21 , 20 , 20 , 19 , 18 , 18 , 17 , 17 , 16 , 16 , 15 , 15 , 14 , 14 , 13 , 13 , 12 , 12 , 11 , 11 , 10 , 10 , 9 , 9 , 8 , 8 , 8 , 7 , 7 , 7 , 6 , 6 , 6 , 5 , 5 , 5 , 4 , 4 , 4 , 4 , 3 , 3 , 3 , 3 , 2 , 2 , 2 , 2 , 2 , 1 , 1 , 1 , 1 , 1 , 1 , 1 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 1 , 1 , 1 , 1 , 1 , 1 , 1 , 2 , 2 , 2 , 2 , 2 , 3 , 3 , 3 , 3 , 4 , 4 , 4 , 4 , 5 , 5 , 5 , 6 , 6 , 6 , 7 , 7 , 7 , 8 , 8 , 8 , 9 , 9 , 10 , 10 , 11 , 11 , 12 , 12 , 13 , 13 , 14 , 14 , 15 , 15 , 16 , 16 , 17 , 17 , 18 , 18 , 19 , 20 , 20 , 21 , 22 , 22 , 23 , 24 , 24 , 25 , 26 , 26 , 27 , 28 , 28 , 29 , 30 , 31 , 31 , 32 , 33 , 34 , 35 , 35 , 36 , 37 , 38 , 39 , 40 , 40 , 41 , 42 , 43 , 44 , 45 , 46 , 47 , 48 , 49 , 50 , 51 , 52 , 53 , 54 , 55 , 56 , 57 , 58 , 59 , 60 , 61 , 62 , 63 , 64 , 65 , 66 , 67 , 69 , 70 , 71 , 72 , 73 , 74 , 76 , 77 , 78 , 79 , 80 , 82 , 83 , 84 , 85 , 87 , 88 , 89 , 90 , 92 , 93 , 94 , 96 , 97 , 98 , 100 , 101 , 102 , 104 , 105 , 106 , 108 , 109 , 111 , 112 , 114 , 115 , 116 , 118 , 119 , 121 , 122 , 124 , 125 , 127 , 128 , 130 , 131 , 133 , 135 , 136 , 138 , 139 , 141 , 142 , 144 , 146 , 147 , 149 , 150 , 152 , 154 , 155 , 157 , 159 , 160 , 162 , 164 , 166 , 167 , 169 , 171 , 172 , 174 , 176 , 178 , 180 , 181 , 183 , 185 , 187 , 189 , 190 , 192 , 194 , 196 , 198 , 200 , 201 , 203 , 205 , 207 , 209 , 211 , 213 , 215 , 217 , 219 , 221 , 222 , 224 , 226 , 228 , 230 , 232 , 234 , 236 , 238 , 240 , 242 , 244 , 246 , 248 , 251 , 253 , 255 , 257 , 259 , 261 , 263 , 265 , 267 , 269 , 271 , 274 , 276 , 278 , 280 , 282 , 284 , 287 , 289 , 291 , 293 , 295 , 298 , 300 , 302 , 304 , 306 , 309 , 311 , 313 , 315 , 318 , 320 , 322 , 325 , 327 , 329 , 332 , 334 , 336 , 338 , 341 , 343 , 346 , 348 , 350 , 353 , 355 , 357 , 360 , 362 , 365 , 367 , 369 , 372 , 374 , 377 , 379 , 382 , 384 , 386 , 389 , 391 , 394 , 396 , 399 , 401 , 404 , 406 , 409 , 411 , 414 , 416 , 419 , 421 , 424 , 426 , 429 , 432 , 434 , 437 , 439 , 442 , 444 , 447 , 450 , 452 , 455 , 457 , 460 , 463 , 465 , 468 , 471 , 473 , 476 , 479 , 481 , 484 , 487 , 489 , 492 , 495 , 497 , 500 , 503 , 505 , 508 , 511 , 514 , 516 , 519 , 522 , 524 , 527 , 530 , 533 , 535 , 538 , 541 , 544 , 547 , 549 , 552 , 555 , 558 , 561 , 563 , 566 , 569 , 572 , 575 , 577 , 580 , 583 , 586 , 589 , 592 , 594 , 597 , 600 , 603 , 606 , 609 , 612 , 614 , 617 , 620 , 623 , 626 , 629 , 632 , 635 , 638 , 641 , 643 , 646 , 649 , 652 , 655 , 658 , 661 , 664 , 667 , 670 , 673 , 676 , 679 , 682 , 685 , 688 , 691 , 694 , 696 , 699 , 702 , 705 , 708 , 711 , 714 , 717 , 720 , 723 , 726 , 729 , 732 , 735 , 738 , 741 , 744 , 747 , 751 , 754 , 757 , 760 , 763 , 766 , 769 , 772 , 775 , 778 , 781 , 784 , 787 , 790 , 793 , 796 , 799 , 802 , 805 , 808 , 812 , 815 , 818 , 821 , 824 , 827 , 830 , 833 , 836 , 839 , 842 , 845 , 849 , 852 , 855 , 858 , 861 , 864 , 867 , 870 , 873 , 876 , 880 , 883 , 886 , 889 , 892 , 895 , 898 , 901 , 904 , 908 , 911 , 914 , 917 , 920 , 923 , 926 , 929 , 933 , 936 , 939 , 942 , 945 , 948 , 951 , 954 , 958 , 961 , 964 , 967 , 970 , 973 , 976 , 980 , 983 , 986 , 989 , 992 , 995 , 998 , 1002 , 1005 , 1008 , 1011 , 1014 , 1017 , 1020 , 1024 , 1027 , 1030 , 1033 , 1036 , 1039 , 1042 , 1045 , 1049 , 1052 , 1055 , 1058 , 1061 , 1064 , 1067 , 1071 , 1074 , 1077 , 1080 , 1083 , 1086 , 1089 , 1093 , 1096 , 1099 , 1102 , 1105 , 1108 , 1111 , 1114 , 1118 , 1121 , 1124 , 1127 , 1130 , 1133 , 1136 , 1139 , 1143 , 1146 , 1149 , 1152 , 1155 , 1158 , 1161 , 1164 , 1167 , 1171 , 1174 , 1177 , 1180 , 1183 , 1186 , 1189 , 1192 , 1195 , 1198 , 1202 , 1205 , 1208 , 1211 , 1214 , 1217 , 1220 , 1223 , 1226 , 1229 , 1232 , 1235 , 1239 , 1242 , 1245 , 1248 , 1251 , 1254 , 1257 , 1260 , 1263 , 1266 , 1269 , 1272 , 1275 , 1278 , 1281 , 1284 , 1287 , 1290 , 1293 , 1296 , 1300 , 1303 , 1306 , 1309 , 1312 , 1315 , 1318 , 1321 , 1324 , 1327 , 1330 , 1333 , 1336 , 1339 , 1342 , 1345 , 1348 , 1351 , 1353 , 1356 , 1359 , 1362 , 1365 , 1368 , 1371 , 1374 , 1377 , 1380 , 1383 , 1386 , 1389 , 1392 , 1395 , 1398 , 1401 , 1404 , 1406 , 1409 , 1412 , 1415 , 1418 , 1421 , 1424 , 1427 , 1430 , 1433 , 1435 , 1438 , 1441 , 1444 , 1447 , 1450 , 1453 , 1455 , 1458 , 1461 , 1464 , 1467 , 1470 , 1472 , 1475 , 1478 , 1481 , 1484 , 1486 , 1489 , 1492 , 1495 , 1498 , 1500 , 1503 , 1506 , 1509 , 1512 , 1514 , 1517 , 1520 , 1523 , 1525 , 1528 , 1531 , 1533 , 1536 , 1539 , 1542 , 1544 , 1547 , 1550 , 1552 , 1555 , 1558 , 1560 , 1563 , 1566 , 1568 , 1571 , 1574 , 1576 , 1579 , 1582 , 1584 , 1587 , 1590 , 1592 , 1595 , 1597 , 1600 , 1603 , 1605 , 1608 , 1610 , 1613 , 1615 , 1618 , 1621 , 1623 , 1626 , 1628 , 1631 , 1633 , 1636 , 1638 , 1641 , 1643 , 1646 , 1648 , 1651 , 1653 , 1656 , 1658 , 1661 , 1663 , 1665 , 1668 , 1670 , 1673 , 1675 , 1678 , 1680 , 1682 , 1685 , 1687 , 1690 , 1692 , 1694 , 1697 , 1699 , 1701 , 1704 , 1706 , 1709 , 1711 , 1713 , 1715 , 1718 , 1720 , 1722 , 1725 , 1727 , 1729 , 1732 , 1734 , 1736 , 1738 , 1741 , 1743 , 1745 , 1747 , 1749 , 1752 , 1754 , 1756 , 1758 , 1760 , 1763 , 1765 , 1767 , 1769 , 1771 , 1773 , 1776 , 1778 , 1780 , 1782 , 1784 , 1786 , 1788 , 1790 , 1792 , 1794 , 1796 , 1799 , 1801 , 1803 , 1805 , 1807 , 1809 , 1811 , 1813 , 1815 , 1817 , 1819 , 1821 , 1823 , 1825 , 1826 , 1828 , 1830 , 1832 , 1834 , 1836 , 1838 , 1840 , 1842 , 1844 , 1846 , 1847 , 1849 , 1851 , 1853 , 1855 , 1857 , 1858 , 1860 , 1862 , 1864 , 1866 , 1867 , 1869 , 1871 , 1873 , 1875 , 1876 , 1878 , 1880 , 1881 , 1883 , 1885 , 1887 , 1888 , 1890 , 1892 , 1893 , 1895 , 1897 , 1898 , 1900 , 1901 , 1903 , 1905 , 1906 , 1908 , 1909 , 1911 , 1912 , 1914 , 1916 , 1917 , 1919 , 1920 , 1922 , 1923 , 1925 , 1926 , 1928 , 1929 , 1931 , 1932 , 1933 , 1935 , 1936 , 1938 , 1939 , 1941 , 1942 , 1943 , 1945 , 1946 , 1947 , 1949 , 1950 , 1951 , 1953 , 1954 , 1955 , 1957 , 1958 , 1959 , 1960 , 1962 , 1963 , 1964 , 1965 , 1967 , 1968 , 1969 , 1970 , 1971 , 1973 , 1974 , 1975 , 1976 , 1977 , 1978 , 1980 , 1981 , 1982 , 1983 , 1984 , 1985 , 1986 , 1987 , 1988 , 1989 , 1990 , 1991 , 1992 , 1993 , 1994 , 1995 , 1996 , 1997 , 1998 , 1999 , 2000 , 2001 , 2002 , 2003 , 2004 , 2005 , 2006 , 2007 , 2007 , 2008 , 2009 , 2010 , 2011 , 2012 , 2012 , 2013 , 2014 , 2015 , 2016 , 2016 , 2017 , 2018 , 2019 , 2019 , 2020 , 2021 , 2021 , 2022 , 2023 , 2023 , 2024 , 2025 , 2025 , 2026 , 2027 , 2027 , 2028 , 2029 , 2029 , 2030 , 2030 , 2031 , 2031 , 2032 , 2032 , 2033 , 2033 , 2034 , 2034 , 2035 , 2035 , 2036 , 2036 , 2037 , 2037 , 2038 , 2038 , 2039 , 2039 , 2039 , 2040 , 2040 , 2040 , 2041 , 2041 , 2041 , 2042 , 2042 , 2042 , 2043 , 2043 , 2043 , 2043 , 2044 , 2044 , 2044 , 2044 , 2045 , 2045 , 2045 , 2045 , 2045 , 2046 , 2046 , 2046 , 2046 , 2046 , 2046 , 2046 , 2047 , 2047 , 2047 , 2047 , 2047 , 2047 , 2047 , 2047 , 2047 , 2047 };
-
-//Gamma Correction Curve
-uint8_t const exp_gamma[256] =
-{0,0,0,0,0,0,0,0,0,0,0,0,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,2,2,2,2,2,2,2,2,2,3,3,3,3,3,
-4,4,4,4,4,5,5,5,5,5,6,6,6,7,7,7,7,8,8,8,9,9,9,10,10,10,11,11,12,12,12,13,13,14,14,14,15,15,
-16,16,17,17,18,18,19,19,20,20,21,21,22,23,23,24,24,25,26,26,27,28,28,29,30,30,31,32,32,33,
-34,35,35,36,37,38,39,39,40,41,42,43,44,44,45,46,47,48,49,50,51,52,53,54,55,56,57,58,59,60,
-61,62,63,64,65,66,67,68,70,71,72,73,74,75,77,78,79,80,82,83,84,85,87,89,91,92,93,95,96,98,
-99,100,101,102,105,106,108,109,111,112,114,115,117,118,120,121,123,125,126,128,130,131,133,
-135,136,138,140,142,143,145,147,149,151,152,154,156,158,160,162,164,165,167,169,171,173,175,
-177,179,181,183,185,187,190,192,194,196,198,200,202,204,207,209,211,213,216,218,220,222,225,
-227,229,232,234,236,239,241,244,246,249,251,253,254,255
-};
-
-
-inline uint16_t fastCosineCalc( uint16_t preWrapVal)
-{
-  return cos_wave_larger[preWrapVal & 2047];//(pgm_read_byte_near(cos_wave_16+wrapVal)); 
-}
-
-
-
 #define TRUE 1
 #define FALSE 0
 
@@ -168,14 +176,35 @@ ws2811_t ledstring =
 
 ws2811_led_t matrix[WIDTH];
 
+// where the LEDs are driven from: the PWM/DMA driver on GPIO 18, or SPI,
+// which leaves the PWM audio to Pd
+#define LED_OUTPUT_PWM                           0
+#define LED_OUTPUT_SPI                           1
 
+static int led_output = LED_OUTPUT_PWM;
+static spiout_t spiout = { .fd = -1 };
+
+// the strips this renderer draws and drives, all of them unless it is one
+// node of a cluster; the scenes' LED loops only visit this range
+typedef struct
+{
+  int first_strip;
+  int end_strip;
+  int first_led;
+  int end_led;
+} slice_t;
+
+static slice_t slice = { 0, 0, 0, N_LEDS };    // end_strip filled in by SetSlice()
+
+
+// a slice goes out from the start of this node's own LED chain
 void matrix_render(void)
 {
     int x;
 
-    for (x = 0; x < WIDTH; x++)
+    for (x = slice.first_led; x < slice.end_led; x++)
     {
-       ledstring.channel[0].leds[x] = matrix[x];
+       ledstring.channel[0].leds[x - slice.first_led] = matrix[x];
     }
 }
 
@@ -208,6 +237,14 @@ static void ctrl_c_handler(int signum)
     ws2811_fini(&ledstring);
 }
 
+// kill -USR1 dumps the flight recorder, from the main loop
+static volatile sig_atomic_t dump_requested;
+
+static void dump_handler(int signum)
+{
+    dump_requested = 1;
+}
+
 static void setup_handlers(void)
 {
     struct sigaction sa =
@@ -215,7 +252,14 @@ static void setup_handlers(void)
         .sa_handler = ctrl_c_handler,
     };
 
+    struct sigaction dump =
+    {
+        .sa_handler = dump_handler,
+        .sa_flags = SA_RESTART,
+    };
+
     sigaction(SIGKILL, &sa, NULL);
+    sigaction(SIGUSR1, &dump, NULL);
 }
 
 
@@ -229,8 +273,14 @@ int strip_y[N_STRIPS] = {24, 25, 8, 32, 49, 66, 74, 76, 85, 78, 90, 88, 77, 65,
 
 #define STRIP_RED_LEVEL_MAX  1024
 #define STRIP_RED_LEVEL_DEC  2
-int strip_red_levels[N_STRIPS];// = {0, 0, 0, 0, 0, 0};
-int strip_red_setpoints[N_STRIPS];// = {0, 0, 0, 0, 0, 0};
+
+// tap envelopes of every strip, see envelope.h.  Updated once per frame by
+// UpdateEnvelopes() whatever the scene; scenes only read the levels
+#define ENV_RED         0    // red level of plasma, fire, smoke and expression scenes, Q10
+#define ENV_FIRE_SLOPE  1    // fire brightness slope, falls with taps
+#define ENV_LIGHTNING   2    // lightning strike probability, 0..255
+#define N_ENVELOPES     3
+static envelopes_t envelopes;
 
 #define N_MOT_SENSORS 23
 
@@ -264,6 +314,7 @@ int wave_x_origins[N_WAVES];
 int wave_y_origins[N_WAVES];
 int wave_sizes[N_WAVES];
 int wave_amplitudes[N_WAVES];
+int wave_limit = N_WAVES;    // active wave cap, lowered by scene quality
 
 static void WaveStep() {
     int i, j;
@@ -278,6 +329,9 @@ static void WaveStep() {
             if (wave_sizes[i] > WAVE_MAX_SIZE) {
                 wave_amplitudes[i] = 0;
             }
+            if (i >= wave_limit) {
+                wave_amplitudes[i] = 0;    // over the quality cap, drop it
+            }
             if (wave_amplitudes[i] == 0) {
                 for (j = 0; j < N_STRIPS; j++) {
                     node_waves_seen[j][i] = 0;
@@ -311,7 +365,7 @@ static bool IsReflectedNodeWithinWave(wave_index, reflection_index, node_index)
 
 static void WaveNodeStep() {
     int wave_index, node_index, reflection_index;
-    for (wave_index = 0; wave_index < N_WAVES; wave_index++) {
+    for (wave_index = 0; wave_index < wave_limit; wave_index++) {
         if (wave_amplitudes[wave_index] != 0) {
             for (node_index = 0; node_index < N_STRIPS; node_index++) {
                 for (reflection_index = 0; reflection_index < NODE_N_REFLECTED_POS; reflection_index++) {
@@ -330,7 +384,7 @@ static void WaveNodeStep() {
 
 static void CreateWave(x, y) {
     int i;
-    for (i = 0; i < N_WAVES; i++) {
+    for (i = 0; i < wave_limit; i++) {
         if (wave_amplitudes[i] == 0) {
             wave_x_origins[i] = x;
             wave_y_origins[i] = y;
@@ -365,19 +419,20 @@ static void XSweep(void);
 static void YSweep(void);
 static void ZSweep(void);
 
-static void InitFire(void);
 static void InitSolidColors(void);
-static void InitLightning(void);
 static void InitSolidDarks(void);
+static void ParticleStep(void);
+static void SmokeStep(void);
 static void CheckSceneChangeKeys(int key_pressed);
+static void InterpolateOddLeds(void);
 
-static uint8_t motion_data[31];
+static uint8_t motion_data[INPUT_MOTION_SIZE];
 int fd_key;
 struct input_event ev;
 
 static int scene = 0;
 static int scene_override = 0;
-#define N_SCENES     10
+#define N_SCENES     12
 #define BLUE_PLASMA  0
 #define FIRE         1
 #define SOLID_COLORS 2
@@ -388,18 +443,1000 @@ static int scene_override = 0;
 #define STATICS      7
 #define RAINBOW      8
 #define WAVE_MACHINE 9
+#define PARTICLES    10
+#define SMOKE        11
+
+// Scene randomness comes from prng_hash() of the shared seed and frame
+// number, one stream per use, so cluster nodes draw identical values.
+#define RAND_LIGHTNING          1
+#define RAND_SOLID_COLORS       2
+#define RAND_SOLID_COLORS_INIT  3
+#define RAND_SOLID_DARKS        4
+#define RAND_SOLID_DARKS_INIT   5
+#define RAND_SOLID_ALL          6
+#define RAND_STATICS            7
+#define RAND_PARTICLES          8
+#define RAND_SMOKE              9
+
+static uint32_t render_seed;
+static uint32_t render_frame;
+
+static inline uint32_t SceneRand(int stream, int index)
+{
+  return prng_hash(render_seed + stream * 0x9e3779b9, render_frame, index);
+}
+
+// for start-up state, the same whichever frame a node (re)initialises on
+static inline uint32_t SeedRand(int stream, int index)
+{
+  return prng_hash(render_seed + stream * 0x9e3779b9, 0, index);
+}
+
+// time accumulators of the field scenes, t1..t3 each
+static int32_t scene_time[N_SCENES][3];
+
+// scene quality levels, stepped down by the frame budget controller under load
+#define QUALITY_FULL       0
+#define QUALITY_NO_NEST    1    // plasma: drop the nested fastCosineCalc term
+#define QUALITY_HALF_RES   2    // plasma: compute every other LED and interpolate
+                                // particles: each level halves the pool
+                                // noise fields: each level drops an octave
+#define QUALITY_MAX        2
+
+// cheapest level each scene offers, 0 = scene has no cheaper path
+static const int scene_quality_levels[N_SCENES] = {QUALITY_HALF_RES,  // BLUE_PLASMA
+                                                   QUALITY_HALF_RES,  // FIRE
+                                                   0, 0, 0, 0, 0, 0,
+                                                   QUALITY_HALF_RES,  // RAINBOW
+                                                   QUALITY_MAX,       // WAVE_MACHINE
+                                                   QUALITY_MAX,       // PARTICLES
+                                                   QUALITY_MAX};      // SMOKE
+
+// LEDs clock out at 1.25 us per bit, 24 bits each; the DMA transfer of the last
+// frame overlaps with computing the next, so that plus the loop sleep is the budget
+#define FRAME_WIRE_US       (LED_COUNT * 30)
+#define FRAME_SLEEP_US      1000
+#define FRAME_BUDGET_US     (FRAME_WIRE_US - FRAME_SLEEP_US)
+
+static quality_t quality;
+static int scene_quality = QUALITY_FULL;
+
+// flight recorder, the last seconds of frames at the wire rate; the ring
+// holds them coded to a quarter of their raw size, more when they change less
+#define RECORDER_SECONDS_DEFAULT  30
+#define RECORDER_RATIO            4
+#define RECORDER_OVERRUN_US       (2 * FRAME_BUDGET_US)    // a frame this slow dumps the recorder
+#define RECORDER_DUMP_DELAY_US    2000000                  // after it, to catch what followed
+#define RECORDER_DUMP_GAP_US      60000000                 // between overrun dumps
+
+static recorder_t recorder;
+static const char *dump_dir = ".";
+static uint32_t dump_at;          // TIMER_GetSysTick() of a pending overrun dump, 0 none
+static uint32_t last_overrun_dump;
+
+// plasma and fire render their fields every keyframe_interval frames and blend
+// in between, see upsample.h; 1 renders every frame
+#define KEYFRAME_INTERVAL_DEFAULT  1
+static upsample_t upsample;
+static ws2811_led_t keyframe_a[WIDTH];
+static ws2811_led_t keyframe_b[WIDTH];
+static uint8_t keyframe_index_a[WIDTH];    // of indexed scenes
+static uint8_t keyframe_index_b[WIDTH];
+
+// LED positions for effects that work in space, see spatial.h
+static spatial_t led_positions;
+
+// particle pool of the PARTICLES scene, see particles.h
+#define PARTICLE_RADIUS      3    // layout units lit around a particle
+#define PARTICLE_DRAG_SHIFT  5    // velocity loses 1/32 per frame
+static particles_t particles;
+
+// indexed frames, see palette.h.  A scene that needs one value per LED
+// renders, blends and has recorded only matrix_index[], a quarter of matrix,
+// and sets frame_palette; the output stage expands the indices through that
+// palette into matrix
+#define PALETTE_SMOKE        0
+#define PALETTE_FIRE         1
+#define PALETTE_RAINBOW      2
+#define PALETTE_FILE         3    // -C palette_file, smoke until one is given
+#define N_PALETTES           4
+static palette_t palettes[N_PALETTES];
+static uint8_t matrix_index[WIDTH];
+static int frame_palette = -1;    // palette of this frame's indices, -1 = matrix written directly
+
+// live tunable parameters, see params.h and box_param; scenes read them every
+// frame.  Each scene's speed/scale set must stay in this order, see StoreSpeedParams()
+enum {
+  P_PLASMA_T1_SPEED, P_PLASMA_T2_SPEED, P_PLASMA_T3_SPEED, P_PLASMA_T_SCALE, P_PLASMA_SPACE_SCALE,
+  P_RAINBOW_T1_SPEED, P_RAINBOW_T2_SPEED, P_RAINBOW_T3_SPEED, P_RAINBOW_T_SCALE, P_RAINBOW_SPACE_SCALE,
+  P_FIRE_T1_SPEED, P_FIRE_T2_SPEED, P_FIRE_T3_SPEED, P_FIRE_T_SCALE, P_FIRE_SPACE_SCALE,
+  P_FIRE_SLOPE_MAX, P_FIRE_SLOPE_MIN, P_FIRE_SLOPE_STEP, P_FIRE_TAP_TO_SLOPE,
+  P_LIGHTNING_PROB_MIN, P_LIGHTNING_PROB_MAX, P_LIGHTNING_PROB_STEP, P_LIGHTNING_TAP_TO_PROB,
+  P_FLASH_PERIOD_MAX, P_FLASH_TAP_STEP, P_FLASH_RECOVER_STEP,
+  P_EXPR_T1_SPEED, P_EXPR_T2_SPEED, P_EXPR_T3_SPEED, P_EXPR_T_SCALE, P_EXPR_SPACE_SCALE,
+  P_PARTICLE_PER_TAP, P_PARTICLE_SPEED, P_PARTICLE_LIFE, P_PARTICLE_GRAVITY,
+  P_FIRE_NOISE_OCTAVES, P_SMOKE_OCTAVES, P_SMOKE_SCALE, P_SMOKE_RISE, P_SMOKE_CHURN,
+  P_SMOKE_PALETTE, P_PALETTE_GAMMA,
+  N_PARAMS
+};
+
+typedef struct {
+  const char *name;
+  int32_t def, min, max;
+} param_desc_t;
+
+static const param_desc_t param_descs[N_PARAMS] = {
+  [P_PLASMA_T1_SPEED]       = {"plasma.t1_speed",        57, -500,  500},
+  [P_PLASMA_T2_SPEED]       = {"plasma.t2_speed",       -91, -500,  500},
+  [P_PLASMA_T3_SPEED]       = {"plasma.t3_speed",        61, -500,  500},
+  [P_PLASMA_T_SCALE]        = {"plasma.t_scale",         50,    1,  500},
+  [P_PLASMA_SPACE_SCALE]    = {"plasma.space_scale",     50,    1,  500},
+  [P_RAINBOW_T1_SPEED]      = {"rainbow.t1_speed",       57, -500,  500},
+  [P_RAINBOW_T2_SPEED]      = {"rainbow.t2_speed",      -91, -500,  500},
+  [P_RAINBOW_T3_SPEED]      = {"rainbow.t3_speed",       61, -500,  500},
+  [P_RAINBOW_T_SCALE]       = {"rainbow.t_scale",        12,    1,  500},
+  [P_RAINBOW_SPACE_SCALE]   = {"rainbow.space_scale",    22,    1,  500},
+  [P_FIRE_T1_SPEED]         = {"fire.t1_speed",          57, -500,  500},
+  [P_FIRE_T2_SPEED]         = {"fire.t2_speed",         101, -500,  500},
+  [P_FIRE_T3_SPEED]         = {"fire.t3_speed",          61, -500,  500},
+  [P_FIRE_T_SCALE]          = {"fire.t_scale",          120,    1,  500},
+  [P_FIRE_SPACE_SCALE]      = {"fire.space_scale",      300,   20, 5000},
+  [P_FIRE_SLOPE_MAX]        = {"fire.slope_max",       2000, 1001, 4000},    // max > min always,
+  [P_FIRE_SLOPE_MIN]        = {"fire.slope_min",        300,   50, 1000},    // FireOverlay divides by the gap
+  [P_FIRE_SLOPE_STEP]       = {"fire.slope_step",         5,    1,  100},
+  [P_FIRE_TAP_TO_SLOPE]     = {"fire.tap_to_slope",      14,    0,  100},
+  [P_LIGHTNING_PROB_MIN]    = {"lightning.prob_min",      6,    0,  255},
+  [P_LIGHTNING_PROB_MAX]    = {"lightning.prob_max",    250,    0,  255},
+  [P_LIGHTNING_PROB_STEP]   = {"lightning.prob_step",     2,    1,  100},
+  [P_LIGHTNING_TAP_TO_PROB] = {"lightning.tap_to_prob",   2,    0,   50},
+  [P_FLASH_PERIOD_MAX]      = {"flash.period_max",    10000,  200, 30000},
+  [P_FLASH_TAP_STEP]        = {"flash.tap_step",        100,    0, 1000},
+  [P_FLASH_RECOVER_STEP]    = {"flash.recover_step",      3,    1,  100},
+  [P_EXPR_T1_SPEED]         = {"expr.t1_speed",          57, -500,  500},
+  [P_EXPR_T2_SPEED]         = {"expr.t2_speed",         -91, -500,  500},
+  [P_EXPR_T3_SPEED]         = {"expr.t3_speed",          61, -500,  500},
+  [P_EXPR_T_SCALE]          = {"expr.t_scale",           50,    1,  500},
+  [P_EXPR_SPACE_SCALE]      = {"expr.space_scale",       50,    1,  500},
+  [P_PARTICLE_PER_TAP]      = {"particles.per_tap",       4,    0,   64},    // per unit of tap strength
+  [P_PARTICLE_SPEED]        = {"particles.speed",       160,    0, 2000},    // Q8 layout units per frame
+  [P_PARTICLE_LIFE]         = {"particles.life",         60,    1, 1000},    // frames
+  [P_PARTICLE_GRAVITY]      = {"particles.gravity",       4,    0,  200},    // Q8 per frame per frame
+  [P_FIRE_NOISE_OCTAVES]    = {"fire.noise_octaves",      0,    0,    4},    // 0 = cosine field
+  [P_SMOKE_OCTAVES]         = {"smoke.octaves",           3,    1,    4},
+  [P_SMOKE_SCALE]           = {"smoke.scale",            24,    1,  256},    // Q8 noise cells per layout unit
+  [P_SMOKE_RISE]            = {"smoke.rise",              3,  -64,   64},    // Q8 noise cells per frame up z
+  [P_SMOKE_CHURN]           = {"smoke.churn",             2,    0,   64},    // Q8 noise cells per frame across
+  [P_SMOKE_PALETTE]         = {"smoke.palette",           0,    0,    3},    // PALETTE_*
+  [P_PALETTE_GAMMA]         = {"palette.gamma",           0,    0,    1},    // 1 = gamma correct indexed frames
+};
+
+static param_table_t *params;
+static int param_slots[N_PARAMS];
+
+static inline int32_t Param(int id)
+{
+  return params_get(params, param_slots[id]);
+}
+
+static void InitParams(const char *snapshot)
+{
+  int i, loaded;
+
+  params = params_open(TRUE);
+  for (i = 0; i < N_PARAMS; i++) {
+    param_slots[i] = params_register(params, param_descs[i].name, param_descs[i].def,
+				     param_descs[i].min, param_descs[i].max);
+    if (param_slots[i] < 0) {
+      fprintf(stderr, "Unable to register parameter %s\n", param_descs[i].name);
+      exit(1);
+    }
+  }
+  // the envelope climbs from min towards max, so min may not pass max
+  params_order(params, param_slots[P_LIGHTNING_PROB_MIN], param_slots[P_LIGHTNING_PROB_MAX]);
+  if (snapshot != NULL) {
+    loaded = params_load(params, snapshot);
+    if (loaded < 0) {
+      fprintf(stderr, "Unable to load parameters from %s: %s\n", snapshot, strerror(errno));
+    } else {
+      printf("Loaded %i parameters from %s\n", loaded, snapshot);
+    }
+  }
+}
+
+// writes back a scene's speed/scale set after its keys changed it, ids from first on
+static void StoreSpeedParams(int first, long t1_speed, long t2_speed, long t3_speed, int t_scale, int space_scale)
+{
+  params_set(params, param_slots[first], t1_speed);
+  params_set(params, param_slots[first + 1], t2_speed);
+  params_set(params, param_slots[first + 2], t3_speed);
+  params_set(params, param_slots[first + 3], t_scale);
+  params_set(params, param_slots[first + 4], space_scale);
+}
+
+// Input from the hub and from UDP is collected as timestamped events and
+// applied once per frame in time order.  Hub packets are levels and persist
+// until the next packet, UDP taps only raise their strip for the frame they
+// arrive in.
+static input_batch_t input_batch;
+static udp_input_t udp_input = { .fd = -1 };
+static uint8_t serial_motion[INPUT_MOTION_SIZE];
+static box_hub_reader_t hub_reader;
+static box_hub_motion_t hub_motion;
+// the hub's time on ours, so a packet goes in at when it was scanned, and
+// each sensor's offset into the scan from the last BOX_HUB_FRAME_OFFSETS
+static hubclock_t hub_clock;
+static uint16_t hub_offset_us[INPUT_MOTION_SIZE - 1];
+static int hub_n_offsets;
+static box_hub_status_t hub_status;    // the hub's last second of sending
+static unsigned long hub_statuses;
+static unsigned long hub_latency_n;
+static int64_t hub_latency_sum_us, hub_latency_max_us;
+static int serial_scene = -1;
+static int input_scene = 0;
+
+// optional network output to remote pixel controllers, per the layout file
+static layout_t layout;
+static netout_t netout = { .fd = -1 };
+
+static int LoadLayout(const char *path)
+{
+  int i;
+
+  if (layout_load(&layout, path) < 0) {
+    return -1;
+  }
+  if (layout.n_strips == 0) {
+    layout_set_strips(&layout, N_STRIPS, strip_lengths, strip_x, strip_y);
+  } else if (layout.n_strips != N_STRIPS) {
+    fprintf(stderr, "%s: %i strips, the renderer has %i\n", path, layout.n_strips, N_STRIPS);
+    return -1;
+  }
+  if (layout_check(&layout) < 0) {
+    return -1;
+  }
+  if (layout.n_leds > N_LEDS) {
+    fprintf(stderr, "%s: %i LEDs, the renderer has room for %i\n", path, layout.n_leds, N_LEDS);
+    return -1;
+  }
+
+  for (i = 0; i < N_STRIPS; i++) {
+    strip_lengths[i] = layout.strip[i].length;
+    strip_x[i] = layout.strip[i].x;
+    strip_y[i] = layout.strip[i].y;
+  }
+
+  return 0;
+}
+
+// a cluster node only sends the universes made up of its own strips, so
+// its slice may not cut through one
+static int OpenNetOutput(void)
+{
+  if (layout.output == LAYOUT_OUTPUT_NONE) {
+    return 0;
+  }
+  if (layout_select_strips(&layout, slice.first_strip, slice.end_strip) < 0) {
+    fprintf(stderr, "Slice %i-%i splits a universe, move it to a universe boundary\n", slice.first_strip,
+	    slice.end_strip - 1);
+    return -1;
+  }
+  if (layout.n_universes == 0) {
+    return 0;
+  }
+  if (netout_open(&netout, &layout) < 0) {
+    fprintf(stderr, "Unable to open network output: %s\n", strerror(errno));
+    return -1;
+  }
+  printf("%s output: %i universes%s\n", layout.output == LAYOUT_OUTPUT_E131 ? "E1.31" : "Art-Net",
+	 layout.n_universes, layout.sync_universe ? " + sync" : "");
+
+  return 0;
+}
+
+// hub frames, see box_hub_frame.h, keyframes and deltas alike; the
+// sensors go in as levels, a node that did not answer as 0.  A packet is
+// timed at its scan on our clock, never later than it came in; the latency
+// is from each sensor's sample to then.
+static void ReadSerialEvents(int fd)
+{
+  box_hub_frame_t frame;
+  input_event_t *event;
+  uint64_t now, scanned;
+  int64_t latency;
+  int data, i;
+
+  while (serialDataAvail(fd) > 0) {
+    data = serialGetchar(fd);
+    if (data < 0) {
+      break;
+    }
+    if (!box_hub_reader_push(&hub_reader, data, &frame)) {
+      continue;
+    }
+    now = input_now_us();
+    hubclock_add(&hub_clock, frame.time_us, now);
+    if (frame.type == BOX_HUB_FRAME_OFFSETS) {
+      hub_n_offsets = box_hub_offsets_read(&frame, hub_offset_us, INPUT_MOTION_SIZE - 1);
+      continue;
+    }
+    if (frame.type == BOX_HUB_FRAME_STATUS) {
+      hub_statuses += box_hub_status_read(&frame, &hub_status) == 0;
+      continue;
+    }
+    if (!box_hub_motion_apply(&hub_motion, &frame) || hub_motion.length < INPUT_MOTION_SIZE) {
+      continue;
+    }
+    scanned = hubclock_to_pi(&hub_clock, hub_motion.time_us);
+    scanned = scanned < now ? scanned : now;
+    for (i = 0; i < hub_n_offsets; i++) {
+      latency = (int64_t)(now - scanned) - hub_offset_us[i];
+      latency = latency > 0 ? latency : 0;
+      hub_latency_sum_us += latency;
+      hub_latency_max_us = latency > hub_latency_max_us ? latency : hub_latency_max_us;
+      hub_latency_n++;
+    }
+    event = input_push(&input_batch, scanned, INPUT_EVENT_PACKET, INPUT_SOURCE_SERIAL);
+    if (event != NULL) {
+      event->motion[0] = hub_motion.data[0];
+      for (i = 1; i < INPUT_MOTION_SIZE; i++) {
+	event->motion[i] = box_hub_level(hub_motion.data[i]);
+      }
+    }
+  }
+}
+
+static void ApplyInputEvents(void)
+{
+  uint8_t taps[INPUT_MOTION_SIZE];
+  input_event_t *event;
+  int i;
+
+  memset(taps, 0, sizeof(taps));
+  input_sort(&input_batch);
+
+  for (i = 0; i < input_batch.count; i++) {
+    event = &input_batch.event[i];
+    switch (event->type) {
+    case INPUT_EVENT_PACKET:
+      memcpy(serial_motion, event->motion, INPUT_MOTION_SIZE);
+      // the hub repeats its scene in every packet, only a change counts as an event
+      if (serial_motion[0] != serial_scene) {
+	serial_scene = serial_motion[0];
+	input_scene = serial_scene;
+      }
+      break;
+    case INPUT_EVENT_SCENE:
+      if (event->value < N_SCENES) {
+	input_scene = event->value;
+      }
+      break;
+    case INPUT_EVENT_TAP:
+      if (taps[event->index + 1] < event->value) {
+	taps[event->index + 1] = event->value;
+      }
+      break;
+    }
+  }
+  input_clear(&input_batch);
+
+  motion_data[0] = input_scene;
+  for (i = 1; i < INPUT_MOTION_SIZE; i++) {
+    motion_data[i] = serial_motion[i] > taps[i] ? serial_motion[i] : taps[i];
+  }
+}
+
+static int SetSlice(int first_strip, int end_strip)
+{
+  int i;
+
+  if (first_strip < 0 || end_strip > N_STRIPS || first_strip >= end_strip) {
+    return -1;
+  }
+  slice.first_strip = first_strip;
+  slice.end_strip = end_strip;
+  slice.first_led = 0;
+  for (i = 0; i < first_strip; i++) {
+    slice.first_led += strip_lengths[i];
+  }
+  slice.end_led = slice.first_led;
+  for (i = first_strip; i < end_strip; i++) {
+    slice.end_led += strip_lengths[i];
+  }
+  if (slice.end_led > N_LEDS) {
+    slice.end_led = N_LEDS;
+  }
+
+  return 0;
+}
+
+// FNV-1a over each strip of the slice, so the leader can check any slice
+// inside its own against its own frame, see cluster_fold()
+static const uint32_t *StripChecksums(void)
+{
+  static uint32_t checksums[N_STRIPS];
+  uint32_t hash;
+  int s, x = slice.first_led, end;
+
+  for (s = slice.first_strip; s < slice.end_strip; s++) {
+    hash = 2166136261u;
+    for (end = x + strip_lengths[s] < slice.end_led ? x + strip_lengths[s] : slice.end_led; x < end; x++) {
+      hash = (hash ^ matrix[x]) * 16777619u;
+    }
+    checksums[s] = hash;
+  }
+  return checksums;
+}
+
+// Scene plugins, see scene_plugin.h and plugins.h.  A plugin built for a
+// scene number runs instead of the built-in scene; the renderer only hands
+// it the context below and these services.
+static plugins_t plugins;
+static scene_context_t plugin_ctx;
+
+static int PluginKeyframeDue(void)
+{
+  return upsample_keyframe_due(&upsample);
+}
+
+static void PluginKeyframePush(const uint32_t *field)
+{
+  upsample_push(&upsample, field);
+}
+
+static void PluginKeyframeOutput(uint32_t *field)
+{
+  upsample_output(&upsample, field);
+}
+
+static uint32_t PluginRand(int stream, int index)
+{
+  return SceneRand(stream, index);
+}
+
+static const scene_services_t plugin_services = {
+  .keyframe_due = PluginKeyframeDue,
+  .keyframe_push = PluginKeyframePush,
+  .keyframe_output = PluginKeyframeOutput,
+  .interpolate_odd = InterpolateOddLeds,
+  .rand = PluginRand,
+};
+
+// what may change between frames: the slice in CatchUp(), the scene, the time
+static void UpdatePluginContext(void)
+{
+  plugin_ctx.abi_version = SCENE_PLUGIN_ABI_VERSION;
+  plugin_ctx.services = &plugin_services;
+  plugin_ctx.n_strips = N_STRIPS;
+  plugin_ctx.strip_lengths = strip_lengths;
+  plugin_ctx.strip_x = strip_x;
+  plugin_ctx.strip_y = strip_y;
+  plugin_ctx.first_strip = slice.first_strip;
+  plugin_ctx.end_strip = slice.end_strip;
+  plugin_ctx.first_led = slice.first_led;
+  plugin_ctx.end_led = slice.end_led;
+  plugin_ctx.matrix = matrix;
+  plugin_ctx.motion = motion_data;
+  plugin_ctx.frame = render_frame;
+  plugin_ctx.quality = scene_quality;
+  plugin_ctx.keyframe_interval = upsample.interval;
+  plugin_ctx.time = scene_time[(scene >= 0 && scene < N_SCENES) ? scene : 0];
+}
+
+// built-in scenes read the keyboard themselves, plugin and expression
+// scenes only get the scene keys
+static void ReadSceneKeys(void)
+{
+  read(fd_key, &ev, sizeof(ev));
+  if (ev.type == 1 && (ev.value == 1 || ev.value == 2)) {
+    CheckSceneChangeKeys(ev.code);
+  }
+}
+
+// Expression scenes, see expr.h.  -e scene:file runs a pattern expression
+// in place of a built-in scene.  Its uniforms are the frame number, t1..t3
+// from the scene's time accumulators driven by the expr.* parameters, and
+// the space scale; tap is the strip's red level envelope.
+#define EXPR_UNIFORMS  5
+
+static const char *const expr_uniform_names[EXPR_UNIFORMS] = {"t", "t1", "t2", "t3", "scale"};
+static expr_prog_t *expr_scenes[N_SCENES];
+static expr_leds_t expr_leds;
+
+static int LoadExprScene(const char *spec)
+{
+  const char *file = strchr(spec, ':');
+  int n = atoi(spec);
+
+  if (file == NULL || n < 0 || n >= N_SCENES) {
+    fprintf(stderr, "expression scene is scene:file, scene 0-%i\n", N_SCENES - 1);
+    return -1;
+  }
+  file++;
+  if (expr_scenes[n] == NULL) {
+    expr_scenes[n] = malloc(sizeof(expr_prog_t));
+  } else {
+    expr_free(expr_scenes[n]);
+  }
+  if (expr_scenes[n] == NULL || expr_load(expr_scenes[n], file, expr_uniform_names, EXPR_UNIFORMS) < 0) {
+    fprintf(stderr, "%s: %s\n", file, expr_scenes[n] != NULL ? expr_scenes[n]->error : strerror(errno));
+    return -1;
+  }
+  printf("scene %i: %s, %i instructions per LED block, %i once per LED\n", n, file, expr_scenes[n]->n_code,
+         expr_scenes[n]->n_static_code);
+  return 0;
+}
+
+static void ExprSceneStep(void)
+{
+  int32_t *t = scene_time[scene];
+  int32_t uniforms[EXPR_UNIFORMS];
+  int t_scale = Param(P_EXPR_T_SCALE);
+
+  ReadSceneKeys();
+
+  if (upsample_keyframe_due(&upsample)) {    // field time covers the whole keyframe interval
+    t[0] += (Param(P_EXPR_T1_SPEED) * t_scale) * upsample.interval;
+    t[1] += (Param(P_EXPR_T2_SPEED) * t_scale) * upsample.interval;
+    t[2] += (Param(P_EXPR_T3_SPEED) * t_scale) * upsample.interval;
+    uniforms[0] = render_frame;
+    uniforms[1] = fastCosineCalc(t[0] >> 10);
+    uniforms[2] = fastCosineCalc(t[1] >> 10);
+    uniforms[3] = fastCosineCalc(t[2] >> 10);
+    uniforms[4] = Param(P_EXPR_SPACE_SCALE);
+    expr_leds_set_strip(&expr_leds, EXPR_IN_TAP, envelopes.level[ENV_RED]);
+    expr_run(expr_scenes[scene], &expr_leds, uniforms, slice.first_led, slice.end_led, matrix);
+    upsample_push(&upsample, matrix);
+  }
+  upsample_output(&upsample, matrix);
+}
+
+// envelope shapes follow the live parameters, the state carries on
+static void ShapeEnvelopes(void)
+{
+  envelope_shape_t red = { 0, 8, STRIP_RED_LEVEL_MAX, STRIP_RED_LEVEL_DEC, 4 };
+  envelope_shape_t slope = { Param(P_FIRE_SLOPE_MAX), -Param(P_FIRE_TAP_TO_SLOPE), Param(P_FIRE_SLOPE_MIN),
+			     Param(P_FIRE_SLOPE_STEP), 4 };
+  envelope_shape_t lightning = { Param(P_LIGHTNING_PROB_MIN), Param(P_LIGHTNING_TAP_TO_PROB),
+				 Param(P_LIGHTNING_PROB_MAX), Param(P_LIGHTNING_PROB_STEP), 0 };
+
+  envelopes_shape(&envelopes, ENV_RED, &red);
+  envelopes_shape(&envelopes, ENV_FIRE_SLOPE, &slope);
+  envelopes_shape(&envelopes, ENV_LIGHTNING, &lightning);
+}
+
+static int InitEnvelopes(void)
+{
+  int i;
+
+  if (envelopes_init(&envelopes, N_STRIPS, N_ENVELOPES) < 0) {
+    return -1;
+  }
+  ShapeEnvelopes();
+  for (i = 0; i < N_ENVELOPES; i++) {
+    envelopes_reset(&envelopes, i);
+  }
+  return 0;
+}
+
+// once per frame, before any scene runs, including frames stepped through
+// by CatchUp() so followers stay in step
+static void UpdateEnvelopes(void)
+{
+  ShapeEnvelopes();
+  envelopes_update(&envelopes, motion_data + 1, N_MOT_SENSORS);
+}
+
+static void SceneStep(void)
+{
+  // A FAT RED LINE OF TEXT ============================================
+
+  frame_palette = -1;
+  UpdateEnvelopes();
+  if (scene >= 0 && scene < N_SCENES && plugins.scene_slot[scene] >= 0) {
+    ReadSceneKeys();
+    UpdatePluginContext();
+    if (plugins_step(&plugins, scene, &plugin_ctx)) {
+      return;
+    }
+  }
+  if (scene >= 0 && scene < N_SCENES && expr_scenes[scene] != NULL) {
+    ExprSceneStep();
+    return;
+  }
+
+  if (FALSE) {   // kill compiler warning on unused fn
+    StripLengthTestStep();
+    XSweep();
+    YSweep();
+    ZSweep();
+    BluePlasmaStep();
+    FireStep();
+    SolidColorsStep();
+    LightningStep();
+    SolidDarksStep();
+    RGBFlashStep();
+    SolidAllStep();
+    StaticStep();
+    RainbowStep();
+    WaveMachineStep();
+    ParticleStep();
+    SmokeStep();
+  }
+  //StripLengthTestStep();
+  switch (scene) {
+  case BLUE_PLASMA:
+    BluePlasmaStep();
+    break;
+  case FIRE:
+    FireStep();
+    break;
+  case SOLID_COLORS:
+    SolidColorsStep();
+    break;
+  case LIGHTNING:
+    LightningStep();
+    break;
+  case SOLID_DARKS:
+    SolidDarksStep();
+    break;
+  case RGB_FLASH:
+    RGBFlashStep();
+    break;
+  case SOLID_ALL:
+    SolidAllStep();
+    break;
+  case STATICS:
+    StaticStep();
+    break;
+  case RAINBOW:
+    RainbowStep();
+    break;
+  case WAVE_MACHINE:
+    WaveMachineStep();
+    break;
+  case PARTICLES:
+    ParticleStep();
+    break;
+  case SMOKE:
+    SmokeStep();
+    break;
+  }
+  //ZSweep();
+}
+
+// Cluster rendering, see cluster.h.  The leader publishes everything a
+// frame depends on before drawing it; followers adopt it and draw the same
+// frame for their own strips.
+#define CLUSTER_WAIT_MS       1000
+#define CLUSTER_MAX_CATCHUP   8     // lost frames stepped through without drawing
+
+static cluster_t cluster = { .fd = -1 };
+
+static void PublishClock(void)
+{
+  cluster_clock_t clock;
+  int i;
+
+  memset(&clock, 0, sizeof(clock));
+  clock.frame = render_frame;
+  clock.seed = render_seed;
+  clock.scene = scene;
+  clock.quality = scene_quality;
+  clock.keyframe_phase = upsample.phase;
+  if (scene >= 0 && scene < N_SCENES) {
+    memcpy(clock.scene_time, scene_time[scene], sizeof(clock.scene_time));
+  }
+  clock.n_params = N_PARAMS < CLUSTER_PARAMS ? N_PARAMS : CLUSTER_PARAMS;
+  for (i = 0; i < clock.n_params; i++) {
+    clock.param[i] = Param(i);
+  }
+  memcpy(clock.motion, motion_data, INPUT_MOTION_SIZE);
+
+  cluster_publish(&cluster, &clock);
+}
+
+// everything except the upsample phase, which has to wait for the scene change reset
+static void ApplyClock(const cluster_clock_t *clock)
+{
+  int i;
+
+  if (clock->seed != render_seed) {
+    render_seed = clock->seed;
+    InitSolidColors();
+    InitSolidDarks();
+  }
+  render_frame = clock->frame;
+  scene = clock->scene;
+  if (scene >= 0 && scene < N_SCENES) {
+    memcpy(scene_time[scene], clock->scene_time, sizeof(clock->scene_time));
+  }
+  for (i = 0; i < clock->n_params && i < N_PARAMS; i++) {
+    if (Param(i) != clock->param[i]) {
+      params_set(params, param_slots[i], clock->param[i]);
+    }
+  }
+  memcpy(motion_data, clock->motion, INPUT_MOTION_SIZE);
+}
+
+static int InitPalettes(const char *file)
+{
+  int gamma = Param(P_PALETTE_GAMMA);
+
+  palette_gradient(&palettes[PALETTE_SMOKE], 0x000000, 0x95a9ff, gamma);    // blue grey
+  palette_set(&palettes[PALETTE_FIRE], fx_palette_fire, gamma);
+  palette_set(&palettes[PALETTE_RAINBOW], fx_palette_rainbow, gamma);
+  palettes[PALETTE_FILE] = palettes[PALETTE_SMOKE];
+  if (file != NULL && palette_load(&palettes[PALETTE_FILE], file, gamma) < 0) {
+    return -1;
+  }
+  return 0;
+}
+
+// the output stage of indexed frames, one lookup per LED with the gamma
+// already in the palette
+static void ExpandIndexedFrame(void)
+{
+  int gamma = Param(P_PALETTE_GAMMA);
+  int i;
+
+  if (frame_palette < 0 || frame_palette >= N_PALETTES) {
+    return;
+  }
+  if (palettes[frame_palette].gamma != gamma) {    // changed live, rebuild the expanded tables
+    for (i = 0; i < N_PALETTES; i++) {
+      palette_set_gamma(&palettes[i], gamma);
+    }
+  }
+  palette_expand(&palettes[frame_palette], matrix_index, slice.first_led, slice.end_led, matrix);
+}
+
+static int InitRecorder(int seconds)
+{
+  int n_leds = slice.end_led - slice.first_led;
+  int max_frames = seconds * (1000000 / FRAME_WIRE_US);
+  int i;
+  size_t size = max_frames * (sizeof(recorder_frame_t) + recorder_coded_max(n_leds * 3) / RECORDER_RATIO);
+
+  if (seconds <= 0) {
+    return 0;
+  }
+  if (recorder_init(&recorder, size, max_frames, n_leds, slice.first_led) < 0) {
+    fprintf(stderr, "Unable to allocate %zu bytes of flight recorder\n", size);
+    return -1;
+  }
+  for (i = 0; i < N_PALETTES; i++) {    // read when a dump is written, so live gamma changes show
+    recorder_palette(&recorder, i, palettes[i].out);
+  }
+  printf("flight recorder: %i s, %zu kB\n", seconds, size / 1024);
+  return 0;
+}
+
+static void DumpRecorder(const char *reason)
+{
+  char path[256];
+  char stamp[32];
+  time_t now = time(NULL);
+
+  strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&now));
+  snprintf(path, sizeof(path), "%s/box-%s.rec", dump_dir, stamp);
+  if (recorder_dump(&recorder, path) < 0) {
+    fprintf(stderr, "flight recorder: %s dump to %s failed\n", reason, path);
+    return;
+  }
+  printf("flight recorder: %s, %.1f s to %s\n", reason, recorder_seconds(&recorder), path);
+}
+
+// after the frame is out: record it, and dump when asked or some while
+// after a badly late frame
+static void RecordFrame(uint32_t frame_start, uint32_t compute_us, uint32_t period_us)
+{
+  recorder_frame_t info;
+  uint32_t now = TIMER_GetSysTick();
+
+  if (recorder.ring == NULL) {
+    return;
+  }
+  memset(&info, 0, sizeof(info));
+  info.frame = render_frame;
+  info.time_us = frame_start;
+  info.compute_us = compute_us;
+  info.period_us = period_us;
+  info.scene = scene;
+  info.quality = scene_quality;
+  info.flags = compute_us > FRAME_BUDGET_US ? RECORDER_OVERRUN : 0;
+  memcpy(info.motion, motion_data, INPUT_MOTION_SIZE);
+  if (frame_palette >= 0 && frame_palette < N_PALETTES) {
+    info.palette = frame_palette;
+    recorder_add_index(&recorder, &info, matrix_index + slice.first_led);
+  } else {
+    recorder_add(&recorder, &info, matrix + slice.first_led);
+  }
+
+  if (compute_us > RECORDER_OVERRUN_US && dump_at == 0 &&
+      (last_overrun_dump == 0 || now - last_overrun_dump > (uint32_t)RECORDER_DUMP_GAP_US)) {
+    dump_at = now + RECORDER_DUMP_DELAY_US;
+    if (dump_at == 0) {
+      dump_at = 1;
+    }
+  }
+  if (dump_at != 0 && (int32_t)(now - dump_at) >= 0) {
+    DumpRecorder("overrun");
+    dump_at = 0;
+    last_overrun_dump = now;
+  }
+  if (dump_requested) {
+    dump_requested = 0;
+    DumpRecorder("signal");
+  }
+}
+
+// Steps the scene state through frames whose clock never arrived, with an
+// empty slice so nothing is drawn.  Taps in those frames are lost, the
+// envelopes still decay in step with the leader.
+static void CatchUp(uint32_t first_frame, int frames)
+{
+  slice_t drawn = slice;
+  int i;
+
+  slice.first_strip = slice.end_strip;
+  slice.first_led = slice.end_led;
+  for (i = 0; i < frames; i++) {
+    render_frame = first_frame + i;
+    SceneStep();
+    upsample_advance(&upsample);
+  }
+  slice = drawn;
+}
 
 int main(int argc, char *argv[])
 {
   int ret = 0;
   int i, x, y;
-  static uint8_t motion_data_read = 0;
-  static uint8_t motion_data_index = 0;
   int loop_count = 0;
   long int this_time, last_time;
   long int time_difference;
+  long int frame_start;
+  long int last_frame_start = 0;
+  long int compute_us;
+  int record_seconds = RECORDER_SECONDS_DEFAULT;
+  int last_scene = -1;
+  int opt;
+  int keyframe_interval = KEYFRAME_INTERVAL_DEFAULT;
+  char *param_snapshot = NULL;
+  char *plugin_dir = NULL;
+  char *palette_file = NULL;
+  int udp_port = 0;
+  char *layout_file = NULL;
+  int cluster_role = CLUSTER_NONE;
+  char *cluster_group = NULL;
+  int slice_first = 0;
+  int slice_last = N_STRIPS - 1;
+  int headless = FALSE;
+  const char *spi_device = SPIOUT_DEVICE_DEFAULT;
+  cluster_clock_t clock;
+  int missed;
   //struct timespec gettime_now;
   setup_handlers();
+
+  while ((opt = getopt(argc, argv, "c:C:e:k:l:m:o:p:P:r:R:s:S:u:x")) != -1) {
+    switch (opt) {
+    case 'c':
+      if (strcmp(optarg, "leader") == 0) {
+	cluster_role = CLUSTER_LEADER;
+      } else if (strcmp(optarg, "follower") == 0) {
+	cluster_role = CLUSTER_FOLLOWER;
+      } else {
+	fprintf(stderr, "cluster role is leader or follower\n");
+	return 1;
+      }
+      break;
+    case 'C':
+      palette_file = optarg;
+      break;
+    case 'e':
+      if (LoadExprScene(optarg) < 0) {
+	return 1;
+      }
+      break;
+    case 'k':
+      keyframe_interval = atoi(optarg);
+      break;
+    case 'l':
+      layout_file = optarg;
+      break;
+    case 'm':
+      cluster_group = optarg;
+      break;
+    case 'o':
+      if (strcmp(optarg, "pwm") == 0) {
+	led_output = LED_OUTPUT_PWM;
+      } else if (strncmp(optarg, "spi", 3) == 0 && (optarg[3] == '\0' || optarg[3] == ':')) {
+	led_output = LED_OUTPUT_SPI;
+	if (optarg[3] == ':') {
+	  spi_device = optarg + 4;
+	}
+      } else {
+	fprintf(stderr, "LED output is pwm or spi[:device]\n");
+	return 1;
+      }
+      break;
+    case 'p':
+      param_snapshot = optarg;
+      break;
+    case 'P':
+      plugin_dir = optarg;
+      break;
+    case 'r':
+      record_seconds = atoi(optarg);
+      break;
+    case 'R':
+      dump_dir = optarg;
+      break;
+    case 's':
+      if (sscanf(optarg, "%i-%i", &slice_first, &slice_last) != 2) {
+	fprintf(stderr, "slice is first-last strip\n");
+	return 1;
+      }
+      break;
+    case 'S':
+      if (strncmp(optarg, SPIOUT_FILE_PREFIX, strlen(SPIOUT_FILE_PREFIX)) != 0) {
+	fprintf(stderr, "SPI sink is file:path\n");
+	return 1;
+      }
+      led_output = LED_OUTPUT_SPI;
+      spi_device = optarg;
+      break;
+    case 'u':
+      udp_port = atoi(optarg);
+      break;
+    case 'x':
+      headless = TRUE;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-c leader|follower] [-C palette_file] [-e scene:expression_file] [-k keyframe_interval]\n"
+	      "          [-l layout] [-m group[:port][@interface]] [-o pwm|spi[:device]] [-p param_snapshot]\n"
+	      "          [-P plugin_dir] [-r record_seconds, 0 off] [-R dump_dir] [-s first-last strip]\n"
+	      "          [-S file:path, SPI stream to a file] [-u udp_port]\n"
+	      "          [-x no LED output, timer or hub; with -u input is UDP only]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (layout_file != NULL && LoadLayout(layout_file) < 0) {
+    return 1;
+  }
+  if (expr_leds_init(&expr_leds, N_STRIPS, strip_lengths, strip_x, strip_y) < 0) {
+    fprintf(stderr, "Unable to set up expression inputs\n");
+    return 1;
+  }
+  for (i = 0; i < N_SCENES; i++) {
+    if (expr_scenes[i] != NULL && expr_prepare(expr_scenes[i], &expr_leds) < 0) {
+      fprintf(stderr, "Unable to prepare expression scene %i\n", i);
+      return 1;
+    }
+  }
+  if (spatial_init(&led_positions, N_STRIPS, strip_lengths, strip_x, strip_y, PARTICLE_RADIUS) < 0) {
+    fprintf(stderr, "Unable to index LED positions\n");
+    return 1;
+  }
+  if (particles_init(&particles, &led_positions, PARTICLE_RADIUS) < 0) {
+    fprintf(stderr, "Unable to allocate particles\n");
+    return 1;
+  }
+  if (SetSlice(slice_first, slice_last + 1) < 0) {
+    fprintf(stderr, "slice %i-%i is outside strips 0-%i\n", slice_first, slice_last, N_STRIPS - 1);
+    return 1;
+  }
+  if (layout_file != NULL && OpenNetOutput() < 0) {
+    return 1;
+  }
+  if (cluster_open(&cluster, cluster_role, cluster_group) < 0) {
+    fprintf(stderr, "Unable to join cluster: %s\n", strerror(errno));
+    return 1;
+  }
+  if (cluster_role != CLUSTER_NONE) {
+    printf("cluster %s, strips %i-%i\n", cluster_role == CLUSTER_LEADER ? "leader" : "follower", slice_first, slice_last);
+  }
     
     // wave machine initialization
     for (i = 0; i < N_STRIPS; i++) {
@@ -417,34 +1454,85 @@ int main(int argc, char *argv[])
 
   fd_key = open("/dev/input/event0", O_RDONLY | O_NONBLOCK);
 
-  if (ws2811_init(&ledstring))
+  if (slice.first_strip > 0 || slice.end_strip < N_STRIPS) {
+    ledstring.channel[0].count = slice.end_led - slice.first_led;
+  }
+  if (!headless && led_output == LED_OUTPUT_PWM && ws2811_init(&ledstring))
     {
       return -1;
     }
+  if (!headless && led_output == LED_OUTPUT_SPI) {
+    if (spiout_open(&spiout, spi_device, slice.end_led - slice.first_led) < 0) {
+      fprintf(stderr, "Unable to open SPI output %s: %s\n", spi_device, strerror(errno));
+      return 1;
+    }
+    printf("SPI output %s %s, %zu bytes per frame in writes of %zu\n", spiout.is_spi ? "on spidev" : "to file, no LEDs,",
+	   spi_device, spiout.size, spiout.chunk);
+    if (spiout.is_spi && spiout.chunk < spiout.size) {
+      printf("SPI frame is split, the gaps may latch it early: raise spidev.bufsiz to %zu\n", spiout.size);
+    }
+  }
 
-  int fd ;
+  int fd = -1;
 
-  printf("Opening Serial\n");
+  if (!headless) {
+    TIMER_Init();
+  }
 
-  TIMER_Init();
+  // followers get their motion data from the leader's clock, and a headless
+  // node with UDP input needs no hub
+  if (cluster_role != CLUSTER_FOLLOWER && headless && udp_port > 0) {
+    printf("No hub, UDP input only\n");
+  } else if (cluster_role != CLUSTER_FOLLOWER) {
+    printf("Opening Serial\n");
+
+    // if ((fd = serialOpen ("/dev/ttyAMA0", 115200)) < 0)
+    // if ((fd = serialOpen ("/dev/serial/by-id/usb-Teensyduino_USB_Serial_847320-if00", 115200)) < 0)
+    if ((fd = serialOpen("/dev/serial/by-id/usb-Silicon_Labs_CP2102_USB_to_UART_Bridge_Controller_0001-if00-port0", 115200)) < 0)
+      {
+	fprintf (stderr, "Unable to open serial device: %s\n", strerror (errno)) ;
+	return 1 ;
+      }
+    box_hub_reader_init(&hub_reader);
+    hubclock_init(&hub_clock);
+  }
 
-  // if ((fd = serialOpen ("/dev/ttyAMA0", 115200)) < 0)
-  // if ((fd = serialOpen ("/dev/serial/by-id/usb-Teensyduino_USB_Serial_847320-if00", 115200)) < 0)
-  if ((fd = serialOpen("/dev/serial/by-id/usb-Silicon_Labs_CP2102_USB_to_UART_Bridge_Controller_0001-if00-port0", 115200)) < 0)
-    {
- 
-      fprintf (stderr, "Unable to open serial device: %s\n", strerror (errno)) ;
-      return 1 ;
+  if (udp_port > 0) {
+    if (udp_input_open(&udp_input, udp_port) < 0) {
+      fprintf(stderr, "Unable to open UDP port %i: %s\n", udp_port, strerror(errno));
+      return 1;
     }
-
+    printf("UDP input on port %i\n", udp_port);
+  }
 
   printf("start\n");
 
+  InitParams(param_snapshot);
+  if (InitEnvelopes() < 0) {
+    fprintf(stderr, "Unable to allocate tap envelopes\n");
+    return 1;
+  }
+  if (InitPalettes(palette_file) < 0) {
+    return 1;
+  }
+  render_seed = TIMER_GetSysTick();    // a follower takes the leader's seed with its first clock
   InitSolidColors();
-  InitFire();
-  InitLightning();
   InitSolidDarks();
 
+  quality_init(&quality, FRAME_BUDGET_US);
+  if (InitRecorder(record_seconds) < 0) {
+    return 1;
+  }
+  upsample_init(&upsample, keyframe_a, keyframe_b, WIDTH, keyframe_interval);
+  upsample_init_index(&upsample, keyframe_index_a, keyframe_index_b);
+  printf("keyframe interval: %i\n", upsample.interval);
+
+  UpdatePluginContext();
+  if (plugins_open(&plugins, plugin_dir, N_SCENES, params, &plugin_ctx) < 0) {
+    fprintf(stderr, "Unable to watch plugin directory %s: %s\n", plugin_dir, strerror(errno));
+    return 1;
+  }
+
   //  clock_gettime(CLOCK_REALTIME, &gettime_now);
   last_time = TIMER_GetSysTick(); //gettime_now.tv_nsec;
 
@@ -457,6 +1545,51 @@ int main(int argc, char *argv[])
 	this_time = TIMER_GetSysTick(); //gettime_now.tv_nsec;
 	time_difference = this_time - last_time;
 	printf("dt [us]: %7lu\n", time_difference);
+	if (hub_reader.frames > 0 || hub_reader.bad > 0 || hub_reader.crc_errors > 0) {
+	  printf("hub: %lu frames, %lu lost, %lu crc errors, %lu bad, %lu keyframes, %lu deltas, %lu deltas skipped\n",
+		 hub_reader.frames, hub_reader.lost, hub_reader.crc_errors, hub_reader.bad, hub_motion.keyframes,
+		 hub_motion.deltas, hub_motion.skipped);
+	  printf("hub clock: drift %.1f ppm, %lu restarts, sensor latency avg %lli us max %lli us, sampled over %i us\n",
+		 hub_clock.drift * 1e6, hub_clock.restarts,
+		 hub_latency_n ? (long long)(hub_latency_sum_us / (int64_t)hub_latency_n) : 0LL,
+		 (long long)hub_latency_max_us, hub_n_offsets ? hub_offset_us[hub_n_offsets - 1] - hub_offset_us[0] : 0);
+	  if (hub_statuses > 0) {
+	    printf("hub tx: %u scans/s, %u frames/s, %u scans unsent, backlog max %u bytes\n", hub_status.scans,
+		   hub_status.frames, hub_status.unsent, hub_status.backlog_max);
+	  }
+	}
+	if (udp_input.fd >= 0) {
+	  printf("udp: %lu datagrams, %lu events, %lu bad, %lu dropped\n",
+		 udp_input.datagrams, udp_input.events, udp_input.bad, input_batch.dropped);
+	}
+	if (netout.fd >= 0) {
+	  printf("net: %lu frames, %lu send errors, %llu ns build per frame\n", netout.frames, netout.errors,
+		 netout.frames ? (unsigned long long)(netout.build_ns / netout.frames) : 0ULL);
+	}
+	if (cluster_role == CLUSTER_LEADER) {
+	  printf("cluster: %lu frames, %lu reports, skew avg %lli us max %lli us, %lu slices compared, %lu mismatches\n",
+		 cluster.frames, cluster.reports, cluster.reports ? (long long)(cluster.skew_sum_us / (int64_t)cluster.reports) : 0LL,
+		 (long long)cluster.skew_max_us, cluster.compared, cluster.mismatches);
+	} else if (cluster_role == CLUSTER_FOLLOWER) {
+	  printf("cluster: %lu frames, %lu missed\n", cluster.frames, cluster.missed);
+	}
+	if (scene == PARTICLES) {
+	  printf("particles: %i live, %lu spawned, %lu dropped\n", particles.count, particles.spawned, particles.dropped);
+	}
+	if (spiout.writer != NULL) {
+	  printf("spi: %lu frames, %lu write errors, %llu ns encode per frame\n", spiout.frames, spiout.errors,
+		 spiout.frames ? (unsigned long long)(spiout.encode_ns / spiout.frames) : 0ULL);
+	}
+	if (recorder.ring != NULL) {
+	  printf("recorder: %.1f s held, %lu frames, %lu dropped, %llu ns code per frame, %lu dumps\n",
+		 recorder_seconds(&recorder), recorder.frames, recorder.dropped,
+		 recorder.frames ? (unsigned long long)(recorder.code_ns / recorder.frames) : 0ULL, recorder.dumps);
+	}
+	if (plugins.inotify_fd >= 0) {
+	  printf("plugins: %lu loads, %lu failures\n", plugins.loads, plugins.failures);
+	}
+	cluster_stats_reset(&cluster);
+	fflush(stdout);    // for box_clustercheck and logs on a pipe
 	last_time = this_time;
 	loop_count = 0;
 	for (i = 0; i < 10; i++) {
@@ -464,91 +1597,95 @@ int main(int argc, char *argv[])
 	}
       }
 
-      while (serialDataAvail (fd)) {
-	motion_data_read = serialGetchar(fd);
-	if (motion_data_read == 254) {
-	  motion_data_index = 0;
-	} else {
-	  if (motion_data_read == 255) motion_data_read = 0;
-	  motion_data[motion_data_index] = motion_data_read;
-	  motion_data_index++;
+      if (cluster_role == CLUSTER_FOLLOWER) {
+	missed = cluster_wait(&cluster, &clock, CLUSTER_WAIT_MS);
+	if (missed < 0) {
+	  printf("cluster: waiting for leader\n");
+	  continue;
+	}
+	if (missed > 0 && missed <= CLUSTER_MAX_CATCHUP) {
+	  CatchUp(clock.frame - missed, missed);
+	}
+	ApplyClock(&clock);
+      } else {
+	if (fd >= 0) {
+	  ReadSerialEvents(fd);
+	}
+	if (udp_input_poll(&udp_input, &input_batch) < 0) {
+	  fprintf(stderr, "UDP input: %s\n", strerror(errno));
+	  udp_input_close(&udp_input);
+	}
+	ApplyInputEvents();
+
+	if (scene_override == 0) {
+	  scene = motion_data[0];
 	}
-	//printf (" -> %3d\n", (uint16_t)motion_data_read);
-	//SetBrightness(motion_data[1]);
-	fflush (stdout) ;
       }
 
-      if (scene_override == 0) {
-	scene = motion_data[0];
+      if (scene != last_scene) {
+	last_scene = scene;
+	quality_set_scene(&quality, scene, (scene >= 0 && scene < N_SCENES) ? scene_quality_levels[scene] : 0);
+	scene_quality = QUALITY_FULL;
+	upsample_reset(&upsample);
       }
 
+      if (cluster_role == CLUSTER_FOLLOWER) {
+	scene_quality = clock.quality;    // the leader's budget decides for everyone
+	upsample.phase = clock.keyframe_phase;
+      } else if (cluster_role == CLUSTER_LEADER) {
+	cluster_collect(&cluster);
+	PublishClock();
+      }
 
-      // A FAT RED LINE OF TEXT ============================================
-      
-      if (FALSE) {   // kill compiler warning on unused fn
-	StripLengthTestStep();
-	XSweep();
-	YSweep();
-	ZSweep();
-	BluePlasmaStep();
-	FireStep();
-	SolidColorsStep();
-	LightningStep();
-	SolidDarksStep();
-	RGBFlashStep();
-	SolidAllStep();
-	StaticStep();
-	RainbowStep();
-          WaveMachineStep();
+      frame_start = TIMER_GetSysTick();
+
+
+      SceneStep();
+      ExpandIndexedFrame();
+
+      netout_send(&netout, &layout, matrix);
+      compute_us = TIMER_GetSysTick() - frame_start;
+      if (cluster_role != CLUSTER_FOLLOWER) {
+	scene_quality = quality_update(&quality, compute_us);
       }
-      //StripLengthTestStep();
-      switch (scene) {
-      case BLUE_PLASMA:
-      	BluePlasmaStep();
-      	break;
-      case FIRE:
-      	FireStep();
-      	break;
-      case SOLID_COLORS:
-      	SolidColorsStep();
-      	break;
-      case LIGHTNING:
-      	LightningStep();
-      	break;
-      case SOLID_DARKS:
-      	SolidDarksStep();
-      	break;
-      case RGB_FLASH:
-      	RGBFlashStep();
-      	break;
-      case SOLID_ALL:
-	SolidAllStep();
-	break;
-      case STATICS:
-	StaticStep();
-	break;
-      case RAINBOW:
-	RainbowStep();
-	break;
-          case WAVE_MACHINE:
-              WaveMachineStep();
-              break;
+
+      if (!headless && led_output == LED_OUTPUT_SPI) {
+	spiout_send(&spiout, matrix + slice.first_led);    // failures are counted
+      } else if (!headless) {
+	matrix_render();
+	if (ws2811_render(&ledstring))
+	  {
+	    ret = -1;
+	    break;
+	  }
       }
-      //ZSweep();
-     
-      matrix_render();
-      if (ws2811_render(&ledstring))
-        {
-	  ret = -1;
-	  break;
-        }
+      cluster_presented(&cluster, render_frame, input_now_us(), slice.first_strip, slice.end_strip, StripChecksums());
+      RecordFrame(frame_start, compute_us, frame_start - last_frame_start);
+      last_frame_start = frame_start;
 
       // 15 frames /sec
-      usleep(1000);//(1000000 /1000);
+      upsample_advance(&upsample);
+      render_frame++;
+
+      UpdatePluginContext();
+      plugins_poll(&plugins, &plugin_ctx);    // rebuilt scenes swap in between frames
+
+      if (cluster_role != CLUSTER_FOLLOWER) {    // followers are paced by the leader's clock
+	usleep(FRAME_SLEEP_US);//(1000000 /1000);
+      }
 
     }
 
-  ws2811_fini(&ledstring);
+  if (!headless && led_output == LED_OUTPUT_PWM) {
+    ws2811_fini(&ledstring);
+  }
+  spiout_close(&spiout);
+  UpdatePluginContext();
+  plugins_close(&plugins, &plugin_ctx);
+  netout_close(&netout);
+  recorder_free(&recorder);
+  cluster_close(&cluster);
+  udp_input_close(&udp_input);
 
   return ret;
 }
@@ -596,13 +1733,15 @@ static void WaveMachineStep(void)
         }
     }
     
+    wave_limit = N_WAVES >> scene_quality;    // halve the active waves per quality step
+    
     WaveStep();
     NodeStep();
     WaveNodeStep();
     
     led_index = -1;
-    strip_index = 0;
-    for (x = 0; x < N_LEDS; x++) {
+    strip_index = slice.first_strip;
+    for (x = slice.first_led; x < slice.end_led; x++) {
         led_index++;
         if (led_index == strip_lengths[strip_index]) {
             led_index = 0;
@@ -622,18 +1761,122 @@ static void WaveMachineStep(void)
 
 
 
-static void BluePlasmaStep(void)
+// fills the odd LEDs of each strip with the average of their even neighbours,
+// used by the plasma scenes at QUALITY_HALF_RES
+static void InterpolateOddLeds(void)
+{
+  int strip_index, led_index, x;
+  ws2811_led_t a, b;
+
+  x = slice.first_led;
+  for (strip_index = slice.first_strip; strip_index < slice.end_strip; strip_index++) {
+    for (led_index = 1; led_index < strip_lengths[strip_index]; led_index += 2) {
+      if (x + led_index >= N_LEDS) {
+	return;
+      }
+      a = matrix[x + led_index - 1];
+      if (led_index + 1 < strip_lengths[strip_index] && x + led_index + 1 < N_LEDS) {
+	b = matrix[x + led_index + 1];
+      } else {
+	b = a;    // strip end, nothing to blend with
+      }
+      matrix[x + led_index] = ((a >> 1) & 0x7f7f7f) + ((b >> 1) & 0x7f7f7f);
+    }
+    x += strip_lengths[strip_index];
+  }
+}
+
+// plasma field for BluePlasmaStep, rendered once per keyframe
+static void BluePlasmaField(uint16_t tpos1, uint16_t tpos2, uint16_t tpos3, int space_scale)
+{
+  int strip_index, led_index;
+  uint16_t x, z, r, g, b, pos1, pos2, pos3;
+
+  led_index = -1;
+  strip_index = slice.first_strip;
+  for (x = slice.first_led; x < slice.end_led; x++) {
+    led_index++;
+    if (led_index == strip_lengths[strip_index]) {
+      led_index = 0;
+      strip_index++;
+      if (strip_index == N_STRIPS) {
+	break;
+      }
+    }
+    if (scene_quality >= QUALITY_HALF_RES && (led_index & 1)) {
+      continue;    // filled in from neighbours by InterpolateOddLeds()
+    }
+    z = strip_lengths[strip_index] - led_index;
+    pos1 = ((-strip_x[strip_index] + strip_y[strip_index] + z) * 10 * space_scale) >> 6;
+    pos2 = ((strip_x[strip_index] - strip_y[strip_index] + z) * 6 * space_scale) >> 6;
+    pos3 = ((strip_x[strip_index] + strip_y[strip_index] - z) * 8 * space_scale) >> 6;
+    //Calculate 3 seperate plasma waves, one for each color channel
+    //r = fastCosineCalc(((x*20) + (t3 >> 1) + fastCosineCalc(t2 + (x*20))));
+    //g = fastCosineCalc((t + (x*20) + fastCosineCalc((-(t3 >> 2) + (x*20)))));
+    //b = fastCosineCalc((t2 + (x*20) + fastCosineCalc((t + (x*20) + 0*(g >> 2)))));
+    if (scene_quality >= QUALITY_NO_NEST) {
+      r = fastCosineCalc(pos1 + (tpos3 >> 1));
+      g = fastCosineCalc(tpos1 + pos2);
+      b = fastCosineCalc(tpos2 + pos3);
+    } else {
+      r = fastCosineCalc((pos1 + (tpos3 >> 1) + fastCosineCalc(tpos2 + pos2)));
+      g = fastCosineCalc((tpos1 + pos2 + fastCosineCalc((-(tpos3 >> 2) + pos3))));
+      b = fastCosineCalc((tpos2 + pos3 + fastCosineCalc((tpos1 + pos1))));
+    }
+
+    r = fx_wave_to_u8(r);    // red follows the tap envelope, applied per frame by RedLevelOverlay()
+    g = fx_wave_to_u8(g);
+    b = fx_wave_to_u8(b);
+    /*if (swap) {
+      r = 255;
+      g = 255;
+      b = 255;
+      } else {
+      r = 0;
+      b = 0;
+      g = 0;
+      }*/
+    matrix[x] = (r << 16) + (g << 8) + b;
+  }
+  if (scene_quality >= QUALITY_HALF_RES) {
+    InterpolateOddLeds();
+  }
+}
+
+// scales the red channel by each strip's tap envelope, every frame on top of the field
+static void RedLevelOverlay(void)
 {
   int strip_index, led_index;
-  uint16_t i, x, z, r, g, b, pos1, pos2, pos3, tpos1, tpos2, tpos3;
-  static long t1 = 0;
-  static long t2 = 0;
-  static long t3 = 0;
-  static long t1_speed = 57;
-  static long t2_speed = -91;
-  static long t3_speed = 61;
-  static int t_scale = 50;
-  static int space_scale = 50;
+  uint16_t x;
+  uint32_t r;
+
+  led_index = -1;
+  strip_index = slice.first_strip;
+  for (x = slice.first_led; x < slice.end_led; x++) {
+    led_index++;
+    if (led_index == strip_lengths[strip_index]) {
+      led_index = 0;
+      strip_index++;
+      if (strip_index == N_STRIPS) {
+	break;
+      }
+    }
+    r = (matrix[x] >> 16) & 0xff;
+    r = fx_mul(r, envelopes.level[ENV_RED][strip_index], 10);    // Q10 level
+    matrix[x] = (matrix[x] & 0x00ffff) | (r << 16);
+  }
+}
+
+static void BluePlasmaStep(void)
+{
+  int keyframe;
+  uint16_t tpos1, tpos2, tpos3;
+  int32_t *t = scene_time[BLUE_PLASMA];    // t1, t2, t3, shared with cluster followers
+  long t1_speed = Param(P_PLASMA_T1_SPEED);
+  long t2_speed = Param(P_PLASMA_T2_SPEED);
+  long t3_speed = Param(P_PLASMA_T3_SPEED);
+  int t_scale = Param(P_PLASMA_T_SCALE);
+  int space_scale = Param(P_PLASMA_SPACE_SCALE);
 
   read(fd_key, &ev, sizeof(ev));
   if (ev.type == 1) {
@@ -705,40 +1948,44 @@ static void BluePlasmaStep(void)
 	printf("t3 speed: %li\n", t3_speed);
 	
       }
+      StoreSpeedParams(P_PLASMA_T1_SPEED, t1_speed, t2_speed, t3_speed, t_scale, space_scale);
     }
   }
 
 
-  t1 += (t1_speed * t_scale);
-  t2 += (t2_speed * t_scale);
-  t3 += (t3_speed * t_scale);
-  tpos1 = fastCosineCalc(t1 >> 10);
-  tpos2 = fastCosineCalc(t2 >> 10);
-  tpos3 = fastCosineCalc(t3 >> 10);
+  keyframe = upsample_keyframe_due(&upsample);
+  if (keyframe) {    // field time covers the whole keyframe interval
+    t[0] += (t1_speed * t_scale) * upsample.interval;
+    t[1] += (t2_speed * t_scale) * upsample.interval;
+    t[2] += (t3_speed * t_scale) * upsample.interval;
+  }
+  tpos1 = fastCosineCalc(t[0] >> 10);
+  tpos2 = fastCosineCalc(t[1] >> 10);
+  tpos3 = fastCosineCalc(t[2] >> 10);
   // frameCount+=10;
   //t = fastCosineCalc((43 * frameCount)/50);  //time displacement - fiddle with these til it looks good...
   //t2 = -fastCosineCalc((35 * frameCount)/50); 
   //t3 = fastCosineCalc((37 * frameCount)/50);
   
     
-  for (i = 0; i < N_MOT_SENSORS; i++) {
-    if (strip_red_setpoints[i] < motion_data[i + 1] * 8) {
-      strip_red_setpoints[i] = motion_data[i + 1] * 8;
-    }
-  }
-  //}
-  
-  for (i = 0; i < N_STRIPS; i++) {
-    if (strip_red_setpoints[i] > STRIP_RED_LEVEL_DEC) {
-      strip_red_setpoints[i] -= STRIP_RED_LEVEL_DEC;
-    } else {
-      strip_red_setpoints[i] = 0;
-    }
-    strip_red_levels[i] = (strip_red_setpoints[i] + strip_red_levels[i] * 15) >> 4;    // recursive set point following
+  if (keyframe) {
+    BluePlasmaField(tpos1, tpos2, tpos3, space_scale);
+    upsample_push(&upsample, matrix);
   }
+  upsample_output(&upsample, matrix);
+  RedLevelOverlay();
+}
+
+// rainbow field for RainbowStep, rendered once per keyframe
+static void RainbowField(uint16_t tpos1, uint16_t tpos2, uint16_t tpos3, int space_scale)
+{
+  int strip_index, led_index;
+  uint16_t x, z, pos1, pos2, pos3;
+  long r, g, b;
+
   led_index = -1;
-  strip_index = 0;
-  for (x = 0; x < N_LEDS; x++) {
+  strip_index = slice.first_strip;
+  for (x = slice.first_led; x < slice.end_led; x++) {
     led_index++;
     if (led_index == strip_lengths[strip_index]) {
       led_index = 0;
@@ -747,6 +1994,9 @@ static void BluePlasmaStep(void)
 	break;
       }
     }
+    if (scene_quality >= QUALITY_HALF_RES && (led_index & 1)) {
+      continue;    // filled in from neighbours by InterpolateOddLeds()
+    }
     z = strip_lengths[strip_index] - led_index;
     pos1 = ((-strip_x[strip_index] + strip_y[strip_index] + z) * 10 * space_scale) >> 6;
     pos2 = ((strip_x[strip_index] - strip_y[strip_index] + z) * 6 * space_scale) >> 6;
@@ -755,13 +2005,19 @@ static void BluePlasmaStep(void)
     //r = fastCosineCalc(((x*20) + (t3 >> 1) + fastCosineCalc(t2 + (x*20))));
     //g = fastCosineCalc((t + (x*20) + fastCosineCalc((-(t3 >> 2) + (x*20)))));
     //b = fastCosineCalc((t2 + (x*20) + fastCosineCalc((t + (x*20) + 0*(g >> 2)))));
-    r = fastCosineCalc((pos1 + (tpos3 >> 1) + fastCosineCalc(tpos2 + pos2)));
-    g = fastCosineCalc((tpos1 + pos2 + fastCosineCalc((-(tpos3 >> 2) + pos3))));
-    b = fastCosineCalc((tpos2 + pos3 + fastCosineCalc((tpos1 + pos1))));
+    if (scene_quality >= QUALITY_NO_NEST) {
+      r = fastCosineCalc(pos1 + (tpos3 >> 1));
+      g = fastCosineCalc(tpos1 + pos2);
+      b = fastCosineCalc(tpos2 + pos3);
+    } else {
+      r = fastCosineCalc((pos1 + (tpos3 >> 1) + fastCosineCalc(tpos2 + pos2)));
+      g = fastCosineCalc((tpos1 + pos2 + fastCosineCalc((-(tpos3 >> 2) + pos3))));
+      b = fastCosineCalc((tpos2 + pos3 + fastCosineCalc((tpos1 + pos1))));
+    }
 
-    r = ((uint32_t)r * strip_red_levels[strip_index]) >> 13 ;
-    g = g >> 3;
-    b = b >> 3;    // bit shift of at least 3 needed for 8 bit color
+    r = fx_wave_sq_u8(r);
+    g = fx_wave_sq_u8(g);
+    b = fx_wave_sq_u8(b);
     /*if (swap) {
       r = 255;
       g = 255;
@@ -773,21 +2029,21 @@ static void BluePlasmaStep(void)
       }*/
     matrix[x] = (r << 16) + (g << 8) + b;
   }
+  if (scene_quality >= QUALITY_HALF_RES) {
+    InterpolateOddLeds();
+  }
 }
 
 static void RainbowStep(void)
 {
-  int strip_index, led_index;
-  uint16_t i, x, z, pos1, pos2, pos3, tpos1, tpos2, tpos3;
-  long r, g, b;
-  static long t1 = 0;
-  static long t2 = 0;
-  static long t3 = 0;
-  static long t1_speed = 57;
-  static long t2_speed = -91;
-  static long t3_speed = 61;
-  static int t_scale = 12;
-  static int space_scale = 22;
+  int keyframe;
+  uint16_t i, tpos1, tpos2, tpos3;
+  int32_t *t = scene_time[RAINBOW];    // t1, t2, t3, shared with cluster followers
+  long t1_speed = Param(P_RAINBOW_T1_SPEED);
+  long t2_speed = Param(P_RAINBOW_T2_SPEED);
+  long t3_speed = Param(P_RAINBOW_T3_SPEED);
+  int t_scale = Param(P_RAINBOW_T_SCALE);
+  int space_scale = Param(P_RAINBOW_SPACE_SCALE);
 
   read(fd_key, &ev, sizeof(ev));
   if (ev.type == 1) {
@@ -859,6 +2115,7 @@ static void RainbowStep(void)
 	printf("t3 speed: %li\n", t3_speed);
 	
       }
+      StoreSpeedParams(P_RAINBOW_T1_SPEED, t1_speed, t2_speed, t3_speed, t_scale, space_scale);
     }
   }
 
@@ -868,12 +2125,15 @@ static void RainbowStep(void)
   }
 
 
-  t1 += (t1_speed * t_scale);
-  t2 += (t2_speed * t_scale);
-  t3 += (t3_speed * t_scale);
-  tpos1 = fastCosineCalc(t1 >> 10);
-  tpos2 = fastCosineCalc(t2 >> 10);
-  tpos3 = fastCosineCalc(t3 >> 10);
+  keyframe = upsample_keyframe_due(&upsample);
+  if (keyframe) {    // field time covers the whole keyframe interval
+    t[0] += (t1_speed * t_scale) * upsample.interval;
+    t[1] += (t2_speed * t_scale) * upsample.interval;
+    t[2] += (t3_speed * t_scale) * upsample.interval;
+  }
+  tpos1 = fastCosineCalc(t[0] >> 10);
+  tpos2 = fastCosineCalc(t[1] >> 10);
+  tpos3 = fastCosineCalc(t[2] >> 10);
   // frameCount+=10;
   //t = fastCosineCalc((43 * frameCount)/50);  //time displacement - fiddle with these til it looks good...
   //t2 = -fastCosineCalc((35 * frameCount)/50); 
@@ -888,9 +2148,27 @@ static void RainbowStep(void)
   for (i = 0; i < N_STRIPS; i++) {
     
   }
+  if (keyframe) {
+    RainbowField(tpos1, tpos2, tpos3, space_scale);
+    upsample_push(&upsample, matrix);
+  }
+  upsample_output(&upsample, matrix);
+}
+
+#define BRIGHT_SLOPE_BASE    1024
+#define BRIGHT_SLOPE_MAX     Param(P_FIRE_SLOPE_MAX)    // live tunable, see param_descs
+#define BRIGHT_SLOPE_MIN     Param(P_FIRE_SLOPE_MIN)    // the slopes themselves are ENV_FIRE_SLOPE
+
+// fire field for FireStep, rendered once per keyframe
+static void FireField(uint16_t tpos1, uint16_t tpos2, uint16_t tpos3, int space_scale)
+{
+  int strip_index, led_index;
+  uint16_t x, z, pos1, pos2, pos3;
+  long r, g, b;
+
   led_index = -1;
-  strip_index = 0;
-  for (x = 0; x < N_LEDS; x++) {
+  strip_index = slice.first_strip;
+  for (x = slice.first_led; x < slice.end_led; x++) {
     led_index++;
     if (led_index == strip_lengths[strip_index]) {
       led_index = 0;
@@ -899,66 +2177,121 @@ static void RainbowStep(void)
 	break;
       }
     }
+    if (scene_quality >= QUALITY_HALF_RES && (led_index & 1)) {
+      continue;    // filled in from neighbours by InterpolateOddLeds()
+    }
     z = strip_lengths[strip_index] - led_index;
     pos1 = ((-strip_x[strip_index] + strip_y[strip_index] + z) * 10 * space_scale) >> 6;
     pos2 = ((strip_x[strip_index] - strip_y[strip_index] + z) * 6 * space_scale) >> 6;
-    pos3 = ((strip_x[strip_index] + strip_y[strip_index] - z) * 8 * space_scale) >> 6;
+    pos3 = ((-strip_x[strip_index] - strip_y[strip_index] + z) * 8 * space_scale) >> 6;
     //Calculate 3 seperate plasma waves, one for each color channel
     //r = fastCosineCalc(((x*20) + (t3 >> 1) + fastCosineCalc(t2 + (x*20))));
     //g = fastCosineCalc((t + (x*20) + fastCosineCalc((-(t3 >> 2) + (x*20)))));
     //b = fastCosineCalc((t2 + (x*20) + fastCosineCalc((t + (x*20) + 0*(g >> 2)))));
-    r = fastCosineCalc((pos1 + (tpos3 >> 1) + fastCosineCalc(tpos2 + pos2)));
-    g = fastCosineCalc((tpos1 + pos2 + fastCosineCalc((-(tpos3 >> 2) + pos3))));
-    b = fastCosineCalc((tpos2 + pos3 + fastCosineCalc((tpos1 + pos1))));
+    if (scene_quality >= QUALITY_NO_NEST) {
+      r = fastCosineCalc(pos1 + (tpos3 >> 1));
+      g = fastCosineCalc(tpos1 + pos2);
+      b = fastCosineCalc(tpos2 + pos3);
+    } else {
+      r = fastCosineCalc((pos1 + (tpos3 >> 1) + fastCosineCalc(tpos2 + pos2)));
+      g = fastCosineCalc((tpos1 + pos2 + fastCosineCalc(((tpos3 >> 2) + pos3))));
+      b = fastCosineCalc((tpos2 + pos3 + fastCosineCalc((tpos1 + pos1))));
+    }
 
-    r = (r * r) >> 14;
-    g = (g * g) >> 14;
-    b = (b * b) >> 14;    // bit shift of at least 3 needed for 8 bit color
-    /*if (swap) {
-      r = 255;
-      g = 255;
-      b = 255;
-      } else {
-      r = 0;
-      b = 0;
-      g = 0;
-      }*/
+    r = fx_wave_to_u8(r);    // raw field, colour and brightness mixed per frame by FireOverlay()
+    g = fx_wave_to_u8(g);
+    b = fx_wave_to_u8(b);
     matrix[x] = (r << 16) + (g << 8) + b;
   }
+  if (scene_quality >= QUALITY_HALF_RES) {
+    InterpolateOddLeds();
+  }
 }
 
-#define BRIGHT_SLOPE_BASE    1024
-#define BRIGHT_SLOPE_MAX     2000
-#define BRIGHT_SLOPE_MIN     300
-#define TAP_TO_SLOPE_SCALE   14   
-#define BRIGHT_SLOPE_STEP    5
+// noise fields, see noise.h, read the LED positions from expr_leds; one
+// channel per field
+static uint8_t noise_out[3][N_LEDS + 4];
 
-static int strip_bright_slopes[N_STRIPS];
-static int strip_bright_slope_setpoints[N_STRIPS];
+static inline uint32_t NoiseStretch(int v)
+{
+  v = (v - 128) * 2 + 128;
+  return v < 0 ? 0 : v > 255 ? 255 : v;
+}
 
-static void InitFire(void)
+// noise in place of the cosine fire field, fire.noise_octaves > 0.  Each
+// channel drifts through its own noise with the fire's time accumulators.
+static void FireNoiseField(const int32_t *t, int space_scale, int octaves)
 {
-  int i;
-  for (i = 0; i < N_STRIPS; i++) {
-    strip_bright_slopes[i] = BRIGHT_SLOPE_MAX;
-    strip_bright_slope_setpoints[i] = BRIGHT_SLOPE_MAX;
+  int32_t drift[3];
+  uint16_t x;
+  int c, k;
+
+  octaves -= scene_quality;
+  for (c = 0; c < 3; c++) {
+    for (k = 0; k < 3; k++) {
+      drift[k] = (t[(c + k) % 3] >> 11) & 0xffffff;    // wraps after 64k noise cells
+    }
+    noise_field(expr_leds.in[EXPR_IN_X], expr_leds.in[EXPR_IN_Y], expr_leds.in[EXPR_IN_Z],
+		slice.first_led, slice.end_led, space_scale / 10, drift, octaves,
+		render_seed + c * 0x9e3779b9, noise_out[c]);
+  }
+  for (x = slice.first_led; x < slice.end_led; x++) {    // value noise sits mid range, widen it to a cosine's
+    matrix[x] = (NoiseStretch(noise_out[0][x]) << 16) + (NoiseStretch(noise_out[1][x]) << 8) + NoiseStretch(noise_out[2][x]);
   }
 }
 
-static void FireStep(void)
+// fire colour and brightness follow the tap slopes, so they are mixed every
+// frame on top of the field
+static void FireOverlay(void)
 {
   int strip_index, led_index;
-  uint16_t i, x, z, pos1, pos2, pos3, tpos1, tpos2, tpos3, next_slope;
+  uint16_t x;
   long r, g, b;
-  long bright_scale, color_shift_strength, color_base_strength;
-  static long t1 = 0;
-  static long t2 = 0;
-  static long t3 = 0;
-  static long t1_speed = 57;
-  static long t2_speed = 101;
-  static long t3_speed = 61;
-  static int t_scale = 120;
-  static int space_scale = 300;
+  long bright_scale, bright_base, color_shift_strength, color_base_strength;
+
+  bright_base = color_shift_strength = color_base_strength = 0;
+  led_index = -1;
+  strip_index = slice.first_strip;
+  for (x = slice.first_led; x < slice.end_led; x++) {
+    led_index++;
+    if (led_index == strip_lengths[strip_index]) {
+      led_index = 0;
+      strip_index++;
+      if (strip_index == N_STRIPS) {
+	break;
+      }
+    }
+    if (led_index == 0) {    // these only change per strip
+      bright_base = BRIGHT_SLOPE_BASE * strip_lengths[strip_index];
+      color_shift_strength = (256 * (BRIGHT_SLOPE_MAX - envelopes.level[ENV_FIRE_SLOPE][strip_index])) / (BRIGHT_SLOPE_MAX - BRIGHT_SLOPE_MIN);
+      color_base_strength = (256 * (envelopes.level[ENV_FIRE_SLOPE][strip_index] - BRIGHT_SLOPE_MIN)) / (BRIGHT_SLOPE_MAX - BRIGHT_SLOPE_MIN);
+    }
+    r = ((matrix[x] >> 16) & 0xff) << 3;
+    g = ((matrix[x] >> 8) & 0xff) << 3;
+    b = (matrix[x] & 0xff) << 3;
+
+    bright_scale = (bright_base - envelopes.level[ENV_FIRE_SLOPE][strip_index] * led_index);
+    if (bright_scale < 0) {
+      bright_scale = 0;
+    }
+    g = ((((g * r * color_base_strength) >> 23) + ((g * color_shift_strength) >> 12)) * bright_scale) / bright_base;
+    b = (((color_shift_strength * b * r) >> 25) * bright_scale) / bright_base;
+    r = ((r / 10 + 50) * bright_scale) / bright_base;
+
+    matrix[x] = (r << 16) + (g << 8) + b;
+  }
+}
+
+static void FireStep(void)
+{
+  int keyframe;
+  uint16_t tpos1, tpos2, tpos3;
+  int32_t *t = scene_time[FIRE];    // t1, t2, t3, shared with cluster followers
+  long t1_speed = Param(P_FIRE_T1_SPEED);
+  long t2_speed = Param(P_FIRE_T2_SPEED);
+  long t3_speed = Param(P_FIRE_T3_SPEED);
+  int t_scale = Param(P_FIRE_T_SCALE);
+  int space_scale = Param(P_FIRE_SPACE_SCALE);
 
   read(fd_key, &ev, sizeof(ev));
   if (ev.type == 1) {
@@ -1030,126 +2363,48 @@ static void FireStep(void)
 	printf("t3 speed: %li\n", t3_speed);
 	
       }
+      StoreSpeedParams(P_FIRE_T1_SPEED, t1_speed, t2_speed, t3_speed, t_scale, space_scale);
     }
   }
 
 
-  t1 += (t1_speed * t_scale);
-  t2 += (t2_speed * t_scale);
-  t3 += (t3_speed * t_scale);
+  keyframe = upsample_keyframe_due(&upsample);
+  if (keyframe) {    // field time covers the whole keyframe interval
+    t[0] += (t1_speed * t_scale) * upsample.interval;
+    t[1] += (t2_speed * t_scale) * upsample.interval;
+    t[2] += (t3_speed * t_scale) * upsample.interval;
+  }
   //tpos1 = fastCosineCalc(t1 >> 10);
   //tpos2 = fastCosineCalc(t2 >> 10);
   //tpos3 = fastCosineCalc(t3 >> 10);
-  tpos1 = t1 >> 10;  // rise continuously instead of circling
-  tpos2 = t2 >> 10;
-  tpos3 = t3 >> 10;
+  tpos1 = t[0] >> 10;  // rise continuously instead of circling
+  tpos2 = t[1] >> 10;
+  tpos3 = t[2] >> 10;
   // frameCount+=10;
   //t = fastCosineCalc((43 * frameCount)/50);  //time displacement - fiddle with these til it looks good...
   //t2 = -fastCosineCalc((35 * frameCount)/50); 
   //t3 = fastCosineCalc((37 * frameCount)/50);
   
-    
-  for (i = 0; i < N_MOT_SENSORS; i++) {
-    if (strip_red_setpoints[i] < motion_data[i + 1] * 8) {
-      strip_red_setpoints[i] = motion_data[i + 1] * 8;
-    }
-    next_slope = BRIGHT_SLOPE_MAX - (motion_data[i + 1] * TAP_TO_SLOPE_SCALE);
-    if (next_slope < BRIGHT_SLOPE_MIN) {
-      next_slope = BRIGHT_SLOPE_MIN;
-    }
-    if (next_slope < strip_bright_slope_setpoints[i]) {
-      strip_bright_slope_setpoints[i] = next_slope;
-    }
-  }
-  //}
-  
-  for (i = 0; i < N_STRIPS; i++) {
-    if (strip_red_setpoints[i] > STRIP_RED_LEVEL_DEC) {
-      strip_red_setpoints[i] -= STRIP_RED_LEVEL_DEC;
-    } else {
-      strip_red_setpoints[i] = 0;
-    }
-    strip_red_levels[i] = (strip_red_setpoints[i] + strip_red_levels[i] * 15) >> 4;    // recursive set point following
-    if (strip_bright_slope_setpoints[i] < BRIGHT_SLOPE_MAX - BRIGHT_SLOPE_STEP) {
-      (strip_bright_slope_setpoints[i]) += BRIGHT_SLOPE_STEP;
-    } else {
-      (strip_bright_slope_setpoints[i]) = BRIGHT_SLOPE_MAX; 
-    }
-    strip_bright_slopes[i] = (strip_bright_slope_setpoints[i] + strip_bright_slopes[i] * 15) >> 4;
-  }
-
-  led_index = -1;
-  strip_index = 0;
-  for (x = 0; x < N_LEDS; x++) {
-    led_index++;
-    if (led_index == strip_lengths[strip_index]) {
-      led_index = 0;
-      strip_index++;
-      if (strip_index == N_STRIPS) {
-	break;
-      }
-    }
-    z = strip_lengths[strip_index] - led_index;
-    pos1 = ((-strip_x[strip_index] + strip_y[strip_index] + z) * 10 * space_scale) >> 6;
-    pos2 = ((strip_x[strip_index] - strip_y[strip_index] + z) * 6 * space_scale) >> 6;
-    pos3 = ((-strip_x[strip_index] - strip_y[strip_index] + z) * 8 * space_scale) >> 6;
-    //Calculate 3 seperate plasma waves, one for each color channel
-    //r = fastCosineCalc(((x*20) + (t3 >> 1) + fastCosineCalc(t2 + (x*20))));
-    //g = fastCosineCalc((t + (x*20) + fastCosineCalc((-(t3 >> 2) + (x*20)))));
-    //b = fastCosineCalc((t2 + (x*20) + fastCosineCalc((t + (x*20) + 0*(g >> 2)))));
-    r = fastCosineCalc((pos1 + (tpos3 >> 1) + fastCosineCalc(tpos2 + pos2)));
-    g = fastCosineCalc((tpos1 + pos2 + fastCosineCalc(((tpos3 >> 2) + pos3))));
-    b = fastCosineCalc((tpos2 + pos3 + fastCosineCalc((tpos1 + pos1))));
 
-    bright_scale = (BRIGHT_SLOPE_BASE * strip_lengths[strip_index] - strip_bright_slopes[strip_index] * led_index);
-    if (bright_scale < 0) {
-      bright_scale = 0;
+  if (keyframe) {
+    if (Param(P_FIRE_NOISE_OCTAVES) > 0) {
+      FireNoiseField(t, space_scale, Param(P_FIRE_NOISE_OCTAVES));
+    } else {
+      FireField(tpos1, tpos2, tpos3, space_scale);
     }
-    color_shift_strength = (256 * (BRIGHT_SLOPE_MAX - strip_bright_slopes[strip_index])) / (BRIGHT_SLOPE_MAX - BRIGHT_SLOPE_MIN);
-    color_base_strength = (256 * (strip_bright_slopes[strip_index] - BRIGHT_SLOPE_MIN)) / (BRIGHT_SLOPE_MAX - BRIGHT_SLOPE_MIN);
-    g = ((((g * r * color_base_strength) >> 23) + ((g * color_shift_strength) >> 12)) * bright_scale) / (BRIGHT_SLOPE_BASE * strip_lengths[strip_index]);
-    b = (((color_shift_strength * b * r) >> 25) * bright_scale) / (BRIGHT_SLOPE_BASE * strip_lengths[strip_index]);
-    r = ((r / 10 + 50) * bright_scale) / (BRIGHT_SLOPE_BASE * strip_lengths[strip_index]);
-   
-
-    
-
-    //r = ((uint32_t)r * strip_red_levels[strip_index]) >> 13 ;
-    //g = g >> 4;
-    //b = b >> 4;    // bit shift of at least 3 needed for 8 bit color
-    /*if (swap) {
-      r = 255;
-      g = 255;
-      b = 255;
-      } else {
-      r = 0;
-      b = 0;
-      g = 0;
-      }*/
-    matrix[x] = (r << 16) + (g << 8) + b;
+    upsample_push(&upsample, matrix);
   }
+  upsample_output(&upsample, matrix);
+  FireOverlay();
 }
 
-#define LIGHTNING_PROB_MIN  6
-#define LIGHTNING_PROB_MAX  250
-#define LIGHTNING_PROB_STEP 2
-#define TAP_TO_PROB_SCALE   2
-
+// strike probabilities are ENV_LIGHTNING
 static int strip_lightning_states[N_STRIPS];
-static int strip_lightning_probs[N_STRIPS];
-
-static void InitLightning(void)
-{
-  int i;
-  for (i = 0; i < N_STRIPS; i++) {
-    strip_lightning_probs[i] = LIGHTNING_PROB_MIN;
-  }
-}
 
 static void LightningStep(void)
 {
   int strip_index, led_index;
-  uint16_t  i, x, r, g, b, next_prob;
+  uint16_t  i, x, r, g, b;
   r = g = b = 0;
 
   read(fd_key, &ev, sizeof(ev));
@@ -1161,38 +2416,19 @@ static void LightningStep(void)
     }
   } 
 
-  for (i = 0; i < N_MOT_SENSORS; i++) {
-    next_prob = LIGHTNING_PROB_MIN + (motion_data[i + 1] * TAP_TO_PROB_SCALE);
-    if (next_prob > LIGHTNING_PROB_MAX) {
-      next_prob = LIGHTNING_PROB_MAX;
-    }
-    if (next_prob > strip_lightning_probs[i]) {
-      strip_lightning_probs[i] = next_prob;
-    }
-  }
-  //}
-  
-  for (i = 0; i < N_STRIPS; i++) {
-    if (strip_lightning_probs[i] > LIGHTNING_PROB_MIN + LIGHTNING_PROB_STEP) {
-      (strip_lightning_probs[i]) -= LIGHTNING_PROB_STEP;
-    } else {
-      strip_lightning_probs[i] = LIGHTNING_PROB_MIN;
-    }
-  }
-
   for (i = 0; i < N_STRIPS; i++) {
     if (strip_lightning_states[i] == TRUE) {
       strip_lightning_states[i] = FALSE;
     } else {
-      if ((uint8_t)rand() < strip_lightning_probs[i]) {
+      if ((uint8_t)SceneRand(RAND_LIGHTNING, i) < envelopes.level[ENV_LIGHTNING][i]) {
 	strip_lightning_states[i] = TRUE;
       }
     }
   }
 
   led_index = -1;
-  strip_index = 0;
-  for (x = 0; x < N_LEDS; x++) {
+  strip_index = slice.first_strip;
+  for (x = slice.first_led; x < slice.end_led; x++) {
     led_index++;
     if (led_index == strip_lengths[strip_index]) {
       led_index = 0;
@@ -1223,11 +2459,12 @@ static long strip_solid_darks[N_STRIPS];
 static void InitSolidColors(void)
 {
   int i, r, g, b;
-  srand(TIMER_GetSysTick());
+  uint32_t ran;
   for (i = 0; i < N_STRIPS; i++) {
-    r = rand() & 0xff;
-    g = rand() & 0xff;
-    b = rand() & 0xff;
+    ran = SeedRand(RAND_SOLID_COLORS_INIT, i);
+    r = ran & 0xff;
+    g = (ran >> 8) & 0xff;
+    b = (ran >> 16) & 0xff;
     r = (r * r) >> 8;
     g = (g * g) >> 8;
     b = (b * b) >> 8;
@@ -1239,11 +2476,12 @@ static void InitSolidDarks(void)
 {
   int i;
   long r, g, b;
-  srand(TIMER_GetSysTick());
+  uint32_t ran;
   for (i = 0; i < N_STRIPS; i++) {
-    r = rand() & 0xff;
-    g = rand() & 0xff;
-    b = rand() & 0xff;
+    ran = SeedRand(RAND_SOLID_DARKS_INIT, i);
+    r = ran & 0xff;
+    g = (ran >> 8) & 0xff;
+    b = (ran >> 16) & 0xff;
     r = (r * r * r * r) >> 24;
     g = (g * g * g * g) >> 24;
     b = (b * b * b * b) >> 24;
@@ -1255,6 +2493,7 @@ static void InitSolidDarks(void)
 static void SolidColorsStep(void)
 {
   int strip_index, led_index;
+  uint32_t ran;
   uint16_t  x, i, r, g, b;
   r = g = b = 0;
 
@@ -1267,10 +2506,11 @@ static void SolidColorsStep(void)
   }
 
   for (i = 0; i < N_STRIPS; i++) {
-    if (motion_data[i + 1] != 0) {
-      r = rand() & 0xff;
-      g = rand() & 0xff;
-      b = rand() & 0xff;
+    if (envelopes.tap[i] != 0) {
+      ran = SceneRand(RAND_SOLID_COLORS, i);
+      r = ran & 0xff;
+      g = (ran >> 8) & 0xff;
+      b = (ran >> 16) & 0xff;
       r = (r * r) >> 8;
       g = (g * g) >> 8;
       b = (b * b) >> 8;
@@ -1280,8 +2520,8 @@ static void SolidColorsStep(void)
       
 
   led_index = -1;
-  strip_index = 0;
-  for (x = 0; x < N_LEDS; x++) {
+  strip_index = slice.first_strip;
+  for (x = slice.first_led; x < slice.end_led; x++) {
     led_index++;
     if (led_index == strip_lengths[strip_index]) {
       led_index = 0;
@@ -1298,6 +2538,7 @@ static void SolidColorsStep(void)
 static void SolidDarksStep(void)
 {
   int strip_index, led_index;
+  uint32_t ran;
   uint16_t  x, i;
   long r, g, b;
   r = g = b = 0;
@@ -1311,10 +2552,11 @@ static void SolidDarksStep(void)
   }
 
   for (i = 0; i < N_STRIPS; i++) {
-    if (motion_data[i + 1] != 0) {
-      r = rand() & 0xff;
-      g = rand() & 0xff;
-      b = rand() & 0xff;
+    if (envelopes.tap[i] != 0) {
+      ran = SceneRand(RAND_SOLID_DARKS, i);
+      r = ran & 0xff;
+      g = (ran >> 8) & 0xff;
+      b = (ran >> 16) & 0xff;
       r = (r * r * r * r) >> 24;
       g = (g * g * g * g) >> 24;
       b = (b * b * b * b) >> 24;
@@ -1324,8 +2566,8 @@ static void SolidDarksStep(void)
       
 
   led_index = -1;
-  strip_index = 0;
-  for (x = 0; x < N_LEDS; x++) {
+  strip_index = slice.first_strip;
+  for (x = slice.first_led; x < slice.end_led; x++) {
     led_index++;
     if (led_index == strip_lengths[strip_index]) {
       led_index = 0;
@@ -1342,6 +2584,7 @@ static void SolidDarksStep(void)
 static void SolidAllStep(void)
 {
   int strip_index, led_index;
+  uint32_t ran;
   uint16_t  x, i;
   static long r = 25;
   static long g = 0;
@@ -1356,10 +2599,11 @@ static void SolidAllStep(void)
   }
 
   for (i = 0; i < N_STRIPS; i++) {
-    if (motion_data[i + 1] != 0) {
-      r = rand() & 0xff;
-      g = rand() & 0xff;
-      b = rand() & 0xff;
+    if (envelopes.tap[i] != 0) {
+      ran = SceneRand(RAND_SOLID_ALL, i);
+      r = ran & 0xff;
+      g = (ran >> 8) & 0xff;
+      b = (ran >> 16) & 0xff;
       r = (r * r * r * r) >> 24;
       g = (g * g * g * g) >> 24;
       b = (b * b * b * b) >> 24;
@@ -1368,8 +2612,8 @@ static void SolidAllStep(void)
       
 
   led_index = -1;
-  strip_index = 0;
-  for (x = 0; x < N_LEDS; x++) {
+  strip_index = slice.first_strip;
+  for (x = slice.first_led; x < slice.end_led; x++) {
     led_index++;
     if (led_index == strip_lengths[strip_index]) {
       led_index = 0;
@@ -1405,7 +2649,7 @@ static void StaticStep(void)
   }
 
   for (i = 0; i < N_STRIPS; i++) {
-    if (motion_data[i + 1] != 0) {
+    if (envelopes.tap[i] != 0) {
       if (prob < 0x7fff) {
 	prob += 200;
       }
@@ -1417,8 +2661,8 @@ static void StaticStep(void)
   }
 
   led_index = -1;
-  strip_index = 0;
-  for (x = 0; x < N_LEDS; x++) {
+  strip_index = slice.first_strip;
+  for (x = slice.first_led; x < slice.end_led; x++) {
     led_index++;
     if (led_index == strip_lengths[strip_index]) {
       led_index = 0;
@@ -1428,7 +2672,7 @@ static void StaticStep(void)
       }
     }
 
-    ran = rand();
+    ran = SceneRand(RAND_STATICS, x);
     if (ran < prob) {
       r = g = b = 255;
     } else {
@@ -1439,6 +2683,10 @@ static void StaticStep(void)
   } 
 }
 
+#define FLASH_PERIOD_MAX    Param(P_FLASH_PERIOD_MAX)    // live tunable, see param_descs
+#define FLASH_TAP_STEP      Param(P_FLASH_TAP_STEP)
+#define FLASH_RECOVER_STEP  Param(P_FLASH_RECOVER_STEP)
+
 static void RGBFlashStep(void)
 {
   int strip_index, led_index;
@@ -1458,15 +2706,15 @@ static void RGBFlashStep(void)
   }
 
   for (i = 0; i < N_STRIPS; i++) {
-    if (motion_data[i + 1] != 0) {
-      if (flash_period > 100) {
-	flash_period -= 100;
+    if (envelopes.tap[i] != 0) {
+      if (flash_period > FLASH_TAP_STEP) {
+	flash_period -= FLASH_TAP_STEP;
       }
     }
   }
 
-  if (flash_period < 10000) {
-    flash_period += 3;
+  if (flash_period < FLASH_PERIOD_MAX) {
+    flash_period += FLASH_RECOVER_STEP;
   }
       
 
@@ -1480,8 +2728,8 @@ static void RGBFlashStep(void)
   } 
 
   led_index = -1;
-  strip_index = 0;
-  for (x = 0; x < N_LEDS; x++) {
+  strip_index = slice.first_strip;
+  for (x = slice.first_led; x < slice.end_led; x++) {
     led_index++;
     if (led_index == strip_lengths[strip_index]) {
       led_index = 0;
@@ -1515,6 +2763,80 @@ static void RGBFlashStep(void)
 
 
 
+// PARTICLES: a tap throws a burst from a random height on the tapped strip,
+// as many particles as the tap got stronger, in the strip's palette colour.
+// Every node simulates the whole pool and splats its own slice.
+static void ParticleStep(void)
+{
+  int i, rise;
+  int life = Param(P_PARTICLE_LIFE);
+
+  ReadSceneKeys();
+
+  particles.limit = PARTICLES_MAX >> scene_quality;
+  for (i = 0; i < N_MOT_SENSORS && i < N_STRIPS; i++) {
+    rise = envelopes.rise[i];
+    if (rise <= 0) {
+      continue;
+    }
+    particles_spawn(&particles, rise * Param(P_PARTICLE_PER_TAP), strip_x[i] << PARTICLES_FIX, strip_y[i] << PARTICLES_FIX,
+		    (SceneRand(RAND_PARTICLES, i) % strip_lengths[i] + 1) << PARTICLES_FIX, Param(P_PARTICLE_SPEED), life,
+		    fx_palette_rainbow[i * FX_PALETTE_SIZE / N_STRIPS],
+		    render_seed + RAND_PARTICLES * 0x9e3779b9 + (i + 1) * 0x85ebca6b, render_frame);
+  }
+  particles_update(&particles, Param(P_PARTICLE_GRAVITY), PARTICLE_DRAG_SHIFT, 0);
+  particles_render(&particles, life, slice.first_led, slice.end_led, matrix);
+}
+
+// Smoke: one noise field rising up the strips and churning sideways, tap
+// levels brighten the smoke on their strip.  An indexed frame, the colour
+// comes from smoke.palette
+static void SmokeStep(void)
+{
+  int32_t *t = scene_time[SMOKE];
+  int32_t drift[3];
+  int strip_index, led_index, octaves, level, v, k;
+  uint16_t x;
+
+  ReadSceneKeys();
+
+  if (upsample_keyframe_due(&upsample)) {
+    t[0] += Param(P_SMOKE_CHURN) * upsample.interval;
+    t[1] -= Param(P_SMOKE_CHURN) * upsample.interval;
+    t[2] -= Param(P_SMOKE_RISE) * upsample.interval;    // z counts down the strip
+    for (k = 0; k < 3; k++) {
+      drift[k] = t[k] & 0xffffff;    // as the fire's, wraps after 64k noise cells
+    }
+    octaves = Param(P_SMOKE_OCTAVES) - scene_quality;
+    noise_field(expr_leds.in[EXPR_IN_X], expr_leds.in[EXPR_IN_Y], expr_leds.in[EXPR_IN_Z],
+		slice.first_led, slice.end_led, Param(P_SMOKE_SCALE), drift, octaves,
+		render_seed + RAND_SMOKE * 0x9e3779b9, noise_out[0]);
+    for (x = slice.first_led; x < slice.end_led; x++) {
+      v = (noise_out[0][x] - 96) * 2;    // value noise sits mid range, stretch it into wisps
+      matrix_index[x] = v < 0 ? 0 : v > 255 ? 255 : v;
+    }
+    upsample_push_index(&upsample, matrix_index);
+  }
+  upsample_output_index(&upsample, matrix_index);
+
+  led_index = -1;
+  strip_index = slice.first_strip;
+  for (x = slice.first_led; x < slice.end_led; x++) {
+    led_index++;
+    if (led_index == strip_lengths[strip_index]) {
+      led_index = 0;
+      strip_index++;
+      if (strip_index == N_STRIPS) {
+	break;
+      }
+    }
+    level = 160 + (envelopes.level[ENV_RED][strip_index] >> 2);
+    v = (matrix_index[x] * level) >> 8;
+    matrix_index[x] = v > 255 ? 255 : v;
+  }
+  frame_palette = Param(P_SMOKE_PALETTE);
+}
+
 static void StripLengthTestStep(void)
 {
   int strip_index, led_index;
@@ -1562,8 +2884,8 @@ static void StripLengthTestStep(void)
     
 
   led_index = -1;
-  strip_index = 0;
-  for (x = 0; x < N_LEDS; x++) {
+  strip_index = slice.first_strip;
+  for (x = slice.first_led; x < slice.end_led; x++) {
     led_index++;
     if (led_index == strip_lengths[strip_index]) {
       led_index = 0;
@@ -1603,8 +2925,8 @@ static void XSweep(void)
   } 
 
   led_index = -1;
-  strip_index = 0;
-  for (x = 0; x < N_LEDS; x++) {
+  strip_index = slice.first_strip;
+  for (x = slice.first_led; x < slice.end_led; x++) {
     led_index++;
     if (led_index == strip_lengths[strip_index]) {
       led_index = 0;
@@ -1644,8 +2966,8 @@ static void YSweep(void)
   } 
 
   led_index = -1;
-  strip_index = 0;
-  for (x = 0; x < N_LEDS; x++) {
+  strip_index = slice.first_strip;
+  for (x = slice.first_led; x < slice.end_led; x++) {
     led_index++;
     if (led_index == strip_lengths[strip_index]) {
       led_index = 0;
@@ -1685,8 +3007,8 @@ static void ZSweep(void)
   } 
 
   led_index = -1;
-  strip_index = 0;
-  for (x = 0; x < N_LEDS; x++) {
+  strip_index = slice.first_strip;
+  for (x = slice.first_led; x < slice.end_led; x++) {
     led_index++;
     if (led_index == strip_lengths[strip_index]) {
       led_index = 0;
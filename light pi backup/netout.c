@@ -0,0 +1,277 @@
+/*
+ * netout.c
+ *
+ * E1.31 / Art-Net pixel output, see netout.h.
+ */
+
+#define _GNU_SOURCE    // sendmmsg
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "layout.h"
+#include "netout.h"
+
+
+struct netout_buffers
+{
+    struct mmsghdr msg[LAYOUT_MAX_UNIVERSES + 1];
+    struct iovec iov[LAYOUT_MAX_UNIVERSES + 1];
+    struct sockaddr_in addr[LAYOUT_MAX_UNIVERSES + 1];
+    uint8_t packet[LAYOUT_MAX_UNIVERSES + 1][NETOUT_PACKET_SIZE];
+};
+
+
+static void put16(uint8_t *p, int value)
+{
+    p[0] = value >> 8;
+    p[1] = value;
+}
+
+static void put32(uint8_t *p, uint32_t value)
+{
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+// E1.31 lengths are 12 bits with the 0x7 flags nibble on top
+static void put_flags_length(uint8_t *p, int length)
+{
+    put16(p, 0x7000 | length);
+}
+
+static void e131_root(uint8_t *p, int size, uint32_t vector, const uint8_t *cid)
+{
+    put16(p, 0x0010);                                  // preamble size
+    put16(p + 2, 0);                                   // postamble size
+    memcpy(p + 4, "ASC-E1.17\0\0\0", 12);
+    put_flags_length(p + 16, size - 16);
+    put32(p + 18, vector);
+    memcpy(p + 22, cid, 16);
+}
+
+static int e131_data_header(uint8_t *p, int universe, int slots, int sync_universe, const uint8_t *cid)
+{
+    int size = NETOUT_E131_HEADER_SIZE + slots;
+
+    e131_root(p, size, 0x00000004, cid);               // VECTOR_ROOT_E131_DATA
+    put_flags_length(p + 38, size - 38);
+    put32(p + 40, 0x00000002);                         // VECTOR_E131_DATA_PACKET
+    strncpy((char *)p + 44, NETOUT_SOURCE_NAME, 64);
+    p[108] = NETOUT_PRIORITY;
+    put16(p + 109, sync_universe);
+    p[111] = 0;                                        // sequence, per frame
+    p[112] = 0;                                        // options
+    put16(p + 113, universe);
+    put_flags_length(p + 115, size - 115);
+    p[117] = 0x02;                                     // VECTOR_DMP_SET_PROPERTY
+    p[118] = 0xa1;                                     // address and data type
+    put16(p + 119, 0);                                 // first property address
+    put16(p + 121, 1);                                 // address increment
+    put16(p + 123, slots + 1);                         // property values, start code included
+    p[125] = 0;                                        // DMX start code
+
+    return size;
+}
+
+static int e131_sync_header(uint8_t *p, int sync_universe, const uint8_t *cid)
+{
+    e131_root(p, NETOUT_E131_SYNC_SIZE, 0x00000008, cid);    // VECTOR_ROOT_E131_EXTENDED
+    put_flags_length(p + 38, NETOUT_E131_SYNC_SIZE - 38);
+    put32(p + 40, 0x00000001);                         // VECTOR_E131_EXTENDED_SYNCHRONIZATION
+    p[44] = 0;                                         // sequence, per frame
+    put16(p + 45, sync_universe);
+    put16(p + 47, 0);
+
+    return NETOUT_E131_SYNC_SIZE;
+}
+
+static int artnet_data_header(uint8_t *p, int universe, int slots)
+{
+    slots = (slots + 1) & ~1;                          // ArtDmx length must be even
+
+    memcpy(p, "Art-Net\0", 8);
+    p[8] = 0x00;                                       // OpDmx 0x5000, little endian
+    p[9] = 0x50;
+    put16(p + 10, 14);                                 // protocol version
+    p[12] = 0;                                         // sequence, per frame
+    p[13] = 0;                                         // physical port
+    p[14] = universe & 0xff;                           // SubUni
+    p[15] = (universe >> 8) & 0x7f;                    // Net
+    put16(p + 16, slots);
+
+    return NETOUT_ARTNET_HEADER_SIZE + slots;
+}
+
+static int artnet_sync_header(uint8_t *p)
+{
+    memcpy(p, "Art-Net\0", 8);
+    p[8] = 0x00;                                       // OpSync 0x5200, little endian
+    p[9] = 0x52;
+    put16(p + 10, 14);
+    p[12] = 0;                                         // aux
+    p[13] = 0;
+
+    return NETOUT_ARTNET_SYNC_SIZE;
+}
+
+static void set_address(struct sockaddr_in *addr, in_addr_t ip, int port)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = ip;
+    addr->sin_port = htons(port);
+}
+
+// E1.31 universes each have their own multicast group, 239.255.<hi>.<lo>
+static in_addr_t e131_multicast(int universe)
+{
+    return htonl(0xefff0000 | (universe & 0xffff));
+}
+
+int netout_open(netout_t *net, const layout_t *layout)
+{
+    struct netout_buffers *tx;
+    uint8_t cid[16];
+    in_addr_t target = 0;
+    int one = 1;
+    int i, n, size, port;
+
+    memset(net, 0, sizeof(*net));
+    net->fd = -1;
+    net->protocol = layout->output;
+
+    if (layout->output == LAYOUT_OUTPUT_NONE || layout->n_universes == 0) {
+        return -1;
+    }
+    port = layout->output == LAYOUT_OUTPUT_E131 ? NETOUT_E131_PORT : NETOUT_ARTNET_PORT;
+    if (layout->target[0] != 0) {
+        if (inet_pton(AF_INET, layout->target, &target) != 1) {
+            fprintf(stderr, "netout: bad target %s\n", layout->target);
+            return -1;
+        }
+    } else if (layout->output == LAYOUT_OUTPUT_ARTNET) {
+        target = htonl(INADDR_BROADCAST);
+    }
+
+    tx = calloc(1, sizeof(*tx));
+    if (tx == NULL) {
+        return -1;
+    }
+    net->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (net->fd < 0) {
+        free(tx);
+        return -1;
+    }
+    setsockopt(net->fd, SOL_SOCKET, SO_BROADCAST, &one, sizeof(one));
+
+    // a source id that stays put for the life of the process is all receivers need
+    srand(time(NULL) ^ getpid());
+    for (i = 0; i < 16; i++) {
+        cid[i] = rand();
+    }
+
+    for (n = 0; n < layout->n_universes; n++) {
+        if (layout->output == LAYOUT_OUTPUT_E131) {
+            size = e131_data_header(tx->packet[n], layout->universe[n].number, layout->universe[n].pixels * 3, layout->sync_universe, cid);
+        } else {
+            size = artnet_data_header(tx->packet[n], layout->universe[n].number, layout->universe[n].pixels * 3);
+        }
+        set_address(&tx->addr[n], target ? target : e131_multicast(layout->universe[n].number), port);
+        tx->iov[n].iov_len = size;
+    }
+    if (layout->sync_universe) {
+        if (layout->output == LAYOUT_OUTPUT_E131) {
+            size = e131_sync_header(tx->packet[n], layout->sync_universe, cid);
+        } else {
+            size = artnet_sync_header(tx->packet[n]);
+        }
+        set_address(&tx->addr[n], target ? target : e131_multicast(layout->sync_universe), port);
+        tx->iov[n].iov_len = size;
+        n++;
+    }
+
+    for (i = 0; i < n; i++) {
+        tx->iov[i].iov_base = tx->packet[i];
+        tx->msg[i].msg_hdr.msg_iov = &tx->iov[i];
+        tx->msg[i].msg_hdr.msg_iovlen = 1;
+        tx->msg[i].msg_hdr.msg_name = &tx->addr[i];
+        tx->msg[i].msg_hdr.msg_namelen = sizeof(tx->addr[i]);
+    }
+    net->n_packets = n;
+    net->tx = tx;
+
+    return 0;
+}
+
+void netout_close(netout_t *net)
+{
+    if (net->fd >= 0) {
+        close(net->fd);
+        net->fd = -1;
+    }
+    free(net->tx);
+    net->tx = NULL;
+}
+
+// frame holds 0x00rrggbb pixels in strip order, as laid out in layout_check()
+int netout_send(netout_t *net, const layout_t *layout, const uint32_t *frame)
+{
+    const layout_universe_t *universe;
+    const layout_strip_t *strip;
+    const uint32_t *pixel;
+    struct timespec start, end;
+    uint8_t *out;
+    int header, n, s, i, sent;
+
+    if (net->fd < 0) {
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    net->sequence++;
+    if (net->sequence == 0 && net->protocol == LAYOUT_OUTPUT_ARTNET) {
+        net->sequence = 1;    // 0 turns Art-Net sequencing off, E1.31 wraps through it
+    }
+    header = net->protocol == LAYOUT_OUTPUT_E131 ? NETOUT_E131_HEADER_SIZE : NETOUT_ARTNET_HEADER_SIZE;
+
+    for (n = 0; n < layout->n_universes; n++) {
+        universe = &layout->universe[n];
+        out = net->tx->packet[n];
+        out[net->protocol == LAYOUT_OUTPUT_E131 ? 111 : 12] = net->sequence;
+        out += header;
+        for (s = 0; s < universe->n_strips; s++) {
+            strip = &layout->strip[universe->strip[s]];
+            pixel = frame + strip->offset;
+            for (i = 0; i < strip->length; i++) {
+                out[0] = pixel[i] >> 16;
+                out[1] = pixel[i] >> 8;
+                out[2] = pixel[i];
+                out += 3;
+            }
+        }
+    }
+    if (n < net->n_packets && net->protocol == LAYOUT_OUTPUT_E131) {
+        net->tx->packet[n][44] = net->sequence;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    net->build_ns += (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+
+    sent = sendmmsg(net->fd, net->tx->msg, net->n_packets, 0);
+    net->frames++;
+    if (sent != net->n_packets) {
+        net->errors++;
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * netout.h
+ *
+ * Network pixel output.  Packs the rendered frame into E1.31 (sACN) or
+ * Art-Net DMX universes as laid out in the layout file and sends the whole
+ * frame with one sendmmsg call, followed by a sync packet when the layout
+ * asks for one so remote controllers latch the frame together.
+ *
+ * Packet headers are built once at open, each frame only fills in the
+ * sequence number and the pixel data.
+ */
+
+#ifndef __NETOUT_H__
+#define __NETOUT_H__
+
+#include <stdint.h>
+
+#include "layout.h"
+
+#define NETOUT_E131_PORT          5568
+#define NETOUT_ARTNET_PORT        6454
+#define NETOUT_E131_HEADER_SIZE   126     // root, framing and DMP layers up to the first slot
+#define NETOUT_E131_SYNC_SIZE     49
+#define NETOUT_ARTNET_HEADER_SIZE 18
+#define NETOUT_ARTNET_SYNC_SIZE   14
+#define NETOUT_PACKET_SIZE        (NETOUT_E131_HEADER_SIZE + 512)
+#define NETOUT_PRIORITY           100
+#define NETOUT_SOURCE_NAME        "box renderer"
+
+
+struct netout_buffers;    // sendmmsg vectors, private to netout.c
+
+typedef struct
+{
+    int fd;
+    int protocol;                      // LAYOUT_OUTPUT_E131 or LAYOUT_OUTPUT_ARTNET
+    int n_packets;                     // data packets, plus one if syncing
+    uint8_t sequence;
+    struct netout_buffers *tx;
+    unsigned long frames;
+    unsigned long errors;              // frames not fully sent
+    uint64_t build_ns;                 // total time spent packing pixels
+} netout_t;
+
+
+int netout_open(netout_t *net, const layout_t *layout);
+int netout_send(netout_t *net, const layout_t *layout, const uint32_t *frame);
+void netout_close(netout_t *net);
+
+
+#endif /* __NETOUT_H__ */
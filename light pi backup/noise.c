@@ -0,0 +1,278 @@
+/*
+ * noise.c
+ *
+ * Vectorised value noise, see noise.h.
+ */
+
+#include <stdint.h>
+
+#include "noise.h"
+
+// 4 lanes, NEON on the Pi
+typedef int32_t noise_v4_t __attribute__((vector_size(16), aligned(4), may_alias));
+typedef uint32_t noise_u4_t __attribute__((vector_size(16), aligned(4), may_alias));
+
+// lattice hash: the cell's coordinates summed with these weights, then
+// mixed.  Being linear before the mix, the corner hashes of a cell are its
+// base hash plus a constant, and neighbouring cells agree on shared corners.
+#define HASH_X                   0x8da6b343u
+#define HASH_Y                   0xd8163841u
+#define HASH_Z                   0xcb1ab31fu
+#define HASH_MIX                 0x85ebca6bu
+#define OCTAVE_SEED              0x9e3779b9u
+
+
+static inline int32_t mix(uint32_t h)
+{
+    h ^= h >> 15;
+    h *= HASH_MIX;
+    h ^= h >> 13;
+    return h >> 24;
+}
+
+static inline noise_v4_t mix_v4(noise_u4_t h)
+{
+    h ^= h >> 15;
+    h *= HASH_MIX;
+    h ^= h >> 13;
+    return (noise_v4_t)(h >> 24);
+}
+
+// octave o moves through its lattice along the drift rotated o axes, (o + 1)
+// times as far
+static inline void octave_drift(const int32_t drift[3], int octave, int32_t out[3])
+{
+    int k;
+
+    for (k = 0; k < 3; k++) {
+        out[k] = drift[(k + octave) % 3] * (octave + 1);
+    }
+}
+
+static inline int32_t octave_weight_inverse(int octaves)
+{
+    int32_t total = 0;
+    int o;
+
+    for (o = 0; o < octaves; o++) {
+        total += 256 >> o;
+    }
+    return 65536 / total;
+}
+
+static inline int clamp_octaves(int octaves)
+{
+    return octaves < 1 ? 1 : octaves > NOISE_MAX_OCTAVES ? NOISE_MAX_OCTAVES : octaves;
+}
+
+uint8_t noise_at(int32_t x, int32_t y, int32_t z, int32_t scale, const int32_t drift[3], int octaves, uint32_t seed)
+{
+    int32_t d[3], px, py, pz, fx, fy, fz, sx, sy, sz, a, b, c, e, acc = 0;
+    uint32_t h;
+    int o;
+
+    octaves = clamp_octaves(octaves);
+    for (o = 0; o < octaves; o++) {
+        octave_drift(drift, o, d);
+        px = x * (scale << o) + d[0];
+        py = y * (scale << o) + d[1];
+        pz = z * (scale << o) + d[2];
+        fx = px & 0xff;
+        fy = py & 0xff;
+        fz = pz & 0xff;
+        sx = (fx * fx * (768 - 2 * fx)) >> 16;    // smoothstep, Q8
+        sy = (fy * fy * (768 - 2 * fy)) >> 16;
+        sz = (fz * fz * (768 - 2 * fz)) >> 16;
+        h = (uint32_t)(px >> NOISE_FIX) * HASH_X + (uint32_t)(py >> NOISE_FIX) * HASH_Y +
+            (uint32_t)(pz >> NOISE_FIX) * HASH_Z + seed + o * OCTAVE_SEED;
+
+        a = mix(h);
+        b = mix(h + HASH_X);
+        a += ((b - a) * sx) >> 8;
+        c = mix(h + HASH_Y);
+        b = mix(h + HASH_X + HASH_Y);
+        c += ((b - c) * sx) >> 8;
+        a += ((c - a) * sy) >> 8;
+        c = mix(h + HASH_Z);
+        b = mix(h + HASH_X + HASH_Z);
+        c += ((b - c) * sx) >> 8;
+        e = mix(h + HASH_Y + HASH_Z);
+        b = mix(h + HASH_X + HASH_Y + HASH_Z);
+        e += ((b - e) * sx) >> 8;
+        c += ((e - c) * sy) >> 8;
+        a += ((c - a) * sz) >> 8;
+
+        acc += a * (256 >> o);
+    }
+    return (acc * octave_weight_inverse(octaves)) >> 16;
+}
+
+// per octave constants of one call
+typedef struct
+{
+    int octaves;
+    int32_t inv;
+    int32_t d[NOISE_MAX_OCTAVES][3];
+    int32_t sc[NOISE_MAX_OCTAVES];
+    uint32_t seed[NOISE_MAX_OCTAVES];
+} octaves_t;
+
+// bilinear value of lattice plane iz at (sx, sy), hxy the hash of the
+// plane's (ix, iy) corner without z; noise_at() computes the same planes
+static inline int32_t plane(uint32_t hxy, int32_t iz, int32_t sx, int32_t sy)
+{
+    uint32_t h = hxy + (uint32_t)iz * HASH_Z;
+    int32_t a, b, c;
+
+    a = mix(h);
+    b = mix(h + HASH_X);
+    a += ((b - a) * sx) >> 8;
+    c = mix(h + HASH_Y);
+    b = mix(h + HASH_X + HASH_Y);
+    c += ((b - c) * sx) >> 8;
+    return a + (((c - a) * sy) >> 8);
+}
+
+// LEDs [first, end) share x and y, a strip: the planes along z are worked
+// out once each as z crosses them and every LED only lerps between two.
+// Octave by octave over chunks of the strip, so the state stays in registers.
+static void noise_column(int32_t x, int32_t y, const int32_t *z, int first, int end, const octaves_t *oct,
+                         uint8_t *out)
+{
+    int32_t acc[NOISE_COLUMN_CHUNK];
+    int32_t sx, sy, iz, lo, hi, p, f, s, n, weight;
+    uint32_t hxy;
+    int chunk, i, o;
+
+    for (chunk = first; chunk < end; chunk += NOISE_COLUMN_CHUNK) {
+        n = end - chunk < NOISE_COLUMN_CHUNK ? end - chunk : NOISE_COLUMN_CHUNK;
+        for (i = 0; i < n; i++) {
+            acc[i] = 0;
+        }
+        for (o = 0; o < oct->octaves; o++) {
+            p = x * oct->sc[o] + oct->d[o][0];
+            f = p & 0xff;
+            sx = (f * f * (768 - 2 * f)) >> 16;
+            hxy = (uint32_t)(p >> NOISE_FIX) * HASH_X;
+            p = y * oct->sc[o] + oct->d[o][1];
+            f = p & 0xff;
+            sy = (f * f * (768 - 2 * f)) >> 16;
+            hxy += (uint32_t)(p >> NOISE_FIX) * HASH_Y + oct->seed[o];
+            weight = 256 >> o;
+
+            iz = (z[chunk] * oct->sc[o] + oct->d[o][2]) >> NOISE_FIX;
+            lo = plane(hxy, iz, sx, sy);
+            hi = plane(hxy, iz + 1, sx, sy);
+            for (i = 0; i < n; i++) {
+                p = z[chunk + i] * oct->sc[o] + oct->d[o][2];
+                if ((p >> NOISE_FIX) != iz) {
+                    if ((p >> NOISE_FIX) == iz + 1) {
+                        lo = hi;
+                        hi = plane(hxy, iz + 2, sx, sy);
+                    } else if ((p >> NOISE_FIX) == iz - 1) {
+                        hi = lo;
+                        lo = plane(hxy, iz - 1, sx, sy);
+                    } else {
+                        lo = plane(hxy, p >> NOISE_FIX, sx, sy);
+                        hi = plane(hxy, (p >> NOISE_FIX) + 1, sx, sy);
+                    }
+                    iz = p >> NOISE_FIX;
+                }
+                f = p & 0xff;
+                s = (f * f * (768 - 2 * f)) >> 16;
+                acc[i] += (lo + (((hi - lo) * s) >> 8)) * weight;
+            }
+        }
+        for (i = 0; i < n; i++) {
+            out[chunk + i] = (acc[i] * oct->inv) >> 16;
+        }
+    }
+}
+
+// LEDs [first, end) anywhere, 4 at a time; a last vector short of 4 is
+// copied out first so nothing at or past end is read
+static void noise_scattered(const int32_t *x, const int32_t *y, const int32_t *z, int first, int end,
+                            const octaves_t *oct, uint8_t *out)
+{
+    noise_v4_t px, py, pz, fx, fy, fz, sx, sy, sz, a, b, c, e, acc, vx, vy, vz;
+    noise_u4_t h;
+    int i, o, lane;
+
+    for (i = first; i < end; i += 4) {
+        if (end - i >= 4) {
+            vx = *(const noise_v4_t *)(x + i);
+            vy = *(const noise_v4_t *)(y + i);
+            vz = *(const noise_v4_t *)(z + i);
+        } else {
+            for (lane = 0; lane < 4; lane++) {
+                vx[lane] = x[i + lane < end ? i + lane : end - 1];
+                vy[lane] = y[i + lane < end ? i + lane : end - 1];
+                vz[lane] = z[i + lane < end ? i + lane : end - 1];
+            }
+        }
+        acc = (noise_v4_t){0, 0, 0, 0};
+        for (o = 0; o < oct->octaves; o++) {
+            px = vx * oct->sc[o] + oct->d[o][0];
+            py = vy * oct->sc[o] + oct->d[o][1];
+            pz = vz * oct->sc[o] + oct->d[o][2];
+            fx = px & 0xff;
+            fy = py & 0xff;
+            fz = pz & 0xff;
+            sx = (fx * fx * (768 - 2 * fx)) >> 16;
+            sy = (fy * fy * (768 - 2 * fy)) >> 16;
+            sz = (fz * fz * (768 - 2 * fz)) >> 16;
+            h = (noise_u4_t)(px >> NOISE_FIX) * HASH_X + (noise_u4_t)(py >> NOISE_FIX) * HASH_Y +
+                (noise_u4_t)(pz >> NOISE_FIX) * HASH_Z + oct->seed[o];
+
+            a = mix_v4(h);
+            b = mix_v4(h + HASH_X);
+            a += ((b - a) * sx) >> 8;
+            c = mix_v4(h + HASH_Y);
+            b = mix_v4(h + (HASH_X + HASH_Y));
+            c += ((b - c) * sx) >> 8;
+            a += ((c - a) * sy) >> 8;
+            c = mix_v4(h + HASH_Z);
+            b = mix_v4(h + (HASH_X + HASH_Z));
+            c += ((b - c) * sx) >> 8;
+            e = mix_v4(h + (HASH_Y + HASH_Z));
+            b = mix_v4(h + (HASH_X + HASH_Y + HASH_Z));
+            e += ((b - e) * sx) >> 8;
+            c += ((e - c) * sy) >> 8;
+            a += ((c - a) * sz) >> 8;
+
+            acc += a * (256 >> o);
+        }
+        acc = (acc * oct->inv) >> 16;
+        for (lane = 0; lane < 4 && i + lane < end; lane++) {
+            out[i + lane] = acc[lane];
+        }
+    }
+}
+
+void noise_field(const int32_t *x, const int32_t *y, const int32_t *z, int first, int end,
+                 int32_t scale, const int32_t drift[3], int octaves, uint32_t seed, uint8_t *out)
+{
+    octaves_t oct;
+    int i, run, o;
+
+    oct.octaves = clamp_octaves(octaves);
+    oct.inv = octave_weight_inverse(oct.octaves);
+    for (o = 0; o < oct.octaves; o++) {
+        octave_drift(drift, o, oct.d[o]);
+        oct.sc[o] = scale << o;
+        oct.seed[o] = seed + o * OCTAVE_SEED;
+    }
+
+    for (i = first; i < end; i = run) {
+        for (run = i + 1; run < end && x[run] == x[i] && y[run] == y[i]; run++) {
+        }
+        if (run - i >= NOISE_MIN_COLUMN) {
+            noise_column(x[i], y[i], z, i, run, &oct, out);
+        } else {
+            // up to the next column
+            for (; run < end && (run + 1 >= end || x[run + 1] != x[run] || y[run + 1] != y[run]); run++) {
+            }
+            noise_scattered(x, y, z, i, run, &oct, out);
+        }
+    }
+}
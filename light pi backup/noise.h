@@ -0,0 +1,42 @@
+/*
+ * noise.h
+ *
+ * Value noise over the LED positions, a field source for the organic
+ * scenes that does not repeat the way summed cosines do.  The lattice is
+ * 3D in layout units; time enters as a drift of each octave through it,
+ * every octave in its own direction and speed, so the field churns rather
+ * than scrolling.
+ *
+ * noise_field() reads the positions as a structure of arrays, as expr_leds_t
+ * has them.  Scattered LEDs run 4 per step on
+ * vectors: per octave, eight lattice hashes and seven smoothstep lerps.
+ * Runs of LEDs sharing x and y, the strips, take a column path instead:
+ * each lattice plane along z is hashed once per strip and every LED only
+ * lerps between the two planes around it, with the same result.  octaves
+ * is the quality knob; each one doubles the frequency and halves the
+ * weight.
+ */
+
+#ifndef __NOISE_H__
+#define __NOISE_H__
+
+#include <stdint.h>
+
+#define NOISE_FIX                8      // Q8 lattice coordinates
+#define NOISE_MAX_OCTAVES        4
+#define NOISE_MIN_COLUMN         8      // LEDs sharing x and y to take the column path
+#define NOISE_COLUMN_CHUNK       64
+
+
+// scale: lattice cells per layout unit, Q8.  drift: offset of the first
+// octave in lattice cells, Q8, advanced by the caller with time; it should
+// be kept to 24 bits, octaves multiply it by up to NOISE_MAX_OCTAVES.  Reads
+// x, y and z and writes 0..255 to out from first to end - 1 only.
+void noise_field(const int32_t *x, const int32_t *y, const int32_t *z, int first, int end,
+                 int32_t scale, const int32_t drift[3], int octaves, uint32_t seed, uint8_t *out);
+
+// one LED, same value as noise_field() gives it
+uint8_t noise_at(int32_t x, int32_t y, int32_t z, int32_t scale, const int32_t drift[3], int octaves, uint32_t seed);
+
+
+#endif /* __NOISE_H__ */
@@ -0,0 +1,120 @@
+/*
+ * palette.c
+ *
+ * Indexed colour palettes, see palette.h.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "box_fixmath.h"
+#include "palette.h"
+
+#define PALETTE_LINE_LEN         128
+
+
+static uint32_t lerp_color(uint32_t a, uint32_t b, int t, int span)
+{
+    uint32_t c = 0;
+    int shift, ca, cb;
+
+    for (shift = 0; shift <= 16; shift += 8) {
+        ca = (a >> shift) & 0xff;
+        cb = (b >> shift) & 0xff;
+        c |= (uint32_t)(ca + (cb - ca) * t / span) << shift;
+    }
+    return c;
+}
+
+void palette_set_gamma(palette_t *palette, int gamma)
+{
+    uint32_t c;
+    int i;
+
+    palette->gamma = gamma;
+    for (i = 0; i < PALETTE_SIZE; i++) {
+        c = palette->colors[i];
+        if (gamma) {
+            c = ((uint32_t)fx_gamma(c >> 16) << 16) | ((uint32_t)fx_gamma((c >> 8) & 0xff) << 8) | fx_gamma(c & 0xff);
+        }
+        palette->out[i] = c;
+    }
+}
+
+void palette_set(palette_t *palette, const uint32_t *colors, int gamma)
+{
+    memcpy(palette->colors, colors, sizeof(palette->colors));
+    palette_set_gamma(palette, gamma);
+}
+
+void palette_gradient(palette_t *palette, uint32_t from, uint32_t to, int gamma)
+{
+    int i;
+
+    for (i = 0; i < PALETTE_SIZE; i++) {
+        palette->colors[i] = lerp_color(from, to, i, PALETTE_SIZE - 1);
+    }
+    palette_set_gamma(palette, gamma);
+}
+
+// a palette that fails to load is left as it was
+int palette_load(palette_t *palette, const char *path, int gamma)
+{
+    uint32_t colors[PALETTE_SIZE];
+    char line[PALETTE_LINE_LEN];
+    int line_number = 0, last = -1, index, i;
+    unsigned int color;
+    uint32_t last_color = 0;
+    char *hash;
+    FILE *f;
+
+    f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line_number++;
+        hash = strchr(line, '#');
+        if (hash != NULL) {
+            *hash = '\0';
+        }
+        if (strspn(line, " \t\r\n") == strlen(line)) {
+            continue;
+        }
+        if (sscanf(line, "%d %x", &index, &color) != 2 || index < 0 || index >= PALETTE_SIZE ||
+            index <= last || color > 0xffffff) {
+            fprintf(stderr, "%s:%i: bad palette line\n", path, line_number);
+            fclose(f);
+            return -1;
+        }
+        for (i = last < 0 ? 0 : last + 1; i < index; i++) {
+            colors[i] = last < 0 ? color : lerp_color(last_color, color, i - last, index - last);
+        }
+        colors[index] = color;
+        last = index;
+        last_color = color;
+    }
+    fclose(f);
+
+    if (last < 0) {
+        fprintf(stderr, "%s: no palette entries\n", path);
+        return -1;
+    }
+    for (i = last + 1; i < PALETTE_SIZE; i++) {
+        colors[i] = last_color;
+    }
+    palette_set(palette, colors, gamma);
+    return 0;
+}
+
+// the output stage: indices to 0x00rrggbb for [first, end)
+void palette_expand(const palette_t *palette, const uint8_t *index, int first, int end, uint32_t *out)
+{
+    int i;
+
+    for (i = first; i < end; i++) {
+        out[i] = palette->out[index[i]];
+    }
+}
@@ -0,0 +1,43 @@
+/*
+ * palette.h
+ *
+ * 256 entry colour palettes for indexed frames.  A scene that only needs
+ * one value per LED writes a palette index per LED instead of packing
+ * 0x00rrggbb itself, and the output stage expands the indices through the
+ * palette.  Gamma is folded into the expanded table when the palette is
+ * set, so expansion is one lookup per LED and swapping palettes at run
+ * time needs no change to the scene.
+ *
+ * Palette files are gradient stops, one per line, # comments:
+ *
+ *   <index 0-255, decimal> <rrggbb>
+ *
+ * Entries between stops are interpolated; before the first stop and after
+ * the last the nearest stop's colour holds.
+ */
+
+#ifndef __PALETTE_H__
+#define __PALETTE_H__
+
+#include <stdint.h>
+
+#define PALETTE_SIZE             256
+
+
+typedef struct
+{
+    uint32_t colors[PALETTE_SIZE];     // as given, 0x00rrggbb
+    uint32_t out[PALETTE_SIZE];        // what the output stage writes, gamma applied
+    int gamma;
+} palette_t;
+
+
+void palette_set(palette_t *palette, const uint32_t *colors, int gamma);
+void palette_set_gamma(palette_t *palette, int gamma);
+void palette_gradient(palette_t *palette, uint32_t from, uint32_t to, int gamma);
+int palette_load(palette_t *palette, const char *path, int gamma);
+
+void palette_expand(const palette_t *palette, const uint8_t *index, int first, int end, uint32_t *out);
+
+
+#endif /* __PALETTE_H__ */
@@ -0,0 +1,213 @@
+/*
+ * params.c
+ *
+ * Live tunable scene parameters in a POSIX shared memory segment.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "params.h"
+
+
+// used when the segment can't be created, so the renderer still runs on defaults
+static param_table_t params_private;
+
+
+param_table_t *params_open(int create)
+{
+    param_table_t *table;
+    int fd;
+
+    fd = shm_open(PARAMS_SHM_NAME, create ? (O_RDWR | O_CREAT) : O_RDWR, 0666);
+    if (fd < 0) {
+        if (!create) {
+            return NULL;
+        }
+        printf("params: can't open shared memory, using private defaults\n");
+        table = &params_private;
+    } else {
+        if (create && ftruncate(fd, sizeof(*table)) < 0) {
+            close(fd);
+            printf("params: can't size shared memory, using private defaults\n");
+            table = &params_private;
+        } else {
+            table = mmap(NULL, sizeof(*table), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+            if (table == MAP_FAILED) {
+                if (!create) {
+                    return NULL;
+                }
+                printf("params: can't map shared memory, using private defaults\n");
+                table = &params_private;
+            }
+        }
+    }
+
+    if (table->magic != PARAMS_MAGIC || table->version != PARAMS_VERSION) {
+        if (!create) {
+            params_close(table);
+            return NULL;    // nobody has set the segment up yet
+        }
+        memset(table, 0, sizeof(*table));
+        table->version = PARAMS_VERSION;
+        __atomic_store_n(&table->magic, PARAMS_MAGIC, __ATOMIC_RELEASE);
+    }
+
+    return table;
+}
+
+void params_close(param_table_t *table)
+{
+    if (table != NULL && table != &params_private) {
+        munmap(table, sizeof(*table));
+    }
+}
+
+int params_find(param_table_t *table, const char *name)
+{
+    uint32_t count = __atomic_load_n(&table->count, __ATOMIC_ACQUIRE);
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        if (strncmp(table->param[i].name, name, PARAM_NAME_LEN) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Only the renderer registers, so there is a single writer for the entry
+// layout.  An entry already in the segment keeps its value, that's what makes
+// tuning survive a restart.
+int params_register(param_table_t *table, const char *name, int32_t def, int32_t min, int32_t max)
+{
+    param_t *param;
+    int slot;
+
+    slot = params_find(table, name);
+    if (slot >= 0) {
+        param = &table->param[slot];
+        param->min = min;
+        param->max = max;
+        param->def = def;
+        param->low = param->high = -1;
+        params_set(table, slot, params_get(table, slot));    // re-clamp to the new range
+        return slot;
+    }
+
+    if (table->count >= PARAMS_MAX) {
+        printf("params: no room for %s\n", name);
+        return -1;
+    }
+
+    slot = table->count;
+    param = &table->param[slot];
+    strncpy(param->name, name, PARAM_NAME_LEN - 1);
+    param->name[PARAM_NAME_LEN - 1] = 0;
+    param->min = min;
+    param->max = max;
+    param->def = def;
+    param->low = param->high = -1;
+    __atomic_store_n(&param->value, def, __ATOMIC_RELAXED);
+    __atomic_store_n(&table->count, slot + 1, __ATOMIC_RELEASE);
+
+    return slot;
+}
+
+// Ties low <= high, which the registered values and ranges must already
+// allow.  Like registering, only the renderer does this.
+int params_order(param_table_t *table, int low, int high)
+{
+    int count = __atomic_load_n(&table->count, __ATOMIC_ACQUIRE);
+
+    if (low < 0 || low >= count || high < 0 || high >= count || low == high ||
+        table->param[low].min > table->param[high].min || table->param[low].max > table->param[high].max) {
+        return -1;
+    }
+    table->param[low].high = high;
+    table->param[high].low = low;
+    params_set(table, low, params_get(table, low));    // pushes high up if it was under
+
+    return 0;
+}
+
+static void store(param_table_t *table, param_t *param, int32_t value)
+{
+    if (__atomic_exchange_n(&param->value, value, __ATOMIC_RELAXED) != value) {
+        __atomic_add_fetch(&table->generation, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// A value past its ordered partner carries the partner with it rather than
+// being refused; params_order() makes sure the partner's range allows that.
+int params_set(param_table_t *table, int slot, int32_t value)
+{
+    param_t *param;
+
+    if (slot < 0 || slot >= (int)__atomic_load_n(&table->count, __ATOMIC_ACQUIRE)) {
+        return -1;
+    }
+
+    param = &table->param[slot];
+    if (value < param->min) {
+        value = param->min;
+    }
+    if (value > param->max) {
+        value = param->max;
+    }
+    store(table, param, value);
+    if (param->high >= 0 && params_get(table, param->high) < value) {
+        store(table, &table->param[param->high], value);
+    }
+    if (param->low >= 0 && params_get(table, param->low) > value) {
+        store(table, &table->param[param->low], value);
+    }
+
+    return 0;
+}
+
+int params_save(param_table_t *table, const char *path)
+{
+    uint32_t count = __atomic_load_n(&table->count, __ATOMIC_ACQUIRE);
+    uint32_t i;
+    FILE *f;
+
+    f = fopen(path, "w");
+    if (f == NULL) {
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        fprintf(f, "%s %i\n", table->param[i].name, (int)params_get(table, i));
+    }
+    fclose(f);
+
+    return 0;
+}
+
+// unknown names are skipped so old snapshots still load
+int params_load(param_table_t *table, const char *path)
+{
+    char name[PARAM_NAME_LEN];
+    int value;
+    int loaded = 0;
+    FILE *f;
+
+    f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    while (fscanf(f, "%31s %i", name, &value) == 2) {
+        if (params_set(table, params_find(table, name), value) == 0) {
+            loaded++;
+        }
+    }
+    fclose(f);
+
+    return loaded;
+}
@@ -0,0 +1,68 @@
+/*
+ * params.h
+ *
+ * Live tunable scene parameters in a POSIX shared memory segment.
+ *
+ * The renderer registers each parameter once at startup and reads it every
+ * frame with a plain atomic load, no syscalls and no locks.  Other processes
+ * (box_param, or anything else that maps the segment) change values with an
+ * atomic store, clamped to the registered range.  Values outlive a renderer
+ * restart for as long as the segment exists, and snapshots can be saved to
+ * and loaded from a text file of "name value" lines.
+ *
+ * Two parameters can be tied as a low and high bound with params_order();
+ * setting either past the other moves the other along, so the pair never
+ * crosses whatever order the values come in.
+ */
+
+#ifndef __PARAMS_H__
+#define __PARAMS_H__
+
+#include <stdint.h>
+
+#define PARAMS_SHM_NAME          "/box_params"
+#define PARAMS_MAGIC             0x50584f42    // "BOXP"
+#define PARAMS_VERSION           2
+#define PARAMS_MAX               64
+#define PARAM_NAME_LEN           32
+
+
+typedef struct
+{
+    char name[PARAM_NAME_LEN];
+    int32_t min;
+    int32_t max;
+    int32_t def;
+    int32_t value;                     // only touched through __atomic builtins
+    int32_t low;                       // slot that must stay <= this one, -1 for none
+    int32_t high;                      // slot that must stay >= this one, -1 for none
+} param_t;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;                    // published with release order once an entry is filled in
+    uint32_t generation;               // bumped on every value change
+    param_t param[PARAMS_MAX];
+} param_table_t;
+
+
+param_table_t *params_open(int create);
+void params_close(param_table_t *table);
+
+int params_register(param_table_t *table, const char *name, int32_t def, int32_t min, int32_t max);
+int params_find(param_table_t *table, const char *name);
+int params_order(param_table_t *table, int low, int high);
+int params_set(param_table_t *table, int slot, int32_t value);
+
+int params_save(param_table_t *table, const char *path);
+int params_load(param_table_t *table, const char *path);
+
+static inline int32_t params_get(param_table_t *table, int slot)
+{
+    return __atomic_load_n(&table->param[slot].value, __ATOMIC_RELAXED);
+}
+
+
+#endif /* __PARAMS_H__ */
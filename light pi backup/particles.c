@@ -0,0 +1,202 @@
+/*
+ * particles.c
+ *
+ * Particle pool, update and splatting, see particles.h.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "prng.h"
+#include "particles.h"
+
+// 4 lanes, NEON on the Pi
+typedef int32_t particles_v4_t __attribute__((vector_size(16), aligned(4), may_alias));
+
+
+int particles_init(particles_t *particles, const spatial_t *index, int radius)
+{
+    int32_t **arrays[] = {&particles->x, &particles->y, &particles->z, &particles->vx, &particles->vy,
+                          &particles->vz, &particles->life, (int32_t **)&particles->color};
+    int k;
+
+    memset(particles, 0, sizeof(*particles));
+    particles->index = index;
+    particles->limit = PARTICLES_MAX;
+    particles->radius = radius > 0 ? radius : 1;
+    for (k = 0; k < (int)(sizeof(arrays) / sizeof(arrays[0])); k++) {
+        *arrays[k] = calloc(PARTICLES_MAX, sizeof(int32_t));
+        if (*arrays[k] == NULL) {
+            particles_free(particles);
+            return -1;
+        }
+    }
+    for (k = 0; k < 3; k++) {
+        particles->acc[k] = calloc(index->n + 1, sizeof(int32_t));
+        if (particles->acc[k] == NULL) {
+            particles_free(particles);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void particles_free(particles_t *particles)
+{
+    int k;
+
+    free(particles->x);
+    free(particles->y);
+    free(particles->z);
+    free(particles->vx);
+    free(particles->vy);
+    free(particles->vz);
+    free(particles->life);
+    free(particles->color);
+    for (k = 0; k < 3; k++) {
+        free(particles->acc[k]);
+    }
+    memset(particles, 0, sizeof(*particles));
+}
+
+// A burst of n from (x, y, z), Q8, in random directions up to `speed` per
+// frame on each axis.  Returns how many fitted in the pool.
+int particles_spawn(particles_t *particles, int n, int32_t x, int32_t y, int32_t z, int32_t speed, int life,
+                    uint32_t color, uint32_t seed, uint32_t frame)
+{
+    int i, p;
+
+    if (n > particles->limit - particles->count) {
+        particles->dropped += n - (particles->limit > particles->count ? particles->limit - particles->count : 0);
+        n = particles->limit > particles->count ? particles->limit - particles->count : 0;
+    }
+    for (i = 0; i < n; i++) {
+        p = particles->count++;
+        particles->x[p] = x;
+        particles->y[p] = y;
+        particles->z[p] = z;
+        particles->vx[p] = (int32_t)(prng_hash(seed, frame, i * 4) % (2 * speed + 1)) - speed;
+        particles->vy[p] = (int32_t)(prng_hash(seed, frame, i * 4 + 1) % (2 * speed + 1)) - speed;
+        particles->vz[p] = (int32_t)(prng_hash(seed, frame, i * 4 + 2) % (2 * speed + 1)) - speed;
+        particles->life[p] = life - (int)(prng_hash(seed, frame, i * 4 + 3) % (life / 4 + 1));
+        particles->color[p] = color;
+    }
+    particles->spawned += n;
+    return n;
+}
+
+// One frame: velocity lost to drag, gravity down z, move, age.  Particles
+// out of life or fallen below floor_z are removed.
+void particles_update(particles_t *particles, int32_t gravity, int drag_shift, int32_t floor_z)
+{
+    particles_v4_t vx, vy, vz;
+    int i, last;
+
+    for (i = 0; i + 4 <= particles->count; i += 4) {
+        vx = *(particles_v4_t *)(particles->vx + i);
+        vy = *(particles_v4_t *)(particles->vy + i);
+        vz = *(particles_v4_t *)(particles->vz + i);
+        vx -= vx >> drag_shift;
+        vy -= vy >> drag_shift;
+        vz -= (vz >> drag_shift) + gravity;
+        *(particles_v4_t *)(particles->vx + i) = vx;
+        *(particles_v4_t *)(particles->vy + i) = vy;
+        *(particles_v4_t *)(particles->vz + i) = vz;
+        *(particles_v4_t *)(particles->x + i) += vx;
+        *(particles_v4_t *)(particles->y + i) += vy;
+        *(particles_v4_t *)(particles->z + i) += vz;
+        *(particles_v4_t *)(particles->life + i) -= 1;
+    }
+    for (; i < particles->count; i++) {
+        particles->vx[i] -= particles->vx[i] >> drag_shift;
+        particles->vy[i] -= particles->vy[i] >> drag_shift;
+        particles->vz[i] -= (particles->vz[i] >> drag_shift) + gravity;
+        particles->x[i] += particles->vx[i];
+        particles->y[i] += particles->vy[i];
+        particles->z[i] += particles->vz[i];
+        particles->life[i]--;
+    }
+
+    for (i = 0; i < particles->count; ) {
+        if (particles->life[i] > 0 && particles->z[i] >= floor_z) {
+            i++;
+            continue;
+        }
+        last = --particles->count;
+        particles->x[i] = particles->x[last];
+        particles->y[i] = particles->y[last];
+        particles->z[i] = particles->z[last];
+        particles->vx[i] = particles->vx[last];
+        particles->vy[i] = particles->vy[last];
+        particles->vz[i] = particles->vz[last];
+        particles->life[i] = particles->life[last];
+        particles->color[i] = particles->color[last];
+    }
+}
+
+// Adds every particle to the LEDs around it, brightness fading with its
+// life, and writes the sum for the LEDs in [first_led, end_led).
+void particles_render(particles_t *particles, int life_max, int first_led, int end_led, uint32_t *matrix)
+{
+    const spatial_t *index = particles->index;
+    spatial_range_t ranges[SPATIAL_MAX_RANGES];
+    int32_t r2 = (particles->radius * particles->radius) << PARTICLES_FIX;    // Q8 units squared
+    int32_t inv_r2 = (256 << 16) / r2;
+    int32_t dx, dy, dz, d2, w, intensity;
+    int32_t p[3];
+    int c[3], n_ranges, r, i, j, led, k;
+    uint32_t color;
+
+    if (end_led > index->n) {
+        end_led = index->n;
+    }
+    for (k = 0; k < 3; k++) {
+        memset(particles->acc[k] + first_led, 0, (end_led - first_led) * sizeof(int32_t));
+    }
+
+    for (i = 0; i < particles->count; i++) {
+        p[0] = particles->x[i];
+        p[1] = particles->y[i];
+        p[2] = particles->z[i];
+        n_ranges = spatial_radius(index, p, particles->radius << PARTICLES_FIX, ranges, SPATIAL_MAX_RANGES);
+        if (n_ranges == 0) {
+            continue;
+        }
+        intensity = (particles->life[i] << 8) / life_max;
+        if (intensity > 256) {
+            intensity = 256;
+        }
+        color = particles->color[i];
+
+        for (r = 0; r < n_ranges; r++) {
+            for (j = ranges[r].start; j < ranges[r].end; j++) {
+                led = index->led[j];
+                if (led < first_led || led >= end_led) {
+                    continue;
+                }
+                dx = index->x[j] - p[0];
+                dy = index->y[j] - p[1];
+                dz = index->z[j] - p[2];
+                d2 = (dx * dx + dy * dy + dz * dz) >> PARTICLES_FIX;
+                if (d2 >= r2) {
+                    continue;
+                }
+                w = (intensity * (256 - ((d2 * inv_r2) >> 16))) >> 8;    // quadratic falloff
+                particles->acc[0][led] += ((color >> 16) & 0xff) * w;
+                particles->acc[1][led] += ((color >> 8) & 0xff) * w;
+                particles->acc[2][led] += (color & 0xff) * w;
+            }
+        }
+    }
+
+    for (led = first_led; led < end_led; led++) {
+        for (k = 0; k < 3; k++) {
+            c[k] = particles->acc[k][led] >> 8;
+            if (c[k] > 255) {
+                c[k] = 255;
+            }
+        }
+        matrix[led] = (c[0] << 16) | (c[1] << 8) | c[2];
+    }
+}
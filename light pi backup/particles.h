@@ -0,0 +1,58 @@
+/*
+ * particles.h
+ *
+ * Tap driven particles.  A fixed pool stored as a structure of arrays,
+ * allocated once; spawning into a full pool drops the new particles, dead
+ * ones are swapped out with the last live one so the pool stays packed.
+ * The update runs on 4 lane vectors over the whole pool.
+ *
+ * Positions are in layout units (strip x/y, LEDs along the strip for z) in
+ * Q8.  Each particle lights the LEDs within `radius` of it with a quadratic
+ * falloff, found through the spatial index of the LED positions, so a
+ * particle only looks at the LEDs of the cells around it.
+ *
+ * Spawning draws from prng_hash() of (seed, frame), so cluster nodes that
+ * share the clock simulate the same particles and each splats its slice.
+ */
+
+#ifndef __PARTICLES_H__
+#define __PARTICLES_H__
+
+#include <stdint.h>
+
+#include "spatial.h"
+
+#define PARTICLES_MAX            16384
+#define PARTICLES_FIX            8      // Q8 positions and velocities
+#define PARTICLES_ONE            (1 << PARTICLES_FIX)
+
+
+typedef struct
+{
+    int count;                         // live particles, packed at the front
+    int limit;                         // spawn cap, PARTICLES_MAX or less under load
+    int32_t *x, *y, *z;
+    int32_t *vx, *vy, *vz;
+    int32_t *life;                     // frames left
+    uint32_t *color;                   // 0x00rrggbb at full life
+
+    const spatial_t *index;            // LED positions, owned by the caller
+    int radius;                        // layout units
+
+    int32_t *acc[3];                   // per LED r, g, b accumulators for one frame
+
+    unsigned long spawned;
+    unsigned long dropped;             // pool full
+} particles_t;
+
+
+int particles_init(particles_t *particles, const spatial_t *index, int radius);
+void particles_free(particles_t *particles);
+
+int particles_spawn(particles_t *particles, int n, int32_t x, int32_t y, int32_t z, int32_t speed, int life,
+                    uint32_t color, uint32_t seed, uint32_t frame);
+void particles_update(particles_t *particles, int32_t gravity, int drag_shift, int32_t floor_z);
+void particles_render(particles_t *particles, int life_max, int first_led, int end_led, uint32_t *matrix);
+
+
+#endif /* __PARTICLES_H__ */
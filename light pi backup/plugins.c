@@ -0,0 +1,304 @@
+/*
+ * plugins.c
+ *
+ * Scene plugin loader with inotify hot reload, see plugins.h.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <sys/inotify.h>
+
+#include "params.h"
+#include "scene_plugin.h"
+#include "plugins.h"
+
+#define PLUGINS_COPY_TEMPLATE    "/tmp/box_scene_XXXXXX"
+
+
+static int is_plugin_name(const char *name)
+{
+    size_t len = strlen(name);
+
+    return len > 3 && strcmp(name + len - 3, ".so") == 0 && name[0] != '.';
+}
+
+// dlopen caches by path and the linker maps the file, so a build landing on
+// the same path would either not reload or pull pages out from under the
+// running copy.  Load a private copy instead; it is unlinked once mapped.
+static void *open_copy(const char *path)
+{
+    char copy[] = PLUGINS_COPY_TEMPLATE;
+    char buf[4096];
+    void *handle;
+    int in, out, len;
+
+    in = open(path, O_RDONLY);
+    if (in < 0) {
+        return NULL;
+    }
+    out = mkstemp(copy);
+    if (out < 0) {
+        close(in);
+        return NULL;
+    }
+    while ((len = read(in, buf, sizeof(buf))) > 0) {
+        if (write(out, buf, len) != len) {
+            len = -1;
+            break;
+        }
+    }
+    close(in);
+    close(out);
+
+    handle = len < 0 ? NULL : dlopen(copy, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL && len >= 0) {
+        printf("plugins: %s\n", dlerror());
+    }
+    unlink(copy);
+
+    return handle;
+}
+
+static int find_slot(plugins_t *plugins, const char *path)
+{
+    int i;
+
+    for (i = 0; i < PLUGINS_MAX; i++) {
+        if (plugins->slot[i].handle != NULL && strcmp(plugins->slot[i].path, path) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void bind_context(plugin_slot_t *slot, scene_context_t *ctx)
+{
+    ctx->state = slot->state;
+    ctx->params = slot->param_values;
+}
+
+static void unload_slot(plugins_t *plugins, int index, scene_context_t *ctx)
+{
+    plugin_slot_t *slot = &plugins->slot[index];
+
+    if (slot->plugin->teardown != NULL) {
+        bind_context(slot, ctx);
+        slot->plugin->teardown(ctx);
+    }
+    printf("plugins: unloaded %s, scene %i back to built-in\n", slot->plugin->name, slot->plugin->scene);
+    plugins->scene_slot[slot->plugin->scene] = -1;
+    free(slot->state);
+    dlclose(slot->handle);
+    memset(slot, 0, sizeof(*slot));
+}
+
+static void load_plugin(plugins_t *plugins, const char *path, scene_context_t *ctx)
+{
+    const scene_plugin_t *plugin;
+    plugin_slot_t next, *old = NULL;
+    char name[PARAM_NAME_LEN];
+    int index, i;
+
+    memset(&next, 0, sizeof(next));
+    strncpy(next.path, path, PLUGINS_PATH_LEN - 1);
+
+    next.handle = open_copy(path);
+    if (next.handle == NULL) {
+        plugins->failures++;
+        return;
+    }
+    plugin = dlsym(next.handle, SCENE_PLUGIN_SYMBOL);
+    if (plugin == NULL || plugin->abi_version != SCENE_PLUGIN_ABI_VERSION || plugin->step == NULL ||
+        plugin->n_params > SCENE_PLUGIN_MAX_PARAMS) {
+        printf("plugins: %s is not a scene plugin for this renderer\n", path);
+        dlclose(next.handle);
+        plugins->failures++;
+        return;
+    }
+    // a scene the renderer never switches to would load and never draw
+    if (plugin->scene < 0 || plugin->scene >= plugins->n_scenes) {
+        printf("plugins: %s (%s) wants scene %i, the renderer has scenes 0-%i\n", path, plugin->name,
+               plugin->scene, plugins->n_scenes - 1);
+        dlclose(next.handle);
+        plugins->failures++;
+        return;
+    }
+    next.plugin = plugin;
+
+    // a rebuild may move to another scene, the old build stays if that one is taken
+    index = find_slot(plugins, path);
+    if (plugins->scene_slot[plugin->scene] >= 0 && plugins->scene_slot[plugin->scene] != index) {
+        printf("plugins: %s wants scene %i, already taken by %s\n", path, plugin->scene,
+               plugins->slot[plugins->scene_slot[plugin->scene]].plugin->name);
+        dlclose(next.handle);
+        plugins->failures++;
+        return;
+    }
+    if (index >= 0) {
+        old = &plugins->slot[index];
+    } else {
+        for (index = 0; index < PLUGINS_MAX && plugins->slot[index].handle != NULL; index++) {
+        }
+        if (index == PLUGINS_MAX) {
+            printf("plugins: no room for %s\n", path);
+            dlclose(next.handle);
+            plugins->failures++;
+            return;
+        }
+    }
+
+    for (i = 0; i < plugin->n_params; i++) {
+        if (snprintf(name, sizeof(name), "%s.%s", plugin->name, plugin->params[i].name) >= (int)sizeof(name)) {
+            next.param_slots[i] = -1;    // name too long for the table, runs on its default
+        } else {
+            next.param_slots[i] = params_register(plugins->params, name, plugin->params[i].def,
+                                                  plugin->params[i].min, plugin->params[i].max);
+        }
+        next.param_values[i] = next.param_slots[i] >= 0 ? params_get(plugins->params, next.param_slots[i]) : plugin->params[i].def;
+    }
+
+    if (old != NULL && old->plugin->state_version == plugin->state_version && old->plugin->state_size == plugin->state_size) {
+        next.state = old->state;    // same layout, carry on where the old build left off
+        old->state = NULL;
+    } else {
+        next.state = calloc(1, plugin->state_size ? plugin->state_size : 1);
+        if (next.state == NULL || (plugin->init != NULL && (bind_context(&next, ctx), plugin->init(ctx)) != 0)) {
+            printf("plugins: %s refused to start\n", path);
+            free(next.state);
+            dlclose(next.handle);
+            plugins->failures++;
+            return;
+        }
+    }
+
+    if (old != NULL) {
+        if (old->state != NULL && old->plugin->teardown != NULL) {
+            bind_context(old, ctx);
+            old->plugin->teardown(ctx);
+        }
+        free(old->state);
+        plugins->scene_slot[old->plugin->scene] = -1;
+        dlclose(old->handle);
+    }
+
+    plugins->slot[index] = next;
+    plugins->scene_slot[plugin->scene] = index;
+    plugins->loads++;
+    printf("plugins: %s %s for scene %i\n", old != NULL ? "reloaded" : "loaded", plugin->name, plugin->scene);
+}
+
+int plugins_open(plugins_t *plugins, const char *dir, int n_scenes, param_table_t *params, scene_context_t *ctx)
+{
+    char path[PLUGINS_PATH_LEN];
+    struct dirent *entry;
+    DIR *d;
+    int i;
+
+    memset(plugins, 0, sizeof(*plugins));
+    for (i = 0; i < PLUGINS_MAX_SCENES; i++) {
+        plugins->scene_slot[i] = -1;
+    }
+    plugins->inotify_fd = -1;
+    plugins->n_scenes = n_scenes < PLUGINS_MAX_SCENES ? n_scenes : PLUGINS_MAX_SCENES;
+    plugins->params = params;
+    if (dir == NULL) {
+        return 0;
+    }
+    strncpy(plugins->dir, dir, PLUGINS_PATH_LEN - 1);
+
+    plugins->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (plugins->inotify_fd < 0 ||
+        inotify_add_watch(plugins->inotify_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM) < 0) {
+        return -1;
+    }
+
+    d = opendir(dir);
+    if (d == NULL) {
+        return -1;
+    }
+    while ((entry = readdir(d)) != NULL) {
+        if (is_plugin_name(entry->d_name)) {
+            if (snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name) < (int)sizeof(path)) {
+                load_plugin(plugins, path, ctx);
+            }
+        }
+    }
+    closedir(d);
+
+    return 0;
+}
+
+// between frames: pick up rebuilt, new and removed plugins
+void plugins_poll(plugins_t *plugins, scene_context_t *ctx)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    char path[PLUGINS_PATH_LEN];
+    const struct inotify_event *event;
+    int len, pos, index;
+
+    if (plugins->inotify_fd < 0) {
+        return;
+    }
+
+    while ((len = read(plugins->inotify_fd, buf, sizeof(buf))) > 0) {
+        for (pos = 0; pos < len; pos += sizeof(*event) + event->len) {
+            event = (const struct inotify_event *)(buf + pos);
+            if (event->len == 0 || !is_plugin_name(event->name) ||
+                snprintf(path, sizeof(path), "%s/%s", plugins->dir, event->name) >= (int)sizeof(path)) {
+                continue;
+            }
+            if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                index = find_slot(plugins, path);
+                if (index >= 0) {
+                    unload_slot(plugins, index, ctx);
+                }
+            } else {
+                load_plugin(plugins, path, ctx);
+            }
+        }
+    }
+}
+
+// Runs the plugin standing in for this scene, if there is one.  Returns 1
+// if it drew the frame, 0 to fall back to the built-in scene.
+int plugins_step(plugins_t *plugins, int scene, scene_context_t *ctx)
+{
+    plugin_slot_t *slot;
+    int i;
+
+    if (scene < 0 || scene >= PLUGINS_MAX_SCENES || plugins->scene_slot[scene] < 0) {
+        return 0;
+    }
+
+    slot = &plugins->slot[plugins->scene_slot[scene]];
+    for (i = 0; i < slot->plugin->n_params; i++) {
+        if (slot->param_slots[i] >= 0) {
+            slot->param_values[i] = params_get(plugins->params, slot->param_slots[i]);
+        }
+    }
+    bind_context(slot, ctx);
+    slot->plugin->step(ctx);
+
+    return 1;
+}
+
+void plugins_close(plugins_t *plugins, scene_context_t *ctx)
+{
+    int i;
+
+    for (i = 0; i < PLUGINS_MAX; i++) {
+        if (plugins->slot[i].handle != NULL) {
+            unload_slot(plugins, i, ctx);
+        }
+    }
+    if (plugins->inotify_fd >= 0) {
+        close(plugins->inotify_fd);
+        plugins->inotify_fd = -1;
+    }
+}
@@ -0,0 +1,55 @@
+/*
+ * plugins.h
+ *
+ * Loads scene plugins (see scene_plugin.h) from a directory and keeps them
+ * current.  The directory is watched with inotify; when a .so is rewritten
+ * or moved in, plugins_poll() loads the new build from a private copy and
+ * swaps it in between frames.  If the new build keeps the same state layout
+ * its state carries over, otherwise the old state is torn down and the new
+ * build starts fresh.  A build that doesn't load leaves the running one in
+ * place.
+ */
+
+#ifndef __PLUGINS_H__
+#define __PLUGINS_H__
+
+#include <stdint.h>
+
+#include "params.h"
+#include "scene_plugin.h"
+
+#define PLUGINS_MAX              16
+#define PLUGINS_MAX_SCENES       32
+#define PLUGINS_PATH_LEN         256
+
+
+typedef struct
+{
+    char path[PLUGINS_PATH_LEN];       // the .so in the plugin directory
+    void *handle;
+    const scene_plugin_t *plugin;
+    void *state;
+    int param_slots[SCENE_PLUGIN_MAX_PARAMS];
+    int32_t param_values[SCENE_PLUGIN_MAX_PARAMS];
+} plugin_slot_t;
+
+typedef struct
+{
+    char dir[PLUGINS_PATH_LEN];
+    int inotify_fd;
+    int n_scenes;                      // the renderer's, plugins for others are refused
+    param_table_t *params;
+    plugin_slot_t slot[PLUGINS_MAX];
+    int scene_slot[PLUGINS_MAX_SCENES];    // -1 where the built-in scene runs
+    unsigned long loads;
+    unsigned long failures;
+} plugins_t;
+
+
+int plugins_open(plugins_t *plugins, const char *dir, int n_scenes, param_table_t *params, scene_context_t *ctx);
+void plugins_poll(plugins_t *plugins, scene_context_t *ctx);
+int plugins_step(plugins_t *plugins, int scene, scene_context_t *ctx);
+void plugins_close(plugins_t *plugins, scene_context_t *ctx);
+
+
+#endif /* __PLUGINS_H__ */
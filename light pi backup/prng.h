@@ -0,0 +1,34 @@
+/*
+ * prng.h
+ *
+ * Counter based random numbers for the scenes.  A value is a hash of
+ * (seed, frame, index) rather than the next step of a hidden generator, so
+ * the number drawn for an LED or strip doesn't depend on how many numbers
+ * were drawn before it.  Renderers that only draw a slice of the strips
+ * still agree on every value as long as they share the seed and frame.
+ */
+
+#ifndef __PRNG_H__
+#define __PRNG_H__
+
+#include <stdint.h>
+
+
+// lowbias32 finaliser, good avalanche for two multiplies
+static inline uint32_t prng_mix(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+static inline uint32_t prng_hash(uint32_t seed, uint32_t frame, uint32_t index)
+{
+    return prng_mix(seed ^ prng_mix(frame ^ prng_mix(index + 0x9e3779b9)));
+}
+
+
+#endif /* __PRNG_H__ */
@@ -0,0 +1,62 @@
+/*
+ * quality.c
+ *
+ * Frame budget controller for the box renderer.
+ */
+
+#include <stdio.h>
+
+#include "quality.h"
+
+
+void quality_init(quality_t *quality, long budget_us)
+{
+    quality->budget_us = budget_us;
+    quality->avg_us = 0;
+    quality->level = 0;
+    quality->max_level = 0;
+    quality->hold = QUALITY_HOLD_FRAMES;
+}
+
+// new scene starts at full quality, the controller walks it down again if needed
+void quality_set_scene(quality_t *quality, int scene, int max_level)
+{
+    if (quality->level != 0) {
+        printf("quality: scene %i, level %i -> 0\n", scene, quality->level);
+    }
+    quality->level = 0;
+    quality->max_level = max_level;
+    quality->avg_us = 0;
+    quality->hold = QUALITY_HOLD_FRAMES;
+}
+
+int quality_update(quality_t *quality, long frame_us)
+{
+    int last_level = quality->level;
+
+    // recursive set point following, same as the strip level filters
+    quality->avg_us += (frame_us - quality->avg_us) >> QUALITY_AVG_SHIFT;
+
+    if (quality->hold > 0) {
+        quality->hold--;
+        return quality->level;
+    }
+
+    if (quality->avg_us > quality->budget_us) {
+        if (quality->level < quality->max_level) {
+            quality->level++;
+        }
+    } else if (quality->avg_us * 100 < quality->budget_us * QUALITY_HEADROOM_PCT) {
+        if (quality->level > 0) {
+            quality->level--;
+        }
+    }
+
+    if (quality->level != last_level) {
+        printf("quality: level %i -> %i (avg %li us, budget %li us)\n",
+               last_level, quality->level, quality->avg_us, quality->budget_us);
+        quality->hold = QUALITY_HOLD_FRAMES;
+    }
+
+    return quality->level;
+}
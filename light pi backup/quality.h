@@ -0,0 +1,34 @@
+/*
+ * quality.h
+ *
+ * Frame budget controller for the box renderer.  Tracks how long each frame
+ * takes to compute and steps the active scene's quality level down when the
+ * recent average runs over budget, and back up once there is headroom again.
+ *
+ * Level 0 is full quality; higher levels are cheaper.
+ */
+
+#ifndef __QUALITY_H__
+#define __QUALITY_H__
+
+#define QUALITY_AVG_SHIFT        3     // frame time average follows 1/8 of each new sample
+#define QUALITY_HOLD_FRAMES      60    // frames to wait after a change before changing again
+#define QUALITY_HEADROOM_PCT     60    // step back up when average is under this % of budget
+
+
+typedef struct
+{
+    long budget_us;                    // compute time allowed per frame
+    long avg_us;                       // running average of compute time
+    int level;                         // current level, 0 = full quality
+    int max_level;                     // cheapest level the active scene offers
+    int hold;                          // frames left before another change is allowed
+} quality_t;
+
+
+void quality_init(quality_t *quality, long budget_us);
+void quality_set_scene(quality_t *quality, int scene, int max_level);
+int quality_update(quality_t *quality, long frame_us);
+
+
+#endif /* __QUALITY_H__ */
@@ -0,0 +1,316 @@
+/*
+ * recorder.c
+ *
+ * Flight recorder of rendered frames, see recorder.h.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "recorder.h"
+
+#define RECORD_ALIGN(n)          (((n) + 3) & ~(size_t)3)
+
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int recorder_init(recorder_t *rec, size_t size, int max_frames, int n_leds, int first_led)
+{
+    memset(rec, 0, sizeof(*rec));
+    rec->n_leds = n_leds;
+    rec->first_led = first_led;
+    rec->key_interval = RECORDER_KEY_INTERVAL;
+    rec->size = RECORD_ALIGN(size);
+    rec->max_frames = max_frames > 0 ? max_frames : 1;
+
+    rec->ring = malloc(rec->size);
+    rec->offset = malloc(rec->max_frames * sizeof(size_t));
+    rec->previous = calloc(n_leds * 3 + 1, 1);
+    rec->delta = malloc(n_leds * 3 + 1);
+    rec->coded = malloc(recorder_coded_max(n_leds * 3) + 1);
+    if (rec->ring == NULL || rec->offset == NULL || rec->previous == NULL || rec->delta == NULL ||
+        rec->coded == NULL) {
+        recorder_free(rec);
+        return -1;
+    }
+    // touch it all now, not a page at a time in the render loop
+    memset(rec->ring, 0, rec->size);
+    return 0;
+}
+
+void recorder_free(recorder_t *rec)
+{
+    if (rec->dumping > 0) {
+        waitpid(rec->dumping, NULL, 0);
+    }
+    free(rec->ring);
+    free(rec->offset);
+    free(rec->previous);
+    free(rec->delta);
+    free(rec->coded);
+    memset(rec, 0, sizeof(*rec));
+}
+
+size_t recorder_code(const uint8_t *bytes, size_t n, uint8_t *out)
+{
+    size_t i = 0, run, start, o = 0;
+
+    while (i < n) {
+        if (bytes[i] == 0) {
+            for (run = 1; i + run < n && run < RECORDER_ZEROS_MAX && bytes[i + run] == 0; run++) {
+            }
+            out[o++] = 127 + run;
+            i += run;
+            continue;
+        }
+        // literal up to the next three zeros, which are cheaper as a run
+        start = i;
+        while (i < n && i - start < RECORDER_LITERAL_MAX &&
+               !(bytes[i] == 0 && i + 2 < n && bytes[i + 1] == 0 && bytes[i + 2] == 0)) {
+            i++;
+        }
+        out[o++] = i - start - 1;
+        memcpy(out + o, bytes + start, i - start);
+        o += i - start;
+    }
+    return o;
+}
+
+int recorder_decode(const uint8_t *coded, size_t length, uint8_t *bytes, size_t n)
+{
+    size_t i = 0, o = 0, run, k;
+
+    while (i < length) {
+        if (coded[i] >= 128) {
+            run = coded[i++] - 127;
+            if (o + run > n) {
+                return -1;
+            }
+        } else {
+            run = coded[i++] + 1;
+            if (o + run > n || i + run > length) {
+                return -1;
+            }
+            for (k = 0; k < run; k++) {
+                bytes[o + k] ^= coded[i + k];
+            }
+            i += run;
+        }
+        o += run;
+    }
+    return o == n ? 0 : -1;
+}
+
+static void drop_oldest(recorder_t *rec)
+{
+    rec->oldest = (rec->oldest + 1) % rec->max_frames;
+    rec->count--;
+}
+
+static const recorder_frame_t *record_at(const recorder_t *rec, int i)
+{
+    return (const recorder_frame_t *)(rec->ring + rec->offset[(rec->oldest + i) % rec->max_frames]);
+}
+
+static void reap(recorder_t *rec)
+{
+    if (rec->dumping > 0 && waitpid(rec->dumping, NULL, WNOHANG) != 0) {
+        rec->dumping = 0;
+    }
+}
+
+// a switch between RGB and indexed frames can't be coded as a change
+static int start_frame(recorder_t *rec, int indexed)
+{
+    reap(rec);
+    if (indexed != rec->previous_indexed) {
+        rec->previous_indexed = indexed;
+        rec->since_key = 0;
+    }
+    return rec->since_key == 0;
+}
+
+static void store(recorder_t *rec, recorder_frame_t *info, size_t n, int key, uint64_t start);
+
+void recorder_add(recorder_t *rec, recorder_frame_t *info, const uint32_t *pixels)
+{
+    uint64_t start = now_ns();
+    int key, i;
+
+    key = start_frame(rec, 0);
+    for (i = 0; i < rec->n_leds; i++) {
+        rec->delta[i * 3] = (pixels[i] >> 16) ^ (key ? 0 : rec->previous[i * 3]);
+        rec->delta[i * 3 + 1] = (pixels[i] >> 8) ^ (key ? 0 : rec->previous[i * 3 + 1]);
+        rec->delta[i * 3 + 2] = pixels[i] ^ (key ? 0 : rec->previous[i * 3 + 2]);
+        rec->previous[i * 3] = pixels[i] >> 16;
+        rec->previous[i * 3 + 1] = pixels[i] >> 8;
+        rec->previous[i * 3 + 2] = pixels[i];
+    }
+    info->flags &= ~RECORDER_INDEXED;
+    store(rec, info, rec->n_leds * 3, key, start);
+}
+
+void recorder_add_index(recorder_t *rec, recorder_frame_t *info, const uint8_t *index)
+{
+    uint64_t start = now_ns();
+    int key, i;
+
+    key = start_frame(rec, 1);
+    for (i = 0; i < rec->n_leds; i++) {
+        rec->delta[i] = index[i] ^ (key ? 0 : rec->previous[i]);
+        rec->previous[i] = index[i];
+    }
+    info->flags |= RECORDER_INDEXED;
+    store(rec, info, rec->n_leds, key, start);
+}
+
+// codes the n delta bytes and puts the record in the ring
+static void store(recorder_t *rec, recorder_frame_t *info, size_t n, int key, uint64_t start)
+{
+    size_t need;
+
+    info->length = recorder_code(rec->delta, n, rec->coded);
+    info->flags = (info->flags & ~RECORDER_KEYFRAME) | (key ? RECORDER_KEYFRAME : 0);
+    rec->frames++;
+
+    need = RECORD_ALIGN(sizeof(*info) + info->length);
+    if (need > rec->size) {
+        // the next frame cannot be coded against this one
+        rec->dropped++;
+        rec->since_key = 0;
+        rec->code_ns += now_ns() - start;
+        return;
+    }
+    if (rec->head + need > rec->size) {
+        // the oldest records run to the end of the ring, those past head
+        while (rec->count > 0 && rec->offset[rec->oldest] >= rec->head) {
+            drop_oldest(rec);
+        }
+        rec->head = 0;
+    }
+    // records from head on are the oldest; drop those in the way
+    while (rec->count > 0 && (rec->count == rec->max_frames ||
+                              (rec->offset[rec->oldest] >= rec->head &&
+                               rec->offset[rec->oldest] < rec->head + need))) {
+        drop_oldest(rec);
+    }
+
+    memcpy(rec->ring + rec->head, info, sizeof(*info));
+    memcpy(rec->ring + rec->head + sizeof(*info), rec->coded, info->length);
+    rec->offset[(rec->oldest + rec->count) % rec->max_frames] = rec->head;
+    rec->count++;
+    rec->head += need;
+    rec->since_key = (rec->since_key + 1) % rec->key_interval;
+    rec->code_ns += now_ns() - start;
+}
+
+int recorder_palette(recorder_t *rec, int n, const uint32_t *table)
+{
+    if (n < 0 || n >= RECORDER_PALETTES_MAX) {
+        return -1;
+    }
+    rec->palette[n] = table;
+    if (n >= rec->n_palettes) {
+        rec->n_palettes = n + 1;
+    }
+    return 0;
+}
+
+double recorder_seconds(const recorder_t *rec)
+{
+    if (rec->count < 2) {
+        return 0.0;
+    }
+    return (uint32_t)(record_at(rec, rec->count - 1)->time_us - record_at(rec, 0)->time_us) / 1e6;
+}
+
+static int write_all(int fd, const void *data, size_t length)
+{
+    const uint8_t *p = data;
+    ssize_t n;
+
+    while (length > 0) {
+        n = write(fd, p, length);
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        length -= n;
+    }
+    return 0;
+}
+
+// in the child: only async-signal-safe calls from here
+static int write_dump(const recorder_t *rec, const char *path)
+{
+    static const uint32_t none[RECORDER_PALETTE_SIZE];
+    const recorder_frame_t *record;
+    recorder_file_t head;
+    int fd, first, i;
+
+    for (first = 0; first < rec->count && !(record_at(rec, first)->flags & RECORDER_KEYFRAME); first++) {
+    }
+
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, RECORDER_MAGIC, sizeof(head.magic));
+    head.n_leds = rec->n_leds;
+    head.first_led = rec->first_led;
+    head.n_frames = rec->count - first;
+    head.key_interval = rec->key_interval;
+    head.n_palettes = rec->n_palettes;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    if (write_all(fd, &head, sizeof(head)) < 0) {
+        close(fd);
+        return -1;
+    }
+    for (i = 0; i < rec->n_palettes; i++) {
+        if (write_all(fd, rec->palette[i] != NULL ? rec->palette[i] : none, sizeof(none)) < 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    for (i = first; i < rec->count; i++) {
+        record = record_at(rec, i);
+        if (write_all(fd, record, sizeof(*record) + record->length) < 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    return close(fd);
+}
+
+int recorder_dump(recorder_t *rec, const char *path)
+{
+    pid_t pid;
+
+    reap(rec);
+    if (rec->dumping > 0) {
+        return -1;
+    }
+    pid = fork();
+    if (pid < 0) {
+        return -1;
+    }
+    if (pid == 0) {
+        _exit(write_dump(rec, path) < 0);
+    }
+    rec->dumping = pid;
+    rec->dumps++;
+    return 0;
+}
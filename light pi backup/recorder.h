@@ -0,0 +1,129 @@
+/*
+ * recorder.h
+ *
+ * Flight recorder: the last few seconds of rendered frames, with the motion
+ * data and timings each was rendered from, kept in memory allocated once at
+ * start so there is something to look at after a glitch.
+ *
+ * Each frame is stored as the XOR of its RGB bytes with the previous frame,
+ * run-length coded: most of a frame changes little from one to the next, so
+ * the zero runs are long and coding them is one pass over the bytes.  Every
+ * key_interval frames is XORed against black instead, so a dump can start
+ * at any keyframe still held.  Records go into one byte ring, the oldest
+ * dropped to make room.
+ *
+ * Indexed frames (palette.h) are recorded as their palette indices, a byte
+ * per LED, and the number of the palette; a change between indexed and RGB
+ * frames starts a keyframe.  The dump carries the palettes' expanded tables
+ * as they are when it is written, for box_replay to colour them with.
+ *
+ * recorder_dump() writes the ring from its oldest keyframe in a child
+ * process, which has its own copy of the memory, so the render loop does not
+ * wait on the disk.  box_replay reads the file back.
+ */
+
+#ifndef __RECORDER_H__
+#define __RECORDER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define RECORDER_MAGIC           "BOXREC2"
+#define RECORDER_MOTION_SIZE     32      // room for INPUT_MOTION_SIZE
+#define RECORDER_KEY_INTERVAL    64
+#define RECORDER_LITERAL_MAX     128     // control bytes 0..127: 1..128 bytes follow
+#define RECORDER_ZEROS_MAX       128     // control bytes 128..255: 1..128 zero bytes
+#define RECORDER_PALETTES_MAX    8
+#define RECORDER_PALETTE_SIZE    256
+
+#define RECORDER_KEYFRAME        0x01
+#define RECORDER_OVERRUN         0x02
+#define RECORDER_INDEXED         0x04    // a byte per LED through palette
+
+
+// header of each frame record, followed by `length` coded bytes
+typedef struct
+{
+    uint32_t frame;
+    uint32_t time_us;                  // frame start
+    uint32_t compute_us;               // scene step to output handed over
+    uint32_t period_us;                // since the previous frame's start
+    uint8_t scene;
+    uint8_t quality;
+    uint8_t flags;
+    uint8_t palette;                   // of an indexed frame
+    uint32_t length;
+    uint8_t motion[RECORDER_MOTION_SIZE];
+} recorder_frame_t;
+
+// head of a dump file, followed by n_palettes tables of
+// RECORDER_PALETTE_SIZE 0x00rrggbb and then n_frames records
+typedef struct
+{
+    char magic[8];
+    uint32_t n_leds;
+    uint32_t first_led;                // of the installation, for slices
+    uint32_t n_frames;
+    uint32_t key_interval;
+    uint32_t n_palettes;
+} recorder_file_t;
+
+typedef struct
+{
+    int n_leds;
+    int first_led;
+    int key_interval;
+    uint8_t *ring;
+    size_t size;
+    size_t head;                       // next record goes here
+    size_t *offset;                    // records, a ring from `oldest`
+    int max_frames;
+    int oldest;
+    int count;
+    int since_key;
+    uint8_t *previous;                 // last frame's RGB bytes, or indices
+    int previous_indexed;
+    uint8_t *delta;
+    uint8_t *coded;                    // worst case of one frame
+    const uint32_t *palette[RECORDER_PALETTES_MAX];    // the tables themselves, read at dump time
+    int n_palettes;
+    pid_t dumping;
+    unsigned long frames;
+    unsigned long dropped;             // frames too big for the ring
+    unsigned long dumps;
+    uint64_t code_ns;                  // total time spent coding frames
+} recorder_t;
+
+
+// size bytes of ring, at most max_frames records of n_leds pixels
+int recorder_init(recorder_t *rec, size_t size, int max_frames, int n_leds, int first_led);
+void recorder_free(recorder_t *rec);
+
+// info's length and keyframe flag are filled in
+void recorder_add(recorder_t *rec, recorder_frame_t *info, const uint32_t *pixels);
+// an indexed frame, info's palette already set; its indexed flag is filled in
+void recorder_add_index(recorder_t *rec, recorder_frame_t *info, const uint8_t *index);
+// palette n's table of RECORDER_PALETTE_SIZE, kept by the caller; -1 for n
+// out of range
+int recorder_palette(recorder_t *rec, int n, const uint32_t *table);
+
+// writes the frames held to path in the background; -1 if a dump is still
+// being written or the fork failed
+int recorder_dump(recorder_t *rec, const char *path);
+
+// seconds of frames held
+double recorder_seconds(const recorder_t *rec);
+
+// run-length code n bytes; out needs recorder_coded_max(n)
+size_t recorder_code(const uint8_t *bytes, size_t n, uint8_t *out);
+static inline size_t recorder_coded_max(size_t n)
+{
+    return n + (n + RECORDER_LITERAL_MAX - 1) / RECORDER_LITERAL_MAX;
+}
+
+// XORs length coded bytes into bytes[n]; -1 if they do not decode to n
+int recorder_decode(const uint8_t *coded, size_t length, uint8_t *bytes, size_t n);
+
+
+#endif /* __RECORDER_H__ */
@@ -0,0 +1,99 @@
+/*
+ * scene_plugin.h
+ *
+ * ABI between the renderer and scenes built as shared objects.  A plugin
+ * exports one scene_plugin_t named SCENE_PLUGIN_SYMBOL; the renderer loads
+ * every .so in its plugin directory, runs the plugin in place of the
+ * built-in scene with the same number, and reloads it between frames when
+ * the file is rebuilt.  Built-in scenes stay as the fallback whenever a
+ * plugin is missing or fails to load.
+ *
+ * Plugins only see this header and box_fixmath, which they link their own
+ * copy of.  Everything else they need from the renderer comes through the
+ * scene_services_t table in the context, so a plugin doesn't link against
+ * the renderer at all.  From scenes/:
+ *
+ *   gcc -std=gnu99 -O2 -shared -fPIC -I.. -I../../libraries/box_fixmath -o rainbow.so \
+ *       rainbow.c ../../libraries/box_fixmath/box_fixmath.c
+ */
+
+#ifndef __SCENE_PLUGIN_H__
+#define __SCENE_PLUGIN_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SCENE_PLUGIN_ABI_VERSION   1
+#define SCENE_PLUGIN_SYMBOL        "box_scene_plugin"
+#define SCENE_PLUGIN_MAX_PARAMS    16
+
+// quality levels a scene may be asked to render at, as in the renderer
+#define SCENE_QUALITY_FULL         0
+#define SCENE_QUALITY_NO_NEST      1
+#define SCENE_QUALITY_HALF_RES     2
+
+
+// one live tunable, registered in the renderer's params table as "<plugin>.<name>"
+typedef struct
+{
+    const char *name;
+    int32_t def;
+    int32_t min;
+    int32_t max;
+} scene_param_desc_t;
+
+struct scene_context;
+
+// renderer functions a plugin may call
+typedef struct
+{
+    int (*keyframe_due)(void);                             // render the field this frame?
+    void (*keyframe_push)(const uint32_t *matrix);         // hand over a freshly rendered field
+    void (*keyframe_output)(uint32_t *matrix);             // blended field for this frame
+    void (*interpolate_odd)(void);                         // fill odd LEDs after a half res field
+    uint32_t (*rand)(int stream, int index);               // per frame, identical on every cluster node
+} scene_services_t;
+
+typedef struct scene_context
+{
+    uint32_t abi_version;
+    const scene_services_t *services;
+
+    // geometry, strips are stored back to back in matrix
+    int n_strips;
+    const int *strip_lengths;
+    const int *strip_x;
+    const int *strip_y;
+
+    // the part of the installation this renderer draws
+    int first_strip;
+    int end_strip;
+    int first_led;
+    int end_led;
+
+    uint32_t *matrix;                  // 0x00rrggbb
+    const uint8_t *motion;             // [0] scene, [1 + strip] tap strength 0..127
+    uint32_t frame;
+    int quality;
+    int keyframe_interval;
+    int32_t *time;                     // three accumulators, kept by the renderer and shared with cluster followers
+    const int32_t *params;             // current values, in descriptor order
+    void *state;                       // state_size bytes, kept across reloads of the same layout
+} scene_context_t;
+
+typedef struct
+{
+    uint32_t abi_version;              // SCENE_PLUGIN_ABI_VERSION
+    const char *name;
+    int scene;                         // built-in scene number this plugin stands in for
+    uint32_t state_version;            // bump when the state layout changes, the old state is then discarded
+    size_t state_size;
+    int n_params;
+    const scene_param_desc_t *params;
+    int (*init)(scene_context_t *ctx);       // fresh state, zeroed; nonzero return refuses the plugin
+    void (*step)(scene_context_t *ctx);      // one frame
+    void (*teardown)(scene_context_t *ctx);  // state about to be discarded
+} scene_plugin_t;
+
+
+#endif /* __SCENE_PLUGIN_H__ */
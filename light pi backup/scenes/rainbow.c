@@ -0,0 +1,100 @@
+/*
+ * rainbow.c
+ *
+ * The RAINBOW scene as a plugin, the same field as RainbowStep() in the
+ * renderer.  Build it into the renderer's plugin directory (-P):
+ *
+ *   gcc -std=gnu99 -O2 -shared -fPIC -I.. -I../../libraries/box_fixmath -o rainbow.so \
+ *       rainbow.c ../../libraries/box_fixmath/box_fixmath.c
+ *
+ * Rebuilding while the renderer runs swaps the new field in at the next
+ * frame; the time accumulators live in the renderer, so it doesn't jump.
+ */
+
+#include <stdint.h>
+
+#include "box_fixmath.h"
+#include "scene_plugin.h"
+
+#define RAINBOW    8    // scene number in the renderer
+
+enum { T1_SPEED, T2_SPEED, T3_SPEED, T_SCALE, SPACE_SCALE, N_PARAMS };
+
+static const scene_param_desc_t rainbow_params[N_PARAMS] = {
+    [T1_SPEED]    = {"t1_speed",     57, -500, 500},
+    [T2_SPEED]    = {"t2_speed",    -91, -500, 500},
+    [T3_SPEED]    = {"t3_speed",     61, -500, 500},
+    [T_SCALE]     = {"t_scale",      12,    1, 500},
+    [SPACE_SCALE] = {"space_scale",  22,    1, 500},
+};
+
+
+static void rainbow_field(scene_context_t *ctx, uint16_t tpos1, uint16_t tpos2, uint16_t tpos3, int space_scale)
+{
+    int strip_index, led_index, x;
+    uint16_t z, pos1, pos2, pos3;
+    long r, g, b;
+
+    led_index = -1;
+    strip_index = ctx->first_strip;
+    for (x = ctx->first_led; x < ctx->end_led; x++) {
+        led_index++;
+        if (led_index == ctx->strip_lengths[strip_index]) {
+            led_index = 0;
+            strip_index++;
+            if (strip_index == ctx->n_strips) {
+                break;
+            }
+        }
+        if (ctx->quality >= SCENE_QUALITY_HALF_RES && (led_index & 1)) {
+            continue;    // filled in by interpolate_odd
+        }
+        z = ctx->strip_lengths[strip_index] - led_index;
+        pos1 = ((-ctx->strip_x[strip_index] + ctx->strip_y[strip_index] + z) * 10 * space_scale) >> 6;
+        pos2 = ((ctx->strip_x[strip_index] - ctx->strip_y[strip_index] + z) * 6 * space_scale) >> 6;
+        pos3 = ((ctx->strip_x[strip_index] + ctx->strip_y[strip_index] - z) * 8 * space_scale) >> 6;
+        if (ctx->quality >= SCENE_QUALITY_NO_NEST) {
+            r = fastCosineCalc(pos1 + (tpos3 >> 1));
+            g = fastCosineCalc(tpos1 + pos2);
+            b = fastCosineCalc(tpos2 + pos3);
+        } else {
+            r = fastCosineCalc((pos1 + (tpos3 >> 1) + fastCosineCalc(tpos2 + pos2)));
+            g = fastCosineCalc((tpos1 + pos2 + fastCosineCalc((-(tpos3 >> 2) + pos3))));
+            b = fastCosineCalc((tpos2 + pos3 + fastCosineCalc((tpos1 + pos1))));
+        }
+        ctx->matrix[x] = ((uint32_t)fx_wave_sq_u8(r) << 16) + (fx_wave_sq_u8(g) << 8) + fx_wave_sq_u8(b);
+    }
+    if (ctx->quality >= SCENE_QUALITY_HALF_RES) {
+        ctx->services->interpolate_odd();
+    }
+}
+
+static void rainbow_step(scene_context_t *ctx)
+{
+    const int32_t *p = ctx->params;
+    int32_t *t = ctx->time;
+    uint16_t tpos1, tpos2, tpos3;
+
+    if (ctx->services->keyframe_due()) {    // field time covers the whole keyframe interval
+        t[0] += (p[T1_SPEED] * p[T_SCALE]) * ctx->keyframe_interval;
+        t[1] += (p[T2_SPEED] * p[T_SCALE]) * ctx->keyframe_interval;
+        t[2] += (p[T3_SPEED] * p[T_SCALE]) * ctx->keyframe_interval;
+        tpos1 = fastCosineCalc(t[0] >> 10);
+        tpos2 = fastCosineCalc(t[1] >> 10);
+        tpos3 = fastCosineCalc(t[2] >> 10);
+        rainbow_field(ctx, tpos1, tpos2, tpos3, p[SPACE_SCALE]);
+        ctx->services->keyframe_push(ctx->matrix);
+    }
+    ctx->services->keyframe_output(ctx->matrix);
+}
+
+const scene_plugin_t box_scene_plugin = {
+    .abi_version = SCENE_PLUGIN_ABI_VERSION,
+    .name = "rainbow",    // same parameter names as the built-in scene, so tuning carries over
+    .scene = RAINBOW,
+    .state_version = 1,
+    .state_size = 0,
+    .n_params = N_PARAMS,
+    .params = rainbow_params,
+    .step = rainbow_step,
+};
@@ -0,0 +1,266 @@
+/*
+ * spatial.c
+ *
+ * Uniform grid index of the LED positions, see spatial.h.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spatial.h"
+
+
+// cell along one axis of a Q8 coordinate, floored, not clamped
+static int cell_of(const spatial_t *index, int32_t v, int axis)
+{
+    int u = (v >> SPATIAL_FIX) - index->min[axis];
+
+    return u >= 0 ? u / index->cell : -((-u + index->cell - 1) / index->cell);
+}
+
+int spatial_init(spatial_t *index, int n_strips, const int *lengths, const int *x, const int *y, int cell)
+{
+    int32_t *pos[3];
+    int max[3], c[3], n_cells, strip, led, i, k, n;
+    int *cells, *fill;
+
+    memset(index, 0, sizeof(*index));
+    index->cell = cell > 0 ? cell : 1;
+    for (strip = 0; strip < n_strips; strip++) {
+        index->n += lengths[strip];
+    }
+
+    index->led = malloc((index->n + 1) * sizeof(int));
+    index->x = malloc((index->n + 1) * sizeof(int32_t));
+    index->y = malloc((index->n + 1) * sizeof(int32_t));
+    index->z = malloc((index->n + 1) * sizeof(int32_t));
+    cells = malloc((index->n + 1) * sizeof(int));
+    for (k = 0; k < 3; k++) {
+        pos[k] = malloc((index->n + 1) * sizeof(int32_t));
+    }
+    if (index->led == NULL || index->x == NULL || index->y == NULL || index->z == NULL || cells == NULL ||
+        pos[0] == NULL || pos[1] == NULL || pos[2] == NULL) {
+        goto fail;
+    }
+
+    n = 0;
+    for (strip = 0; strip < n_strips; strip++) {
+        for (led = 0; led < lengths[strip]; led++, n++) {
+            pos[0][n] = x[strip];
+            pos[1][n] = y[strip];
+            pos[2][n] = lengths[strip] - led;
+        }
+    }
+    for (k = 0; k < 3; k++) {
+        index->min[k] = INT32_MAX;
+        max[k] = INT32_MIN;
+        for (i = 0; i < index->n; i++) {
+            index->min[k] = pos[k][i] < index->min[k] ? pos[k][i] : index->min[k];
+            max[k] = pos[k][i] > max[k] ? pos[k][i] : max[k];
+        }
+        if (index->n == 0) {
+            index->min[k] = max[k] = 0;
+        }
+        index->dim[k] = (max[k] - index->min[k]) / index->cell + 1;
+    }
+    n_cells = index->dim[0] * index->dim[1] * index->dim[2];
+
+    // counting sort by cell, stable so each strip's LEDs keep their order
+    index->cell_start = calloc(n_cells + 1, sizeof(int));
+    fill = calloc(n_cells, sizeof(int));
+    if (index->cell_start == NULL || fill == NULL) {
+        free(fill);
+        goto fail;
+    }
+    for (i = 0; i < index->n; i++) {
+        for (k = 0; k < 3; k++) {
+            c[k] = (pos[k][i] - index->min[k]) / index->cell;
+        }
+        cells[i] = (c[2] * index->dim[1] + c[1]) * index->dim[0] + c[0];
+        index->cell_start[cells[i] + 1]++;
+    }
+    for (i = 0; i < n_cells; i++) {
+        index->cell_start[i + 1] += index->cell_start[i];
+    }
+    for (i = 0; i < index->n; i++) {
+        n = index->cell_start[cells[i]] + fill[cells[i]]++;
+        index->led[n] = i;
+        index->x[n] = pos[0][i] << SPATIAL_FIX;
+        index->y[n] = pos[1][i] << SPATIAL_FIX;
+        index->z[n] = pos[2][i] << SPATIAL_FIX;
+    }
+    free(fill);
+
+    free(cells);
+    for (k = 0; k < 3; k++) {
+        free(pos[k]);
+    }
+    return 0;
+
+fail:
+    free(cells);
+    for (k = 0; k < 3; k++) {
+        free(pos[k]);
+    }
+    spatial_free(index);
+    return -1;
+}
+
+void spatial_free(spatial_t *index)
+{
+    free(index->cell_start);
+    free(index->led);
+    free(index->x);
+    free(index->y);
+    free(index->z);
+    memset(index, 0, sizeof(*index));
+}
+
+// Rows of cells overlapping the box [lo, hi], Q8, as ranges of sorted
+// entries.  Rows that follow on in the sorted order are merged; past
+// max_ranges the rest is folded into the last range, which only adds
+// candidates.
+int spatial_box(const spatial_t *index, const int32_t lo[3], const int32_t hi[3], spatial_range_t *ranges, int max_ranges)
+{
+    int c0[3], c1[3], cy, cz, row, start, end, k, n = 0;
+
+    for (k = 0; k < 3; k++) {
+        c0[k] = cell_of(index, lo[k], k);
+        c1[k] = cell_of(index, hi[k], k);
+        c0[k] = c0[k] < 0 ? 0 : c0[k];
+        c1[k] = c1[k] >= index->dim[k] ? index->dim[k] - 1 : c1[k];
+        if (c0[k] > c1[k]) {
+            return 0;
+        }
+    }
+
+    for (cz = c0[2]; cz <= c1[2]; cz++) {
+        for (cy = c0[1]; cy <= c1[1]; cy++) {
+            row = (cz * index->dim[1] + cy) * index->dim[0];
+            start = index->cell_start[row + c0[0]];
+            end = index->cell_start[row + c1[0] + 1];
+            if (start == end) {
+                continue;
+            }
+            if (n > 0 && (ranges[n - 1].end == start || n == max_ranges)) {
+                ranges[n - 1].end = end;
+            } else if (max_ranges > 0) {
+                ranges[n].start = start;
+                ranges[n].end = end;
+                n++;
+            }
+        }
+    }
+    return n;
+}
+
+int spatial_radius(const spatial_t *index, const int32_t p[3], int32_t r, spatial_range_t *ranges, int max_ranges)
+{
+    int32_t lo[3], hi[3];
+    int k;
+
+    for (k = 0; k < 3; k++) {
+        lo[k] = p[k] - r;
+        hi[k] = p[k] + r;
+    }
+    return spatial_box(index, lo, hi, ranges, max_ranges);
+}
+
+static void scan(const spatial_t *index, const int32_t p[3], int start, int end, int k, int *found,
+                 int *leds, int64_t *best)
+{
+    int64_t dx, dy, dz, d2;
+    int j, i;
+
+    for (j = start; j < end; j++) {
+        dx = index->x[j] - p[0];
+        dy = index->y[j] - p[1];
+        dz = index->z[j] - p[2];
+        d2 = dx * dx + dy * dy + dz * dz;
+        if (*found == k && d2 >= best[k - 1]) {
+            continue;
+        }
+        // insertion into the sorted best list
+        i = *found < k ? (*found)++ : k - 1;
+        while (i > 0 && best[i - 1] > d2) {
+            best[i] = best[i - 1];
+            leds[i] = leds[i - 1];
+            i--;
+        }
+        best[i] = d2;
+        leds[i] = index->led[j];
+    }
+}
+
+// The k LEDs nearest p, nearest first, with their squared distances (Q8).
+// Searches shells of cells outwards from p's cell until nothing outside
+// the shells searched can be closer than the k-th found.
+int spatial_nearest(const spatial_t *index, const int32_t p[3], int k, int *leds, int32_t *d2)
+{
+    int64_t best[k > 0 ? k : 1];
+    int64_t face, out;
+    int c[3], s, cx, cy, cz, row, axis, found = 0, done;
+
+    if (k <= 0 || index->n == 0) {
+        return 0;
+    }
+    for (axis = 0; axis < 3; axis++) {
+        c[axis] = cell_of(index, p[axis], axis);
+    }
+
+    for (s = 0; ; s++) {
+        done = 1;
+        for (cz = c[2] - s; cz <= c[2] + s; cz++) {
+            if (cz < 0 || cz >= index->dim[2]) {
+                continue;
+            }
+            for (cy = c[1] - s; cy <= c[1] + s; cy++) {
+                if (cy < 0 || cy >= index->dim[1]) {
+                    continue;
+                }
+                row = (cz * index->dim[1] + cy) * index->dim[0];
+                if (cz == c[2] - s || cz == c[2] + s || cy == c[1] - s || cy == c[1] + s) {
+                    // a face of the shell, the whole row
+                    cx = c[0] - s < 0 ? 0 : c[0] - s;
+                    if (cx <= c[0] + s && cx < index->dim[0]) {
+                        scan(index, p, index->cell_start[row + cx],
+                             index->cell_start[row + (c[0] + s < index->dim[0] ? c[0] + s : index->dim[0] - 1) + 1],
+                             k, &found, leds, best);
+                    }
+                } else {
+                    // inside, only the two ends of the row are new
+                    for (cx = c[0] - s; cx <= c[0] + s; cx += 2 * s) {
+                        if (cx >= 0 && cx < index->dim[0]) {
+                            scan(index, p, index->cell_start[row + cx], index->cell_start[row + cx + 1],
+                                 k, &found, leds, best);
+                        }
+                    }
+                }
+            }
+        }
+
+        // nearest point outside the searched box, or the whole grid searched
+        out = INT64_MAX;
+        for (axis = 0; axis < 3; axis++) {
+            if (c[axis] - s > 0) {
+                done = 0;
+                face = p[axis] - ((int64_t)(index->min[axis] + (c[axis] - s) * index->cell) << SPATIAL_FIX);
+                out = face < out ? face : out;
+            }
+            if (c[axis] + s < index->dim[axis] - 1) {
+                done = 0;
+                face = ((int64_t)(index->min[axis] + (c[axis] + s + 1) * index->cell) << SPATIAL_FIX) - p[axis];
+                out = face < out ? face : out;
+            }
+        }
+        if (done || (found == k && best[k - 1] <= (out > 0 ? out * out : 0))) {
+            break;
+        }
+    }
+
+    for (s = 0; s < found; s++) {
+        d2[s] = (int32_t)(best[s] >> SPATIAL_FIX);
+    }
+    return found;
+}
@@ -0,0 +1,57 @@
+/*
+ * spatial.h
+ *
+ * Spatial index of the LED positions, for effects that need the LEDs near a
+ * point without looping over all of them.  LEDs sit at (strip x, strip y,
+ * z) with z counted from the strip end as the scenes use it, in layout
+ * units, stored Q8.
+ *
+ * The index is a uniform grid of `cell` wide cubes with the LEDs sorted by
+ * cell, x fastest.  Cells next to each other along x are therefore next to
+ * each other in the sorted order, so a box or radius query comes back as a
+ * handful of contiguous ranges of sorted entries, one per row of cells,
+ * whatever the size of the installation.  Positions are kept in sorted
+ * order too, so scanning a range reads memory front to back; led[] maps an
+ * entry back to its index in the frame.
+ *
+ * Box and radius queries return candidates, every LED in the cells touched;
+ * callers test the exact distance while they scan.  spatial_nearest() does
+ * that itself and returns the k nearest LEDs in order.
+ */
+
+#ifndef __SPATIAL_H__
+#define __SPATIAL_H__
+
+#include <stdint.h>
+
+#define SPATIAL_FIX              8      // Q8 positions
+#define SPATIAL_MAX_RANGES       64     // rows a single query may return
+
+
+typedef struct
+{
+    int start;
+    int end;
+} spatial_range_t;
+
+typedef struct
+{
+    int n;                             // LEDs
+    int cell;                          // cell width, layout units
+    int min[3];                        // grid origin, layout units
+    int dim[3];                        // cells per axis
+    int *cell_start;                   // sorted entries of cell c: cell_start[c] .. cell_start[c + 1] - 1
+    int *led;                          // LED index of each sorted entry
+    int32_t *x, *y, *z;                // Q8 position of each sorted entry
+} spatial_t;
+
+
+int spatial_init(spatial_t *index, int n_strips, const int *lengths, const int *x, const int *y, int cell);
+void spatial_free(spatial_t *index);
+
+int spatial_box(const spatial_t *index, const int32_t lo[3], const int32_t hi[3], spatial_range_t *ranges, int max_ranges);
+int spatial_radius(const spatial_t *index, const int32_t p[3], int32_t r, spatial_range_t *ranges, int max_ranges);
+int spatial_nearest(const spatial_t *index, const int32_t p[3], int k, int *leds, int32_t *d2);
+
+
+#endif /* __SPATIAL_H__ */
@@ -0,0 +1,265 @@
+/*
+ * spiout.c
+ *
+ * WS2811 bitstream over spidev, see spiout.h.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+
+#include "spiout.h"
+
+#define SPIDEV_BUFSIZ_PATH       "/sys/module/spidev/parameters/bufsiz"
+
+
+// the three wire bytes of each colour byte in memory order, and a fourth
+// that is zero, so one 32 bit store writes them and the next store, three
+// bytes on, overwrites the spare
+static uint32_t pattern[256];
+static int pattern_ready;
+
+static void build_patterns(void)
+{
+    uint32_t bits;
+    uint8_t wire[4];
+    int v, i;
+
+    for (v = 0; v < 256; v++) {
+        bits = 0;
+        for (i = 7; i >= 0; i--) {
+            bits = (bits << 3) | ((v >> i) & 1 ? 6 : 4);    // 110 or 100
+        }
+        wire[0] = bits >> 16;
+        wire[1] = bits >> 8;
+        wire[2] = bits;
+        wire[3] = 0;
+        memcpy(&pattern[v], wire, 4);
+    }
+    pattern_ready = 1;
+}
+
+static inline uint8_t *put(uint8_t *out, uint32_t v)
+{
+    memcpy(out, &pattern[v], 4);
+    return out + 3;
+}
+
+void spiout_encode(const uint32_t *frame, int n_leds, uint8_t *out)
+{
+    uint32_t c0, c1, c2, c3;
+    int i = 0;
+
+    if (!pattern_ready) {
+        build_patterns();
+    }
+    // four LEDs a step, the loads ahead of the stores
+    for (; i + 4 <= n_leds; i += 4) {
+        c0 = frame[i];
+        c1 = frame[i + 1];
+        c2 = frame[i + 2];
+        c3 = frame[i + 3];
+        out = put(out, (c0 >> 8) & 0xff);
+        out = put(out, (c0 >> 16) & 0xff);
+        out = put(out, c0 & 0xff);
+        out = put(out, (c1 >> 8) & 0xff);
+        out = put(out, (c1 >> 16) & 0xff);
+        out = put(out, c1 & 0xff);
+        out = put(out, (c2 >> 8) & 0xff);
+        out = put(out, (c2 >> 16) & 0xff);
+        out = put(out, c2 & 0xff);
+        out = put(out, (c3 >> 8) & 0xff);
+        out = put(out, (c3 >> 16) & 0xff);
+        out = put(out, c3 & 0xff);
+    }
+    for (; i < n_leds; i++) {
+        out = put(out, (frame[i] >> 8) & 0xff);
+        out = put(out, (frame[i] >> 16) & 0xff);
+        out = put(out, frame[i] & 0xff);
+    }
+}
+
+static size_t spidev_bufsiz(void)
+{
+    FILE *f = fopen(SPIDEV_BUFSIZ_PATH, "r");
+    unsigned long bufsiz = 0;
+
+    if (f != NULL) {
+        if (fscanf(f, "%lu", &bufsiz) != 1) {
+            bufsiz = 0;
+        }
+        fclose(f);
+    }
+    return bufsiz > 0 ? bufsiz : SPIOUT_CHUNK_DEFAULT;
+}
+
+struct spiout_writer
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int pending;                       // a frame in bits to write
+    int failed;                        // the last one was not fully written
+    int stop;
+};
+
+// writes whole frames as spiout_send() hands them over
+static void *writer_main(void *arg)
+{
+    spiout_t *spi = arg;
+    struct spiout_writer *w = spi->writer;
+    size_t offset, length;
+    ssize_t n;
+
+    pthread_mutex_lock(&w->lock);
+    while (1) {
+        while (!w->pending && !w->stop) {
+            pthread_cond_wait(&w->wake, &w->lock);
+        }
+        if (w->stop) {
+            break;
+        }
+        pthread_mutex_unlock(&w->lock);
+
+        for (offset = 0; offset < spi->size; offset += n) {
+            length = spi->size - offset < spi->chunk ? spi->size - offset : spi->chunk;
+            n = write(spi->fd, spi->bits + offset, length);
+            if (n <= 0) {
+                break;
+            }
+        }
+
+        pthread_mutex_lock(&w->lock);
+        w->failed = offset < spi->size;
+        if (w->failed) {
+            spi->errors++;
+        } else {
+            spi->frames++;
+        }
+        w->pending = 0;
+        pthread_cond_broadcast(&w->wake);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+int spiout_open(spiout_t *spi, const char *device, int n_leds)
+{
+    uint8_t mode = SPI_MODE_0, bits = 8;
+    uint32_t speed = SPIOUT_SPEED_HZ;
+    int error;
+
+    memset(spi, 0, sizeof(*spi));
+    spi->fd = -1;
+    spi->n_leds = n_leds;
+    spi->size = (size_t)n_leds * SPIOUT_BYTES_PER_LED + SPIOUT_LATCH_BYTES;
+    spi->bits = calloc(spi->size + 1, 1);
+    if (spi->bits == NULL) {
+        return -1;
+    }
+
+    if (strncmp(device, SPIOUT_FILE_PREFIX, strlen(SPIOUT_FILE_PREFIX)) == 0) {
+        spi->fd = open(device + strlen(SPIOUT_FILE_PREFIX), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        spi->chunk = spi->size;    // the whole frame at once
+    } else {
+        spi->fd = open(device, O_WRONLY);
+        spi->is_spi = 1;
+        spi->chunk = spidev_bufsiz();
+    }
+    // a device that won't take the settings is not spidev, and not written to
+    if (spi->fd < 0 || (spi->is_spi && (ioctl(spi->fd, SPI_IOC_WR_MODE, &mode) < 0 ||
+                                        ioctl(spi->fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 ||
+                                        ioctl(spi->fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0))) {
+        error = errno;
+        spiout_close(spi);
+        errno = error;
+        return -1;
+    }
+    if (!pattern_ready) {
+        build_patterns();
+    }
+
+    spi->writer = calloc(1, sizeof(*spi->writer));
+    if (spi->writer == NULL) {
+        spiout_close(spi);
+        return -1;
+    }
+    pthread_mutex_init(&spi->writer->lock, NULL);
+    pthread_cond_init(&spi->writer->wake, NULL);
+    if (pthread_create(&spi->writer->thread, NULL, writer_main, spi) != 0) {
+        pthread_mutex_destroy(&spi->writer->lock);
+        pthread_cond_destroy(&spi->writer->wake);
+        free(spi->writer);
+        spi->writer = NULL;
+        spiout_close(spi);
+        return -1;
+    }
+    return 0;
+}
+
+// until the last frame handed over is out, -1 if it failed
+static int wait_idle(struct spiout_writer *w)
+{
+    int failed;
+
+    pthread_mutex_lock(&w->lock);
+    while (w->pending) {
+        pthread_cond_wait(&w->wake, &w->lock);
+    }
+    failed = w->failed;
+    pthread_mutex_unlock(&w->lock);
+    return failed ? -1 : 0;
+}
+
+int spiout_send(spiout_t *spi, const uint32_t *frame)
+{
+    struct timespec start, end;
+    int ret;
+
+    if (spi->writer == NULL) {
+        return 0;
+    }
+    ret = wait_idle(spi->writer);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    spiout_encode(frame, spi->n_leds, spi->bits);    // its spare byte lands in the latch as a zero
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    spi->encode_ns += (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+
+    pthread_mutex_lock(&spi->writer->lock);
+    spi->writer->pending = 1;
+    pthread_cond_broadcast(&spi->writer->wake);
+    pthread_mutex_unlock(&spi->writer->lock);
+
+    return ret;
+}
+
+void spiout_close(spiout_t *spi)
+{
+    if (spi->writer != NULL) {
+        wait_idle(spi->writer);
+        pthread_mutex_lock(&spi->writer->lock);
+        spi->writer->stop = 1;
+        pthread_cond_broadcast(&spi->writer->wake);
+        pthread_mutex_unlock(&spi->writer->lock);
+        pthread_join(spi->writer->thread, NULL);
+        pthread_mutex_destroy(&spi->writer->lock);
+        pthread_cond_destroy(&spi->writer->wake);
+        free(spi->writer);
+        spi->writer = NULL;
+    }
+    if (spi->fd >= 0) {
+        close(spi->fd);
+    }
+    free(spi->bits);
+    spi->bits = NULL;
+    spi->fd = -1;
+}
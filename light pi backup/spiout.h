@@ -0,0 +1,66 @@
+/*
+ * spiout.h
+ *
+ * WS2811 output over SPI, which leaves GPIO 18, DMA 5 and the PWM audio to
+ * Pd.  At 2.4 MHz three SPI bits make one LED bit, 100 for a 0 and 110 for
+ * a 1, so each colour byte is three bytes on the wire, looked up in a table
+ * of all 256 built once.  The frame goes out GRB like the PWM driver's,
+ * followed by a low stretch that latches it.
+ *
+ * spidev takes at most its bufsiz (/sys/module/spidev/parameters/bufsiz,
+ * 4096 unless raised with spidev.bufsiz= on the kernel command line) per
+ * write, so the stream is written in chunks of that; the gaps between them
+ * must stay under the latch time, which the bigger bufsiz avoids.  A device
+ * that doesn't take the SPI settings is refused; to run the encoder without
+ * one, name a sink of SPIOUT_FILE_PREFIX and a path and the stream goes to
+ * that file instead.
+ *
+ * spidev writes block for the whole transfer, 20 ms for the box, so a
+ * writer thread does them and the next frame is computed meanwhile, as with
+ * the PWM driver's DMA: spiout_send() waits for the last frame to be out,
+ * encodes the new one and hands it over.
+ */
+
+#ifndef __SPIOUT_H__
+#define __SPIOUT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SPIOUT_DEVICE_DEFAULT    "/dev/spidev0.0"
+#define SPIOUT_FILE_PREFIX       "file:"
+#define SPIOUT_SPEED_HZ          2400000
+#define SPIOUT_BYTES_PER_LED     9       // 24 LED bits, 3 SPI bits each
+#define SPIOUT_LATCH_BYTES       90      // 300 us low, enough for WS2812B too
+#define SPIOUT_CHUNK_DEFAULT     4096
+
+
+struct spiout_writer;    // the thread doing the writes, private to spiout.c
+
+typedef struct
+{
+    int fd;
+    int is_spi;                        // else a file sink
+    int n_leds;
+    size_t size;                       // bitstream with the latch
+    size_t chunk;                      // per write
+    uint8_t *bits;
+    struct spiout_writer *writer;
+    unsigned long frames;
+    unsigned long errors;              // frames not fully written
+    uint64_t encode_ns;                // total time spent encoding
+} spiout_t;
+
+
+// device is a spidev node or SPIOUT_FILE_PREFIX and a file path
+int spiout_open(spiout_t *spi, const char *device, int n_leds);
+// -1 if the frame before this one was not fully written
+int spiout_send(spiout_t *spi, const uint32_t *frame);
+void spiout_close(spiout_t *spi);
+
+// n_leds pixels, 0x00RRGGBB, to n_leds * SPIOUT_BYTES_PER_LED bytes of out,
+// which must have one byte to spare after them
+void spiout_encode(const uint32_t *frame, int n_leds, uint8_t *out);
+
+
+#endif /* __SPIOUT_H__ */
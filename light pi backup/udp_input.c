@@ -0,0 +1,299 @@
+/*
+ * udp_input.c
+ *
+ * Scene change and tap events over UDP, see udp_input.h for the formats.
+ */
+
+#define _GNU_SOURCE    // recvmmsg
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "input.h"
+#include "udp_input.h"
+
+
+struct udp_input_buffers
+{
+    struct mmsghdr msg[UDP_INPUT_BATCH];
+    struct iovec iov[UDP_INPUT_BATCH];
+    uint8_t buf[UDP_INPUT_BATCH][UDP_INPUT_DATAGRAM_SIZE];
+    uint8_t control[UDP_INPUT_BATCH][CMSG_SPACE(sizeof(struct timespec))];
+};
+
+
+int udp_input_open(udp_input_t *udp, int port)
+{
+    struct udp_input_buffers *rx;
+    struct sockaddr_in addr;
+    int one = 1;
+    int i;
+
+    memset(udp, 0, sizeof(*udp));
+    udp->fd = -1;
+
+    rx = calloc(1, sizeof(*rx));
+    if (rx == NULL) {
+        return -1;
+    }
+
+    udp->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (udp->fd < 0) {
+        free(rx);
+        return -1;
+    }
+    setsockopt(udp->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(udp->fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one));
+    fcntl(udp->fd, F_SETFL, fcntl(udp->fd, F_GETFL) | O_NONBLOCK);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(udp->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(udp->fd);
+        udp->fd = -1;
+        free(rx);
+        return -1;
+    }
+
+    for (i = 0; i < UDP_INPUT_BATCH; i++) {
+        rx->iov[i].iov_base = rx->buf[i];
+        rx->iov[i].iov_len = UDP_INPUT_DATAGRAM_SIZE;
+        rx->msg[i].msg_hdr.msg_iov = &rx->iov[i];
+        rx->msg[i].msg_hdr.msg_iovlen = 1;
+    }
+    udp->rx = rx;
+
+    return 0;
+}
+
+void udp_input_close(udp_input_t *udp)
+{
+    if (udp->fd >= 0) {
+        close(udp->fd);
+        udp->fd = -1;
+    }
+    free(udp->rx);
+    udp->rx = NULL;
+}
+
+static int udp_push(udp_input_t *udp, input_batch_t *batch, uint64_t time_us, int type, int index, int value)
+{
+    input_event_t *event;
+
+    if (type == INPUT_EVENT_TAP && (index < 0 || index >= INPUT_MOTION_SIZE - 1)) {
+        return 0;
+    }
+    if (value < 0) {
+        value = 0;
+    }
+    if (value > 127) {
+        value = 127;    // same range as the hub's sensor bytes
+    }
+
+    event = input_push(batch, time_us, type, INPUT_SOURCE_UDP);
+    if (event == NULL) {
+        return 0;
+    }
+    event->index = index;
+    event->value = value;
+    udp->events++;
+
+    return 1;
+}
+
+static int parse_binary(udp_input_t *udp, input_batch_t *batch, uint64_t time_us, const uint8_t *data, int len)
+{
+    const uint8_t *record;
+    int count, i, added = 0;
+
+    if (data[2] != UDP_INPUT_VERSION) {
+        return -1;
+    }
+    count = data[3];
+    if (UDP_INPUT_HEADER_SIZE + count * UDP_INPUT_RECORD_SIZE > len) {
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        record = data + UDP_INPUT_HEADER_SIZE + i * UDP_INPUT_RECORD_SIZE;
+        if (record[0] == INPUT_EVENT_SCENE || record[0] == INPUT_EVENT_TAP) {
+            added += udp_push(udp, batch, time_us, record[0], record[1], record[2]);
+        }
+    }
+
+    return added;
+}
+
+// OSC strings are NUL terminated and padded to 4 bytes
+static int osc_string(const uint8_t *data, int len, int pos, const char **str)
+{
+    int start = pos;
+
+    while (pos < len && data[pos] != 0) {
+        pos++;
+    }
+    if (pos >= len) {
+        return -1;
+    }
+    *str = (const char *)data + start;
+
+    return (pos + 4) & ~3;
+}
+
+// -1 for a float that is NaN or infinite, others are clamped to the int range
+static int osc_int(const uint8_t *data, char tag, int32_t *value)
+{
+    union { uint32_t u; float f; } v;
+
+    v.u = ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+
+    if (tag != 'f') {
+        *value = (int32_t)v.u;
+    } else if (!isfinite(v.f)) {
+        return -1;
+    } else {
+        *value = v.f >= 2147483647.0f ? INT32_MAX : v.f <= -2147483648.0f ? INT32_MIN : (int32_t)v.f;
+    }
+    return 0;
+}
+
+static int parse_osc(udp_input_t *udp, input_batch_t *batch, uint64_t time_us, const uint8_t *data, int len)
+{
+    const char *address, *tags;
+    int32_t arg[2];
+    int32_t size;
+    int pos, n, added = 0;
+
+    pos = osc_string(data, len, 0, &address);
+    if (pos < 0) {
+        return -1;
+    }
+
+    // a bundle is "#bundle", an 8 byte time tag we ignore, then sized elements
+    if (strcmp(address, "#bundle") == 0) {
+        pos += 8;
+        while (pos + 4 <= len) {
+            osc_int(data + pos, 'i', &size);
+            pos += 4;
+            if (size <= 0 || size > len - pos) {
+                return added ? added : -1;
+            }
+            n = parse_osc(udp, batch, time_us, data + pos, size);
+            if (n > 0) {
+                added += n;
+            }
+            pos += size;
+        }
+        return added;
+    }
+
+    pos = osc_string(data, len, pos, &tags);
+    if (pos < 0 || tags[0] != ',') {
+        return -1;
+    }
+    for (n = 0; n < 2 && tags[n + 1] != 0; n++) {
+        if ((tags[n + 1] != 'i' && tags[n + 1] != 'f') || pos + 4 > len || osc_int(data + pos, tags[n + 1], &arg[n]) < 0) {
+            return -1;
+        }
+        pos += 4;
+    }
+
+    if (strcmp(address, "/box/scene") == 0 && n >= 1) {
+        return udp_push(udp, batch, time_us, INPUT_EVENT_SCENE, 0, arg[0]);
+    }
+    if (strcmp(address, "/box/tap") == 0 && n >= 2) {
+        return udp_push(udp, batch, time_us, INPUT_EVENT_TAP, arg[0], arg[1]);
+    }
+
+    return -1;
+}
+
+// SO_TIMESTAMPNS stamps are CLOCK_REALTIME, the serial side is CLOCK_MONOTONIC
+static uint64_t receive_time_us(struct msghdr *hdr, int64_t realtime_to_mono_us, uint64_t now_us)
+{
+    struct cmsghdr *cmsg;
+    struct timespec *ts;
+
+    for (cmsg = CMSG_FIRSTHDR(hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            ts = (struct timespec *)CMSG_DATA(cmsg);
+            return (uint64_t)((int64_t)ts->tv_sec * 1000000 + ts->tv_nsec / 1000 + realtime_to_mono_us);
+        }
+    }
+
+    return now_us;
+}
+
+// Drain whatever has arrived since the last frame into the batch.  Returns
+// the number of events added, or -1 on a socket error.
+int udp_input_poll(udp_input_t *udp, input_batch_t *batch)
+{
+    struct udp_input_buffers *rx = udp->rx;
+    struct timespec real, mono;
+    int64_t realtime_to_mono_us;
+    uint64_t now_us;
+    const uint8_t *data;
+    int received, call, i, len, n;
+    int added = 0;
+
+    if (udp->fd < 0) {
+        return 0;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &real);
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    now_us = (uint64_t)mono.tv_sec * 1000000 + mono.tv_nsec / 1000;
+    realtime_to_mono_us = (int64_t)now_us - ((int64_t)real.tv_sec * 1000000 + real.tv_nsec / 1000);
+
+    for (call = 0; call < UDP_INPUT_MAX_CALLS; call++) {
+        for (i = 0; i < UDP_INPUT_BATCH; i++) {
+            rx->msg[i].msg_hdr.msg_control = rx->control[i];
+            rx->msg[i].msg_hdr.msg_controllen = sizeof(rx->control[i]);
+        }
+
+        received = recvmmsg(udp->fd, rx->msg, UDP_INPUT_BATCH, MSG_DONTWAIT, NULL);
+        if (received < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                break;
+            }
+            return -1;
+        }
+
+        for (i = 0; i < received; i++) {
+            data = rx->buf[i];
+            len = rx->msg[i].msg_len;
+            udp->datagrams++;
+
+            if (len >= UDP_INPUT_HEADER_SIZE && data[0] == UDP_INPUT_MAGIC_0 && data[1] == UDP_INPUT_MAGIC_1) {
+                n = parse_binary(udp, batch, receive_time_us(&rx->msg[i].msg_hdr, realtime_to_mono_us, now_us), data, len);
+            } else if (len >= 4 && (data[0] == '/' || data[0] == '#')) {
+                n = parse_osc(udp, batch, receive_time_us(&rx->msg[i].msg_hdr, realtime_to_mono_us, now_us), data, len);
+            } else {
+                n = -1;
+            }
+
+            if (n < 0) {
+                udp->bad++;
+            } else {
+                added += n;
+            }
+        }
+
+        if (received < UDP_INPUT_BATCH) {
+            break;
+        }
+    }
+
+    return added;
+}
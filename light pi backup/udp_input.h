@@ -0,0 +1,55 @@
+/*
+ * udp_input.h
+ *
+ * Scene change and tap events over UDP, as an addition to the hub's serial
+ * stream.  The socket is nonblocking and drained once per frame with
+ * recvmmsg, each datagram is stamped with its kernel receive time so it can
+ * be merged with the serial events (see input.h).
+ *
+ * Two datagram formats are accepted on the same port:
+ *
+ *   binary   'B' 'X' version(1) count, then count records of
+ *            type index value 0    (type as INPUT_EVENT_SCENE / INPUT_EVENT_TAP)
+ *
+ *   OSC      /box/scene ,i scene
+ *            /box/tap   ,ii sensor strength    (f arguments are accepted too)
+ *            and #bundle of those
+ */
+
+#ifndef __UDP_INPUT_H__
+#define __UDP_INPUT_H__
+
+#include <stdint.h>
+
+#include "input.h"
+
+#define UDP_INPUT_PORT_DEFAULT   7770
+#define UDP_INPUT_BATCH          32    // datagrams per recvmmsg call
+#define UDP_INPUT_MAX_CALLS      16    // recvmmsg calls per frame, bounds the time spent draining
+#define UDP_INPUT_DATAGRAM_SIZE  512
+
+#define UDP_INPUT_MAGIC_0        'B'
+#define UDP_INPUT_MAGIC_1        'X'
+#define UDP_INPUT_VERSION        1
+#define UDP_INPUT_HEADER_SIZE    4
+#define UDP_INPUT_RECORD_SIZE    4
+
+
+struct udp_input_buffers;    // recvmmsg vectors, private to udp_input.c
+
+typedef struct
+{
+    int fd;
+    struct udp_input_buffers *rx;
+    unsigned long datagrams;
+    unsigned long events;
+    unsigned long bad;                 // datagrams in neither format
+} udp_input_t;
+
+
+int udp_input_open(udp_input_t *udp, int port);
+int udp_input_poll(udp_input_t *udp, input_batch_t *batch);
+void udp_input_close(udp_input_t *udp);
+
+
+#endif /* __UDP_INPUT_H__ */
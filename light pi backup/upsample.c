@@ -0,0 +1,142 @@
+/*
+ * upsample.c
+ *
+ * Temporal upsampling for smooth scenes.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "upsample.h"
+
+
+void upsample_init(upsample_t *upsample, uint32_t *buf_a, uint32_t *buf_b, int count, int interval)
+{
+    if (interval < 1) {
+        interval = 1;
+    }
+    if (interval > UPSAMPLE_MAX_INTERVAL) {
+        interval = UPSAMPLE_MAX_INTERVAL;
+    }
+
+    upsample->prev = buf_a;
+    upsample->next = buf_b;
+    upsample->count = count;
+    upsample->interval = interval;
+    upsample_reset(upsample);
+}
+
+// forget the old keyframes, e.g. on scene change, so we never blend two scenes
+void upsample_reset(upsample_t *upsample)
+{
+    upsample->phase = 0;
+    upsample->primed = 0;
+}
+
+// the index keyframes share count, interval and phase with the colour ones
+void upsample_init_index(upsample_t *upsample, uint8_t *buf_a, uint8_t *buf_b)
+{
+    upsample->prev_index = buf_a;
+    upsample->next_index = buf_b;
+}
+
+int upsample_keyframe_due(upsample_t *upsample)
+{
+    return upsample->interval == 1 || upsample->phase == 0 || !upsample->primed;
+}
+
+void upsample_push(upsample_t *upsample, const uint32_t *frame)
+{
+    uint32_t *tmp;
+
+    if (upsample->interval == 1) {
+        return;
+    }
+
+    if (!upsample->primed) {
+        memcpy(upsample->prev, frame, upsample->count * sizeof(*frame));
+        upsample->primed = 1;
+        upsample->phase = 0;
+    } else {
+        tmp = upsample->prev;
+        upsample->prev = upsample->next;
+        upsample->next = tmp;
+    }
+    memcpy(upsample->next, frame, upsample->count * sizeof(*frame));
+}
+
+void upsample_output(upsample_t *upsample, uint32_t *frame)
+{
+    if (upsample->interval == 1) {
+        return;    // frame already holds a freshly rendered field
+    }
+
+    upsample_lerp(frame, upsample->prev, upsample->next, upsample->count,
+                  (upsample->phase * 256) / upsample->interval);
+}
+
+void upsample_push_index(upsample_t *upsample, const uint8_t *frame)
+{
+    uint8_t *tmp;
+
+    if (upsample->interval == 1) {
+        return;
+    }
+
+    if (!upsample->primed) {
+        memcpy(upsample->prev_index, frame, upsample->count);
+        upsample->primed = 1;
+        upsample->phase = 0;
+    } else {
+        tmp = upsample->prev_index;
+        upsample->prev_index = upsample->next_index;
+        upsample->next_index = tmp;
+    }
+    memcpy(upsample->next_index, frame, upsample->count);
+}
+
+void upsample_output_index(upsample_t *upsample, uint8_t *frame)
+{
+    if (upsample->interval == 1) {
+        return;
+    }
+
+    upsample_lerp_index(frame, upsample->prev_index, upsample->next_index, upsample->count,
+                        (upsample->phase * 256) / upsample->interval);
+}
+
+void upsample_advance(upsample_t *upsample)
+{
+    upsample->phase++;
+    if (upsample->phase >= upsample->interval) {
+        upsample->phase = 0;
+    }
+}
+
+// out = a + (b - a) * weight / 256 on each 8 bit channel of 0x00RRGGBB pixels.
+// Red and blue are blended together in one word, 16 bits apart so the products
+// can't carry into each other; green gets its own word.  No branches or lookups,
+// so the compiler can vectorize the loop.
+void upsample_lerp(uint32_t *out, const uint32_t *a, const uint32_t *b, int count, int weight)
+{
+    uint32_t inv = 256 - weight;
+    uint32_t rb, g;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        rb = ((a[i] & 0xff00ff) * inv + (b[i] & 0xff00ff) * weight) >> 8;
+        g = ((a[i] & 0x00ff00) * inv + (b[i] & 0x00ff00) * weight) >> 8;
+        out[i] = (rb & 0xff00ff) | (g & 0x00ff00);
+    }
+}
+
+// out = a + (b - a) * weight / 256 on 8 bit indices
+void upsample_lerp_index(uint8_t *out, const uint8_t *a, const uint8_t *b, int count, int weight)
+{
+    uint32_t inv = 256 - weight;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        out[i] = (a[i] * inv + b[i] * weight) >> 8;
+    }
+}
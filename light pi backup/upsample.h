@@ -0,0 +1,50 @@
+/*
+ * upsample.h
+ *
+ * Temporal upsampling for smooth scenes.  A scene renders its field only every
+ * `interval` frames; the frames in between are blended linearly from the last
+ * two keyframes, per 8 bit channel in fixed point.  Output lags the field by
+ * one interval, motion reactive layers are applied on top every frame by the
+ * scene itself.
+ *
+ * Indexed scenes (palette.h) keep their keyframes as one palette index per
+ * LED in a second pair of buffers and blend the indices, which follows the
+ * colours as long as the palette is a gradient.
+ */
+
+#ifndef __UPSAMPLE_H__
+#define __UPSAMPLE_H__
+
+#include <stdint.h>
+
+#define UPSAMPLE_MAX_INTERVAL    64
+
+
+typedef struct
+{
+    uint32_t *prev;                    // keyframe being blended from
+    uint32_t *next;                    // keyframe being blended to
+    uint8_t *prev_index;               // the same for indexed scenes
+    uint8_t *next_index;
+    int count;                         // pixels per frame
+    int interval;                      // frames per keyframe, 1 = off
+    int phase;                         // frame within the current interval
+    int primed;                        // a keyframe has been pushed since reset
+} upsample_t;
+
+
+void upsample_init(upsample_t *upsample, uint32_t *buf_a, uint32_t *buf_b, int count, int interval);
+void upsample_init_index(upsample_t *upsample, uint8_t *buf_a, uint8_t *buf_b);
+void upsample_reset(upsample_t *upsample);
+int upsample_keyframe_due(upsample_t *upsample);
+void upsample_push(upsample_t *upsample, const uint32_t *frame);
+void upsample_output(upsample_t *upsample, uint32_t *frame);
+void upsample_push_index(upsample_t *upsample, const uint8_t *frame);
+void upsample_output_index(upsample_t *upsample, uint8_t *frame);
+void upsample_advance(upsample_t *upsample);
+
+void upsample_lerp(uint32_t *out, const uint32_t *a, const uint32_t *b, int count, int weight);
+void upsample_lerp_index(uint8_t *out, const uint8_t *a, const uint8_t *b, int count, int weight);
+
+
+#endif /* __UPSAMPLE_H__ */
@@ -0,0 +1,360 @@
+/*
+ * hub_scan.h
+ *
+ * Port-wide scan of the motion sensors: every sensor is triggered at once
+ * and the GPIO input registers of all five ports are snapshotted together,
+ * HUB_SCAN_OVERSAMPLE times per bit, until the last sensor to answer has
+ * sent its byte.  The replies then come out of the snapshots: each sensor's
+ * start is the first snapshot with its line low, and the sensors that
+ * started on the same snapshot have their 8 bits in the same 8 snapshots,
+ * which one 8x32 bit transpose per port turns into a byte for every pin.
+ *
+ * Where bit 0 falls after the start comes from hub_cal_*(): edges of the
+ * sensors' replies timed on the cycle counter give the bit period and the
+ * start pulse in cycles, so the sample points follow the nodes rather than
+ * loop counts tuned for one build.  hub_scan_check() counts the bits whose
+ * neighbouring snapshots disagree and the replies not back high after bit 7,
+ * to show how close to the edges the sampling runs.
+ *
+ * Plain C with no Arduino headers, so hub_scan_sim.c can run it on a host.
+ */
+
+#ifndef __HUB_SCAN_H__
+#define __HUB_SCAN_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#define HUB_SCAN_PORTS           5       // A to E
+#define HUB_SCAN_OVERSAMPLE      4       // snapshots per bit
+#define HUB_SCAN_FIRST_BIT       3       // snapshots from the start to the middle of bit 0, uncalibrated
+#define HUB_SCAN_FIRST_BIT_MAX   (2 * HUB_SCAN_OVERSAMPLE)
+#define HUB_SCAN_START_WAIT      128     // snapshots to wait for a sensor to start
+#define HUB_SCAN_MAX_SAMPLES     (HUB_SCAN_START_WAIT + HUB_SCAN_FIRST_BIT_MAX + 9 * HUB_SCAN_OVERSAMPLE)
+#define HUB_SCAN_MAX_PINS        32
+
+#define HUB_CAL_MAX_EDGES        24      // per reply, the start first
+#define HUB_CAL_MAX_INTERVALS    1024
+#define HUB_CAL_MAX_STARTS       512
+#define HUB_CAL_MIN_INTERVALS    32      // data edges needed to trust a period
+#define HUB_CAL_GLITCH_SHARE     32      // intervals that may be too short to be a bit, one in
+
+typedef struct
+{
+  uint8_t port;                  // 0 = A
+  uint8_t bit;
+} hub_pin_t;
+
+// Teensy 3.1/3.2 pins 0-33 to their port bits
+static const hub_pin_t hub_teensy3_pins[34] = {
+  {1, 16}, {1, 17}, {3, 0}, {0, 12}, {0, 13}, {3, 7}, {3, 4}, {3, 2}, {3, 3}, {2, 3},
+  {2, 4}, {2, 6}, {2, 7}, {2, 5}, {3, 1}, {2, 0}, {1, 0}, {1, 1}, {1, 3}, {1, 2},
+  {3, 5}, {3, 6}, {2, 1}, {2, 2}, {0, 5}, {1, 19}, {4, 1}, {2, 9}, {2, 8}, {2, 10},
+  {2, 11}, {4, 0}, {1, 18}, {0, 4},
+};
+
+typedef struct
+{
+  int n_pins;
+  hub_pin_t pin[HUB_SCAN_MAX_PINS];
+  uint32_t mask[HUB_SCAN_PORTS];       // the sensor lines on each port
+  uint32_t seen[HUB_SCAN_PORTS];       // lines gone low this scan
+  int last_start;                      // snapshot of the latest start
+  int first_bit;                       // snapshots from a start to the middle of its bit 0
+  unsigned long scans;
+  unsigned long marginal[HUB_SCAN_MAX_PINS];    // bits read next to an edge
+  unsigned long framing[HUB_SCAN_MAX_PINS];     // replies still low after bit 7
+} hub_scan_t;
+
+// what the cycle counter saw of the replies
+typedef struct
+{
+  int n_intervals;
+  uint32_t interval[HUB_CAL_MAX_INTERVALS];     // between data edges, whole bits
+  uint8_t interval_pin[HUB_CAL_MAX_INTERVALS];
+  int n_starts;
+  uint32_t start[HUB_CAL_MAX_STARTS];           // start edge to the next one
+  uint32_t period;                              // results, cycles
+  uint32_t start_pulse;
+  uint32_t pin_period[HUB_SCAN_MAX_PINS];       // 0 with too few edges of its own
+} hub_cal_t;
+
+
+static inline void hub_scan_init(hub_scan_t *scan, const int *teensy_pins, int n_pins)
+{
+  int i;
+
+  memset(scan, 0, sizeof(*scan));
+  scan->n_pins = n_pins < HUB_SCAN_MAX_PINS ? n_pins : HUB_SCAN_MAX_PINS;
+  for (i = 0; i < scan->n_pins; i++) {
+    scan->pin[i] = hub_teensy3_pins[teensy_pins[i]];
+    scan->mask[scan->pin[i].port] |= 1UL << scan->pin[i].bit;
+  }
+  scan->first_bit = HUB_SCAN_FIRST_BIT;
+}
+
+// snapshots taken from a start until the byte and the stop after it are in
+static inline int hub_scan_reply(const hub_scan_t *scan)
+{
+  return scan->first_bit + 8 * HUB_SCAN_OVERSAMPLE + 1;
+}
+
+static inline void hub_scan_begin(hub_scan_t *scan)
+{
+  memset(scan->seen, 0, sizeof(scan->seen));
+  scan->last_start = -1;
+}
+
+// Notes the starts in snapshot n; 1 once every sensor that started has
+// finished its byte and the rest have had HUB_SCAN_START_WAIT to start.
+static inline int hub_scan_sample(hub_scan_t *scan, const uint32_t *sample, int n)
+{
+  uint32_t started, waiting = 0;
+  int p;
+
+  for (p = 0; p < HUB_SCAN_PORTS; p++) {
+    started = ~sample[p] & scan->mask[p] & ~scan->seen[p];
+    if (started) {
+      scan->seen[p] |= started;
+      scan->last_start = n;
+    }
+    waiting |= scan->mask[p] & ~scan->seen[p];
+  }
+  return n >= scan->last_start + hub_scan_reply(scan) && (!waiting || n + 1 >= HUB_SCAN_START_WAIT);
+}
+
+// out[k] bit j = bit k of w[j], for k 0-31: four 8x8 transposes
+static inline void hub_transpose8x32(const uint32_t w[8], uint8_t out[32])
+{
+  uint64_t x, t;
+  int lane, j;
+
+  for (lane = 0; lane < 4; lane++) {
+    x = 0;
+    for (j = 0; j < 8; j++) {
+      x |= (uint64_t)((w[j] >> (lane * 8)) & 0xff) << (j * 8);
+    }
+    // row j, bit k to row k, bit j
+    t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aaULL;
+    x ^= t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000cccc0000ccccULL;
+    x ^= t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0ULL;
+    x ^= t ^ (t << 28);
+    for (j = 0; j < 8; j++) {
+      out[lane * 8 + j] = x >> (j * 8);
+    }
+  }
+}
+
+// The byte of every pin from n snapshots, 0xff for pins that never went low,
+// like an idle line read one bit at a time.  Bits past the last snapshot read
+// as idle too.
+static inline void hub_scan_decode(const hub_scan_t *scan, const uint32_t (*samples)[HUB_SCAN_PORTS], int n,
+                                   uint8_t *out)
+{
+  int16_t start_of[HUB_SCAN_PORTS][32];
+  uint32_t seen[HUB_SCAN_PORTS], started, w[8];
+  uint8_t bytes[HUB_SCAN_PORTS][32];
+  uint32_t done = 0;
+  int s, p, b, i, j, slot, first, ports;
+
+  memset(start_of, -1, sizeof(start_of));
+  memset(seen, 0, sizeof(seen));
+  for (s = 0; s < n; s++) {
+    for (p = 0; p < HUB_SCAN_PORTS; p++) {
+      started = ~samples[s][p] & scan->mask[p] & ~seen[p];
+      seen[p] |= started;
+      for (; started; started &= started - 1) {
+        start_of[p][__builtin_ctz(started)] = s;
+      }
+    }
+  }
+
+  // one transpose per start snapshot and port, for the pins that started there
+  for (i = 0; i < scan->n_pins; i++) {
+    out[i] = 0xff;
+  }
+  for (i = 0; i < scan->n_pins; i++) {
+    if (done & (1UL << i)) {
+      continue;
+    }
+    first = start_of[scan->pin[i].port][scan->pin[i].bit];
+    if (first < 0) {
+      continue;
+    }
+    ports = 0;
+    for (b = i; b < scan->n_pins; b++) {
+      if (start_of[scan->pin[b].port][scan->pin[b].bit] == first) {
+        ports |= 1 << scan->pin[b].port;
+      }
+    }
+    for (p = 0; p < HUB_SCAN_PORTS; p++) {
+      if (!(ports & (1 << p))) {
+        continue;
+      }
+      for (j = 0; j < 8; j++) {
+        slot = first + scan->first_bit + j * HUB_SCAN_OVERSAMPLE;
+        w[j] = slot < n ? samples[slot][p] : 0xffffffff;
+      }
+      hub_transpose8x32(w, bytes[p]);
+    }
+    for (b = i; b < scan->n_pins; b++) {
+      if (start_of[scan->pin[b].port][scan->pin[b].bit] == first) {
+        out[b] = bytes[scan->pin[b].port][scan->pin[b].bit];
+        done |= 1UL << b;
+      }
+    }
+  }
+}
+
+// level of a pin in snapshot s, idle past the end
+static inline int hub_scan_level(const uint32_t (*samples)[HUB_SCAN_PORTS], int n, hub_pin_t pin, int s)
+{
+  return s < n ? (samples[s][pin.port] >> pin.bit) & 1 : 1;
+}
+
+// Adds the scan's marginal bits, read with a neighbouring snapshot on the
+// other side of an edge, and framing errors, a line low where the stop is.
+static inline void hub_scan_check(hub_scan_t *scan, const uint32_t (*samples)[HUB_SCAN_PORTS], int n)
+{
+  uint32_t seen[HUB_SCAN_PORTS];
+  int16_t start_of[HUB_SCAN_MAX_PINS];
+  int s, i, j, slot, level;
+
+  memset(seen, 0, sizeof(seen));
+  for (i = 0; i < scan->n_pins; i++) {
+    start_of[i] = -1;
+  }
+  for (s = 0; s < n; s++) {
+    for (i = 0; i < scan->n_pins; i++) {
+      if (start_of[i] < 0 && !hub_scan_level(samples, n, scan->pin[i], s)) {
+        start_of[i] = s;
+      }
+    }
+  }
+  for (i = 0; i < scan->n_pins; i++) {
+    if (start_of[i] < 0) {
+      continue;
+    }
+    for (j = 0; j < 8; j++) {
+      slot = start_of[i] + scan->first_bit + j * HUB_SCAN_OVERSAMPLE;
+      level = hub_scan_level(samples, n, scan->pin[i], slot);
+      scan->marginal[i] += hub_scan_level(samples, n, scan->pin[i], slot - 1) != level ||
+                           hub_scan_level(samples, n, scan->pin[i], slot + 1) != level;
+    }
+    scan->framing[i] += !hub_scan_level(samples, n, scan->pin[i], slot + HUB_SCAN_OVERSAMPLE);
+  }
+  scan->scans++;
+}
+
+static inline void hub_cal_begin(hub_cal_t *cal)
+{
+  memset(cal, 0, sizeof(*cal));
+}
+
+// One reply of pin i: the cycle counts of its line changes, the start first.
+static inline void hub_cal_add(hub_cal_t *cal, int pin, const uint32_t *edge, int n_edges)
+{
+  int e;
+
+  if (n_edges >= 2 && cal->n_starts < HUB_CAL_MAX_STARTS) {
+    cal->start[cal->n_starts++] = edge[1] - edge[0];
+  }
+  for (e = 1; e + 1 < n_edges && cal->n_intervals < HUB_CAL_MAX_INTERVALS; e++) {
+    cal->interval[cal->n_intervals] = edge[e + 1] - edge[e];
+    cal->interval_pin[cal->n_intervals++] = pin;
+  }
+}
+
+// Intervals of pin, or all for pin -1, no longer than max.
+static inline int hub_cal_count(const hub_cal_t *cal, int pin, uint32_t max)
+{
+  int i, n = 0;
+
+  for (i = 0; i < cal->n_intervals; i++) {
+    n += (pin < 0 || cal->interval_pin[i] == pin) && cal->interval[i] <= max;
+  }
+  return n;
+}
+
+// The bit period from the intervals of pin, or all for pin -1; 0 with too
+// few.  The polling loop times an edge up to a pass late, a tenth of a bit
+// or so, which is too much to take the shortest interval as the bit: the
+// one in HUB_CAL_GLITCH_SHARE shortest is only a first guess, the intervals
+// around it are averaged for one bit, and then every interval is summed
+// over the bits it spans, twice, to count the long ones right.
+static inline uint32_t hub_cal_period(const hub_cal_t *cal, int pin, int min_intervals)
+{
+  uint64_t sum;
+  uint32_t lo = 0, hi = 0xffffffff, mid, one, bits;
+  int i, n = hub_cal_count(cal, pin, 0xffffffff), pass;
+
+  if (n < min_intervals) {
+    return 0;
+  }
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (hub_cal_count(cal, pin, mid) > n / HUB_CAL_GLITCH_SHARE) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  sum = bits = 0;
+  for (i = 0; i < cal->n_intervals; i++) {
+    if ((pin < 0 || cal->interval_pin[i] == pin) && cal->interval[i] >= lo / 2 && cal->interval[i] < lo + lo / 2) {
+      sum += cal->interval[i];
+      bits++;
+    }
+  }
+  one = sum / bits;
+  for (pass = 0; pass < 2 && one > 0; pass++) {
+    sum = bits = 0;
+    for (i = 0; i < cal->n_intervals; i++) {
+      if ((pin < 0 || cal->interval_pin[i] == pin) && cal->interval[i] >= one / 2) {
+        sum += cal->interval[i];
+        bits += (cal->interval[i] + one / 2) / one;
+      }
+    }
+    one = sum / bits;
+  }
+  return one;
+}
+
+// The bit period and start pulse from the replies added, -1 with too few
+// edges.  The start pulse is taken as shorter than a bit, as the first
+// sample 41/49 of a bit after the start in the old tuned loops says, so it
+// is what the first interval leaves over whole bits.
+static inline int hub_cal_finish(hub_cal_t *cal, int n_pins)
+{
+  uint64_t sum = 0;
+  int i;
+
+  cal->period = hub_cal_period(cal, -1, HUB_CAL_MIN_INTERVALS);
+  if (cal->period == 0 || cal->n_starts == 0) {
+    return -1;
+  }
+  for (i = 0; i < cal->n_starts; i++) {
+    sum += cal->start[i] % cal->period;
+  }
+  cal->start_pulse = sum / cal->n_starts;
+  for (i = 0; i < n_pins && i < HUB_SCAN_MAX_PINS; i++) {
+    cal->pin_period[i] = hub_cal_period(cal, i, 4);
+  }
+  return 0;
+}
+
+// Sample points for snapshots HUB_SCAN_OVERSAMPLE a bit of period cycles.
+// A start is seen half a snapshot after it happened on average, so the
+// middle of bit 0 is rounded down.  A start pulse shorter than a snapshot can go
+// unseen when bit 0 is a 1, which only more oversampling helps.
+static inline void hub_scan_set_timing(hub_scan_t *scan, uint32_t period, uint32_t start_pulse)
+{
+  int first_bit = (int)((uint64_t)(2 * start_pulse + period) * HUB_SCAN_OVERSAMPLE / (2 * period));
+
+  scan->first_bit = first_bit < HUB_SCAN_FIRST_BIT_MAX ? first_bit : HUB_SCAN_FIRST_BIT_MAX;
+}
+
+
+#endif /* __HUB_SCAN_H__ */
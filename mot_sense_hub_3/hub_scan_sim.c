@@ -0,0 +1,345 @@
+/*
+ * hub_scan_sim.c
+ *
+ * Host simulation of the port-wide sensor scan in hub_scan.h.  Sensors on
+ * the hub's pins answer a trigger after a random delay with a random byte,
+ * each with its own bit period error; the five port registers are sampled
+ * at HUB_SCAN_OVERSAMPLE per nominal bit with a random phase until
+ * hub_scan_sample() says the scan is done, and hub_scan_decode() must give
+ * back every byte.  The transpose is checked against a bit at a time one,
+ * and the scan length is compared with reading the sensors one by one.
+ *
+ * Before the scans the sample points are calibrated as the sketch does at
+ * startup, from reply edges seen by a polling loop on the cycle counter
+ * (time units here are cycles); -u skips that and keeps the defaults, -s
+ * changes the nodes' start pulse to see either way cope.
+ *
+ * Captures are text, a snapshot per line as five hex words, A to E, and a
+ * blank line after each; SCAN_DUMP in the sketch prints them from a board.
+ * -w writes the simulated ones with a "# expect" line of the bytes sent,
+ * -f decodes a file of them and checks the bytes where it says.
+ *
+ *   cc -O2 -o hub_scan_sim hub_scan_sim.c
+ *   hub_scan_sim [-n scans] [-a absent sensors] [-s start pulse] [-u] [-w capture file]
+ *   hub_scan_sim -f capture file
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "hub_scan.h"
+
+#define SIM_BIT                  1000    // time units per nominal bit
+#define SIM_START_PULSE          340     // the node's low start before bit 0, by default
+#define SIM_MAX_DELAY            (6 * SIM_BIT)
+#define SIM_PERIOD_ERROR         20      // per mille, either way
+#define SIM_ABSENT_DEFAULT       2
+#define SIM_SCANS_DEFAULT        10000
+#define SIM_POLL                 80      // cycles per pass of the edge polling loop, a Teensy's 8 of 96
+#define SIM_CAL_REPLIES          16      // per sensor
+
+static const int sensor_pins[29] = {4, 5, 6, 7, 8, 9, 10, 11, 12, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26,
+                                    27, 28, 29, 30, 31, 32, 33};
+
+typedef struct
+{
+  int present;
+  int delay;
+  int period;
+  int start_pulse;
+  uint8_t byte;
+} node_t;
+
+
+static int64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// the line of a node at time t after the trigger, pulled up when idle
+static int line(const node_t *node, int t)
+{
+  int bit;
+
+  if (!node->present || t < node->delay) {
+    return 1;
+  }
+  t -= node->delay;
+  if (t < node->start_pulse) {
+    return 0;
+  }
+  bit = (t - node->start_pulse) / node->period;
+  return bit < 8 ? (node->byte >> bit) & 1 : 1;
+}
+
+static void new_reply(node_t *node, int start_pulse)
+{
+  node->present = 1;
+  node->delay = rand() % SIM_MAX_DELAY;
+  node->period = SIM_BIT + (rand() % (2 * SIM_PERIOD_ERROR + 1) - SIM_PERIOD_ERROR) * SIM_BIT / 1000;
+  node->start_pulse = start_pulse;
+  node->byte = rand();
+}
+
+// the line changes of a reply as the polling loop times them
+static int reply_edges(const node_t *node, uint32_t *edge)
+{
+  int t, level = 1, n = 0;
+
+  for (t = rand() % SIM_POLL; t < node->delay + node->start_pulse + 10 * node->period && n < HUB_CAL_MAX_EDGES;
+       t += SIM_POLL) {
+    if (line(node, t) != level) {
+      level = !level;
+      edge[n++] = t;
+    }
+  }
+  return n;
+}
+
+// what the sketch does at startup
+static void calibrate(hub_scan_t *scan, node_t *nodes, int start_pulse)
+{
+  static hub_cal_t cal;
+  uint32_t edge[HUB_CAL_MAX_EDGES];
+  long sum = 0;
+  int i, r, worst = 0;
+
+  hub_cal_begin(&cal);
+  for (i = 0; i < 29; i++) {
+    for (r = 0; r < SIM_CAL_REPLIES; r++) {
+      new_reply(&nodes[i], start_pulse);
+      sum += nodes[i].period;
+      hub_cal_add(&cal, i, edge, reply_edges(&nodes[i], edge));
+    }
+  }
+  if (hub_cal_finish(&cal, 29) < 0) {
+    printf("calibration: too few edges, sample points left as they were\n");
+    return;
+  }
+  for (i = 0; i < 29; i++) {
+    if (cal.pin_period[i] != 0) {
+      r = abs((int)cal.pin_period[i] - (int)cal.period) * 1000 / (int)cal.period;
+      worst = r > worst ? r : worst;
+    }
+  }
+  hub_scan_set_timing(scan, cal.period, cal.start_pulse);
+  printf("calibration: bit %u cycles (mean %li), start pulse %u (%i), first bit at snapshot %i, "
+         "sensors up to %i.%i%% apart\n", cal.period, sum / (29 * SIM_CAL_REPLIES), cal.start_pulse, start_pulse,
+         scan->first_bit, worst / 10, worst % 10);
+}
+
+static int check_transpose(void)
+{
+  uint32_t w[8];
+  uint8_t out[32];
+  int round, j, k, bad = 0;
+
+  for (round = 0; round < 1000; round++) {
+    for (j = 0; j < 8; j++) {
+      w[j] = (uint32_t)rand() << 16 ^ (uint32_t)rand();
+    }
+    hub_transpose8x32(w, out);
+    for (k = 0; k < 32; k++) {
+      for (j = 0; j < 8; j++) {
+        bad += ((out[k] >> j) & 1) != ((w[j] >> k) & 1);
+      }
+    }
+  }
+  return bad;
+}
+
+static void write_capture(FILE *f, const uint32_t (*samples)[HUB_SCAN_PORTS], int n, const node_t *nodes)
+{
+  int s, p, i;
+
+  fprintf(f, "# expect");
+  for (i = 0; i < 29; i++) {
+    fprintf(f, " %i", nodes[i].present ? nodes[i].byte : 0xff);
+  }
+  fprintf(f, "\n");
+  for (s = 0; s < n; s++) {
+    for (p = 0; p < HUB_SCAN_PORTS; p++) {
+      fprintf(f, p ? " %08x" : "%08x", samples[s][p]);
+    }
+    fprintf(f, "\n");
+  }
+  fprintf(f, "\n");
+}
+
+// decodes every capture in a file, printing the bytes
+static int read_captures(const hub_scan_t *scan, const char *path)
+{
+  static uint32_t samples[HUB_SCAN_MAX_SAMPLES][HUB_SCAN_PORTS];
+  char line[256], *p;
+  int expect[29], has_expect = 0, n = 0, i, captures = 0, errors = 0, at_end;
+  uint8_t out[29];
+  FILE *f = fopen(path, "r");
+
+  if (f == NULL) {
+    perror(path);
+    return -1;
+  }
+  do {
+    at_end = fgets(line, sizeof(line), f) == NULL;
+    if (!at_end && strncmp(line, "# expect", 8) == 0) {
+      p = line + 8;
+      for (i = 0; i < 29; i++) {
+        expect[i] = strtol(p, &p, 10);
+      }
+      has_expect = 1;
+    } else if (!at_end && line[0] != '\n' && line[0] != '#') {
+      if (n < HUB_SCAN_MAX_SAMPLES &&
+          sscanf(line, "%x %x %x %x %x", &samples[n][0], &samples[n][1], &samples[n][2], &samples[n][3],
+                 &samples[n][4]) == HUB_SCAN_PORTS) {
+        n++;
+      }
+    } else if (n > 0) {
+      hub_scan_decode(scan, (const uint32_t (*)[HUB_SCAN_PORTS])samples, n, out);
+      printf("capture %i, %i snapshots:", captures, n);
+      for (i = 0; i < 29; i++) {
+        printf(" %i", out[i]);
+        errors += has_expect && out[i] != expect[i];
+      }
+      printf("\n");
+      captures++;
+      has_expect = 0;
+      n = 0;
+    }
+  } while (!at_end);
+  fclose(f);
+  printf("%i captures, %i bytes wrong\n", captures, errors);
+  return errors;
+}
+
+int main(int argc, char *argv[])
+{
+  static uint32_t samples[HUB_SCAN_MAX_SAMPLES][HUB_SCAN_PORTS];
+  node_t nodes[29];
+  uint8_t out[29];
+  hub_scan_t scan;
+  int64_t start, decode_ns = 0;
+  long total_samples = 0, sequential = 0;
+  int scans = SIM_SCANS_DEFAULT;
+  int absent = SIM_ABSENT_DEFAULT;
+  int start_pulse = SIM_START_PULSE;
+  int calibrated = 1;
+  unsigned long marginal = 0, framing = 0;
+  const char *read_path = NULL;
+  FILE *write_file = NULL;
+  int s, i, n, p, t, phase, done, opt, errors = 0, longest = 0;
+
+  while ((opt = getopt(argc, argv, "n:a:s:uw:f:")) != -1) {
+    switch (opt) {
+    case 's':
+      start_pulse = atoi(optarg);
+      break;
+    case 'u':
+      calibrated = 0;
+      break;
+    case 'n':
+      scans = atoi(optarg);
+      break;
+    case 'a':
+      absent = atoi(optarg);
+      break;
+    case 'w':
+      write_file = fopen(optarg, "w");
+      if (write_file == NULL) {
+        perror(optarg);
+        return 1;
+      }
+      break;
+    case 'f':
+      read_path = optarg;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n scans] [-a absent sensors] [-s start pulse] [-u] [-w capture file]\n"
+              "       %s -f capture file\n", argv[0], argv[0]);
+      return 1;
+    }
+  }
+
+  srand(1);
+  if (check_transpose() > 0) {
+    printf("transpose wrong\n");
+    return 1;
+  }
+  hub_scan_init(&scan, sensor_pins, 29);
+  if (read_path != NULL) {
+    return read_captures(&scan, read_path) != 0;
+  }
+  if (calibrated) {
+    calibrate(&scan, nodes, start_pulse);
+  }
+
+  for (s = 0; s < scans; s++) {
+    for (i = 0; i < 29; i++) {
+      new_reply(&nodes[i], start_pulse);
+    }
+    for (i = 0; i < absent; i++) {
+      nodes[rand() % 29].present = 0;
+    }
+
+    // the capture loop, as the sketch runs it
+    phase = rand() % (SIM_BIT / HUB_SCAN_OVERSAMPLE);
+    hub_scan_begin(&scan);
+    for (n = 0; n < HUB_SCAN_MAX_SAMPLES; n++) {
+      t = phase + n * SIM_BIT / HUB_SCAN_OVERSAMPLE;
+      for (p = 0; p < HUB_SCAN_PORTS; p++) {
+        samples[n][p] = 0xffffffff;
+      }
+      for (i = 0; i < 29; i++) {
+        if (!line(&nodes[i], t)) {
+          samples[n][scan.pin[i].port] &= ~(1UL << scan.pin[i].bit);
+        }
+      }
+      done = hub_scan_sample(&scan, samples[n], n);
+      if (done) {
+        n++;
+        break;
+      }
+    }
+
+    if (write_file != NULL) {
+      write_capture(write_file, (const uint32_t (*)[HUB_SCAN_PORTS])samples, n, nodes);
+    }
+    start = now_ns();
+    hub_scan_decode(&scan, (const uint32_t (*)[HUB_SCAN_PORTS])samples, n, out);
+    decode_ns += now_ns() - start;
+    hub_scan_check(&scan, (const uint32_t (*)[HUB_SCAN_PORTS])samples, n);
+
+    for (i = 0; i < 29; i++) {
+      errors += out[i] != (nodes[i].present ? nodes[i].byte : 0xff);
+      // one at a time: wait for the start, then to the middle of bit 0 and 8 bits
+      sequential += nodes[i].present ? nodes[i].delay + nodes[i].start_pulse + SIM_BIT / 2 + 8 * SIM_BIT
+                                     : SIM_BIT * HUB_SCAN_START_WAIT / HUB_SCAN_OVERSAMPLE;
+    }
+    total_samples += n;
+    longest = n > longest ? n : longest;
+  }
+
+  printf("%i scans of 29 sensors, %i absent each, start delay up to %i bits, bit period +-%i.%i%%\n", scans,
+         absent, SIM_MAX_DELAY / SIM_BIT, SIM_PERIOD_ERROR / 10, SIM_PERIOD_ERROR % 10);
+  printf("port-wide scan  %6.1f bits average, %5.1f longest\n",
+         (double)total_samples / scans / HUB_SCAN_OVERSAMPLE, (double)longest / HUB_SCAN_OVERSAMPLE);
+  printf("one at a time   %6.1f bits average\n", (double)sequential / scans / SIM_BIT);
+  printf("decode          %6.0f ns on this host\n", (double)decode_ns / scans);
+  for (i = 0; i < 29; i++) {
+    marginal += scan.marginal[i];
+    framing += scan.framing[i];
+  }
+  printf("%lu bits read next to an edge, %lu framing errors\n", marginal, framing);
+  printf("%i bytes wrong\n", errors);
+  if (write_file != NULL) {
+    fclose(write_file);
+  }
+
+  return errors > 0;
+}
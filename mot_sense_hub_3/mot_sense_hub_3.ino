@@ -6,10 +6,13 @@
    This example code is in the public domain.
 */
 
+#include <DMAChannel.h>
+#include <box_hub_frame.h>    // what goes to the Pi
+#include "hub_scan.h"
+
 // set this to the hardware serial port you wish to use
 #define HWSERIAL Serial1
 int led = 13;
-int sample_enable = 3;
 
 #define N_MOTION_SENSORS_ACTIVE  29
 int motion_sensor_pins[29] = {4, 5, 6, 7, 8, 9, 10, 11, 12, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33};
@@ -24,26 +27,104 @@ int scene_timeouts[N_SCENES];// = {0, 0, 0, 5};
 #define SCENE_CHANGE_IGNORE_TIME    1    // tilt for scene change ignored for this many seconds after last scene change
 #define US_IN_S    1000000     // one million us in a second
 
+// a scan begins this often, the frames of the one before going out
+// meanwhile; the loop counts below were set for the 10 ms or so a loop
+// took when it waited on the UART and the sample enable
+#define SCAN_PERIOD_US     2500
+#define LOOPS_MS(ms)       ((ms) * 1000L / SCAN_PERIOD_US)
+
+// Sound goes to Pd on the USB Serial as bytes: a tap is sensor * 8 + its
+// velocity bucket, level / 16, and 232 on is a scene.  Taps are sent as a
+// batch closed by SOUND_BATCH_END_CODE, every pending tap of the loop at
+// once, loudest first, for Pd to trigger together; taps over
+// SOUND_BATCH_MAX wait for the next loop, loudest first again.
 #define SOUND_SCENE_CODE_OFFSET    232    // 232 is scene 0
-#define SOUND_NO_UPDATE_CODE       255
+#define SOUND_BATCH_END_CODE       254
+#define SOUND_TAP_LEVEL            48     // taps quieter are not sent
+#define SOUND_TAP_HOLDOFF_LOOPS    LOOPS_MS(1200)    // after a sensor's tap is sent, before it can queue another
+#define SOUND_BATCH_MAX            8
+uint8_t sound_message[1 + SOUND_BATCH_MAX + 1];
 
-#define MOTION_TILT_TIMEOUT_RESET   50
+#define MOTION_TILT_TIMEOUT_RESET   LOOPS_MS(500)
 // scene control unresponsive to tilt events when sensor-specific timeout is non-zero
 int motion_tilt_timeouts[N_SCENES] = {0, 0, 0, 0};
 
 #define N_MOTION_SENSORS           30
-#define OUTPUT_PACKET_START_INDEX  0
-#define OUTPUT_PACKET_SCENE_INDEX  1
-#define OUTPUT_PACKET_HEADER_SIZE  2
+#define OUTPUT_PACKET_SCENE_INDEX  0
+#define OUTPUT_PACKET_HEADER_SIZE  1
 #define OUTPUT_PACKET_SIZE  (N_MOTION_SENSORS + OUTPUT_PACKET_HEADER_SIZE)
 uint8_t output_packet[OUTPUT_PACKET_SIZE];
 
+// the packet goes to the Pi as the data of a BOX_HUB_FRAME_MOTION frame,
+// sensor bytes as read, with the micros() the scan began at; in between
+// keyframes only what changed goes, which at 115200 baud is what bounds
+// the scan rate
+#define MOTION_DELTAS              1     // 0: every frame a keyframe
+#define MOTION_KEYFRAME_FRAMES     32    // a keyframe every so many, for a Pi that missed a frame
+box_hub_motion_t motion_sent;
+box_hub_frame_t hub_frame;
+uint32_t scan_start_us;
+
+// The frames go out of two buffers: a scan's are built in one while the
+// DMA sends the other to UART0, Serial1's, a byte whenever it asks, so the
+// loop never waits on the UART.  A scan that finds its buffer still
+// waiting is not sent, and the deltas go on from the last one that was.
+// Once a second a BOX_HUB_FRAME_STATUS frame has the counts for the Pi,
+// with the next periodic keyframe so that no delta follows it.
+#define TX_DMA              1     // 0: HWSERIAL.write(), which waits when its buffer is full
+#define TX_BUFFER_SIZE      (3 * BOX_HUB_FRAME_MAX_ENCODED)    // status, offsets and a keyframe
+DMAChannel tx_dma;
+uint8_t tx_buffer[2][TX_BUFFER_SIZE];
+int tx_length[2];
+int tx_fill;                  // the buffer being built
+int tx_busy;                  // the other one still going out
+box_hub_status_t tx_status;   // this second so far
+box_hub_status_t tx_report;   // the last whole second, to send
+int tx_report_due;
+uint32_t tx_second_us;
+
+// when each sensor was triggered, in cycles after the scan began; before
+// each keyframe they go as a BOX_HUB_FRAME_OFFSETS frame in us, so the Pi
+// can tell when every byte was sampled and not only when the frame came
+uint32_t scan_start_cycles;
+uint32_t sensor_cycles[N_MOTION_SENSORS];
+uint16_t sensor_offset_us[N_MOTION_SENSORS];
+
+// how the sensors are read, see hub_scan.h for the port-wide scans
+#define SCAN_SEQUENTIAL     0     // one after another, timed on the cycle counter
+#define SCAN_PORT_WIDE      1     // all together, the ports snapshotted on the cycle counter
+#define SCAN_DMA            2     // all together, the ports captured by DMA on a PIT timer
+#define SCAN_MODE           SCAN_DMA
+#define SCAN_BIT_NS         1000  // the nodes' bit period, from the scope, until calibrated
+#define SCAN_START_NS       340   // their start pulse, the same
+#define SCAN_DUMP           0     // 1: every capture printed on USB serial for hub_scan_sim -f; not with Pd
+#define SCAN_REPORT         0     // 1: calibration and sampling margins printed on USB serial; not with Pd
+#define SCAN_REPORT_SCANS   1000  // scans between reports
+#define CAL_REPLIES         16    // per sensor at startup
+#define CAL_TIMEOUT_BITS    32    // for a reply to be over
+
+hub_scan_t scan;
+uint32_t scan_samples[HUB_SCAN_MAX_SAMPLES][HUB_SCAN_PORTS];
+
+// sensor timing in cycles of the DWT cycle counter, measured at startup by
+// CalibrateSensors() when the replies have edges enough, else from the ns above
+hub_cal_t cal;
+int calibrated;
+uint32_t bit_cycles;
+uint32_t first_bit_cycles;    // from seeing a start to the middle of bit 0
+unsigned long late_snapshots;    // busy loop snapshots taken after their time
+
+// the capture: each PIT tick triggers one minor loop of five words, PDIR of
+// ports A to E, 0x40 apart; only DMA channels 0-3 have a PIT, the same number
+DMAChannel capture_dma;
+int capture_ready;
+uint32_t capture_ldval;
+
 void setup() {
   Serial.begin(115200);
   HWSERIAL.begin(115200);
   // initialize the digital pin as an output.
   pinMode(led, OUTPUT);
-  pinMode(sample_enable, INPUT_PULLUP);
   digitalWrite(2, LOW);    // serial GND here for now
   pinMode(2, OUTPUT);
   digitalWrite(2, LOW);
@@ -53,55 +134,448 @@ void setup() {
     sound_tap_queue[i] = 0;
   }
 
-  output_packet[OUTPUT_PACKET_START_INDEX] = 254;
+  hub_scan_init(&scan, motion_sensor_pins, N_MOTION_SENSORS_ACTIVE);
+
+  ARM_DEMCR |= ARM_DEMCR_TRCENA;    // the cycle counter
+  ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+  SetScanTiming((uint32_t)((uint64_t)F_CPU * SCAN_BIT_NS / 1000000000),
+                (uint32_t)((uint64_t)F_CPU * SCAN_START_NS / 1000000000));
+#if SCAN_MODE == SCAN_DMA
+  CaptureInit();    // first, for a DMA channel with a PIT
+#endif
+#if TX_DMA
+  TxInit();
+#endif
+  CalibrateSensors();
+#if SCAN_REPORT
+  ReportScan();
+#endif
 
 }
 
-void loop() {
-  int i, j, k, mot_sense_pin;
-  uint8_t rx_char;
-  int sound_byte;
-  //static uint8_t last_rx_char;
-  static long scene_start_time = 0;
-  long clock_time_us;
-  long time_since_scene_start = 0;
-  static int current_scene = 0;
-  static int last_scene = 0;
+// where every scan samples, from the nodes' bit period and start pulse in cycles
+void SetScanTiming(uint32_t bit, uint32_t start_pulse) {
+  bit_cycles = bit;
+  first_bit_cycles = start_pulse + bit / 2;
+  hub_scan_set_timing(&scan, bit, start_pulse);
+  // bus clock ticks per snapshot, less one, rounded: 95 cycles a bit cut
+  // down to 11 ticks would sample 8% fast and miss the last bits
+  capture_ldval = (uint32_t)(((uint64_t)bit * F_BUS / F_CPU + HUB_SCAN_OVERSAMPLE / 2) / HUB_SCAN_OVERSAMPLE) - 1;
+}
 
-  //rx_char = 0;
+// pulls one sensor line low and lets go, which has the node answer
+void TriggerSensor(int pin) {
+  pinMode(pin, OUTPUT);
+  digitalWrite(pin, LOW);
+  digitalWrite(pin, LOW);
+  digitalWrite(pin, LOW);
+  digitalWrite(pin, HIGH);
+  pinMode(pin, INPUT_PULLUP);
+}
+
+// times CAL_REPLIES replies of each sensor on the cycle counter, polling
+// its port bit with interrupts off, and takes the sample points from them;
+// replies of all zeros or all ones have no data edges, so if the nodes send
+// nothing else yet the SCAN_*_NS ones stay
+void CalibrateSensors() {
+  uint32_t edge[HUB_CAL_MAX_EDGES];
+  uint32_t mask, level, start, now, timeout = bit_cycles * CAL_TIMEOUT_BITS;
+  volatile uint32_t *pdir;
+  int i, r, n;
+
+  hub_cal_begin(&cal);
+  for (i = 0; i < N_MOTION_SENSORS_ACTIVE; i++) {
+    pdir = &GPIOA_PDIR + scan.pin[i].port * 16;    // the ports are 0x40 apart
+    mask = 1UL << scan.pin[i].bit;
+    for (r = 0; r < CAL_REPLIES; r++) {
+      n = 0;
+      level = mask;
+
+      cli();
+      TriggerSensor(motion_sensor_pins[i]);
+      start = ARM_DWT_CYCCNT;
+      do {
+        now = ARM_DWT_CYCCNT;
+        if ((*pdir & mask) != level) {
+          level ^= mask;
+          edge[n++] = now;
+        }
+      } while (n < HUB_CAL_MAX_EDGES && now - start < timeout);
+      sei();
+
+      hub_cal_add(&cal, i, edge, n);
+      delayMicroseconds(100);    // the node back to waiting
+    }
+  }
+  if (hub_cal_finish(&cal, N_MOTION_SENSORS_ACTIVE) == 0) {
+    calibrated = 1;
+    SetScanTiming(cal.period, cal.start_pulse);
+  }
+}
+
+#if SCAN_REPORT
+void ReportScan() {
+  int i;
+
+  Serial.printf("%s: bit %lu cycles, start pulse %lu, first bit at snapshot %i, %lu scans, %lu late snapshots\n",
+                calibrated ? "calibrated" : "not calibrated", bit_cycles, first_bit_cycles - bit_cycles / 2,
+                scan.first_bit, scan.scans, late_snapshots);
+  for (i = 0; i < N_MOTION_SENSORS_ACTIVE; i++) {
+    Serial.printf("sensor %2i pin %2i: bit %lu cycles, %lu bits next to an edge, %lu framing errors\n", i,
+                  motion_sensor_pins[i], cal.pin_period[i], scan.marginal[i], scan.framing[i]);
+  }
+}
+#endif
+
+// UART0 asks the DMA for a byte whenever its FIFO has room; Serial1 is
+// only written, and its interrupt, on a byte received, would take TIE back
+void TxInit() {
+  volatile uint8_t *mux;
+
+  UART0_C2 &= ~UART_C2_RIE;
+  tx_dma.begin();
+  tx_dma.TCD->SOFF = 1;
+  tx_dma.TCD->ATTR = DMA_TCD_ATTR_SSIZE(0) | DMA_TCD_ATTR_DSIZE(0);
+  tx_dma.TCD->NBYTES_MLNO = 1;
+  tx_dma.TCD->SLAST = 0;
+  tx_dma.TCD->DADDR = &UART0_D;
+  tx_dma.TCD->DOFF = 0;
+  tx_dma.TCD->DLASTSGA = 0;
+  tx_dma.TCD->CSR = DMA_TCD_CSR_DREQ;    // stops at the end of the buffer
+  mux = &DMAMUX0_CHCFG0 + tx_dma.channel;
+  *mux = 0;
+  *mux = DMAMUX_SOURCE_UART0_TX | DMAMUX_ENABLE;
+  UART0_C5 |= UART_C5_TDMAS;
+}
+
+// the built buffer out once the other is done
+void TxPoll() {
+#if TX_DMA
+  if (tx_busy && !tx_dma.complete()) {
+    return;
+  }
+#endif
+  tx_busy = 0;
+  if (tx_length[tx_fill] == 0) {
+    return;
+  }
+#if TX_DMA
+  tx_dma.TCD->SADDR = tx_buffer[tx_fill];
+  tx_dma.TCD->CITER_ELINKNO = tx_length[tx_fill];
+  tx_dma.TCD->BITER_ELINKNO = tx_length[tx_fill];
+  tx_dma.clearComplete();
+  tx_dma.enable();
+  UART0_C2 |= UART_C2_TIE;
+  tx_busy = 1;
+#else
+  HWSERIAL.write(tx_buffer[tx_fill], tx_length[tx_fill]);
+#endif
+  tx_fill ^= 1;
+  tx_length[tx_fill] = 0;
+}
+
+// bytes built or going out that the UART has yet to take
+uint32_t TxBacklog() {
+  uint32_t n = tx_length[tx_fill];
+
+#if TX_DMA
+  if (tx_busy && !tx_dma.complete()) {
+    n += tx_dma.TCD->CITER_ELINKNO;
+  }
+#endif
+  return n;
+}
+
+// the scan's frames into the buffer being built, if it is free: before
+// each periodic keyframe the last second's status, when due, and the
+// sensor offsets, then the output packet
+void SendMotionFrame() {
+  uint8_t *out;
+  uint32_t backlog;
+  int i, n = 0, keyframe = hub_frame.sequence % MOTION_KEYFRAME_FRAMES == 0;
+
+  TxPoll();
+  if (scan_start_us - tx_second_us >= US_IN_S) {
+    tx_report = tx_status;
+    tx_report_due = 1;
+    memset(&tx_status, 0, sizeof(tx_status));
+    tx_second_us = scan_start_us;
+  }
+  tx_status.scans++;
+  backlog = TxBacklog();
+  tx_status.backlog_max = backlog > tx_status.backlog_max ? backlog : tx_status.backlog_max;
+  if (tx_length[tx_fill] != 0) {
+    tx_status.unsent++;
+    return;
+  }
+
+  out = tx_buffer[tx_fill];
+  hub_frame.time_us = scan_start_us;
+  if (keyframe && tx_report_due) {
+    box_hub_status_frame(&tx_report, &hub_frame);
+    n += box_hub_frame_encode(&hub_frame, out + n);
+    hub_frame.sequence++;
+    tx_report_due = 0;
+  }
+  if (keyframe) {
+    for (i = 0; i < N_MOTION_SENSORS; i++) {
+      sensor_offset_us[i] = sensor_cycles[i] / (F_CPU / 1000000);
+    }
+    box_hub_offsets_frame(sensor_offset_us, N_MOTION_SENSORS, &hub_frame);
+    n += box_hub_frame_encode(&hub_frame, out + n);
+    hub_frame.sequence++;
+  }
+  box_hub_motion_frame(&motion_sent, output_packet, OUTPUT_PACKET_SIZE, !MOTION_DELTAS || keyframe, &hub_frame);
+  n += box_hub_frame_encode(&hub_frame, out + n);
+  hub_frame.sequence++;
+  tx_status.frames++;
+  tx_length[tx_fill] = n;
+  TxPoll();
+}
+
+// reads the sensors one at a time into the output packet
+void ScanSequential() {
+  int i, j, mot_sense_pin;
+  uint8_t rx_char;
+  uint32_t t;
 
   cli();
 
   for (i = 0; i < N_MOTION_SENSORS_ACTIVE; i++) {
     rx_char = 0;
     mot_sense_pin = motion_sensor_pins[i];
-    pinMode(mot_sense_pin, OUTPUT);
-    digitalWrite(mot_sense_pin, LOW);
-    digitalWrite(mot_sense_pin, LOW);
-    digitalWrite(mot_sense_pin, LOW);
-    digitalWrite(mot_sense_pin, HIGH);
-    pinMode(mot_sense_pin, INPUT_PULLUP);
+    sensor_cycles[i] = ARM_DWT_CYCCNT - scan_start_cycles;
+    TriggerSensor(mot_sense_pin);
     for (j = 0; j < 1000; j++) {    // give mot sensor some time to respond
       if (digitalRead(mot_sense_pin) == LOW) {    // first low indicated motion sensor is driving comm line
         break;
       }
     }
-    //us = micros();
-    for (j = 0; j < 41; j++);    // tuned delay
+    t = ARM_DWT_CYCCNT + first_bit_cycles;
     for (j = 0; j < 8; j++) {
+      while ((int32_t)(ARM_DWT_CYCCNT - t) < 0);    // to the middle of bit j
       rx_char |= (digitalRead(mot_sense_pin) << j);
-      for (k = 0; k < 49; k++);    // tuned delay
+      t += bit_cycles;
     }
     output_packet[i + OUTPUT_PACKET_HEADER_SIZE] = rx_char;
   }
 
   sei();
+}
+
+// pulls every sensor line low together and lets go, what pinMode() and
+// digitalWrite() do above for one pin; the pins are already pulled up
+void TriggerAllSensors() {
+  uint32_t t = ARM_DWT_CYCCNT - scan_start_cycles;
+
+  for (int i = 0; i < N_MOTION_SENSORS_ACTIVE; i++) {
+    sensor_cycles[i] = t;
+  }
+  GPIOA_PCOR = scan.mask[0];
+  GPIOB_PCOR = scan.mask[1];
+  GPIOC_PCOR = scan.mask[2];
+  GPIOD_PCOR = scan.mask[3];
+  GPIOE_PCOR = scan.mask[4];
+  GPIOA_PDDR |= scan.mask[0];
+  GPIOB_PDDR |= scan.mask[1];
+  GPIOC_PDDR |= scan.mask[2];
+  GPIOD_PDDR |= scan.mask[3];
+  GPIOE_PDDR |= scan.mask[4];
+  GPIOA_PCOR = scan.mask[0];    // held low about as long as three digitalWrite()s
+  GPIOB_PCOR = scan.mask[1];
+  GPIOC_PCOR = scan.mask[2];
+  GPIOD_PCOR = scan.mask[3];
+  GPIOE_PCOR = scan.mask[4];
+  GPIOA_PSOR = scan.mask[0];
+  GPIOB_PSOR = scan.mask[1];
+  GPIOC_PSOR = scan.mask[2];
+  GPIOD_PSOR = scan.mask[3];
+  GPIOE_PSOR = scan.mask[4];
+  GPIOA_PDDR &= ~scan.mask[0];
+  GPIOB_PDDR &= ~scan.mask[1];
+  GPIOC_PDDR &= ~scan.mask[2];
+  GPIOD_PDDR &= ~scan.mask[3];
+  GPIOE_PDDR &= ~scan.mask[4];
+}
+
+void CaptureInit() {
+  volatile uint8_t *mux;
+
+  capture_dma.begin();
+  if (capture_dma.channel >= 4) {
+    return;    // no PIT to trigger it, the busy loop scan instead
+  }
+  capture_dma.TCD->SOFF = 0x40;
+  capture_dma.TCD->ATTR = DMA_TCD_ATTR_SSIZE(2) | DMA_TCD_ATTR_DSIZE(2);
+  capture_dma.TCD->NBYTES_MLOFFYES = DMA_TCD_NBYTES_SMLOE | DMA_TCD_NBYTES_MLOFFYES_MLOFF(-HUB_SCAN_PORTS * 0x40) |
+                                     DMA_TCD_NBYTES_MLOFFYES_NBYTES(HUB_SCAN_PORTS * 4);
+  capture_dma.TCD->SLAST = 0;
+  capture_dma.TCD->DOFF = 4;
+  capture_dma.TCD->DLASTSGA = 0;
+  capture_dma.TCD->CSR = DMA_TCD_CSR_DREQ;    // one capture per enable
+  mux = &DMAMUX0_CHCFG0 + capture_dma.channel;
+  *mux = 0;
+  *mux = DMAMUX_SOURCE_ALWAYS0 | DMAMUX_TRIG | DMAMUX_ENABLE;    // always requesting, let through by the PIT
+
+  SIM_SCGC6 |= SIM_SCGC6_PIT;
+  PIT_MCR = 0;
+  capture_ready = 1;
+}
+
+#if SCAN_DUMP
+// one capture in the text hub_scan_sim -f reads
+void DumpCapture(int n) {
+  int s;
+
+  for (s = 0; s < n; s++) {
+    Serial.printf("%08lx %08lx %08lx %08lx %08lx\n", scan_samples[s][0], scan_samples[s][1], scan_samples[s][2],
+                  scan_samples[s][3], scan_samples[s][4]);
+  }
+  Serial.printf("\n");
+}
+#endif
+
+// reads every sensor at once into the output packet, the ports captured by
+// DMA at HUB_SCAN_OVERSAMPLE per bit; interrupts are only off for the
+// trigger, the capture is followed with them on and stopped once every reply
+// is in
+void ScanCapture() {
+  volatile uint32_t *pit = &PIT_LDVAL0 + capture_dma.channel * 4;    // LDVAL, CVAL, TCTRL, TFLG
+  int n = 0, captured, done = 0;
+
+  pit[2] = 0;
+  pit[0] = capture_ldval;
+  capture_dma.TCD->SADDR = &GPIOA_PDIR;
+  capture_dma.TCD->DADDR = scan_samples;
+  capture_dma.TCD->CITER_ELINKNO = HUB_SCAN_MAX_SAMPLES;
+  capture_dma.TCD->BITER_ELINKNO = HUB_SCAN_MAX_SAMPLES;
+  capture_dma.clearComplete();
+  capture_dma.enable();
+
+  cli();
+  TriggerAllSensors();
+  pit[2] = PIT_TCTRL_TEN;
+  sei();
+
+  hub_scan_begin(&scan);
+  while (!done) {
+    // CITER counts down per snapshot and reloads when the last is in
+    captured = capture_dma.complete() ? HUB_SCAN_MAX_SAMPLES : HUB_SCAN_MAX_SAMPLES - capture_dma.TCD->CITER_ELINKNO;
+    __asm__ volatile("" ::: "memory");    // the snapshots below were written by the DMA
+    while (n < captured && !done) {
+      done = hub_scan_sample(&scan, scan_samples[n], n);
+      n++;
+    }
+    done |= n == HUB_SCAN_MAX_SAMPLES;
+  }
+  pit[2] = 0;
+  capture_dma.disable();
+
+  hub_scan_decode(&scan, scan_samples, n, output_packet + OUTPUT_PACKET_HEADER_SIZE);
+  hub_scan_check(&scan, scan_samples, n);
+#if SCAN_DUMP
+  DumpCapture(n);
+#endif
+}
+
+// reads every sensor at once into the output packet: snapshots of the five
+// ports HUB_SCAN_OVERSAMPLE times a bit until the last reply is in, decoded
+// with interrupts back on; each snapshot waits for its time on the cycle
+// counter, so one late behind hub_scan_sample() does not push the rest
+void ScanPortWide() {
+  uint32_t *sample;
+  uint32_t t0, t;
+  int n;
+
+  cli();
+
+  TriggerAllSensors();
+  hub_scan_begin(&scan);
+  t0 = ARM_DWT_CYCCNT;
+  for (n = 0; n < HUB_SCAN_MAX_SAMPLES; n++) {
+    t = t0 + (uint32_t)n * bit_cycles / HUB_SCAN_OVERSAMPLE;
+    late_snapshots += (int32_t)(ARM_DWT_CYCCNT - t) > 0;
+    while ((int32_t)(ARM_DWT_CYCCNT - t) < 0);
+    sample = scan_samples[n];
+    sample[0] = GPIOA_PDIR;
+    sample[1] = GPIOB_PDIR;
+    sample[2] = GPIOC_PDIR;
+    sample[3] = GPIOD_PDIR;
+    sample[4] = GPIOE_PDIR;
+    if (hub_scan_sample(&scan, sample, n)) {
+      n++;
+      break;
+    }
+  }
+
+  sei();
+
+  hub_scan_decode(&scan, scan_samples, n, output_packet + OUTPUT_PACKET_HEADER_SIZE);
+  hub_scan_check(&scan, scan_samples, n);
+}
+
+// a scene change if there is one, then the pending taps by velocity,
+// in one write
+void SendSoundEvents(int scene_changed, int scene) {
+  int i, bucket, n = 0, taps = 0;
+
+  if (scene_changed) {
+    sound_message[n++] = scene + SOUND_SCENE_CODE_OFFSET;
+  }
+  for (bucket = 7; bucket >= 0 && taps < SOUND_BATCH_MAX; bucket--) {
+    for (i = 0; i < N_MOTION_SENSORS_ACTIVE && taps < SOUND_BATCH_MAX; i++) {
+      if (sound_tap_queue[i] == bucket + 1) {
+        sound_message[n++] = i * 8 + bucket;
+        sound_tap_queue[i] = 0;
+        sound_tap_timeout[i] = SOUND_TAP_HOLDOFF_LOOPS;
+        taps++;
+      }
+    }
+  }
+  if (taps > 0) {
+    sound_message[n++] = SOUND_BATCH_END_CODE;
+  }
+  if (n > 0) {
+    Serial.write(sound_message, n);
+  }
+}
+
+void loop() {
+  int i;
+  uint32_t elapsed;
+  //static uint8_t last_rx_char;
+  static long scene_start_time = 0;
+  long clock_time_us;
+  long time_since_scene_start = 0;
+  static int current_scene = 0;
+  static int last_scene = 0;
+
+  //rx_char = 0;
+
+  scan_start_us = micros();
+  scan_start_cycles = ARM_DWT_CYCCNT;
+#if SCAN_MODE == SCAN_DMA
+  if (capture_ready) {
+    ScanCapture();
+  } else {
+    ScanPortWide();
+  }
+#elif SCAN_MODE == SCAN_PORT_WIDE
+  ScanPortWide();
+#else
+  ScanSequential();
+#endif
+#if SCAN_REPORT
+  if (scan.scans % SCAN_REPORT_SCANS == 0 && scan.scans > 0) {
+    ReportScan();
+  }
+#endif
 
   clock_time_us = micros();
   time_since_scene_start = (clock_time_us - scene_start_time) / US_IN_S;
 
   for (i = 0; i < N_SCENES; i++) {
-    if ((output_packet[i + OUTPUT_PACKET_HEADER_SIZE] & 0x80) == 0x80 && output_packet[i + OUTPUT_PACKET_HEADER_SIZE] != 255) {
+    if (box_hub_tilted(output_packet[i + OUTPUT_PACKET_HEADER_SIZE])) {
       if (motion_tilt_timeouts[i] == 0) {
         if (time_since_scene_start >= SCENE_CHANGE_IGNORE_TIME) {
           current_scene = i;
@@ -124,18 +598,12 @@ void loop() {
 
   output_packet[OUTPUT_PACKET_SCENE_INDEX] = current_scene;
 
-  for (i = 0; i < OUTPUT_PACKET_SIZE; i++) {
-    if (output_packet[i] == 255) {
-      output_packet[i] = 0;
-    }
-    if (i >= OUTPUT_PACKET_HEADER_SIZE) {
-      output_packet[i] &= 0x7f;
-    }
-    //Serial.printf("%03d\n", output_packet[i]);
-    //Serial.printf("%c", output_packet[i]);
-    HWSERIAL.printf("%c", output_packet[i]);
+  SendMotionFrame();
+
+  // the taps below are on levels: no tilt bit, and 0 for a node that did not answer
+  for (i = OUTPUT_PACKET_HEADER_SIZE; i < OUTPUT_PACKET_SIZE; i++) {
+    output_packet[i] = box_hub_level(output_packet[i]);
   }
-  //Serial.printf("\n");
 
   // SOUND BYTE TRANSMITION 
   
@@ -144,7 +612,7 @@ void loop() {
     if (sound_tap_timeout[i] > 1) {
       (sound_tap_timeout[i])--;
     }
-    if (output_packet[i + OUTPUT_PACKET_HEADER_SIZE] > 48) { // consider cutting off taps < 16 or 32
+    if (output_packet[i + OUTPUT_PACKET_HEADER_SIZE] > SOUND_TAP_LEVEL) { // consider cutting off taps < 16 or 32
       if (sound_tap_timeout[i] == 1) {
         if (output_packet[i + OUTPUT_PACKET_HEADER_SIZE] / 16 + 1 >= sound_tap_queue[i]) { // and if queue ready isn't counting down
           sound_tap_queue[i] = output_packet[i + OUTPUT_PACKET_HEADER_SIZE] / 16 + 1;
@@ -157,27 +625,8 @@ void loop() {
     }
   }
 
-  sound_byte = SOUND_NO_UPDATE_CODE;
-  
-  if (current_scene != last_scene) {
-    last_scene = current_scene;
-    sound_byte = current_scene + SOUND_SCENE_CODE_OFFSET;
-  } else {
-    for (i = 0; i < N_MOTION_SENSORS_ACTIVE; i++) {
-      if (sound_tap_queue[i] != 0) {
-        sound_byte = i * 8 + (sound_tap_queue[i] - 1);
-        sound_tap_queue[i] = 0;
-        sound_tap_timeout[i] = 120;
-        break;
-      }
-    }
-  }
-  
-  
-  if (sound_byte != 255) {
-    Serial.printf("%c", sound_byte);
-    //Serial.printf("%i\n", sound_byte);
-  }
+  SendSoundEvents(current_scene != last_scene, current_scene);
+  last_scene = current_scene;
   
   /* pinMode(12, OUTPUT);
    digitalWrite(12, LOW);
@@ -228,10 +677,13 @@ void loop() {
   }*/
 
 
-  digitalWrite(led, HIGH);   // turn the LED on (HIGH is the voltage level)
-  delay(5);               // wait for a second
-  while (digitalRead(sample_enable) == HIGH);
-  digitalWrite(led, LOW);    // turn the LED off by making the voltage LOW
-  delay(5);               // wait for a second
+  // the LED on while frames go out; the next scan one period after this
+  // one began
+  TxPoll();
+  digitalWrite(led, tx_busy || tx_length[tx_fill] != 0);
+  elapsed = micros() - scan_start_us;
+  if (elapsed < SCAN_PERIOD_US) {
+    delayMicroseconds(SCAN_PERIOD_US - elapsed);
+  }
 }
 